@@ -0,0 +1,543 @@
+#include <istream>   // std::istream, std::getline
+#include <ostream>   // std::ostream
+#include <sstream>   // std::ostringstream
+#include <map>       // std::map
+#include <vector>    // std::vector
+#include <deque>     // std::deque
+#include <thread>    // std::thread
+#include <mutex>     // std::mutex
+#include <condition_variable> // std::condition_variable
+#include <filesystem> // std::filesystem::directory_iterator
+#include <chrono>    // std::chrono::steady_clock
+#include <stdexcept> // std::runtime_error
+#include <algorithm> // std::max
+#include <cctype>    // std::isspace, std::tolower
+#include "batch.h"
+#include "steganography.h"
+
+using namespace std;
+
+namespace
+{
+    // Reads the flat JSON objects of a manifest line: string keys, with string, number or literal values.
+    class JsonObjectReader
+    {
+        public:
+            explicit JsonObjectReader(const string &text) : m_text(text), m_pos(0) {}
+
+            map<string, string> read()
+            {
+                map<string, string> fields;
+                expect('{');
+                if (peek() == '}')
+                {
+                    m_pos++;
+                }
+                else
+                {
+                    for (;;)
+                    {
+                        string key = readString();
+                        expect(':');
+                        fields[key] = peek() == '"' ? readString() : readLiteral();
+                        if (peek() == ',')
+                        {
+                            m_pos++;
+                            continue;
+                        }
+                        expect('}');
+                        break;
+                    }
+                }
+
+                if (peek() != '\0')
+                {
+                    throw runtime_error("Unexpected text after the JSON object");
+                }
+                return fields;
+            }
+
+        private:
+            char peek()
+            {
+                while (m_pos < m_text.size() && isspace(static_cast<unsigned char>(m_text[m_pos])))
+                {
+                    m_pos++;
+                }
+                return m_pos < m_text.size() ? m_text[m_pos] : '\0';
+            }
+
+            void expect(char c)
+            {
+                if (peek() != c)
+                {
+                    throw runtime_error(string("Invalid JSON, expected '") + c + "'");
+                }
+                m_pos++;
+            }
+
+            string readString()
+            {
+                expect('"');
+                string value;
+                while (m_pos < m_text.size() && m_text[m_pos] != '"')
+                {
+                    char c = m_text[m_pos++];
+                    if (c != '\\')
+                    {
+                        value += c;
+                        continue;
+                    }
+                    if (m_pos >= m_text.size())
+                    {
+                        break;
+                    }
+                    switch (char escaped = m_text[m_pos++])
+                    {
+                        case 'b': value += '\b'; break;
+                        case 'f': value += '\f'; break;
+                        case 'n': value += '\n'; break;
+                        case 'r': value += '\r'; break;
+                        case 't': value += '\t'; break;
+                        case 'u': appendCodePoint(value); break;
+                        default: value += escaped; break;
+                    }
+                }
+                expect('"');
+                return value;
+            }
+
+            void appendCodePoint(string &value)
+            {
+                if (m_pos + 4 > m_text.size())
+                {
+                    throw runtime_error("Invalid JSON escape sequence");
+                }
+                unsigned long codePoint = stoul(m_text.substr(m_pos, 4), nullptr, 16);
+                m_pos += 4;
+
+                // paths are passed on as UTF-8
+                if (codePoint < 0x80)
+                {
+                    value += static_cast<char>(codePoint);
+                }
+                else if (codePoint < 0x800)
+                {
+                    value += static_cast<char>(0xC0 | (codePoint >> 6));
+                    value += static_cast<char>(0x80 | (codePoint & 0x3F));
+                }
+                else
+                {
+                    value += static_cast<char>(0xE0 | (codePoint >> 12));
+                    value += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+                    value += static_cast<char>(0x80 | (codePoint & 0x3F));
+                }
+            }
+
+            string readLiteral()
+            {
+                peek();
+                size_t start = m_pos;
+                while (m_pos < m_text.size() && m_text[m_pos] != ',' && m_text[m_pos] != '}' && !isspace(static_cast<unsigned char>(m_text[m_pos])))
+                {
+                    m_pos++;
+                }
+                if (m_pos == start)
+                {
+                    throw runtime_error("Invalid JSON, expected a value");
+                }
+                return m_text.substr(start, m_pos - start);
+            }
+
+            const string &m_text;
+            size_t m_pos;
+    };
+
+    string jsonEscape(const string &text)
+    {
+        string escaped;
+        for (char c : text)
+        {
+            switch (c)
+            {
+                case '"': escaped += "\\\""; break;
+                case '\\': escaped += "\\\\"; break;
+                case '\n': escaped += "\\n"; break;
+                case '\r': escaped += "\\r"; break;
+                case '\t': escaped += "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20)
+                    {
+                        const char *digits = "0123456789abcdef";
+                        escaped += "\\u00";
+                        escaped += digits[(c >> 4) & 0xF];
+                        escaped += digits[c & 0xF];
+                    }
+                    else
+                    {
+                        escaped += c;
+                    }
+                    break;
+            }
+        }
+        return escaped;
+    }
+
+    bool hasBitmapExtension(const filesystem::path &path)
+    {
+        string extension = path.extension().string();
+        for (char &c : extension)
+        {
+            c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+        }
+        return extension == ".bmp";
+    }
+
+    int parseBitsPerPixel(const string &text)
+    {
+        size_t end = 0;
+        int value = 0;
+        try
+        {
+            value = stoi(text, &end, 10);
+        }
+        catch (const exception &)
+        {
+            end = 0;
+        }
+        if (end == 0 ||
+            end != text.size() ||
+            value < 0 ||
+            value > UINT8_MAX)
+        {
+            throw runtime_error("Invalid value for bitsPerPixel '" + text + "'");
+        }
+        return value;
+    }
+}
+
+SteganographyLib::BatchJob SteganographyLib::parseBatchJob(const std::string &text, std::size_t line)
+{
+    BatchJob job;
+    job.line = line;
+
+    size_t first = text.find_first_not_of(" \t");
+    if (first != string::npos && text[first] == '{')
+    {
+        auto fields = JsonObjectReader(text).read();
+        auto field = [&](const char *name, bool required) -> string
+        {
+            auto it = fields.find(name);
+            if (it == fields.end())
+            {
+                if (required)
+                {
+                    throw runtime_error(string("Missing field '") + name + "'");
+                }
+                return string();
+            }
+            return it->second;
+        };
+
+        job.id = field("id", false);
+        job.operation = field("operation", true);
+        job.bitmap = field("bitmap", true);
+        job.data = field("data", job.operation == "embed");
+        job.output = field("output", job.operation != "probe");
+        job.bitsPerPixel = parseBitsPerPixel(field("bitsPerPixel", true));
+    }
+    else
+    {
+        // same arguments as the command line, separated by tabs
+        vector<string> arguments;
+        size_t start = 0;
+        for (;;)
+        {
+            size_t tab = text.find('\t', start);
+            arguments.push_back(text.substr(start, tab == string::npos ? string::npos : tab - start));
+            if (tab == string::npos)
+            {
+                break;
+            }
+            start = tab + 1;
+        }
+
+        job.operation = arguments[0];
+        if (job.operation == "embed" && arguments.size() == 5)
+        {
+            job.bitmap = arguments[1];
+            job.data = arguments[2];
+            job.output = arguments[3];
+            job.bitsPerPixel = parseBitsPerPixel(arguments[4]);
+        }
+        else if (job.operation == "extract" && arguments.size() == 4)
+        {
+            job.bitmap = arguments[1];
+            job.output = arguments[2];
+            job.bitsPerPixel = parseBitsPerPixel(arguments[3]);
+        }
+        else if (job.operation == "probe" && arguments.size() == 3)
+        {
+            job.bitmap = arguments[1];
+            job.bitsPerPixel = parseBitsPerPixel(arguments[2]);
+        }
+        else if (job.operation == "embed" || job.operation == "extract" || job.operation == "probe")
+        {
+            throw runtime_error("Invalid argument count for " + job.operation + " operation");
+        }
+    }
+
+    if (job.operation != "embed" && job.operation != "extract" && job.operation != "probe")
+    {
+        throw runtime_error("Invalid operation '" + job.operation + "'");
+    }
+    return job;
+}
+
+SteganographyLib::BatchJobStatus SteganographyLib::runBatchJob(Steganography &steg, const std::string &text, std::size_t line, std::chrono::steady_clock::time_point received)
+{
+    BatchJob job;
+    string error;
+    ProbeResult probe;
+    try
+    {
+        job = parseBatchJob(text, line);
+        if (job.operation == "embed")
+        {
+            steg.embed(job.bitmap, job.data, job.output, static_cast<uint8_t>(job.bitsPerPixel));
+        }
+        else if (job.operation == "extract")
+        {
+            steg.extract(job.bitmap, job.output, static_cast<uint8_t>(job.bitsPerPixel));
+        }
+        else
+        {
+            probe = steg.probe(job.bitmap, static_cast<uint8_t>(job.bitsPerPixel));
+        }
+    }
+    catch (const exception &e)
+    {
+        error = e.what();
+    }
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - received;
+
+    ostringstream result;
+    result << "{\"line\": " << line << ", ";
+    if (!job.id.empty())
+    {
+        result << "\"id\": \"" << jsonEscape(job.id) << "\", ";
+    }
+    result << "\"operation\": \"" << jsonEscape(job.operation) << "\", ";
+    if (!error.empty())
+    {
+        result << "\"status\": \"error\", \"error\": \"" << jsonEscape(error) << "\"}\n";
+        return {false, result.str()};
+    }
+    result << "\"status\": \"ok\", \"milliseconds\": " << elapsed.count();
+    if (job.operation == "probe")
+    {
+        result << ", \"format\": \"" << (probe.format == ContainerFormat::Chunked ? "chunked" : "legacy") << "\""
+               << ", \"payloadLength\": " << probe.payloadLength
+               << ", \"capacity\": " << probe.capacity
+               << ", \"plausible\": " << (probe.plausible ? "true" : "false");
+    }
+    result << "}\n";
+    return {true, result.str()};
+}
+
+SteganographyLib::BatchSummary SteganographyLib::runBatch(std::istream &manifest, std::ostream &status, std::size_t workerCount, std::shared_ptr<CoverCache> coverCache)
+{
+    if (workerCount == 0)
+    {
+        workerCount = max(1u, thread::hardware_concurrency());
+    }
+
+    mutex manifestMutex;
+    mutex statusMutex;
+    size_t lineNumber = 0;
+    BatchSummary summary;
+
+    auto worker = [&]()
+    {
+        // the instance, its buffers and its bit packer are reused by every job of the worker
+        Steganography steg;
+        steg.setCoverCache(coverCache);
+        for (;;)
+        {
+            string text;
+            size_t line;
+            {
+                lock_guard<mutex> lock(manifestMutex);
+                do
+                {
+                    if (!getline(manifest, text))
+                    {
+                        return;
+                    }
+                    line = ++lineNumber;
+                    if (!text.empty() && text.back() == '\r')
+                    {
+                        text.pop_back();
+                    }
+                }
+                while (text.find_first_not_of(" \t") == string::npos || text[text.find_first_not_of(" \t")] == '#');
+            }
+
+            BatchJobStatus result = runBatchJob(steg, text, line, chrono::steady_clock::now());
+
+            lock_guard<mutex> lock(statusMutex);
+            status << result.text << flush;
+            (result.succeeded ? summary.succeeded : summary.failed)++;
+        }
+    };
+
+    vector<thread> workers;
+    workers.reserve(workerCount);
+    for (size_t i = 0; i < workerCount; i++)
+    {
+        workers.emplace_back(worker);
+    }
+    for (auto &thread : workers)
+    {
+        thread.join();
+    }
+
+    return summary;
+}
+
+SteganographyLib::ScanSummary SteganographyLib::runScan(const std::string &root, std::ostream &results, std::size_t workerCount)
+{
+    if (workerCount == 0)
+    {
+        workerCount = max(1u, thread::hardware_concurrency());
+    }
+
+    // directories and files waiting for a worker
+    struct ScanItem
+    {
+        filesystem::path path;
+        bool directory;
+    };
+    mutex queueMutex;
+    condition_variable queueChanged;
+    deque<ScanItem> queue;
+    size_t busyWorkers = 0;
+    std::error_code rootError;
+    queue.push_back({filesystem::path(root), !filesystem::is_regular_file(root, rootError)});
+
+    mutex resultsMutex;
+    ScanSummary summary;
+    auto report = [&](const string &line, bool file, bool flagged, bool failed)
+    {
+        lock_guard<mutex> lock(resultsMutex);
+        results << line << flush;
+        summary.files += file;
+        summary.flagged += flagged;
+        summary.failed += failed;
+    };
+
+    auto worker = [&]()
+    {
+        Steganography steg;
+        auto scanFile = [&](const filesystem::path &path)
+        {
+            ostringstream result;
+            result << "{\"path\": \"" << jsonEscape(path.string()) << "\", ";
+            try
+            {
+                ScanResult scan = steg.scan(path.string());
+                if (scan.found)
+                {
+                    result << "\"status\": \"payload\", \"bitsPerPixel\": " << static_cast<int>(scan.bitsPerPixel)
+                           << ", \"payloadLength\": " << scan.payloadLength
+                           << ", \"compressed\": " << (scan.compressed ? "true" : "false")
+                           << ", \"supported\": " << (scan.supported ? "true" : "false")
+                           << ", \"plausible\": " << (scan.plausible ? "true" : "false") << "}\n";
+                }
+                else
+                {
+                    result << "\"status\": \"clean\"}\n";
+                }
+                report(result.str(), true, scan.found, false);
+            }
+            catch (const exception &e)
+            {
+                result << "\"status\": \"error\", \"error\": \"" << jsonEscape(e.what()) << "\"}\n";
+                report(result.str(), true, false, true);
+            }
+        };
+
+        for (;;)
+        {
+            ScanItem item;
+            {
+                // the scan is over once nothing is queued and no worker is left to queue more
+                unique_lock<mutex> lock(queueMutex);
+                queueChanged.wait(lock, [&]() { return !queue.empty() || busyWorkers == 0; });
+                if (queue.empty())
+                {
+                    return;
+                }
+                item = move(queue.front());
+                queue.pop_front();
+                busyWorkers++;
+            }
+
+            if (!item.directory)
+            {
+                scanFile(item.path);
+            }
+            else
+            {
+                std::error_code error;
+                for (filesystem::directory_iterator entry(item.path, error), end; !error && entry != end; entry.increment(error))
+                {
+                    std::error_code typeError;
+                    bool directory = entry->is_directory(typeError) && !entry->is_symlink(typeError);
+                    if (!directory &&
+                        (!hasBitmapExtension(entry->path()) || !entry->is_regular_file(typeError)))
+                    {
+                        continue;
+                    }
+
+                    // bitmaps are scanned here once the other workers have enough to do, which bounds the queue
+                    {
+                        lock_guard<mutex> lock(queueMutex);
+                        if (directory || queue.size() < workerCount * 4)
+                        {
+                            queue.push_back({entry->path(), directory});
+                            queueChanged.notify_one();
+                            continue;
+                        }
+                    }
+                    scanFile(entry->path());
+                }
+                if (error)
+                {
+                    report("{\"path\": \"" + jsonEscape(item.path.string()) + "\", \"status\": \"error\", \"error\": \"" + jsonEscape(error.message()) + "\"}\n", false, false, true);
+                }
+            }
+
+            lock_guard<mutex> lock(queueMutex);
+            busyWorkers--;
+            if (busyWorkers == 0 &&
+                queue.empty())
+            {
+                queueChanged.notify_all();
+            }
+        }
+    };
+
+    vector<thread> workers;
+    workers.reserve(workerCount);
+    for (size_t i = 0; i < workerCount; i++)
+    {
+        workers.emplace_back(worker);
+    }
+    for (auto &thread : workers)
+    {
+        thread.join();
+    }
+
+    return summary;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef> // std::size_t
+#include <iosfwd>  // std::istream, std::ostream
+#include <string>  // std::string
+#include <memory>  // std::shared_ptr
+#include <chrono>  // std::chrono::steady_clock
+#include "covercache.h"
+
+namespace SteganographyLib
+{
+    class Steganography;
+
+    /// @brief One embed, extract or probe operation of a batch manifest.
+    struct BatchJob
+    {
+        std::size_t line = 0;   // line of the manifest, counted from 1
+        std::string id;         // identifier given by the caller, echoed in the status line, JSON lines only
+        std::string operation;  // "embed", "extract" or "probe"
+        std::string bitmap;     // original bitmap for embed, encoded bitmap for extract and probe
+        std::string data;       // source data file, embed only
+        std::string output;     // destination bitmap for embed, destination data file for extract, unused by probe
+        int bitsPerPixel = 0;
+    };
+
+    /// @brief Status of a job that has run, see runBatchJob().
+    struct BatchJobStatus
+    {
+        bool succeeded = false;
+        std::string text; // the JSON status line, newline included
+    };
+
+    /// @brief Outcome of a batch.
+    struct BatchSummary
+    {
+        std::size_t succeeded = 0;
+        std::size_t failed = 0;
+    };
+
+    /// @brief Outcome of a scan.
+    struct ScanSummary
+    {
+        std::size_t files = 0;   // bitmaps scanned, including those that could not be read
+        std::size_t flagged = 0; // bitmaps carrying a chunked header
+        std::size_t failed = 0;  // bitmaps and directories that could not be read
+    };
+
+    /// @brief Parses one line of a batch manifest.
+    /// A line is either a JSON object, such as
+    ///     {"operation": "embed", "bitmap": "in.bmp", "data": "secret.txt", "output": "out.bmp", "bitsPerPixel": 6}
+    ///     {"operation": "extract", "bitmap": "out.bmp", "output": "secret.txt", "bitsPerPixel": 6}
+    ///     {"operation": "probe", "bitmap": "out.bmp", "bitsPerPixel": 6, "id": "request-7"}
+    /// or the arguments of the command line separated by tabs, such as
+    ///     embed<TAB>in.bmp<TAB>secret.txt<TAB>out.bmp<TAB>6
+    ///     extract<TAB>out.bmp<TAB>secret.txt<TAB>6
+    ///     probe<TAB>out.bmp<TAB>6
+    /// @throws std::runtime_error if the line is not a valid job
+    BatchJob parseBatchJob(const std::string &text, std::size_t line);
+
+    /// @brief Parses and runs one line of a manifest on an instance, and formats its status line, see runBatch().
+    /// @param received When the line was read: the milliseconds of the status line count from there.
+    BatchJobStatus runBatchJob(Steganography &steg, const std::string &text, std::size_t line, std::chrono::steady_clock::time_point received);
+
+    /// @brief Runs every job of a manifest on a fixed number of workers, each with its own Steganography instance.
+    /// Jobs are read from the manifest as workers become free, so the manifest can be a pipe.  Blank lines and lines
+    /// starting with '#' are skipped.  A failed job does not stop the batch: one JSON status line is written per job,
+    /// in completion order, such as
+    ///     {"line": 3, "operation": "embed", "status": "ok", "milliseconds": 1.25}
+    ///     {"line": 4, "operation": "extract", "status": "error", "error": "Could not open ..."}
+    ///     {"line": 5, "id": "request-7", "operation": "probe", "status": "ok", "milliseconds": 0.05, "format": "chunked", "payloadLength": 1024, "capacity": 60111, "plausible": true}
+    /// @param manifest Lines of the manifest.
+    /// @param status Receives the status lines.
+    /// @param workerCount Number of workers, 0 selects the number of hardware threads.
+    /// @param coverCache Cache of decoded covers shared by the workers, or nullptr for none.
+    BatchSummary runBatch(std::istream &manifest, std::ostream &status, std::size_t workerCount, std::shared_ptr<CoverCache> coverCache = nullptr);
+
+    /// @brief Looks for embedded data in every .bmp file of a directory tree, at every density, see Steganography::scan().
+    /// The workers share a queue of directories and files: a worker lists a directory, queuing its subdirectories and
+    /// handing its bitmaps to the other workers while the queue is short, so that wide, deep and flat trees all keep
+    /// every worker busy.  Only the header and the top rows of each bitmap are read.  Symbolic links to directories
+    /// are not followed.  One JSON line is written per bitmap, in completion order, such as
+    ///     {"path": "a/1.bmp", "status": "payload", "bitsPerPixel": 6, "payloadLength": 1024, "compressed": false, "supported": true, "plausible": true}
+    ///     {"path": "a/2.bmp", "status": "clean"}
+    ///     {"path": "a/3.bmp", "status": "error", "error": "Could not open ..."}
+    /// and one error line per directory that cannot be listed.
+    /// @param root Directory to scan, or a single bitmap.
+    /// @param results Receives the result lines.
+    /// @param workerCount Number of workers, 0 selects the number of hardware threads.
+    ScanSummary runScan(const std::string &root, std::ostream &results, std::size_t workerCount);
+}
@@ -0,0 +1,194 @@
+#include <benchmark/benchmark.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include "../steganography.h"
+
+using namespace SteganographyLib;
+
+// Throughput of the engine on synthetic covers held in memory, so that the disk is never measured.
+// Results are reported in bytes per second, and written to SteganographyBench.json unless --benchmark_out is given:
+//     SteganographyBench --benchmark_filter=Embed
+//     SteganographyBench --benchmark_out=release.json --benchmark_out_format=json
+
+namespace
+{
+    const std::vector<std::int64_t> megapixels = {1, 10, 100};
+    const std::vector<std::int64_t> payloadKibibytes = {64, 1024, 16 * 1024};
+    const std::vector<std::int64_t> threadCounts = {1, 0};
+
+    std::int64_t coverWidth(std::int64_t megapixelCount)
+    {
+        // 4:3 covers, with a width that needs row padding
+        std::int64_t width = static_cast<std::int64_t>(std::sqrt(megapixelCount * 1000000.0 * 4 / 3));
+        return width | 1;
+    }
+
+    std::int64_t coverHeight(std::int64_t megapixelCount)
+    {
+        return megapixelCount * 1000000 / coverWidth(megapixelCount);
+    }
+
+    // .bmp file of a cover filled with noise, generated once per size
+    const std::vector<std::uint8_t> &coverFile(std::int64_t megapixelCount)
+    {
+        static std::map<std::int64_t, std::vector<std::uint8_t>> covers;
+        auto &cover = covers[megapixelCount];
+        if (cover.empty())
+        {
+            bmp::Bitmap bitmap(static_cast<std::int32_t>(coverWidth(megapixelCount)), static_cast<std::int32_t>(coverHeight(megapixelCount)));
+            std::uint32_t state = 0x9E3779B9;
+            for (bmp::Pixel &pixel : bitmap)
+            {
+                state = state * 1664525 + 1013904223;
+                pixel = bmp::Pixel(static_cast<std::uint8_t>(state >> 24), static_cast<std::uint8_t>(state >> 16), static_cast<std::uint8_t>(state >> 8));
+            }
+            bitmap.save(cover);
+        }
+        return cover;
+    }
+
+    std::vector<char> payload(std::size_t size)
+    {
+        std::vector<char> data(size);
+        std::uint32_t state = 0x2545F491;
+        for (char &byte : data)
+        {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            byte = static_cast<char>(state);
+        }
+        return data;
+    }
+
+    // megapixels x bitsPerPixel x payload size x threads, for the payloads that fit the cover
+    void engineArguments(benchmark::internal::Benchmark *benchmark)
+    {
+        benchmark->ArgNames({"megapixels", "bitsPerPixel", "payloadKiB", "threads"});
+        for (std::int64_t megapixelCount : megapixels)
+        {
+            for (std::int64_t bitsPerPixel = 3; bitsPerPixel <= 24; bitsPerPixel += 3)
+            {
+                for (std::int64_t kibibytes : payloadKibibytes)
+                {
+                    std::int64_t capacity = coverWidth(megapixelCount) * coverHeight(megapixelCount) * bitsPerPixel / 8;
+                    if (kibibytes * 1024 + static_cast<std::int64_t>(ContainerHeader(ContainerFormat::Chunked, kibibytes * 1024).size()) > capacity)
+                    {
+                        continue;
+                    }
+                    for (std::int64_t threadCount : threadCounts)
+                    {
+                        benchmark->Args({megapixelCount, bitsPerPixel, kibibytes, threadCount});
+                    }
+                }
+            }
+        }
+        benchmark->Unit(benchmark::kMillisecond);
+    }
+
+    void bitmapArguments(benchmark::internal::Benchmark *benchmark)
+    {
+        benchmark->ArgNames({"megapixels"});
+        for (std::int64_t megapixelCount : megapixels)
+        {
+            benchmark->Args({megapixelCount});
+        }
+        benchmark->Unit(benchmark::kMillisecond);
+    }
+}
+
+static void Embed(benchmark::State &state)
+{
+    std::vector<std::uint8_t> cover = coverFile(state.range(0));
+    auto bitsPerPixel = static_cast<std::uint8_t>(state.range(1));
+    std::vector<char> data = payload(static_cast<std::size_t>(state.range(2)) * 1024);
+
+    Steganography steg;
+    steg.setThreadCount(static_cast<std::size_t>(state.range(3)));
+    for (auto _ : state)
+    {
+        // in place, the cover is overwritten with the same stream on every iteration
+        steg.embed(cover.data(), cover.size(), data.data(), data.size(), bitsPerPixel);
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * static_cast<std::int64_t>(data.size()));
+}
+BENCHMARK(Embed)->Apply(engineArguments);
+
+static void Extract(benchmark::State &state)
+{
+    std::vector<std::uint8_t> cover = coverFile(state.range(0));
+    auto bitsPerPixel = static_cast<std::uint8_t>(state.range(1));
+    std::vector<char> data = payload(static_cast<std::size_t>(state.range(2)) * 1024);
+
+    Steganography steg;
+    steg.embed(cover.data(), cover.size(), data.data(), data.size(), bitsPerPixel);
+    steg.setThreadCount(static_cast<std::size_t>(state.range(3)));
+    for (auto _ : state)
+    {
+        std::vector<char> extracted = steg.extract(cover.data(), cover.size(), bitsPerPixel);
+        benchmark::DoNotOptimize(extracted.data());
+    }
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * static_cast<std::int64_t>(data.size()));
+}
+BENCHMARK(Extract)->Apply(engineArguments);
+
+static void BitmapLoad(benchmark::State &state)
+{
+    const std::vector<std::uint8_t> &cover = coverFile(state.range(0));
+    bmp::Bitmap bitmap;
+    for (auto _ : state)
+    {
+        bitmap.load(cover.data(), cover.size());
+        benchmark::DoNotOptimize(&*bitmap.begin());
+    }
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * static_cast<std::int64_t>(cover.size()));
+}
+BENCHMARK(BitmapLoad)->Apply(bitmapArguments);
+
+static void BitmapSave(benchmark::State &state)
+{
+    const std::vector<std::uint8_t> &cover = coverFile(state.range(0));
+    bmp::Bitmap bitmap;
+    bitmap.load(cover.data(), cover.size());
+    std::vector<std::uint8_t> saved;
+    saved.reserve(cover.size());
+    for (auto _ : state)
+    {
+        bitmap.save(saved);
+        benchmark::DoNotOptimize(saved.data());
+    }
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * static_cast<std::int64_t>(cover.size()));
+}
+BENCHMARK(BitmapSave)->Apply(bitmapArguments);
+
+int main(int argc, char **argv)
+{
+    // results also go to a JSON file by default, so that they can be compared between releases
+    std::vector<char *> arguments(argv, argv + argc);
+    std::string output = "--benchmark_out=SteganographyBench.json";
+    std::string format = "--benchmark_out_format=json";
+    bool outputGiven = std::any_of(arguments.begin(), arguments.end(), [](const char *argument)
+    {
+        return std::string(argument).rfind("--benchmark_out=", 0) == 0;
+    });
+    if (!outputGiven)
+    {
+        arguments.push_back(output.data());
+        arguments.push_back(format.data());
+    }
+
+    int count = static_cast<int>(arguments.size());
+    benchmark::Initialize(&count, arguments.data());
+    if (benchmark::ReportUnrecognizedArguments(count, arguments.data()))
+    {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
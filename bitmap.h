@@ -4,6 +4,9 @@
 #pragma once
 
 #include <fstream>   // std::*fstream
+#include <istream>   // std::istream
+#include <ostream>   // std::ostream
+#include <streambuf> // std::streambuf
 #include <vector>    // std::vector
 #include <memory>    // std::unique_ptr
 #include <algorithm> // std::fill
@@ -13,11 +16,52 @@
 #include <cstring>   // std::memcmp
 #include <stdexcept> // std::runtime_error
 #include <utility>   // std::exchange
+#include <filesystem> // std::filesystem::rename
+#include <type_traits> // std::is_trivially_copyable
+#include <new>       // placement new
+#include <cerrno>    // errno
+#include <functional> // std::function
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h> // CreateFileMapping, MapViewOfFile
+#else
+#include <fcntl.h>    // open
+#include <sys/mman.h> // mmap, munmap
+#include <sys/stat.h> // fstat
+#include <unistd.h>   // close, write, ftruncate
+#endif
+
+// Byte shuffles that convert between .bmp rows and pixels, selected at run time on x86-64
+#if defined(__x86_64__) || defined(_M_X64)
+#define BMP_SHUFFLE_KERNELS
+#include <immintrin.h> // SSSE3 intrinsics
+#if defined(__GNUC__) || defined(__clang__)
+#define BMP_SSSE3_TARGET __attribute__((target("ssse3")))
+#else
+#include <intrin.h>    // __cpuid
+#define BMP_SSSE3_TARGET
+#endif
+#endif
 
 namespace bmp {
   // Magic number for Bitmap .bmp 24 bpp files (24/8 = 3 = rgb colors only)
   static constexpr const std::uint16_t BITMAP_BUFFER_MAGIC = 0x4D42;
 
+  // Pixel rows are read and written in blocks of about this many bytes
+  static constexpr const std::size_t BITMAP_IO_BLOCK_SIZE = 1024 * 1024;
+
+  // Alignment of the buffers, offsets and sizes of writes that bypass the page cache
+  static constexpr const std::size_t BITMAP_DIRECT_IO_ALIGNMENT = 4096;
+
+  // Called by a save before every block it writes, may throw to stop the save
+  using BlockCallback = std::function<void()>;
+
 #pragma pack(push, 1)
   struct BitmapHeader {
     /* Bitmap file header structure */
@@ -103,8 +147,288 @@ namespace bmp {
     explicit Exception(const std::string &message) : std::runtime_error(message) {}
   };
 
+  // Compression of uncompressed bitmaps, and of bitmaps whose channels are described by masks
+  static constexpr const std::uint32_t BITMAP_COMPRESSION_RGB = 0;
+  static constexpr const std::uint32_t BITMAP_COMPRESSION_BITFIELDS = 3;
+
+  // Size of the red, green and blue masks that follow the header of BI_BITFIELDS bitmaps
+  static constexpr const std::size_t BITMAP_MASKS_SIZE = 12;
+
+  /**
+   *	Returns the size in bytes of the pixels of a .bmp file whose layout is supported: 3 for 24 bpp BGR,
+   *	4 for 32 bpp BGRA, or 0 for any other layout.
+   *	'masks' are the bytes that follow the header, only read for BI_BITFIELDS bitmaps, which are
+   *	supported when their masks select the BGRA byte order.
+   */
+  inline std::size_t pixel_size(const BitmapHeader &header, const std::uint8_t *masks) noexcept {
+    if (header.compression == BITMAP_COMPRESSION_RGB && (header.bits_per_pixel == 24 || header.bits_per_pixel == 32))
+      return header.bits_per_pixel / 8;
+    if (header.compression == BITMAP_COMPRESSION_BITFIELDS && header.bits_per_pixel == 32 && masks != nullptr) {
+      static constexpr const std::uint8_t bgra_masks[BITMAP_MASKS_SIZE] = {0, 0, 0xff, 0, 0, 0xff, 0, 0, 0xff, 0, 0, 0};
+      return std::memcmp(masks, bgra_masks, BITMAP_MASKS_SIZE) == 0 ? 4 : 0;
+    }
+    return 0;
+  }
+
+  /**
+   *	Returns the header of an uncompressed bottom-up .bmp file with pixels of 'pixel_size' bytes, 3 or 4,
+   *	which start right after the header
+   */
+  inline BitmapHeader make_header(const std::int32_t width, const std::int32_t height, const std::size_t pixel_size) noexcept {
+    const std::size_t stride = (static_cast<std::size_t>(width) * pixel_size + 3) & ~static_cast<std::size_t>(3);
+    const std::uint32_t bitmap_size = static_cast<std::uint32_t>(stride * static_cast<std::size_t>(height));
+
+    BitmapHeader header{};
+    /* Bitmap file header structure */
+    header.magic = BITMAP_BUFFER_MAGIC;
+    header.file_size = bitmap_size + sizeof(BitmapHeader);
+    header.reserved1 = 0;
+    header.reserved2 = 0;
+    header.offset_bits = sizeof(BitmapHeader);
+    /* Bitmap file info structure */
+    header.size = 40;
+    header.width = width;
+    header.height = height;
+    header.planes = 1;
+    header.bits_per_pixel = static_cast<std::uint16_t>(pixel_size * 8); // 32bpp or 24bpp
+    header.compression = BITMAP_COMPRESSION_RGB;
+    header.size_image = bitmap_size;
+    header.x_pixels_per_meter = 0;
+    header.y_pixels_per_meter = 0;
+    header.clr_used = 0;
+    header.clr_important = 0;
+    return header;
+  }
+
+  /**
+   *	Stream buffer reading from a caller's memory without copying it, or appending to a vector
+   */
+  class MemoryStreamBuffer : public std::streambuf {
+  public:
+    MemoryStreamBuffer(const std::uint8_t *data, const std::size_t size) : m_output(nullptr) {
+      char *begin = const_cast<char *>(reinterpret_cast<const char *>(data));
+      setg(begin, begin, begin + size);
+    }
+
+    explicit MemoryStreamBuffer(std::vector<std::uint8_t> &output) : m_output(&output) {}
+
+  protected:
+    std::streamsize xsputn(const char *s, std::streamsize n) override {
+      if (m_output == nullptr) return 0;
+      m_output->insert(m_output->end(), reinterpret_cast<const std::uint8_t *>(s), reinterpret_cast<const std::uint8_t *>(s) + n);
+      return n;
+    }
+
+    int_type overflow(int_type c) override {
+      if (m_output == nullptr || traits_type::eq_int_type(c, traits_type::eof())) return traits_type::eof();
+      m_output->push_back(static_cast<std::uint8_t>(c));
+      return c;
+    }
+
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+      if (m_output != nullptr || !(which & std::ios_base::in)) return pos_type(off_type(-1));
+      char *target = (dir == std::ios_base::beg ? eback() : dir == std::ios_base::cur ? gptr() : egptr()) + off;
+      if (target < eback() || target > egptr()) return pos_type(off_type(-1));
+      setg(eback(), target, egptr());
+      return pos_type(target - eback());
+    }
+
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+      return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+
+  private:
+    std::vector<std::uint8_t> *m_output;
+  };
+
+  /**
+   *	Allocator that leaves elements uninitialized when a vector grows without a value, so that
+   *	pixel buffers about to be overwritten by a load are not cleared first
+   */
+  template <typename T>
+  class UninitializedAllocator : public std::allocator<T> {
+  public:
+    template <typename U>
+    struct rebind {
+      using other = UninitializedAllocator<U>;
+    };
+
+    UninitializedAllocator() noexcept = default;
+
+    template <typename U>
+    UninitializedAllocator(const UninitializedAllocator<U> &) noexcept {}
+
+    template <typename U>
+    void construct(U *) noexcept {
+      static_assert(std::is_trivially_copyable<U>::value, "Only trivially copyable elements can be left uninitialized");
+    }
+
+    template <typename U, typename... Args>
+    void construct(U *p, Args &&... args) {
+      ::new (static_cast<void *>(p)) U(std::forward<Args>(args)...);
+    }
+  };
+
+  namespace detail {
+#if defined(BMP_SHUFFLE_KERNELS)
+    /**
+     *	Returns true if the processor supports the SSSE3 byte shuffles
+     */
+    inline bool has_ssse3() noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+      static const bool supported = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("ssse3") != 0;
+      }();
+#else
+      static const bool supported = [] {
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 9)) != 0;
+      }();
+#endif
+      return supported;
+    }
+
+    /**
+     *	Converts BGR bytes to pixels 4 at a time, returns the number of pixels converted.
+     *	The 16 byte loads and stores reach into the next 2 pixels, which the next iteration or the caller rewrites.
+     */
+    BMP_SSSE3_TARGET inline std::size_t bgr_to_pixels_ssse3(const std::uint8_t *row, Pixel *pixels, const std::size_t count) noexcept {
+      const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, -1, -1, -1, -1);
+      std::size_t i = 0;
+      for (; i + 6 <= count; i += 4) {
+        const __m128i bgr = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + 3 * i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&pixels[i]), _mm_shuffle_epi8(bgr, shuffle));
+      }
+      return i;
+    }
+
+    /**
+     *	Converts BGRA bytes to pixels and alpha values 4 at a time, returns the number of pixels converted.
+     */
+    BMP_SSSE3_TARGET inline std::size_t bgra_to_pixels_ssse3(const std::uint8_t *row, Pixel *pixels, std::uint8_t *alpha, const std::size_t count) noexcept {
+      const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, 3, 7, 11, 15);
+      std::size_t i = 0;
+      for (; i + 6 <= count; i += 4) {
+        const __m128i rgba = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(row + 4 * i)), shuffle);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&pixels[i]), rgba);
+        const std::uint32_t a = static_cast<std::uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(rgba, 12)));
+        std::memcpy(alpha + i, &a, sizeof(a));
+      }
+      return i;
+    }
+
+    /**
+     *	Converts pixels to BGR bytes 4 at a time, returns the number of pixels converted.
+     *	The 16 byte loads and stores reach into the next 2 pixels, which the next iteration or the caller rewrites.
+     */
+    BMP_SSSE3_TARGET inline std::size_t pixels_to_bgr_ssse3(const Pixel *pixels, std::uint8_t *row, const std::size_t count) noexcept {
+      const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, -1, -1, -1, -1);
+      std::size_t i = 0;
+      for (; i + 6 <= count; i += 4) {
+        const __m128i rgb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&pixels[i]));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(row + 3 * i), _mm_shuffle_epi8(rgb, shuffle));
+      }
+      return i;
+    }
+
+    /**
+     *	Converts pixels and alpha values to BGRA bytes 4 at a time, returns the number of pixels converted.
+     */
+    BMP_SSSE3_TARGET inline std::size_t pixels_to_bgra_ssse3(const Pixel *pixels, const std::uint8_t *alpha, std::uint8_t *row, const std::size_t count) noexcept {
+      const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 12, 5, 4, 3, 13, 8, 7, 6, 14, 11, 10, 9, 15);
+      const __m128i colors = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 0, 0, 0);
+      std::size_t i = 0;
+      for (; i + 6 <= count; i += 4) {
+        std::uint32_t a;
+        std::memcpy(&a, alpha + i, sizeof(a));
+        const __m128i rgb = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(&pixels[i])), colors);
+        const __m128i rgba = _mm_or_si128(rgb, _mm_slli_si128(_mm_cvtsi32_si128(static_cast<int>(a)), 12));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(row + 4 * i), _mm_shuffle_epi8(rgba, shuffle));
+      }
+      return i;
+    }
+#endif
+
+    /**
+     *	Converts a row of BGR bytes, as stored in .bmp files, to pixels
+     */
+    inline void bgr_to_pixels(const std::uint8_t *row, Pixel *pixels, const std::size_t count) noexcept {
+      std::size_t i = 0;
+#if defined(BMP_SHUFFLE_KERNELS)
+      if (has_ssse3())
+        i = bgr_to_pixels_ssse3(row, pixels, count);
+#endif
+      for (; i < count; ++i) {
+        pixels[i] = Pixel(row[3 * i + 2], row[3 * i + 1], row[3 * i]);
+      }
+    }
+
+    /**
+     *	Converts a row of BGRA bytes, as stored in 32 bpp .bmp files, to pixels and alpha values
+     */
+    inline void bgra_to_pixels(const std::uint8_t *row, Pixel *pixels, std::uint8_t *alpha, const std::size_t count) noexcept {
+      std::size_t i = 0;
+#if defined(BMP_SHUFFLE_KERNELS)
+      if (has_ssse3())
+        i = bgra_to_pixels_ssse3(row, pixels, alpha, count);
+#endif
+      for (; i < count; ++i) {
+        pixels[i] = Pixel(row[4 * i + 2], row[4 * i + 1], row[4 * i]);
+        alpha[i] = row[4 * i + 3];
+      }
+    }
+
+    /**
+     *	Converts pixels to a row of BGR bytes, as stored in .bmp files
+     */
+    inline void pixels_to_bgr(const Pixel *pixels, std::uint8_t *row, const std::size_t count) noexcept {
+      std::size_t i = 0;
+#if defined(BMP_SHUFFLE_KERNELS)
+      if (has_ssse3())
+        i = pixels_to_bgr_ssse3(pixels, row, count);
+#endif
+      for (; i < count; ++i) {
+        row[3 * i] = pixels[i].b;
+        row[3 * i + 1] = pixels[i].g;
+        row[3 * i + 2] = pixels[i].r;
+      }
+    }
+
+    /**
+     *	Converts pixels and alpha values to a row of BGRA bytes, as stored in 32 bpp .bmp files
+     */
+    inline void pixels_to_bgra(const Pixel *pixels, const std::uint8_t *alpha, std::uint8_t *row, const std::size_t count) noexcept {
+      std::size_t i = 0;
+#if defined(BMP_SHUFFLE_KERNELS)
+      if (has_ssse3())
+        i = pixels_to_bgra_ssse3(pixels, alpha, row, count);
+#endif
+      for (; i < count; ++i) {
+        row[4 * i] = pixels[i].b;
+        row[4 * i + 1] = pixels[i].g;
+        row[4 * i + 2] = pixels[i].r;
+        row[4 * i + 3] = alpha[i];
+      }
+    }
+  }
+
+  /**
+   *	How Bitmap::save writes a file
+   */
+  enum class WriteMode {
+    Buffered, /* Through the page cache */
+    Direct    /* Bypassing the page cache where the platform and filesystem support it, for very large files */
+  };
+
   class Bitmap {
   public:
+    /**
+     *	Pixels are left uninitialized when the vector grows without a value
+     */
+    using pixel_vector = std::vector<Pixel, UninitializedAllocator<Pixel>>;
+
     Bitmap() noexcept
       : m_pixels(),
         m_width(0),
@@ -119,7 +443,7 @@ namespace bmp {
     }
 
     Bitmap(const std::int32_t width, const std::int32_t height)
-      : m_pixels(static_cast<std::size_t>(width) * static_cast<std::size_t>(height)),
+      : m_pixels(static_cast<std::size_t>(width) * static_cast<std::size_t>(height), Black),
         m_width(width),
         m_height(height) {
       if (width == 0 || height == 0)
@@ -130,6 +454,7 @@ namespace bmp {
 
     Bitmap(Bitmap &&other) noexcept
       : m_pixels(std::move(other.m_pixels)),
+        m_alpha(std::move(other.m_alpha)),
         m_width(std::exchange(other.m_width, 0)),
         m_height(std::exchange(other.m_height, 0)) {
     }
@@ -390,6 +715,31 @@ namespace bmp {
       std::fill(m_pixels.begin(), m_pixels.end(), pixel);
     }
 
+    /**
+     *	Returns true if the Bitmap has an alpha channel, which it keeps when saved as a 32 bpp file
+     */
+    bool has_alpha() const noexcept { return !m_alpha.empty(); }
+
+    /**
+     *	Returns the alpha value of every pixel, in the order of the pixels, or nullptr without alpha channel
+     */
+    std::uint8_t *alpha() noexcept { return m_alpha.empty() ? nullptr : m_alpha.data(); }
+
+    /**
+     *	Returns the const alpha value of every pixel, in the order of the pixels, or nullptr without alpha channel
+     */
+    const std::uint8_t *alpha() const noexcept { return m_alpha.empty() ? nullptr : m_alpha.data(); }
+
+    /**
+     *	Adds an alpha channel with every pixel set to 'value', or removes it
+     */
+    void set_alpha_channel(const bool enabled, const std::uint8_t value = 255) {
+      if (!enabled)
+        m_alpha.clear();
+      else if (m_alpha.empty())
+        m_alpha.assign(m_pixels.size(), value);
+    }
+
   public: /* Operators */
     const Pixel &operator[](const std::size_t i) const { return m_pixels[i]; }
 
@@ -403,7 +753,8 @@ namespace bmp {
       if (this != &image) {
         return (m_width == image.m_width) &&
                (m_height == image.m_height) &&
-               (std::memcmp(m_pixels.data(), image.m_pixels.data(), sizeof(Pixel) * m_pixels.size()) == 0);
+               (std::memcmp(m_pixels.data(), image.m_pixels.data(), sizeof(Pixel) * m_pixels.size()) == 0) &&
+               (m_alpha == image.m_alpha);
       }
       return true;
     }
@@ -416,6 +767,7 @@ namespace bmp {
         m_width = image.m_width;
         m_height = image.m_height;
         m_pixels = image.m_pixels;
+        m_alpha = image.m_alpha;
       }
       return *this;
     }
@@ -423,6 +775,7 @@ namespace bmp {
     Bitmap &operator=(Bitmap &&image) noexcept {
       if (this != &image) {
         m_pixels = std::move(image.m_pixels);
+        m_alpha = std::move(image.m_alpha);
         m_width = std::exchange(image.m_width, 0);
         m_height = std::exchange(image.m_height, 0);
       }
@@ -430,21 +783,21 @@ namespace bmp {
     }
 
   public: /** foreach iterators access */
-    std::vector<Pixel>::iterator begin() noexcept { return m_pixels.begin(); }
+    pixel_vector::iterator begin() noexcept { return m_pixels.begin(); }
 
-    std::vector<Pixel>::iterator end() noexcept { return m_pixels.end(); }
+    pixel_vector::iterator end() noexcept { return m_pixels.end(); }
 
-    std::vector<Pixel>::const_iterator cbegin() const noexcept { return m_pixels.cbegin(); }
+    pixel_vector::const_iterator cbegin() const noexcept { return m_pixels.cbegin(); }
 
-    std::vector<Pixel>::const_iterator cend() const noexcept { return m_pixels.cend(); }
+    pixel_vector::const_iterator cend() const noexcept { return m_pixels.cend(); }
 
-    std::vector<Pixel>::reverse_iterator rbegin() noexcept { return m_pixels.rbegin(); }
+    pixel_vector::reverse_iterator rbegin() noexcept { return m_pixels.rbegin(); }
 
-    std::vector<Pixel>::reverse_iterator rend() noexcept { return m_pixels.rend(); }
+    pixel_vector::reverse_iterator rend() noexcept { return m_pixels.rend(); }
 
-    std::vector<Pixel>::const_reverse_iterator crbegin() const noexcept { return m_pixels.crbegin(); }
+    pixel_vector::const_reverse_iterator crbegin() const noexcept { return m_pixels.crbegin(); }
 
-    std::vector<Pixel>::const_reverse_iterator crend() const noexcept { return m_pixels.crend(); }
+    pixel_vector::const_reverse_iterator crend() const noexcept { return m_pixels.crend(); }
 
   public: /* Modifiers */
     /**
@@ -462,54 +815,147 @@ namespace bmp {
      *	Saves Bitmap pixels into a file
      *   @throws bmp::Exception on error
      */
-    void save(const std::string &filename) {
-      // Calculate row and bitmap size
-      const std::int32_t row_size = m_width * 3 + m_width % 4;
-      const std::uint32_t bitmap_size = row_size * m_height;
+    void save(const std::string &filename, const WriteMode mode = WriteMode::Buffered) const {
+      save(filename, std::vector<Pixel>(), mode);
+    }
 
-      // Construct bitmap header
-      BitmapHeader header{};
-      /* Bitmap file header structure */
-      header.magic = BITMAP_BUFFER_MAGIC;
-      header.file_size = bitmap_size + sizeof(BitmapHeader);
-      header.reserved1 = 0;
-      header.reserved2 = 0;
-      header.offset_bits = sizeof(BitmapHeader);
-      /* Bitmap file info structure */
-      header.size = 40;
-      header.width = m_width;
-      header.height = m_height;
-      header.planes = 1;
-      header.bits_per_pixel = sizeof(Pixel) * 8; // 24bpp
-      header.compression = 0;
-      header.size_image = bitmap_size;
-      header.x_pixels_per_meter = 0;
-      header.y_pixels_per_meter = 0;
-      header.clr_used = 0;
-      header.clr_important = 0;
-
-      // Save bitmap to output file
+    /**
+     *	Saves Bitmap pixels into a file, taking the top rows from 'top_rows' instead of this Bitmap
+     *	The file is allocated up front, and written in blocks of BITMAP_IO_BLOCK_SIZE bytes, 'before_block' being
+     *	called before each of them
+     *   @throws bmp::Exception on error, or what 'before_block' throws
+     */
+    void save(const std::string &filename, const std::vector<Pixel> &top_rows, const WriteMode mode = WriteMode::Buffered,
+              const BlockCallback &before_block = nullptr) const {
+#if defined(_WIN32)
+      (void)mode;
       if (std::ofstream ofs{filename, std::ios::binary}) {
-        // Write Header
-        ofs.write(reinterpret_cast<const char *>(&header), sizeof(BitmapHeader));
-
-        // Write Pixels
-        std::vector<std::uint8_t> line(row_size);
-        for (std::int32_t y = m_height - 1; y >= 0; --y) {
-          std::size_t i = 0;
-          for (std::int32_t x = 0; x < m_width; ++x) {
-            const Pixel &color = m_pixels[IX(x, y)];
-            line[i++] = color.b;
-            line[i++] = color.g;
-            line[i++] = color.r;
-          }
-          ofs.write(reinterpret_cast<const char *>(line.data()), line.size());
-        }
+        save(ofs, top_rows, before_block);
 
         // Close File
         ofs.close();
+        if (!ofs)
+          throw Exception("Bitmap::Save(\"" + filename + "\"): Failed to save pixels to file.");
       } else
         throw Exception("Bitmap::Save(\"" + filename + "\"): Failed to save pixels to file.");
+#else
+      const int flags = O_WRONLY | O_CREAT | O_TRUNC;
+      bool direct = false;
+      int fd = -1;
+#if defined(__linux__) && defined(O_DIRECT)
+      if (mode == WriteMode::Direct) {
+        // Filesystems such as tmpfs refuse O_DIRECT, they are written through the page cache instead
+        fd = ::open(filename.c_str(), flags | O_DIRECT, 0666);
+        direct = fd >= 0;
+      }
+#else
+      (void)mode;
+#endif
+      if (fd < 0)
+        fd = ::open(filename.c_str(), flags, 0666);
+      if (fd < 0)
+        throw Exception("Bitmap::Save(\"" + filename + "\"): Failed to save pixels to file.");
+
+      const std::uint64_t size = file_size();
+#if defined(__linux__)
+      // Reserve the blocks of the whole file, filesystems that cannot are simply written to
+      (void)::fallocate(fd, 0, 0, static_cast<off_t>(size));
+#endif
+
+      // Staging buffer aligned for O_DIRECT, holding a block and the row that overflows it
+      const std::size_t block_size = direct ? BITMAP_IO_BLOCK_SIZE : static_cast<std::size_t>(std::min<std::uint64_t>(BITMAP_IO_BLOCK_SIZE, size));
+      std::vector<std::uint8_t, UninitializedAllocator<std::uint8_t>> storage(block_size + row_stride() + BITMAP_DIRECT_IO_ALIGNMENT);
+      std::uint8_t *staging = storage.data() + (-reinterpret_cast<std::uintptr_t>(storage.data()) & (BITMAP_DIRECT_IO_ALIGNMENT - 1));
+
+      bool failed = false;
+      auto write_block = [&](const std::uint8_t *data, std::size_t count) {
+        if (direct && count % BITMAP_DIRECT_IO_ALIGNMENT != 0) {
+          // The last block is padded to the alignment, and the padding cut off below
+          const std::size_t padded = (count + BITMAP_DIRECT_IO_ALIGNMENT - 1) & ~(BITMAP_DIRECT_IO_ALIGNMENT - 1);
+          std::fill(staging + count, staging + padded, std::uint8_t(0));
+          count = padded;
+        }
+        while (count > 0 && !failed) {
+          const ssize_t written = ::write(fd, data, count);
+#if defined(__linux__) && defined(O_DIRECT)
+          if (written < 0 && errno == EINVAL && direct) {
+            // Refused by the filesystem at write time, continue through the page cache
+            direct = false;
+            failed = ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) & ~O_DIRECT) != 0;
+            continue;
+          }
+#endif
+          if (written < 0 && errno == EINTR)
+            continue;
+          failed = written <= 0;
+          if (!failed) {
+            data += written;
+            count -= static_cast<std::size_t>(written);
+          }
+        }
+      };
+      try {
+        write_file(top_rows, staging, block_size, [&](const std::uint8_t *data, std::size_t count) {
+          if (before_block)
+            before_block();
+          write_block(data, count);
+        });
+      } catch (...) {
+        ::close(fd);
+        throw;
+      }
+      failed = ::ftruncate(fd, static_cast<off_t>(size)) != 0 || failed;
+      failed = ::close(fd) != 0 || failed;
+      if (failed)
+        throw Exception("Bitmap::Save(\"" + filename + "\"): Failed to save pixels to file.");
+#endif
+    }
+
+    /**
+     *	Saves Bitmap pixels into a memory buffer, replacing its content
+     *   @throws bmp::Exception on error
+     */
+    void save(std::vector<std::uint8_t> &buffer) const {
+      buffer.clear();
+      buffer.reserve(static_cast<std::size_t>(file_size()));
+      MemoryStreamBuffer stream_buffer(buffer);
+      std::ostream os(&stream_buffer);
+      save(os);
+    }
+
+    /**
+     *	Saves Bitmap pixels into a stream, from its current position
+     *   @throws bmp::Exception on error
+     */
+    void save(std::ostream &os) const {
+      save(os, std::vector<Pixel>());
+    }
+
+    /**
+     *	Saves Bitmap pixels into a stream, taking the top rows from 'top_rows' instead of this Bitmap
+     *	Lets copies that only differ in their top rows share the pixels of the rest of the image
+     *	Bitmaps with an alpha channel are saved as 32 bpp BGRA files, others as 24 bpp BGR files
+     *	'before_block' is called before every block of BITMAP_IO_BLOCK_SIZE bytes is written
+     *   @throws bmp::Exception on error, or what 'before_block' throws
+     */
+    void save(std::ostream &os, const std::vector<Pixel> &top_rows, const BlockCallback &before_block = nullptr) const {
+      const std::size_t block_size = static_cast<std::size_t>(std::min<std::uint64_t>(BITMAP_IO_BLOCK_SIZE, file_size()));
+      std::vector<std::uint8_t, UninitializedAllocator<std::uint8_t>> staging(block_size + row_stride());
+      write_file(top_rows, staging.data(), block_size, [&os, &before_block](const std::uint8_t *data, const std::size_t count) {
+        if (before_block)
+          before_block();
+        os.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(count));
+      });
+
+      if (!os)
+        throw Exception("Bitmap::Save(): Failed to write pixels to stream.");
+    }
+
+    /**
+     *	Returns the size in bytes of the .bmp file that save writes
+     */
+    std::uint64_t file_size() const noexcept {
+      return sizeof(BitmapHeader) + static_cast<std::uint64_t>(row_stride()) * static_cast<std::uint64_t>(m_height);
     }
 
     /**
@@ -517,50 +963,11 @@ namespace bmp {
      *   @throws bmp::Exception on error
      */
     void load(const std::string &filename) {
-      m_pixels.clear();
-
       if (std::ifstream ifs{filename, std::ios::binary}) {
-        // Read Header
-        std::unique_ptr<BitmapHeader> header(new BitmapHeader());
-        ifs.read(reinterpret_cast<char *>(header.get()), sizeof(BitmapHeader));
-
-        // Check if Bitmap file is valid
-        if (header->magic != BITMAP_BUFFER_MAGIC) {
-          ifs.close();
-          throw Exception("Bitmap::Load(\"" + filename + "\"): Unrecognized file format.");
-        }
-        // Check if the Bitmap file has 24 bits per pixel (for now supporting only 24bpp bitmaps)
-        if (header->bits_per_pixel != 24) {
-          ifs.close();
-          throw Exception("Bitmap::Load(\"" + filename + "\"): Only 24 bits per pixel bitmaps supported.");
-        }
-
-        // Seek the beginning of the pixels data
-        // Note: We can't just assume we're there right after we read the BitmapHeader
-        // Because some editors like Gimp might put extra information after the header.
-        // Thanks to @seeliger-ec
-        ifs.seekg(header->offset_bits);
-
-        // Set width & height
-        m_width = header->width;
-        m_height = header->height;
-
-        // Resize pixels size
-        m_pixels.resize(static_cast<std::size_t>(m_width) * static_cast<std::size_t>(m_height), Black);
-
-        // Read Bitmap pixels
-        const std::int32_t row_size = m_width * 3 + m_width % 4;
-        std::vector<std::uint8_t> line(row_size);
-        for (std::int32_t y = m_height - 1; y >= 0; --y) {
-          ifs.read(reinterpret_cast<char *>(line.data()), line.size());
-          std::size_t i = 0;
-          for (std::int32_t x = 0; x < m_width; ++x) {
-            Pixel color{};
-            color.b = line[i++];
-            color.g = line[i++];
-            color.r = line[i++];
-            m_pixels[IX(x, y)] = color;
-          }
+        try {
+          load(ifs);
+        } catch (const Exception &e) {
+          throw Exception("Bitmap::Load(\"" + filename + "\"): " + e.what());
         }
 
         // Close file
@@ -569,7 +976,137 @@ namespace bmp {
         throw Exception("Bitmap::Load(\"" + filename + "\"): Failed to load bitmap pixels from file.");
     }
 
+    /**
+     *	Loads Bitmap from a memory buffer holding a .bmp file, without copying the buffer
+     *   @throws bmp::Exception on error
+     */
+    void load(const std::uint8_t *data, const std::size_t size) {
+      MemoryStreamBuffer stream_buffer(data, size);
+      std::istream is(&stream_buffer);
+      load(is);
+    }
+
+    /**
+     *	Loads Bitmap from a stream positioned at the start of a .bmp file
+     *   @throws bmp::Exception on error
+     */
+    void load(std::istream &is) {
+      m_pixels.clear();
+      m_alpha.clear();
+
+      // Read Header
+      const std::streampos start = is.tellg();
+      std::unique_ptr<BitmapHeader> header(new BitmapHeader());
+      is.read(reinterpret_cast<char *>(header.get()), sizeof(BitmapHeader));
+
+      // Check if Bitmap file is valid
+      if (!is || header->magic != BITMAP_BUFFER_MAGIC) {
+        throw Exception("Unrecognized file format.");
+      }
+      // Check if the Bitmap file has 24 bits per pixel BGR or 32 bits per pixel BGRA pixels
+      std::uint8_t masks[BITMAP_MASKS_SIZE] = {};
+      std::size_t header_size = sizeof(BitmapHeader);
+      if (header->compression == BITMAP_COMPRESSION_BITFIELDS && is.read(reinterpret_cast<char *>(masks), sizeof(masks))) {
+        header_size += sizeof(masks);
+      }
+      const std::size_t pixel_size = bmp::pixel_size(*header, masks);
+      if (pixel_size == 0) {
+        throw Exception("Only 24 bits per pixel BGR and 32 bits per pixel BGRA bitmaps supported.");
+      }
+
+      // Seek the beginning of the pixels data
+      // Note: We can't just assume we're there right after we read the BitmapHeader
+      // Because some editors like Gimp might put extra information after the header.
+      // Thanks to @seeliger-ec
+      // Streams that cannot seek, such as pipes, are read up to the pixels instead
+      if (start == std::streampos(-1) || !is.seekg(start + std::streamoff(header->offset_bits))) {
+        is.clear();
+        is.ignore(header->offset_bits > header_size ? header->offset_bits - header_size : 0);
+      }
+
+      // Set width & height, rows are stored bottom-up unless the height is negative
+      if (header->width <= 0 || header->height == 0 || header->height == INT32_MIN) {
+        throw Exception("Invalid bitmap dimensions.");
+      }
+      const bool top_down = header->height < 0;
+      m_width = header->width;
+      m_height = top_down ? -header->height : header->height;
+
+      // Resize pixels size, without clearing them since every pixel is read below
+      const std::size_t width = static_cast<std::size_t>(m_width);
+      const std::size_t height = static_cast<std::size_t>(m_height);
+      m_pixels.resize(width * height);
+      if (pixel_size == 4)
+        m_alpha.resize(m_pixels.size());
+
+      // Read Bitmap pixels in blocks of rows, which are padded to a multiple of 4 bytes
+      const std::size_t row_stride = (width * pixel_size + 3) & ~static_cast<std::size_t>(3);
+      const std::size_t block_rows = std::min(std::max<std::size_t>(BITMAP_IO_BLOCK_SIZE / row_stride, 1), height);
+      std::vector<std::uint8_t> block(block_rows * row_stride);
+      for (std::size_t file_row = 0; file_row < height;) {
+        const std::size_t rows = std::min(block_rows, height - file_row);
+        if (!is.read(reinterpret_cast<char *>(block.data()), static_cast<std::streamsize>(rows * row_stride))) {
+          m_pixels.clear();
+          m_alpha.clear();
+          throw Exception("Bitmap pixels are truncated.");
+        }
+        for (std::size_t i = 0; i < rows; ++i, ++file_row) {
+          const std::size_t y = top_down ? file_row : height - 1 - file_row;
+          const std::uint8_t *row = block.data() + i * row_stride;
+          if (pixel_size == 4)
+            detail::bgra_to_pixels(row, &m_pixels[y * width], &m_alpha[y * width], width);
+          else
+            detail::bgr_to_pixels(row, &m_pixels[y * width], width);
+        }
+      }
+    }
+
   private: /* Utils */
+    /**
+     *	Returns the size in bytes of a saved row, padded to a multiple of 4 bytes
+     */
+    [[nodiscard]] std::size_t row_stride() const noexcept {
+      return (static_cast<std::size_t>(m_width) * (has_alpha() ? 4 : 3) + 3) & ~static_cast<std::size_t>(3);
+    }
+
+    /**
+     *	Produces the .bmp file in 'staging', which holds 'block_size' bytes plus a row, and hands it to 'write'
+     *	in multiples of 'block_size' bytes, then the rest of the file, shorter than a block, in a last call
+     */
+    template <typename Write>
+    void write_file(const std::vector<Pixel> &top_rows, std::uint8_t *staging, const std::size_t block_size, Write &&write) const {
+      const std::size_t width = static_cast<std::size_t>(m_width);
+      const std::size_t pixel_size = has_alpha() ? 4 : 3;
+      const std::size_t stride = row_stride();
+
+      // Construct bitmap header
+      const BitmapHeader header = make_header(m_width, m_height, pixel_size);
+      std::memcpy(staging, &header, sizeof(BitmapHeader));
+      std::size_t filled = sizeof(BitmapHeader);
+
+      // Rows are stored bottom-up, converted straight into the staging buffer with zeroed padding
+      const std::size_t top_row_count = width > 0 ? top_rows.size() / width : 0;
+      for (std::int32_t y = m_height - 1; y >= 0; --y) {
+        const std::size_t offset = IX(0, y);
+        const Pixel *row = static_cast<std::size_t>(y) < top_row_count ? top_rows.data() + offset : m_pixels.data() + offset;
+        std::uint8_t *line = staging + filled;
+        if (has_alpha())
+          detail::pixels_to_bgra(row, m_alpha.data() + offset, line, width);
+        else
+          detail::pixels_to_bgr(row, line, width);
+        std::fill(line + width * pixel_size, line + stride, std::uint8_t(0));
+        filled += stride;
+        if (filled >= block_size) {
+          const std::size_t blocks = filled - filled % block_size;
+          write(staging, blocks);
+          std::memmove(staging, staging + blocks, filled - blocks);
+          filled -= blocks;
+        }
+      }
+      if (filled > 0)
+        write(staging, filled);
+    }
+
     /**
      *	Converts 2D x,y coords into 1D index
      */
@@ -585,8 +1122,592 @@ namespace bmp {
     }
 
   private:
-    std::vector<Pixel> m_pixels;
+    pixel_vector m_pixels;
+    std::vector<std::uint8_t, UninitializedAllocator<std::uint8_t>> m_alpha; /* Empty for 24 bpp bitmaps */
     std::int32_t m_width;
     std::int32_t m_height;
   };
+
+  /**
+   *	Reads the pixel rows of a 24 bpp or 32 bpp .bmp file a block at a time, in the order the file stores them:
+   *	bottom row first for ordinary bottom-up files, top row first for top-down files.  Only the rows asked for
+   *	are held in memory, so images of any size can be read in a fixed amount of memory.
+   */
+  class BitmapRowReader {
+  public:
+    BitmapRowReader() noexcept
+      : m_header(),
+        m_pixel_size(0),
+        m_row_stride(0),
+        m_rows_read(0) {
+    }
+
+    explicit BitmapRowReader(const std::string &filename)
+      : BitmapRowReader() {
+      this->open(filename);
+    }
+
+  public: /* Accessors */
+    /**
+     *	Returns the header of the file
+     */
+    const BitmapHeader &header() const noexcept { return m_header; }
+
+    /**
+     *	Returns the bytes of the file that precede the pixels: the header, the masks and anything editors put after them
+     */
+    const std::vector<std::uint8_t> &header_bytes() const noexcept { return m_header_bytes; }
+
+    /**
+     *	Returns the width of the Bitmap image
+     */
+    std::int32_t width() const noexcept { return m_header.width; }
+
+    /**
+     *	Returns the height of the Bitmap image
+     */
+    std::int32_t height() const noexcept { return m_header.height < 0 ? -m_header.height : m_header.height; }
+
+    /**
+     *	Returns the size in bytes of a pixel: 3 for BGR files, 4 for BGRA files
+     */
+    std::size_t pixel_size() const noexcept { return m_pixel_size; }
+
+    /**
+     *	Returns the number of bytes between the start of two rows, padding included
+     */
+    std::size_t row_stride() const noexcept { return m_row_stride; }
+
+    /**
+     *	Returns the number of rows read or skipped so far
+     */
+    std::size_t rows_read() const noexcept { return m_rows_read; }
+
+    /**
+     *	Returns the row of the image, counting from the top, stored at 'file_row' in the file
+     */
+    std::int32_t image_row(const std::size_t file_row) const noexcept {
+      return m_header.height < 0 ? static_cast<std::int32_t>(file_row) : height() - 1 - static_cast<std::int32_t>(file_row);
+    }
+
+    bool operator!() const noexcept { return !m_stream.is_open(); }
+
+    explicit operator bool() const noexcept { return m_stream.is_open(); }
+
+  public:
+    /**
+     *	Opens a .bmp file and reads everything up to its first row
+     *   @throws bmp::Exception on error
+     */
+    void open(const std::string &filename) {
+      close();
+      m_stream.open(filename, std::ios::binary);
+      if (!m_stream)
+        throw Exception("BitmapRowReader::Open(\"" + filename + "\"): Failed to open file.");
+
+      try {
+        read_header();
+      } catch (const Exception &e) {
+        close();
+        throw Exception("BitmapRowReader::Open(\"" + filename + "\"): " + e.what());
+      }
+    }
+
+    /**
+     *	Closes the file
+     */
+    void close() noexcept {
+      if (m_stream.is_open())
+        m_stream.close();
+      m_stream.clear();
+      m_header = BitmapHeader{};
+      m_header_bytes.clear();
+      m_pixel_size = 0;
+      m_row_stride = 0;
+      m_rows_read = 0;
+    }
+
+    /**
+     *	Reads up to 'count' rows as the file stores them, BGR or BGRA bytes padded to row_stride() bytes each
+     *	Returns the number of rows read, 0 once every row has been read
+     *   @throws bmp::Exception if the file is truncated
+     */
+    std::size_t read_rows(std::uint8_t *rows, const std::size_t count) {
+      const std::size_t n = std::min(count, static_cast<std::size_t>(height()) - m_rows_read);
+      if (n > 0 && !m_stream.read(reinterpret_cast<char *>(rows), static_cast<std::streamsize>(n * m_row_stride)))
+        throw Exception("BitmapRowReader::Read(): Bitmap pixels are truncated.");
+      m_rows_read += n;
+      return n;
+    }
+
+    /**
+     *	Reads up to 'count' rows converted to width() pixels each, along with their alpha values for 32 bpp files
+     *	unless 'alpha' is nullptr.  Returns the number of rows read, 0 once every row has been read
+     *   @throws bmp::Exception if the file is truncated
+     */
+    std::size_t read_rows(Pixel *pixels, std::uint8_t *alpha, const std::size_t count) {
+      const std::size_t width = static_cast<std::size_t>(this->width());
+      const std::size_t block_rows = std::max<std::size_t>(BITMAP_IO_BLOCK_SIZE / m_row_stride, 1);
+      std::size_t done = 0;
+      while (done < count) {
+        m_block.resize(std::min(block_rows, count - done) * m_row_stride);
+        const std::size_t rows = read_rows(m_block.data(), m_block.size() / m_row_stride);
+        if (rows == 0)
+          break;
+        if (m_pixel_size == 4 && alpha == nullptr)
+          m_discarded_alpha.resize(width);
+        for (std::size_t i = 0; i < rows; ++i, ++done) {
+          const std::uint8_t *row = m_block.data() + i * m_row_stride;
+          if (m_pixel_size == 4)
+            detail::bgra_to_pixels(row, pixels + done * width, alpha != nullptr ? alpha + done * width : m_discarded_alpha.data(), width);
+          else
+            detail::bgr_to_pixels(row, pixels + done * width, width);
+        }
+      }
+      return done;
+    }
+
+    /**
+     *	Skips up to 'count' rows without reading them.  Returns the number of rows skipped
+     *   @throws bmp::Exception if the file is truncated
+     */
+    std::size_t skip_rows(const std::size_t count) {
+      const std::size_t n = std::min(count, static_cast<std::size_t>(height()) - m_rows_read);
+      if (n > 0 && !m_stream.seekg(static_cast<std::streamoff>(n * m_row_stride), std::ios::cur))
+        throw Exception("BitmapRowReader::Skip(): Bitmap pixels are truncated.");
+      m_rows_read += n;
+      return n;
+    }
+
+  private:
+    /**
+     *	Reads and checks the bytes before the pixels, keeping them for a BitmapRowWriter
+     */
+    void read_header() {
+      m_stream.read(reinterpret_cast<char *>(&m_header), sizeof(BitmapHeader));
+      if (!m_stream || m_header.magic != BITMAP_BUFFER_MAGIC || m_header.offset_bits < sizeof(BitmapHeader))
+        throw Exception("Unrecognized file format.");
+
+      // The pixels are read sequentially, so the bytes up to them are read rather than seeked over
+      m_stream.seekg(0, std::ios::end);
+      const std::streamoff file_size = m_stream.tellg();
+      m_stream.seekg(static_cast<std::streamoff>(sizeof(BitmapHeader)));
+      if (!m_stream || static_cast<std::streamoff>(m_header.offset_bits) > file_size)
+        throw Exception("Unrecognized file format.");
+      m_header_bytes.resize(m_header.offset_bits);
+      std::memcpy(m_header_bytes.data(), &m_header, sizeof(BitmapHeader));
+      if (!m_stream.read(reinterpret_cast<char *>(m_header_bytes.data() + sizeof(BitmapHeader)),
+                         static_cast<std::streamsize>(m_header_bytes.size() - sizeof(BitmapHeader))))
+        throw Exception("Unrecognized file format.");
+
+      // Check if the Bitmap file has 24 bits per pixel BGR or 32 bits per pixel BGRA pixels
+      const bool has_masks = m_header_bytes.size() >= sizeof(BitmapHeader) + BITMAP_MASKS_SIZE;
+      m_pixel_size = bmp::pixel_size(m_header, has_masks ? m_header_bytes.data() + sizeof(BitmapHeader) : nullptr);
+      if (m_pixel_size == 0)
+        throw Exception("Only 24 bits per pixel BGR and 32 bits per pixel BGRA bitmaps supported.");
+      if (m_header.width <= 0 || m_header.height == 0 || m_header.height == INT32_MIN)
+        throw Exception("Invalid bitmap dimensions.");
+
+      // Rows are padded to a multiple of 4 bytes
+      m_row_stride = (static_cast<std::size_t>(m_header.width) * m_pixel_size + 3) & ~static_cast<std::size_t>(3);
+    }
+
+  private:
+    std::ifstream m_stream;
+    BitmapHeader m_header;
+    std::vector<std::uint8_t> m_header_bytes;
+    std::size_t m_pixel_size;
+    std::size_t m_row_stride;
+    std::size_t m_rows_read;
+    std::vector<std::uint8_t> m_block;           /* Rows being converted by read_rows */
+    std::vector<std::uint8_t> m_discarded_alpha; /* Alpha values nobody asked for */
+  };
+
+  /**
+   *	Writes a .bmp file a block of pixel rows at a time, in the order the file stores them, so that the image
+   *	never has to be held in memory whole.  Every row must be written before close().
+   */
+  class BitmapRowWriter {
+  public:
+    /**
+     *	Creates a bottom-up 24 bpp BGR file, or 32 bpp BGRA file with 'alpha', whose rows are written bottom row first
+     *   @throws bmp::Exception on error
+     */
+    BitmapRowWriter(const std::string &filename, const std::int32_t width, const std::int32_t height, const bool alpha = false)
+      : m_filename(filename),
+        m_header(make_header(width, height, alpha ? 4 : 3)),
+        m_pixel_size(alpha ? 4 : 3),
+        m_rows_written(0) {
+      if (width <= 0 || height <= 0)
+        throw Exception("Bitmap width and height must be > 0");
+      create(reinterpret_cast<const std::uint8_t *>(&m_header), sizeof(BitmapHeader));
+    }
+
+    /**
+     *	Creates a file with the header bytes and layout of the file 'reader' reads, whose rows are written in the
+     *	order the reader returns them
+     *   @throws bmp::Exception on error
+     */
+    BitmapRowWriter(const std::string &filename, const BitmapRowReader &reader)
+      : m_filename(filename),
+        m_header(reader.header()),
+        m_pixel_size(reader.pixel_size()),
+        m_rows_written(0) {
+      create(reader.header_bytes().data(), reader.header_bytes().size());
+    }
+
+  public: /* Accessors */
+    /**
+     *	Returns the width of the Bitmap image
+     */
+    std::int32_t width() const noexcept { return m_header.width; }
+
+    /**
+     *	Returns the height of the Bitmap image
+     */
+    std::int32_t height() const noexcept { return m_header.height < 0 ? -m_header.height : m_header.height; }
+
+    /**
+     *	Returns the size in bytes of a pixel: 3 for BGR files, 4 for BGRA files
+     */
+    std::size_t pixel_size() const noexcept { return m_pixel_size; }
+
+    /**
+     *	Returns the number of bytes between the start of two rows, padding included
+     */
+    std::size_t row_stride() const noexcept {
+      return (static_cast<std::size_t>(m_header.width) * m_pixel_size + 3) & ~static_cast<std::size_t>(3);
+    }
+
+    /**
+     *	Returns the number of rows written so far
+     */
+    std::size_t rows_written() const noexcept { return m_rows_written; }
+
+  public:
+    /**
+     *	Writes 'count' rows as the file stores them, BGR or BGRA bytes padded to row_stride() bytes each
+     *   @throws bmp::Exception on error
+     */
+    void write_rows(const std::uint8_t *rows, const std::size_t count) {
+      if (count > static_cast<std::size_t>(height()) - m_rows_written)
+        throw Exception("BitmapRowWriter::Write(\"" + m_filename + "\"): More rows than the height of the bitmap.");
+      if (!m_stream.write(reinterpret_cast<const char *>(rows), static_cast<std::streamsize>(count * row_stride())))
+        throw Exception("BitmapRowWriter::Write(\"" + m_filename + "\"): Failed to write pixels to file.");
+      m_rows_written += count;
+    }
+
+    /**
+     *	Writes 'count' rows of width() pixels each, with their alpha values for 32 bpp files, opaque when 'alpha' is nullptr
+     *   @throws bmp::Exception on error
+     */
+    void write_rows(const Pixel *pixels, const std::uint8_t *alpha, const std::size_t count) {
+      const std::size_t width = static_cast<std::size_t>(this->width());
+      const std::size_t stride = row_stride();
+      const std::size_t block_rows = std::max<std::size_t>(BITMAP_IO_BLOCK_SIZE / stride, 1);
+      if (m_pixel_size == 4 && alpha == nullptr)
+        m_opaque_alpha.assign(width, 255);
+      for (std::size_t done = 0; done < count;) {
+        const std::size_t rows = std::min(block_rows, count - done);
+        m_block.resize(rows * stride);
+        for (std::size_t i = 0; i < rows; ++i, ++done) {
+          std::uint8_t *line = m_block.data() + i * stride;
+          if (m_pixel_size == 4)
+            detail::pixels_to_bgra(pixels + done * width, alpha != nullptr ? alpha + done * width : m_opaque_alpha.data(), line, width);
+          else
+            detail::pixels_to_bgr(pixels + done * width, line, width);
+          std::fill(line + width * m_pixel_size, line + stride, std::uint8_t(0));
+        }
+        write_rows(m_block.data(), rows);
+      }
+    }
+
+    /**
+     *	Closes the file once every row has been written
+     *   @throws bmp::Exception if rows are missing or the file could not be written
+     */
+    void close() {
+      if (m_rows_written != static_cast<std::size_t>(height()))
+        throw Exception("BitmapRowWriter::Close(\"" + m_filename + "\"): " +
+                        std::to_string(static_cast<std::size_t>(height()) - m_rows_written) + " rows were never written.");
+      m_stream.close();
+      if (!m_stream)
+        throw Exception("BitmapRowWriter::Close(\"" + m_filename + "\"): Failed to save pixels to file.");
+    }
+
+  private:
+    void create(const std::uint8_t *header_bytes, const std::size_t size) {
+      m_stream.open(m_filename, std::ios::binary);
+      if (!m_stream || !m_stream.write(reinterpret_cast<const char *>(header_bytes), static_cast<std::streamsize>(size)))
+        throw Exception("BitmapRowWriter::Open(\"" + m_filename + "\"): Failed to save pixels to file.");
+    }
+
+  private:
+    std::ofstream m_stream;
+    std::string m_filename;
+    BitmapHeader m_header;
+    std::size_t m_pixel_size;
+    std::size_t m_rows_written;
+    std::vector<std::uint8_t> m_block;        /* Rows being converted by write_rows */
+    std::vector<std::uint8_t> m_opaque_alpha; /* Alpha values of pixels written without them */
+  };
+
+  /**
+   *	How a MappedBitmap maps its file
+   */
+  enum class MapMode {
+    ReadOnly,   /* Pixels can only be read */
+    CopyOnWrite /* Pixels can be modified in memory, the file itself is never changed */
+  };
+
+  /**
+   *	Bitmap view backed by a memory mapping of a 24 bpp or 32 bpp .bmp file.
+   *	Pixels are not decoded: rows point straight into the pixel array of the file, in its native
+   *	BGR or BGRA byte order, with the row stride and padding of the file.  Rows are indexed top to bottom
+   *	like Bitmap, whichever order the file stores them in.
+   */
+  class MappedBitmap {
+  public:
+    MappedBitmap() noexcept
+      : m_data(nullptr),
+        m_size(0),
+        m_header(),
+        m_pixel_size(0),
+        m_row_stride(0) {
+    }
+
+    explicit MappedBitmap(const std::string &filename, const MapMode mode = MapMode::ReadOnly)
+      : MappedBitmap() {
+      this->open(filename, mode);
+    }
+
+    MappedBitmap(const MappedBitmap &other) = delete;
+
+    MappedBitmap &operator=(const MappedBitmap &other) = delete;
+
+    MappedBitmap(MappedBitmap &&other) noexcept
+      : m_data(std::exchange(other.m_data, nullptr)),
+        m_size(std::exchange(other.m_size, 0)),
+        m_header(other.m_header),
+        m_pixel_size(std::exchange(other.m_pixel_size, 0)),
+        m_row_stride(std::exchange(other.m_row_stride, 0)) {
+    }
+
+    MappedBitmap &operator=(MappedBitmap &&other) noexcept {
+      if (this != &other) {
+        close();
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+        m_header = other.m_header;
+        m_pixel_size = std::exchange(other.m_pixel_size, 0);
+        m_row_stride = std::exchange(other.m_row_stride, 0);
+      }
+      return *this;
+    }
+
+    virtual ~MappedBitmap() noexcept {
+      close();
+    }
+
+  public: /* Accessors */
+    /**
+     *	Returns the header of the mapped file
+     */
+    const BitmapHeader &header() const noexcept { return m_header; }
+
+    /**
+     *	Returns the width of the Bitmap image
+     */
+    std::int32_t width() const noexcept { return m_header.width; }
+
+    /**
+     *	Returns the height of the Bitmap image
+     */
+    std::int32_t height() const noexcept { return m_header.height < 0 ? -m_header.height : m_header.height; }
+
+    /**
+     *	Returns the bytes of the whole mapped file
+     */
+    const std::uint8_t *data() const noexcept { return m_data; }
+
+    /**
+     *	Returns the size in bytes of the mapped file
+     */
+    std::size_t size() const noexcept { return m_size; }
+
+    /**
+     *	Returns the size in bytes of a pixel: 3 for BGR files, 4 for BGRA files
+     */
+    std::size_t pixel_size() const noexcept { return m_pixel_size; }
+
+    /**
+     *	Returns the number of bytes between the start of two rows, padding included
+     */
+    std::size_t row_stride() const noexcept { return m_row_stride; }
+
+    /**
+     *	Returns the BGR or BGRA bytes of row y, counting from the top of the image
+     */
+    std::uint8_t *row(const std::int32_t y) noexcept {
+      return m_data + row_offset(y);
+    }
+
+    /**
+     *	Returns the const BGR or BGRA bytes of row y, counting from the top of the image
+     */
+    const std::uint8_t *row(const std::int32_t y) const noexcept {
+      return m_data + row_offset(y);
+    }
+
+    /**
+     *	Returns the distance in bytes from one row to the row below it (negative for bottom-up files)
+     */
+    std::ptrdiff_t row_step() const noexcept {
+      return m_header.height < 0 ? static_cast<std::ptrdiff_t>(m_row_stride) : -static_cast<std::ptrdiff_t>(m_row_stride);
+    }
+
+    bool operator!() const noexcept { return m_data == nullptr; }
+
+    explicit operator bool() const noexcept { return m_data != nullptr; }
+
+  public:
+    /**
+     *	Maps a .bmp file
+     *   @throws bmp::Exception on error
+     */
+    void open(const std::string &filename, const MapMode mode = MapMode::ReadOnly) {
+      close();
+
+#if defined(_WIN32)
+      HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL, nullptr);
+      if (file == INVALID_HANDLE_VALUE)
+        throw Exception("MappedBitmap::Open(\"" + filename + "\"): Failed to open file.");
+
+      LARGE_INTEGER file_size{};
+      GetFileSizeEx(file, &file_size);
+      m_size = static_cast<std::size_t>(file_size.QuadPart);
+
+      HANDLE mapping = m_size == 0 ? nullptr : CreateFileMappingA(file, nullptr, mode == MapMode::CopyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY,
+                                                                  0, 0, nullptr);
+      CloseHandle(file);
+      if (mapping != nullptr) {
+        m_data = static_cast<std::uint8_t *>(MapViewOfFile(mapping, mode == MapMode::CopyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ,
+                                                           0, 0, 0));
+        // the view keeps the mapping alive
+        CloseHandle(mapping);
+      }
+#else
+      const int fd = ::open(filename.c_str(), O_RDONLY);
+      if (fd < 0)
+        throw Exception("MappedBitmap::Open(\"" + filename + "\"): Failed to open file.");
+
+      struct stat file_stat{};
+      if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+        m_size = static_cast<std::size_t>(file_stat.st_size);
+        void *data = mmap(nullptr, m_size, mode == MapMode::CopyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ,
+                          mode == MapMode::CopyOnWrite ? MAP_PRIVATE : MAP_SHARED, fd, 0);
+        m_data = data == MAP_FAILED ? nullptr : static_cast<std::uint8_t *>(data);
+      }
+      ::close(fd);
+#endif
+
+      if (m_data == nullptr) {
+        m_size = 0;
+        throw Exception("MappedBitmap::Open(\"" + filename + "\"): Failed to map file.");
+      }
+
+      // Check if Bitmap file is valid
+      if (m_size < sizeof(BitmapHeader)) {
+        close();
+        throw Exception("MappedBitmap::Open(\"" + filename + "\"): Unrecognized file format.");
+      }
+      std::memcpy(&m_header, m_data, sizeof(BitmapHeader));
+      if (m_header.magic != BITMAP_BUFFER_MAGIC) {
+        close();
+        throw Exception("MappedBitmap::Open(\"" + filename + "\"): Unrecognized file format.");
+      }
+      // Pixels are used in place, so only 24 bits per pixel BGR and 32 bits per pixel BGRA bitmaps can be mapped
+      m_pixel_size = bmp::pixel_size(m_header, m_size >= sizeof(BitmapHeader) + BITMAP_MASKS_SIZE ? m_data + sizeof(BitmapHeader) : nullptr);
+      if (m_pixel_size == 0) {
+        close();
+        throw Exception("MappedBitmap::Open(\"" + filename + "\"): Only 24 bits per pixel BGR and 32 bits per pixel BGRA bitmaps supported.");
+      }
+
+      // The dimensions are checked before height() negates a top-down height, then the rows must fit in the file.
+      // Rows are padded to a multiple of 4 bytes
+      if (m_header.width <= 0 || m_header.height == 0 || m_header.height == INT32_MIN ||
+          m_header.offset_bits > m_size) {
+        close();
+        throw Exception("MappedBitmap::Open(\"" + filename + "\"): File is truncated or has invalid dimensions.");
+      }
+      m_row_stride = (static_cast<std::size_t>(m_header.width) * m_pixel_size + 3) & ~static_cast<std::size_t>(3);
+      if (static_cast<std::size_t>(height()) > (m_size - m_header.offset_bits) / m_row_stride) {
+        close();
+        throw Exception("MappedBitmap::Open(\"" + filename + "\"): File is truncated or has invalid dimensions.");
+      }
+    }
+
+    /**
+     *	Unmaps the file
+     */
+    void close() noexcept {
+      if (m_data != nullptr) {
+#if defined(_WIN32)
+        UnmapViewOfFile(m_data);
+#else
+        munmap(m_data, m_size);
+#endif
+      }
+      m_data = nullptr;
+      m_size = 0;
+      m_header = BitmapHeader{};
+      m_pixel_size = 0;
+      m_row_stride = 0;
+    }
+
+    /**
+     *	Saves the mapped file, including any changes made to a copy-on-write mapping, in blocks of
+     *	BITMAP_IO_BLOCK_SIZE bytes, 'before_block' being called before each of them.
+     *	The file is written next to its destination and then renamed over it, so the destination may
+     *	be the mapped file itself.
+     *   @throws bmp::Exception on error, or what 'before_block' throws
+     */
+    void save(const std::string &filename, const BlockCallback &before_block = nullptr) const {
+      const std::string temporary_filename = filename + ".tmp";
+      std::error_code error;
+      try {
+        std::ofstream ofs{temporary_filename, std::ios::binary};
+        for (std::size_t offset = 0; ofs && offset < m_size; offset += BITMAP_IO_BLOCK_SIZE) {
+          if (before_block)
+            before_block();
+          ofs.write(reinterpret_cast<const char *>(m_data + offset), static_cast<std::streamsize>(std::min(BITMAP_IO_BLOCK_SIZE, m_size - offset)));
+        }
+        if (!ofs)
+          throw Exception("MappedBitmap::Save(\"" + filename + "\"): Failed to save pixels to file.");
+      } catch (...) {
+        std::filesystem::remove(temporary_filename, error);
+        throw;
+      }
+
+      std::filesystem::rename(temporary_filename, filename, error);
+      if (error) {
+        std::filesystem::remove(temporary_filename, error);
+        throw Exception("MappedBitmap::Save(\"" + filename + "\"): Failed to save pixels to file.");
+      }
+    }
+
+  private:
+    [[nodiscard]] std::size_t row_offset(const std::int32_t y) const noexcept {
+      const std::size_t file_row = m_header.height < 0 ? static_cast<std::size_t>(y) : static_cast<std::size_t>(height() - 1 - y);
+      return m_header.offset_bits + file_row * m_row_stride;
+    }
+
+  private:
+    std::uint8_t *m_data;
+    std::size_t m_size;
+    BitmapHeader m_header;
+    std::size_t m_pixel_size;
+    std::size_t m_row_stride;
+  };
 }
\ No newline at end of file
@@ -0,0 +1,463 @@
+#include <stdexcept> // std::runtime_error
+#include <algorithm> // std::min, std::upper_bound
+#include "bitpacker.h"
+#include "bitpacker_kernels.h"
+
+#if defined(_M_X64)
+#include <intrin.h>    // __cpuid, __cpuidex
+#include <immintrin.h> // _xgetbv
+#endif
+
+using namespace std;
+using namespace SteganographyLib;
+
+namespace
+{
+    // Kernels indexed by (bitsPerPixel / 3) - 1
+    const EncodeKernel encodeKernels[] = {
+        scalarEncodeKernel<3>, scalarEncodeKernel<6>, scalarEncodeKernel<9>, scalarEncodeKernel<12>,
+        scalarEncodeKernel<15>, scalarEncodeKernel<18>, scalarEncodeKernel<21>, scalarEncodeKernel<24>
+    };
+
+    const DecodeKernel decodeKernels[] = {
+        scalarDecodeKernel<3>, scalarDecodeKernel<6>, scalarDecodeKernel<9>, scalarDecodeKernel<12>,
+        scalarDecodeKernel<15>, scalarDecodeKernel<18>, scalarDecodeKernel<21>, scalarDecodeKernel<24>
+    };
+}
+
+SteganographyLib::BitPacker::BitPacker() noexcept
+    : m_state(),
+      m_spans(),
+      m_spanStarts(),
+      m_nextSpan(0),
+      m_spanBase(0),
+      m_currentSpanCount(0),
+      m_skipBits(0),
+      m_encodeKernel(encodeKernels[0]),
+      m_decodeKernel(decodeKernels[0]),
+      m_bitsPerPixel(3),
+      m_profile()
+{
+}
+
+SteganographyLib::PackingKernels SteganographyLib::BitPacker::detectKernels() noexcept
+{
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    // pdep/pext are microcoded and far slower than the scalar kernels on AMD processors before Zen 3
+    if (__builtin_cpu_supports("avx2") &&
+        __builtin_cpu_supports("bmi2") &&
+        !__builtin_cpu_is("znver1") &&
+        !__builtin_cpu_is("znver2"))
+    {
+        return PackingKernels::Avx2;
+    }
+#elif defined(_M_X64)
+    int info[4];
+    __cpuid(info, 1);
+    bool osUsesYmm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+    __cpuidex(info, 7, 0);
+    bool avx2 = (info[1] & (1 << 5)) != 0;
+    bool bmi2 = (info[1] & (1 << 8)) != 0;
+    if (osUsesYmm && avx2 && bmi2)
+    {
+        return PackingKernels::Avx2;
+    }
+#endif
+    return PackingKernels::Scalar;
+}
+
+void SteganographyLib::BitPacker::reset(int bitsPerPixel)
+{
+    // the processor does not change while we run, so detect its features only once
+    static const PackingKernels kernels = detectKernels();
+    reset(bitsPerPixel, kernels);
+}
+
+void SteganographyLib::BitPacker::reset(int bitsPerPixel, PackingKernels kernels)
+{
+    if (bitsPerPixel < 3 ||
+        bitsPerPixel > 24 ||
+        bitsPerPixel % 3 > 0)
+    {
+        throw runtime_error("Invalid value for parameter bitsPerPixel. Must be a value between 3 and 24 and multiple of 3. Aborting operation.");
+    }
+
+    m_bitsPerPixel = bitsPerPixel;
+    m_profile = DensityProfile();
+    m_encodeKernel = encodeKernels[bitsPerPixel / 3 - 1];
+    m_decodeKernel = decodeKernels[bitsPerPixel / 3 - 1];
+
+    // vector kernels exist only for densities 3 and 6, where every bit of the stream is stored
+    if (kernels == PackingKernels::Avx2 &&
+        avx2EncodeKernel(bitsPerPixel) != nullptr)
+    {
+        m_encodeKernel = avx2EncodeKernel(bitsPerPixel);
+        m_decodeKernel = avx2DecodeKernel(bitsPerPixel);
+    }
+
+    resetWalk();
+}
+
+void SteganographyLib::BitPacker::reset(const DensityProfile &profile)
+{
+    if (profile.red > 8 ||
+        profile.green > 8 ||
+        profile.blue > 8 ||
+        profile.empty())
+    {
+        throw runtime_error("Invalid density profile. Each channel stores between 0 and 8 bits, and at least one bit per pixel. Aborting operation.");
+    }
+
+    // a pixel is a channel of the walk, which carries the bits of all three of its color bytes
+    m_bitsPerPixel = profile.bitsPerPixel();
+    m_profile = profile;
+    m_encodeKernel = profileEncodeKernel(profile);
+    m_decodeKernel = profileDecodeKernel(profile);
+    resetWalk();
+}
+
+void SteganographyLib::BitPacker::resetWalk() noexcept
+{
+    m_state = BitPackerState();
+    m_spans.reset();
+    m_spanStarts.reset();
+    m_nextSpan = 0;
+    m_spanBase = 0;
+    m_currentSpanCount = 0;
+    m_skipBits = 0;
+}
+
+void SteganographyLib::BitPacker::setChannels(const std::vector<ChannelSpan> &spans, std::ptrdiff_t channelStep)
+{
+    setWalk(spans);
+    m_state.channelStep = channelStep;
+    m_nextSpan = 0;
+    m_spanBase = 0;
+    m_currentSpanCount = 0;
+    m_state.channel = nullptr;
+    m_state.channelCount = 0;
+    nextSpan();
+}
+
+void SteganographyLib::BitPacker::setPixels(std::uint8_t *pixels, std::size_t pixelCount)
+{
+    if (pixelCount == 0)
+    {
+        setChannels({});
+        return;
+    }
+    if (!m_profile.empty())
+    {
+        setChannels({{pixels, pixelCount, 3}}, 1);
+        return;
+    }
+
+    setChannels({
+        {pixels, 3, 1},
+        {pixels + 3, pixelCount - 1, 3}
+    });
+}
+
+void SteganographyLib::BitPacker::setBgrRows(std::uint8_t *topRow, std::size_t width, std::size_t height, std::ptrdiff_t rowStep, std::size_t pixelSize)
+{
+    vector<ChannelSpan> spans;
+    if (!m_profile.empty())
+    {
+        // every pixel from its R byte, the third byte, back to its B byte
+        spans.reserve(height);
+        for (size_t y = 0; y < height && width > 0; y++)
+        {
+            spans.push_back({topRow + static_cast<ptrdiff_t>(y) * rowStep + 2, width, static_cast<ptrdiff_t>(pixelSize)});
+        }
+    }
+    else if (width > 0 && height > 0)
+    {
+        // R, G, B of the first pixel are stored backwards, then R is the third byte of each pixel
+        ptrdiff_t stride = static_cast<ptrdiff_t>(pixelSize);
+        spans.reserve(height + 1);
+        spans.push_back({topRow + 2, 3, -1});
+        spans.push_back({topRow + stride + 2, width - 1, stride});
+        for (size_t y = 1; y < height; y++)
+        {
+            spans.push_back({topRow + static_cast<ptrdiff_t>(y) * rowStep + 2, width, stride});
+        }
+    }
+
+    setChannels(spans, -1);
+}
+
+void SteganographyLib::BitPacker::appendChannels(const std::vector<ChannelSpan> &spans)
+{
+    vector<ChannelSpan> walk;
+    if (m_spans)
+    {
+        walk = *m_spans;
+    }
+    walk.insert(walk.end(), spans.begin(), spans.end());
+    // a walk that had run out continues in the new spans on the next encode or decode
+    setWalk(move(walk));
+}
+
+void SteganographyLib::BitPacker::setWalk(std::vector<ChannelSpan> spans)
+{
+    // the position of every span in the walk, for seek() to find a channel byte by bisection
+    vector<size_t> starts;
+    starts.reserve(spans.size() + 1);
+    size_t position = 0;
+    for (const ChannelSpan &span : spans)
+    {
+        starts.push_back(position);
+        position += span.count;
+    }
+    starts.push_back(position);
+    m_spans = make_shared<const vector<ChannelSpan>>(move(spans));
+    m_spanStarts = make_shared<const vector<size_t>>(move(starts));
+}
+
+void SteganographyLib::BitPacker::seek(std::uint64_t bitPosition) noexcept
+{
+    uint64_t channelIndex = bitPosition / m_bitsPerPixel;
+    m_state.bits = 0;
+    m_state.bitCount = 0;
+    m_state.channel = nullptr;
+    m_state.channelCount = 0;
+    m_skipBits = static_cast<unsigned int>(bitPosition % m_bitsPerPixel);
+    m_nextSpan = 0;
+    m_spanBase = 0;
+    m_currentSpanCount = 0;
+    if (!m_spans)
+    {
+        return;
+    }
+
+    // the last span that starts at or before the channel byte holds it, unless the walk is shorter.
+    // Empty spans start where the following span does, so they are never the last one
+    const vector<size_t> &starts = *m_spanStarts;
+    size_t index = static_cast<size_t>(upper_bound(starts.begin(), starts.end() - 1, channelIndex) - starts.begin());
+    if (index > 0 && channelIndex < starts.back())
+    {
+        m_nextSpan = index - 1;
+        m_spanBase = starts[index - 1];
+        nextSpan();
+        size_t offset = static_cast<size_t>(channelIndex - m_spanBase);
+        m_state.channel += static_cast<ptrdiff_t>(offset) * m_state.stride;
+        m_state.channelCount -= offset;
+        return;
+    }
+
+    // past the last channel byte
+    m_nextSpan = m_spans->size();
+    m_spanBase = starts.back();
+}
+
+void SteganographyLib::BitPacker::applySkipBits(bool encoding) noexcept
+{
+    if (m_state.channelCount == 0 && !nextSpan())
+    {
+        return;
+    }
+
+    unsigned int storedBits = m_profile.empty() ? min<unsigned int>(m_bitsPerPixel, 8) : m_bitsPerPixel;
+    uint64_t channelBits = loadChannel();
+    if (encoding)
+    {
+        // start with the bits already in the channel byte, the kernel writes them back unchanged
+        m_state.bits = channelBits & ((1ull << min(m_skipBits, storedBits)) - 1);
+        m_state.bitCount = m_skipBits;
+    }
+    else
+    {
+        // consume the channel byte, keeping only the bits after the position
+        m_state.bits = m_skipBits < storedBits ? channelBits >> m_skipBits : 0;
+        m_state.bitCount = m_bitsPerPixel - m_skipBits;
+        m_state.channel += m_state.stride;
+        m_state.channelCount--;
+    }
+    m_skipBits = 0;
+}
+
+std::size_t SteganographyLib::BitPacker::encode(const std::uint8_t *data, std::size_t length)
+{
+    if (m_skipBits > 0)
+    {
+        applySkipBits(true);
+    }
+
+    size_t consumed = 0;
+    for (;;)
+    {
+        consumed += m_encodeKernel(m_state, data + consumed, length - consumed);
+
+        // channel bytes remain only when all the input has been consumed and no full group of bits is pending
+        if (m_state.channelCount > 0 || !nextSpan())
+        {
+            return consumed;
+        }
+    }
+}
+
+std::size_t SteganographyLib::BitPacker::decode(std::uint8_t *data, std::size_t length)
+{
+    if (m_skipBits > 0)
+    {
+        applySkipBits(false);
+    }
+
+    size_t produced = 0;
+    for (;;)
+    {
+        produced += m_decodeKernel(m_state, data + produced, length - produced);
+
+        if (produced == length || !nextSpan())
+        {
+            return produced;
+        }
+    }
+}
+
+bool SteganographyLib::BitPacker::flush()
+{
+    if (m_state.bitCount == 0)
+    {
+        return true;
+    }
+
+    // drain any full groups of bits that are still waiting for a span
+    encode(nullptr, 0);
+    if (m_state.bitCount == 0)
+    {
+        return true;
+    }
+
+    if (m_state.channelCount == 0)
+    {
+        return false;
+    }
+
+    // the bits that did not make it into the channel byte keep their original value
+    storeChannel(m_state.bits, m_state.bitCount);
+    m_state.channel += m_state.stride;
+    m_state.channelCount--;
+    m_state.bits = 0;
+    m_state.bitCount = 0;
+    return true;
+}
+
+void SteganographyLib::BitPacker::storeChannel(std::uint64_t bits, unsigned int bitCount) noexcept
+{
+    if (m_profile.empty())
+    {
+        unsigned int storedBits = min<unsigned int>({bitCount, static_cast<unsigned int>(m_bitsPerPixel), 8});
+        uint8_t mask = static_cast<uint8_t>((1u << storedBits) - 1);
+        *m_state.channel = static_cast<uint8_t>((*m_state.channel & ~mask) | (bits & mask));
+        return;
+    }
+
+    // the R, G and B bytes of the pixel in turn, until the bits run out
+    const unsigned int channelBits[] = {m_profile.red, m_profile.green, m_profile.blue};
+    uint8_t *channel = m_state.channel;
+    for (unsigned int storedBits : channelBits)
+    {
+        storedBits = min(storedBits, bitCount);
+        uint8_t mask = static_cast<uint8_t>((1u << storedBits) - 1);
+        *channel = static_cast<uint8_t>((*channel & ~mask) | (bits & mask));
+        bits >>= storedBits;
+        bitCount -= storedBits;
+        channel += m_state.channelStep;
+    }
+}
+
+std::uint64_t SteganographyLib::BitPacker::loadChannel() const noexcept
+{
+    if (m_profile.empty())
+    {
+        return *m_state.channel & ((1u << min(m_bitsPerPixel, 8)) - 1);
+    }
+
+    const unsigned int channelBits[] = {m_profile.red, m_profile.green, m_profile.blue};
+    const uint8_t *channel = m_state.channel;
+    uint64_t bits = 0;
+    unsigned int bitCount = 0;
+    for (unsigned int storedBits : channelBits)
+    {
+        bits |= static_cast<uint64_t>(*channel & ((1u << storedBits) - 1)) << bitCount;
+        bitCount += storedBits;
+        channel += m_state.channelStep;
+    }
+    return bits;
+}
+
+std::uint8_t *SteganographyLib::BitPacker::channel() const noexcept
+{
+    if (m_state.channelCount > 0)
+    {
+        return m_state.channel;
+    }
+
+    return m_spans && m_nextSpan < m_spans->size() ? (*m_spans)[m_nextSpan].first : nullptr;
+}
+
+std::size_t SteganographyLib::BitPacker::channelPosition() const noexcept
+{
+    return m_spanBase + m_currentSpanCount - m_state.channelCount;
+}
+
+std::size_t SteganographyLib::BitPacker::copyChannels(std::uint8_t *destination, std::size_t count) const noexcept
+{
+    size_t copied = 0;
+    for (size_t i = 0; m_spans && i < m_spans->size() && copied < count; i++)
+    {
+        const ChannelSpan &span = (*m_spans)[i];
+        const uint8_t *channel = span.first;
+        for (size_t j = 0; j < span.count && copied < count; j++, channel += span.stride)
+        {
+            for (size_t k = 0; k < channelWidth(); k++)
+            {
+                *destination++ = channel[static_cast<ptrdiff_t>(k) * m_state.channelStep];
+            }
+            copied++;
+        }
+    }
+    return copied;
+}
+
+std::size_t SteganographyLib::BitPacker::countChangedChannels(const std::uint8_t *original, std::size_t count) const noexcept
+{
+    size_t compared = 0;
+    size_t changed = 0;
+    for (size_t i = 0; m_spans && i < m_spans->size() && compared < count; i++)
+    {
+        const ChannelSpan &span = (*m_spans)[i];
+        const uint8_t *channel = span.first;
+        for (size_t j = 0; j < span.count && compared < count; j++, channel += span.stride)
+        {
+            for (size_t k = 0; k < channelWidth(); k++)
+            {
+                changed += channel[static_cast<ptrdiff_t>(k) * m_state.channelStep] != *original++;
+            }
+            compared++;
+        }
+    }
+    return changed;
+}
+
+bool SteganographyLib::BitPacker::nextSpan() noexcept
+{
+    m_spanBase += m_currentSpanCount;
+    m_currentSpanCount = 0;
+    while (m_spans && m_nextSpan < m_spans->size())
+    {
+        const ChannelSpan &span = (*m_spans)[m_nextSpan++];
+        if (span.count > 0)
+        {
+            m_currentSpanCount = span.count;
+            m_state.channel = span.first;
+            m_state.channelCount = span.count;
+            m_state.stride = span.stride;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstdint> // std::*int*_t
+#include <cstddef> // std::size_t, std::ptrdiff_t
+#include <vector>  // std::vector
+#include <memory>  // std::shared_ptr
+
+namespace SteganographyLib
+{
+    /// @brief A run of 'count' channel bytes, each 'stride' bytes after the previous one.
+    struct ChannelSpan
+    {
+        std::uint8_t *first;
+        std::size_t count;
+        std::ptrdiff_t stride;
+    };
+
+    /// @brief Bits stored in each color channel of a pixel, from 0 (the channel is left untouched) to 8.
+    struct DensityProfile
+    {
+        std::uint8_t red = 0;
+        std::uint8_t green = 0;
+        std::uint8_t blue = 0;
+
+        /// @brief Returns the number of bits stored in each pixel.
+        constexpr int bitsPerPixel() const noexcept { return red + green + blue; }
+
+        /// @brief Returns true for the default profile, which selects the uniform densities.
+        constexpr bool empty() const noexcept { return bitsPerPixel() == 0; }
+    };
+
+    /// @brief Streaming state shared by the packing kernels.
+    struct BitPackerState
+    {
+        std::uint64_t bits = 0;          // pending stream bits, least significant bit first
+        unsigned int bitCount = 0;       // number of valid bits held in 'bits'
+        std::uint8_t *channel = nullptr; // next channel byte to be written or read
+        std::size_t channelCount = 0;    // channel bytes left in the current span
+        std::ptrdiff_t stride = 1;       // distance between channel bytes of the current span
+        std::ptrdiff_t channelStep = 1;  // with a density profile, distance from the R byte of a pixel to its G byte and from G to B
+    };
+
+    /// @brief Kernel that packs data bytes into channel bytes. Returns the number of data bytes consumed.
+    typedef std::size_t (*EncodeKernel)(BitPackerState &state, const std::uint8_t *data, std::size_t length);
+
+    /// @brief Kernel that unpacks data bytes from channel bytes. Returns the number of data bytes produced.
+    typedef std::size_t (*DecodeKernel)(BitPackerState &state, std::uint8_t *data, std::size_t length);
+
+    /// @brief Instruction sets the packing kernels are built for.
+    enum class PackingKernels
+    {
+        Scalar, // portable 64-bit kernels
+        Avx2    // AVX2 vector blends with BMI2 pdep/pext bit spreading
+    };
+
+    /// @brief Packs a stream of data bytes into the least significant bits of a sequence of channel bytes and unpacks them again.
+    /// Data bits are consumed from least significant to most significant bit, and each channel byte carries 'bitsPerPixel'
+    /// consecutive bits of the stream starting at its least significant bit.  Only 8 bits fit in a channel byte, so for
+    /// densities above 8 the remaining bits of each group are skipped, exactly as the original per-bit encoder did.
+    /// The kernels are specialized at compile time for every legal density and selected once in reset(), using
+    /// vector kernels when the processor supports them.
+    /// With a density profile, every pixel is a channel of the walk instead, whose R, G and B bytes carry the stream
+    /// bits in that order, as many in each as the profile gives.  A kernel is specialized for each of the 728 profiles.
+    /// A single instance is used either for encoding or for decoding, not both.  Copies share the channel spans, so a
+    /// configured packer can be copied and seeked cheaply to work on separate parts of the stream in parallel.
+    class BitPacker
+    {
+        public:
+            /// @brief Constructor
+            BitPacker() noexcept;
+
+            /// @brief Selects the kernels for a density, clears any pending bits and forgets the channel spans.
+            /// @param bitsPerPixel Must be a multiple of 3 between 3 and 24.
+            void reset(int bitsPerPixel);
+
+            /// @brief Selects the kernels for a density from a specific instruction set.
+            /// Falls back to the scalar kernels for densities that have no vector kernel.
+            /// @param kernels Must be supported by the processor, see detectKernels().
+            void reset(int bitsPerPixel, PackingKernels kernels);
+
+            /// @brief Selects the kernels for a density profile, clears any pending bits and forgets the channel spans.
+            /// The walks set afterwards go through whole pixels, see setPixels() and setBgrRows().
+            /// @param profile Up to 8 bits in each channel, and at least one bit per pixel.
+            void reset(const DensityProfile &profile);
+
+            /// @brief Returns the fastest instruction set supported by the processor.
+            static PackingKernels detectKernels() noexcept;
+
+            /// @brief Sets the channel bytes that subsequent encode/decode calls will walk through, span after span.
+            /// Pending bits are kept, so a stream can continue in a new set of spans.  With a density profile, each channel
+            /// of a span is the R byte of a pixel.
+            /// @param channelStep With a density profile, distance from the R byte of a pixel to its G byte and from G to B:
+            /// 1 for RGB pixels, -1 for BGR pixels.
+            void setChannels(const std::vector<ChannelSpan> &spans, std::ptrdiff_t channelStep = 1);
+
+            /// @brief Sets the channel bytes of a contiguous array of 3 byte pixels, walked in the order of the
+            /// steganography format: the R, G and B bytes of the first pixel, then the R byte of every following pixel.
+            /// With a density profile, every pixel in turn.
+            void setPixels(std::uint8_t *pixels, std::size_t pixelCount);
+
+            /// @brief Sets the channel bytes of an image stored as rows of 3 byte BGR or 4 byte BGRA pixels, such as the
+            /// pixel array of a .bmp file, walked in the same order as setPixels() starting from the top left pixel.
+            /// @param topRow BGR bytes of the top row of the image.
+            /// @param rowStep Distance in bytes from a row to the row below it, negative for bottom-up images.
+            /// @param pixelSize 3 for BGR pixels, 4 for BGRA pixels.
+            void setBgrRows(std::uint8_t *topRow, std::size_t width, std::size_t height, std::ptrdiff_t rowStep, std::size_t pixelSize = 3);
+
+            /// @brief Adds channel bytes at the end of the walk, such as the alpha channel of an image.
+            /// The position in the walk is kept.
+            void appendChannels(const std::vector<ChannelSpan> &spans);
+
+            /// @brief Moves to a bit of the stream, counted from the first bit of the first channel byte.
+            /// Pending bits are discarded.  The next encode keeps the bits of the channel byte that precede the
+            /// position, and the next decode starts after them, so a stream can be resumed in the middle of a channel.
+            void seek(std::uint64_t bitPosition) noexcept;
+
+            /// @brief Packs up to 'length' bytes into the channel bytes.
+            /// @return Number of bytes consumed, less than 'length' only when the channel bytes run out.
+            std::size_t encode(const std::uint8_t *data, std::size_t length);
+
+            /// @brief Unpacks up to 'length' bytes from the channel bytes.
+            /// @return Number of bytes produced, less than 'length' only when the channel bytes run out.
+            std::size_t decode(std::uint8_t *data, std::size_t length);
+
+            /// @brief Writes the pending bits of a partially filled channel byte, leaving its remaining bits untouched.
+            /// @return false if there were pending bits but no channel byte left to hold them.
+            bool flush();
+
+            /// @brief Returns the next channel byte that will be written or read, or nullptr when none are left.
+            std::uint8_t *channel() const noexcept;
+
+            /// @brief Returns the position in the channel walk of the next channel byte, which is also the number of
+            /// channel bytes written or read so far.
+            std::size_t channelPosition() const noexcept;
+
+            /// @brief Copies the bytes of the first 'count' channels of the walk, in walk order.
+            /// @return Number of bytes copied, less than 'count' when the walk is shorter.
+            std::size_t copyChannels(std::uint8_t *destination, std::size_t count) const noexcept;
+
+            /// @brief Returns how many bytes of the first 'count' channels of the walk differ from 'original', a copy made by copyChannels().
+            std::size_t countChangedChannels(const std::uint8_t *original, std::size_t count) const noexcept;
+
+            /// @brief Returns the density selected in reset(), the bits of a channel of the walk.
+            int bitsPerPixel() const noexcept { return m_bitsPerPixel; }
+
+            /// @brief Returns the profile selected in reset(), empty for a uniform density.
+            const DensityProfile &profile() const noexcept { return m_profile; }
+
+            /// @brief Returns the number of bytes of a channel of the walk: 3 with a density profile, 1 otherwise.
+            /// copyChannels() and countChangedChannels() work on that many bytes per channel.
+            std::size_t channelWidth() const noexcept { return m_profile.empty() ? 1 : 3; }
+
+        private:
+            bool nextSpan() noexcept;
+            void applySkipBits(bool encoding) noexcept;
+            void storeChannel(std::uint64_t bits, unsigned int bitCount) noexcept;
+            std::uint64_t loadChannel() const noexcept;
+            void resetWalk() noexcept;
+            void setWalk(std::vector<ChannelSpan> spans);
+
+            BitPackerState m_state;
+            std::shared_ptr<const std::vector<ChannelSpan>> m_spans;
+            std::shared_ptr<const std::vector<std::size_t>> m_spanStarts; // channel bytes before each span, then in all of them
+            std::size_t m_nextSpan;
+            std::size_t m_spanBase;      // channel bytes in the spans before the current one
+            std::size_t m_currentSpanCount;
+            unsigned int m_skipBits;     // bits of the current channel byte that precede a seek position
+            EncodeKernel m_encodeKernel;
+            DecodeKernel m_decodeKernel;
+            int m_bitsPerPixel;
+            DensityProfile m_profile;
+    };
+}
@@ -0,0 +1,272 @@
+#include "bitpacker_kernels.h"
+
+using namespace std;
+using namespace SteganographyLib;
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+#include <array>       // std::array
+#include <immintrin.h> // AVX2 and BMI2 intrinsics
+
+// The kernels below are compiled for AVX2 and BMI2 through function attributes rather than compiler flags,
+// so that nothing else in the library can pick up these instructions.  They are only selected by
+// BitPacker::reset() after the processor has been checked for support.
+#if defined(__GNUC__) || defined(__clang__)
+#define AVX2_TARGET __attribute__((target("avx2,bmi2")))
+#else
+#define AVX2_TARGET
+#endif
+
+namespace
+{
+    // Every iteration handles 32 channel bytes.  Their values are spread from (or gathered into) the stream
+    // with pdep/pext, 8 channels per 64-bit word, and the channel bytes are gathered from the pixels with
+    // byte shuffles.  When the channels are 3 bytes apart (the R byte of consecutive pixels) the 32 channels
+    // cover 96 pixel bytes, i.e. 3 vectors, and when they are 4 bytes apart (BGRA pixels) they cover 128 bytes,
+    // one 32-bit lane per channel.
+    // The bytes in between belong to the other walks of the pixels, which segments of a parallel embed may be
+    // writing at the same time, so spread channels are stored one byte at a time rather than as whole vectors.
+    constexpr size_t blockChannels = 32;
+
+    // Shuffle that moves byte 3c of the 96 byte block to byte c % 16 of its lane, so that OR-ing the
+    // lanes together as described above produces channels 0-15 and 16-31.
+    constexpr array<uint8_t, 96> gatherShuffle()
+    {
+        array<uint8_t, 96> shuffle{};
+        for (size_t i = 0; i < shuffle.size(); i++)
+        {
+            shuffle[i] = 0x80;
+        }
+        for (size_t c = 0; c < blockChannels; c++)
+        {
+            size_t lane = (3 * c) / 16;
+            shuffle[lane * 16 + c % 16] = static_cast<uint8_t>((3 * c) % 16);
+        }
+        return shuffle;
+    }
+
+    constexpr array<uint8_t, 96> gatherIndex = gatherShuffle();
+
+    AVX2_TARGET inline __m256i load(const uint8_t *p)
+    {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    }
+
+    AVX2_TARGET inline void store(uint8_t *p, __m256i value)
+    {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), value);
+    }
+
+    // the 32 channels of a block, in channel order
+    template <size_t Stride>
+    AVX2_TARGET inline __m256i gather(const uint8_t *channel)
+    {
+        if (Stride == 4)
+        {
+            // byte 0 of every 32-bit lane, narrowed back to bytes and put in channel order
+            __m256i low = _mm256_set1_epi32(0xFF);
+            __m256i v0 = _mm256_and_si256(load(channel), low);
+            __m256i v1 = _mm256_and_si256(load(channel + 32), low);
+            __m256i v2 = _mm256_and_si256(load(channel + 64), low);
+            __m256i v3 = _mm256_and_si256(load(channel + 96), low);
+            __m256i packed = _mm256_packus_epi16(_mm256_packus_epi32(v0, v1), _mm256_packus_epi32(v2, v3));
+            return _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+        }
+        __m256i t0 = _mm256_shuffle_epi8(load(channel), load(gatherIndex.data()));
+        __m256i t1 = _mm256_shuffle_epi8(load(channel + 32), load(gatherIndex.data() + 32));
+        __m256i t2 = _mm256_shuffle_epi8(load(channel + 64), load(gatherIndex.data() + 64));
+        return _mm256_or_si256(t1, _mm256_or_si256(_mm256_permute2x128_si256(t0, t2, 0x21),
+                                                   _mm256_permute2x128_si256(t0, t2, 0x30)));
+    }
+
+    // writes the 32 channels of a block and nothing in between
+    template <size_t Stride>
+    AVX2_TARGET inline void scatter(uint8_t *channel, __m256i values)
+    {
+        alignas(32) uint8_t bytes[blockChannels];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(bytes), values);
+        for (size_t i = 0; i < blockChannels; i++)
+        {
+            channel[Stride * i] = bytes[i];
+        }
+    }
+
+    template <unsigned int K>
+    AVX2_TARGET size_t avx2Encode(BitPackerState &state, const uint8_t *data, size_t length)
+    {
+        constexpr uint8_t channelMask = static_cast<uint8_t>(storedChannelMask<K>());
+        constexpr uint64_t depositMask = 0x0101010101010101ull * channelMask;
+        constexpr unsigned int groupBits = 8 * K;
+
+        const uint8_t *in = data;
+        const uint8_t *inEnd = data + length;
+
+        if (state.stride == 1 || state.stride == 3 || state.stride == 4)
+        {
+            uint64_t bits = state.bits;
+            unsigned int count = state.bitCount;
+            uint8_t *channel = state.channel;
+            size_t channelCount = state.channelCount;
+
+            // an iteration refills at most 4 times, reading 8 bytes and advancing at most 8 bytes each time,
+            // and the channel after the block must exist so that the loads of the block stay inside the pixels
+            while (channelCount > blockChannels && inEnd - in >= 40)
+            {
+                uint64_t groups[4];
+                for (auto &group : groups)
+                {
+                    if (count < groupBits)
+                    {
+                        uint64_t word;
+                        memcpy(&word, in, sizeof(word));
+                        unsigned int take = (64 - count) / 8;
+                        bits |= (take == 8 ? word : word & ((1ull << (take * 8)) - 1)) << count;
+                        count += take * 8;
+                        in += take;
+                    }
+                    group = _pdep_u64(bits, depositMask);
+                    bits >>= groupBits;
+                    count -= groupBits;
+                }
+
+                __m256i values = _mm256_set_epi64x(groups[3], groups[2], groups[1], groups[0]);
+                __m256i mask = _mm256_set1_epi8(static_cast<char>(channelMask));
+                if (state.stride == 1)
+                {
+                    store(channel, _mm256_or_si256(_mm256_andnot_si256(mask, load(channel)), values));
+                    channel += blockChannels;
+                }
+                else if (state.stride == 4)
+                {
+                    scatter<4>(channel, _mm256_or_si256(_mm256_andnot_si256(mask, gather<4>(channel)), values));
+                    channel += 4 * blockChannels;
+                }
+                else
+                {
+                    scatter<3>(channel, _mm256_or_si256(_mm256_andnot_si256(mask, gather<3>(channel)), values));
+                    channel += 3 * blockChannels;
+                }
+                channelCount -= blockChannels;
+            }
+
+            state.bits = bits;
+            state.bitCount = count;
+            state.channel = channel;
+            state.channelCount = channelCount;
+        }
+
+        // the scalar kernel finishes the tail of the data and any other span layout
+        size_t consumed = in - data;
+        return consumed + scalarEncodeKernel<K>(state, in, length - consumed);
+    }
+
+    template <unsigned int K>
+    AVX2_TARGET size_t avx2Decode(BitPackerState &state, uint8_t *data, size_t length)
+    {
+        constexpr uint8_t channelMask = static_cast<uint8_t>(storedChannelMask<K>());
+        constexpr uint64_t depositMask = 0x0101010101010101ull * channelMask;
+        constexpr unsigned int groupBits = 8 * K;
+
+        uint8_t *out = data;
+        uint8_t *outEnd = data + length;
+
+        if (state.stride == 1 || state.stride == 3 || state.stride == 4)
+        {
+            uint64_t bits = state.bits;
+            unsigned int count = state.bitCount;
+            const uint8_t *channel = state.channel;
+            size_t channelCount = state.channelCount;
+
+            while (count >= 8 && out != outEnd)
+            {
+                *out++ = static_cast<uint8_t>(bits);
+                bits >>= 8;
+                count -= 8;
+            }
+
+            // the output must need all 32 channels of the block, and have room for the 8 byte stores
+            while (channelCount > blockChannels && outEnd - out >= static_cast<ptrdiff_t>(4 * K + 16))
+            {
+                __m256i values;
+                if (state.stride == 1)
+                {
+                    values = load(channel);
+                    channel += blockChannels;
+                }
+                else if (state.stride == 4)
+                {
+                    values = gather<4>(channel);
+                    channel += 4 * blockChannels;
+                }
+                else
+                {
+                    values = gather<3>(channel);
+                    channel += 3 * blockChannels;
+                }
+                channelCount -= blockChannels;
+
+                alignas(32) uint64_t groups[4];
+                _mm256_store_si256(reinterpret_cast<__m256i *>(groups), values);
+                for (auto group : groups)
+                {
+                    bits |= _pext_u64(group, depositMask) << count;
+                    count += groupBits;
+                    memcpy(out, &bits, sizeof(bits));
+                    unsigned int bytes = count / 8;
+                    out += bytes;
+                    bits >>= bytes * 8;
+                    count -= bytes * 8;
+                }
+            }
+
+            state.bits = bits;
+            state.bitCount = count;
+            state.channel = const_cast<uint8_t *>(channel);
+            state.channelCount = channelCount;
+        }
+
+        size_t produced = out - data;
+        return produced + scalarDecodeKernel<K>(state, out, length - produced);
+    }
+}
+
+EncodeKernel SteganographyLib::avx2EncodeKernel(int bitsPerPixel) noexcept
+{
+    switch (bitsPerPixel)
+    {
+        case 3:
+            return avx2Encode<3>;
+        case 6:
+            return avx2Encode<6>;
+        default:
+            return nullptr;
+    }
+}
+
+DecodeKernel SteganographyLib::avx2DecodeKernel(int bitsPerPixel) noexcept
+{
+    switch (bitsPerPixel)
+    {
+        case 3:
+            return avx2Decode<3>;
+        case 6:
+            return avx2Decode<6>;
+        default:
+            return nullptr;
+    }
+}
+
+#else
+
+// No vector kernels on other architectures, BitPacker keeps the scalar kernels.
+EncodeKernel SteganographyLib::avx2EncodeKernel(int) noexcept
+{
+    return nullptr;
+}
+
+DecodeKernel SteganographyLib::avx2DecodeKernel(int) noexcept
+{
+    return nullptr;
+}
+
+#endif
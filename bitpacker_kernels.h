@@ -0,0 +1,308 @@
+#pragma once
+
+// Packing kernels shared by the BitPacker translation units.  Not part of the public interface.
+
+#include <cstdint>   // std::*int*_t
+#include <cstddef>   // std::size_t, std::ptrdiff_t
+#include <cstring>   // std::memcpy
+#include <algorithm> // std::min
+#include "bitpacker.h"
+
+namespace SteganographyLib
+{
+    /// @brief Bits of each channel byte that carry data at density 'K'.
+    template <unsigned int K>
+    constexpr std::uint64_t storedChannelMask()
+    {
+        return K < 8 ? (1u << K) - 1 : 0xFF;
+    }
+
+    /// @brief Packs the stream into channel bytes 'K' bits at a time.
+    /// Whole data bytes are shifted into a 64-bit buffer (8 at a time when available) and each channel byte
+    /// then receives its bits with a single masked write.
+    template <unsigned int K>
+    std::size_t scalarEncodeKernel(BitPackerState &state, const std::uint8_t *data, std::size_t length)
+    {
+        constexpr std::uint64_t channelMask = storedChannelMask<K>();
+
+        const std::uint8_t *in = data;
+        const std::uint8_t *inEnd = data + length;
+        std::uint64_t bits = state.bits;
+        unsigned int count = state.bitCount;
+        std::uint8_t *channel = state.channel;
+        std::size_t channelCount = state.channelCount;
+        const std::ptrdiff_t stride = state.stride;
+
+        for (;;)
+        {
+            while (count >= K && channelCount > 0)
+            {
+                *channel = static_cast<std::uint8_t>((*channel & ~channelMask) | (bits & channelMask));
+                channel += stride;
+                channelCount--;
+                bits >>= K;
+                count -= K;
+            }
+
+            if (count >= K)
+            {
+                break; // span is full, keep the pending bits for the next span
+            }
+
+            if (inEnd - in >= 8)
+            {
+                std::uint64_t word;
+                std::memcpy(&word, in, sizeof(word));
+                unsigned int take = (64 - count) / 8;
+                if (take == 8)
+                {
+                    bits = word;
+                }
+                else
+                {
+                    bits |= (word & ((1ull << (take * 8)) - 1)) << count;
+                }
+                count += take * 8;
+                in += take;
+            }
+            else if (in != inEnd)
+            {
+                bits |= static_cast<std::uint64_t>(*in++) << count;
+                count += 8;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        state.bits = bits;
+        state.bitCount = count;
+        state.channel = channel;
+        state.channelCount = channelCount;
+        return in - data;
+    }
+
+    /// @brief Unpacks the stream from channel bytes 'K' bits at a time.
+    /// Only the channel bytes needed for the requested output are read, so a decode never looks past its data.
+    template <unsigned int K>
+    std::size_t scalarDecodeKernel(BitPackerState &state, std::uint8_t *data, std::size_t length)
+    {
+        constexpr std::uint64_t channelMask = storedChannelMask<K>();
+
+        std::uint8_t *out = data;
+        std::uint8_t *outEnd = data + length;
+        std::uint64_t bits = state.bits;
+        unsigned int count = state.bitCount;
+        const std::uint8_t *channel = state.channel;
+        std::size_t channelCount = state.channelCount;
+        const std::ptrdiff_t stride = state.stride;
+
+        while (out != outEnd)
+        {
+            while (count >= 8 && out != outEnd)
+            {
+                *out++ = static_cast<std::uint8_t>(bits);
+                bits >>= 8;
+                count -= 8;
+            }
+
+            if (out == outEnd)
+            {
+                break;
+            }
+
+            std::size_t neededChannels = (static_cast<std::size_t>(outEnd - out) * 8 - count + K - 1) / K;
+            std::size_t channels = std::min<std::size_t>({(64 - count) / K, neededChannels, channelCount});
+            if (channels == 0)
+            {
+                break; // span is exhausted
+            }
+
+            for (std::size_t i = 0; i < channels; i++)
+            {
+                bits |= (*channel & channelMask) << count;
+                channel += stride;
+                count += K;
+            }
+            channelCount -= channels;
+        }
+
+        state.bits = bits;
+        state.bitCount = count;
+        state.channel = const_cast<std::uint8_t *>(channel);
+        state.channelCount = channelCount;
+        return out - data;
+    }
+
+    /// @brief Bits of a channel byte that carry data when it stores 'N' bits.
+    template <unsigned int N>
+    constexpr std::uint8_t profileChannelMask()
+    {
+        return static_cast<std::uint8_t>(N < 8 ? (1u << N) - 1 : 0xFF);
+    }
+
+    /// @brief Writes the first 'N' bits of 'bits' to a channel byte, nothing at all for a skipped channel.
+    template <unsigned int N>
+    inline void storeProfileChannel(std::uint8_t *channel, std::uint64_t bits)
+    {
+        if constexpr (N > 0)
+        {
+            constexpr std::uint8_t mask = profileChannelMask<N>();
+            *channel = static_cast<std::uint8_t>((*channel & ~mask) | (bits & mask));
+        }
+    }
+
+    /// @brief Reads the 'N' bits a channel byte carries, without reading a skipped channel at all.
+    template <unsigned int N>
+    inline std::uint64_t loadProfileChannel(const std::uint8_t *channel)
+    {
+        if constexpr (N > 0)
+        {
+            return *channel & profileChannelMask<N>();
+        }
+        return 0;
+    }
+
+    /// @brief Packs the stream into whole pixels, 'R', 'G' and 'B' bits into their R, G and B bytes.
+    /// The same 64-bit buffering as scalarEncodeKernel, with the masks and shifts of every channel known at compile time.
+    template <unsigned int R, unsigned int G, unsigned int B>
+    std::size_t profileEncodeKernel(BitPackerState &state, const std::uint8_t *data, std::size_t length)
+    {
+        constexpr unsigned int K = R + G + B;
+        if constexpr (K == 0)
+        {
+            return 0;
+        }
+
+        const std::uint8_t *in = data;
+        const std::uint8_t *inEnd = data + length;
+        std::uint64_t bits = state.bits;
+        unsigned int count = state.bitCount;
+        std::uint8_t *pixel = state.channel;
+        std::size_t pixelCount = state.channelCount;
+        const std::ptrdiff_t stride = state.stride;
+        const std::ptrdiff_t step = state.channelStep;
+
+        for (;;)
+        {
+            while (count >= K && pixelCount > 0)
+            {
+                storeProfileChannel<R>(pixel, bits);
+                storeProfileChannel<G>(pixel + step, bits >> R);
+                storeProfileChannel<B>(pixel + 2 * step, bits >> (R + G));
+                pixel += stride;
+                pixelCount--;
+                bits >>= K;
+                count -= K;
+            }
+
+            if (count >= K)
+            {
+                break; // span is full, keep the pending bits for the next span
+            }
+
+            if (inEnd - in >= 8)
+            {
+                std::uint64_t word;
+                std::memcpy(&word, in, sizeof(word));
+                unsigned int take = (64 - count) / 8;
+                if (take == 8)
+                {
+                    bits = word;
+                }
+                else
+                {
+                    bits |= (word & ((1ull << (take * 8)) - 1)) << count;
+                }
+                count += take * 8;
+                in += take;
+            }
+            else if (in != inEnd)
+            {
+                bits |= static_cast<std::uint64_t>(*in++) << count;
+                count += 8;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        state.bits = bits;
+        state.bitCount = count;
+        state.channel = pixel;
+        state.channelCount = pixelCount;
+        return in - data;
+    }
+
+    /// @brief Unpacks the stream from whole pixels, see profileEncodeKernel.
+    template <unsigned int R, unsigned int G, unsigned int B>
+    std::size_t profileDecodeKernel(BitPackerState &state, std::uint8_t *data, std::size_t length)
+    {
+        constexpr unsigned int K = R + G + B;
+        if constexpr (K == 0)
+        {
+            return 0;
+        }
+
+        std::uint8_t *out = data;
+        std::uint8_t *outEnd = data + length;
+        std::uint64_t bits = state.bits;
+        unsigned int count = state.bitCount;
+        const std::uint8_t *pixel = state.channel;
+        std::size_t pixelCount = state.channelCount;
+        const std::ptrdiff_t stride = state.stride;
+        const std::ptrdiff_t step = state.channelStep;
+
+        while (out != outEnd)
+        {
+            while (count >= 8 && out != outEnd)
+            {
+                *out++ = static_cast<std::uint8_t>(bits);
+                bits >>= 8;
+                count -= 8;
+            }
+
+            if (out == outEnd)
+            {
+                break;
+            }
+
+            std::size_t neededPixels = (static_cast<std::size_t>(outEnd - out) * 8 - count + K - 1) / K;
+            std::size_t pixels = std::min<std::size_t>({(64 - count) / K, neededPixels, pixelCount});
+            if (pixels == 0)
+            {
+                break; // span is exhausted
+            }
+
+            for (std::size_t i = 0; i < pixels; i++)
+            {
+                bits |= (loadProfileChannel<R>(pixel) |
+                         loadProfileChannel<G>(pixel + step) << R |
+                         loadProfileChannel<B>(pixel + 2 * step) << (R + G)) << count;
+                pixel += stride;
+                count += K;
+            }
+            pixelCount -= pixels;
+        }
+
+        state.bits = bits;
+        state.bitCount = count;
+        state.channel = const_cast<std::uint8_t *>(pixel);
+        state.channelCount = pixelCount;
+        return out - data;
+    }
+
+    /// @brief Returns the encode kernel specialized for a density profile.
+    EncodeKernel profileEncodeKernel(const DensityProfile &profile) noexcept;
+
+    /// @brief Returns the decode kernel specialized for a density profile.
+    DecodeKernel profileDecodeKernel(const DensityProfile &profile) noexcept;
+
+    /// @brief Returns the AVX2/BMI2 encode kernel for a density, or nullptr if there is none.
+    EncodeKernel avx2EncodeKernel(int bitsPerPixel) noexcept;
+
+    /// @brief Returns the AVX2/BMI2 decode kernel for a density, or nullptr if there is none.
+    DecodeKernel avx2DecodeKernel(int bitsPerPixel) noexcept;
+}
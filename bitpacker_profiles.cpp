@@ -0,0 +1,46 @@
+#include <array>   // std::array
+#include <utility> // std::index_sequence
+#include "bitpacker.h"
+#include "bitpacker_kernels.h"
+
+// The kernels of the 9 * 9 * 9 combinations of 0 to 8 bits per channel live in their own translation unit,
+// which is the slowest of the library to compile.
+
+using namespace std;
+using namespace SteganographyLib;
+
+namespace
+{
+    constexpr size_t PROFILE_COUNT = 9 * 9 * 9;
+
+    // Kernels indexed by red * 81 + green * 9 + blue
+    template <size_t... I>
+    constexpr array<EncodeKernel, sizeof...(I)> makeEncodeKernels(index_sequence<I...>)
+    {
+        return {{profileEncodeKernel<I / 81, I / 9 % 9, I % 9>...}};
+    }
+
+    template <size_t... I>
+    constexpr array<DecodeKernel, sizeof...(I)> makeDecodeKernels(index_sequence<I...>)
+    {
+        return {{profileDecodeKernel<I / 81, I / 9 % 9, I % 9>...}};
+    }
+
+    constexpr auto encodeKernels = makeEncodeKernels(make_index_sequence<PROFILE_COUNT>());
+    constexpr auto decodeKernels = makeDecodeKernels(make_index_sequence<PROFILE_COUNT>());
+
+    size_t profileIndex(const DensityProfile &profile) noexcept
+    {
+        return profile.red * 81 + profile.green * 9 + profile.blue;
+    }
+}
+
+SteganographyLib::EncodeKernel SteganographyLib::profileEncodeKernel(const DensityProfile &profile) noexcept
+{
+    return encodeKernels[profileIndex(profile)];
+}
+
+SteganographyLib::DecodeKernel SteganographyLib::profileDecodeKernel(const DensityProfile &profile) noexcept
+{
+    return decodeKernels[profileIndex(profile)];
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>            // std::size_t
+#include <deque>              // std::deque
+#include <mutex>              // std::mutex
+#include <condition_variable> // std::condition_variable
+#include <utility>            // std::move
+
+namespace SteganographyLib
+{
+    /// @brief Queue holding at most 'capacity' items, handing them from one thread to another such as between the
+    /// stages of a pipeline.  push() waits while the queue is full and pop() while it is empty.
+    template <typename T>
+    class BoundedQueue
+    {
+        public:
+            /// @brief Constructor
+            /// @param capacity Number of items the queue holds at most, at least 1.
+            explicit BoundedQueue(std::size_t capacity) : m_capacity(capacity), m_closed(false), m_cancelled(false) {}
+
+            BoundedQueue(const BoundedQueue &) = delete;
+            BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+            /// @brief Adds an item, waiting for room.
+            /// @return false if the queue was closed or cancelled, the item is then dropped.
+            bool push(T item)
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_notFull.wait(lock, [this]() { return m_closed || m_cancelled || m_items.size() < m_capacity; });
+                if (m_closed || m_cancelled)
+                {
+                    return false;
+                }
+                m_items.push_back(std::move(item));
+                m_notEmpty.notify_one();
+                return true;
+            }
+
+            /// @brief Removes the oldest item, waiting for one.
+            /// @return false once the queue is closed and empty, or as soon as it is cancelled.
+            bool pop(T &item)
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_notEmpty.wait(lock, [this]() { return m_closed || m_cancelled || !m_items.empty(); });
+                if (m_cancelled || m_items.empty())
+                {
+                    return false;
+                }
+                item = std::move(m_items.front());
+                m_items.pop_front();
+                m_notFull.notify_one();
+                return true;
+            }
+
+            /// @brief Marks the end of the items, which are still handed out by pop().
+            void close()
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_closed = true;
+                m_notEmpty.notify_all();
+                m_notFull.notify_all();
+            }
+
+            /// @brief Drops the items and wakes every waiting thread, so that the threads on both ends can stop.
+            void cancel()
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_cancelled = true;
+                m_items.clear();
+                m_notEmpty.notify_all();
+                m_notFull.notify_all();
+            }
+
+        private:
+            std::size_t m_capacity;
+            bool m_closed;
+            bool m_cancelled;
+            std::deque<T> m_items;
+            std::mutex m_mutex;
+            std::condition_variable m_notEmpty;
+            std::condition_variable m_notFull;
+    };
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <atomic>    // std::atomic
+#include <stdexcept> // std::runtime_error
+#include <string>    // std::string
+
+namespace SteganographyLib
+{
+    /// @brief Lets a caller stop running operations from any thread.
+    /// Operations check the token once per block of data, so they stop within milliseconds of cancel().
+    class CancellationToken
+    {
+        public:
+            /// @brief Requests every operation using the token to stop.
+            void cancel() noexcept { m_cancelled.store(true, std::memory_order_relaxed); }
+
+            /// @brief Returns true once cancel() has been called.
+            bool cancelled() const noexcept { return m_cancelled.load(std::memory_order_relaxed); }
+
+        private:
+            std::atomic<bool> m_cancelled{false};
+    };
+
+    /// @brief Thrown by an operation that stopped because it was cancelled or ran past its deadline.
+    class OperationCancelled : public std::runtime_error
+    {
+        public:
+            explicit OperationCancelled(const std::string &message) : std::runtime_error(message) {}
+    };
+}
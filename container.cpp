@@ -0,0 +1,314 @@
+#include <stdexcept> // std::runtime_error
+#include <algorithm> // std::min
+#include "container.h"
+#include "crc32c.h"
+
+using namespace std;
+
+namespace
+{
+    // fields are stored byte by byte, so that the format does not depend on the endianness of the machine
+    void store(char *bytes, uint64_t value, size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            bytes[i] = static_cast<char>(value >> (8 * i));
+        }
+    }
+
+    uint64_t load(const char *bytes, size_t size)
+    {
+        uint64_t value = 0;
+        for (size_t i = 0; i < size; i++)
+        {
+            value |= static_cast<uint64_t>(static_cast<uint8_t>(bytes[i])) << (8 * i);
+        }
+        return value;
+    }
+}
+
+SteganographyLib::ContainerHeader::ContainerHeader() noexcept
+    : m_format(ContainerFormat::Legacy),
+      m_flags(0),
+      m_payloadLength(0),
+      m_dataLength(0),
+      m_chunkCount(0),
+      m_chunkTableCrc(0)
+{
+}
+
+SteganographyLib::ContainerHeader::ContainerHeader(ContainerFormat format, std::uint64_t payloadLength, std::uint32_t chunkSize, std::uint8_t flags)
+    : m_format(format),
+      m_flags(flags),
+      m_payloadLength(payloadLength),
+      m_dataLength(payloadLength),
+      m_chunkCount(0),
+      m_chunkTableCrc(0)
+{
+    // the shard flag comes with the shard record, see setShard()
+    if ((flags & ~FLAG_COMPRESSED) != 0)
+    {
+        throw runtime_error("Unsupported container flags.");
+    }
+    if (format == ContainerFormat::Legacy &&
+        flags != 0)
+    {
+        throw runtime_error("The legacy container format does not support compression.");
+    }
+
+    if (format == ContainerFormat::Legacy)
+    {
+        if (payloadLength > UINT16_MAX)
+        {
+            throw runtime_error("Source file size is too large");
+        }
+        if (payloadLength > 0)
+        {
+            m_chunks.push_back({0, static_cast<uint32_t>(payloadLength), 0, static_cast<uint32_t>(payloadLength)});
+        }
+        return;
+    }
+
+    if (chunkSize == 0 ||
+        (payloadLength + chunkSize - 1) / chunkSize > UINT32_MAX)
+    {
+        throw runtime_error("Source file size is too large");
+    }
+    if ((flags & FLAG_COMPRESSED) != 0 &&
+        chunkSize != DEFAULT_CHUNK_SIZE)
+    {
+        throw runtime_error("Compressed containers use chunks of DEFAULT_CHUNK_SIZE bytes.");
+    }
+
+    for (uint64_t offset = 0; offset < payloadLength; offset += chunkSize)
+    {
+        uint32_t length = static_cast<uint32_t>(min<uint64_t>(chunkSize, payloadLength - offset));
+        m_chunks.push_back({offset, length, offset, length});
+    }
+    m_chunkCount = static_cast<uint32_t>(m_chunks.size());
+}
+
+SteganographyLib::ContainerHeader SteganographyLib::ContainerHeader::parse(const char *bytes, std::size_t length, std::uint64_t capacity)
+{
+    ContainerHeader header;
+    if (length >= FIXED_SIZE &&
+        load(bytes, 4) == MAGIC)
+    {
+        // a legacy length of 0x5453 followed by a payload starting with "EG" also begins with the magic: a header
+        // that cannot be read as chunked is only refused when its legacy reading does not fit in the cover either
+        bool legacyFits = LEGACY_SIZE + load(bytes, LEGACY_SIZE) <= capacity;
+        if (static_cast<uint8_t>(bytes[4]) != VERSION)
+        {
+            if (legacyFits)
+            {
+                return parseLegacy(bytes);
+            }
+            throw runtime_error("The embedded data uses a container version that this version does not support.");
+        }
+        if (!checksumMatches(bytes))
+        {
+            if (legacyFits)
+            {
+                return parseLegacy(bytes);
+            }
+            throw runtime_error("The header of the embedded data is corrupt.");
+        }
+
+        header.m_format = ContainerFormat::Chunked;
+        header.m_flags = static_cast<uint8_t>(bytes[5]);
+        header.m_payloadLength = load(bytes + 8, 8);
+        header.m_dataLength = header.m_payloadLength;
+        header.m_chunkCount = static_cast<uint32_t>(load(bytes + 16, 4));
+        header.m_chunkTableCrc = static_cast<uint32_t>(load(bytes + 20, 4));
+
+        if ((header.m_flags & ~SUPPORTED_FLAGS) != 0)
+        {
+            throw runtime_error("The embedded data uses features that this version does not support.");
+        }
+        return header;
+    }
+
+    return parseLegacy(bytes);
+}
+
+SteganographyLib::ContainerHeader SteganographyLib::ContainerHeader::parseLegacy(const char *bytes)
+{
+    ContainerHeader header;
+    header.m_payloadLength = load(bytes, LEGACY_SIZE);
+    header.m_dataLength = header.m_payloadLength;
+    if (header.m_payloadLength > 0)
+    {
+        header.m_chunks.push_back({0, static_cast<uint32_t>(header.m_payloadLength), 0, static_cast<uint32_t>(header.m_payloadLength)});
+    }
+    return header;
+}
+
+bool SteganographyLib::ContainerHeader::checksumMatches(const char *bytes) noexcept
+{
+    return load(bytes + 24, 4) == crc32c(bytes, 24);
+}
+
+void SteganographyLib::ContainerHeader::parseChunkTable(const char *bytes)
+{
+    if (crc32c(bytes, chunkTableSize()) != m_chunkTableCrc)
+    {
+        throw runtime_error("The chunk table of the embedded data is corrupt.");
+    }
+
+    // the chunks are stored back to back and must cover the payload exactly.  Compressed chunks never grow, and
+    // they hold the data in chunks of DEFAULT_CHUNK_SIZE bytes, so that their data lengths cannot make a reader
+    // allocate more than the data written
+    if (sharded())
+    {
+        m_shard.payloadId = load(bytes, 8);
+        m_shard.index = static_cast<uint32_t>(load(bytes + 8, 4));
+        m_shard.count = static_cast<uint32_t>(load(bytes + 12, 4));
+        m_shard.dataOffset = load(bytes + 16, 8);
+        m_shard.totalLength = load(bytes + 24, 8);
+        bytes += SHARD_RECORD_SIZE;
+    }
+
+    m_chunks.clear();
+    m_chunks.reserve(m_chunkCount);
+    uint64_t offset = 0;
+    uint64_t dataOffset = 0;
+    for (uint32_t i = 0; i < m_chunkCount; i++)
+    {
+        const char *entry = bytes + i * chunkEntrySize();
+        uint32_t length = static_cast<uint32_t>(load(entry + 8, 4));
+        uint32_t dataLength = compressed() ? static_cast<uint32_t>(load(entry + 12, 4)) : length;
+        ContainerChunk chunk{load(entry, 8), length, dataOffset, dataLength};
+        if (chunk.offset != offset ||
+            chunk.length == 0 ||
+            chunk.length > chunk.dataLength ||
+            (compressed() && chunk.dataLength > DEFAULT_CHUNK_SIZE) ||
+            (compressed() && i + 1 < m_chunkCount && chunk.dataLength != DEFAULT_CHUNK_SIZE))
+        {
+            throw runtime_error("The chunk table of the embedded data is corrupt.");
+        }
+        offset += chunk.length;
+        dataOffset += chunk.dataLength;
+        m_chunks.push_back(chunk);
+    }
+
+    if (offset != m_payloadLength)
+    {
+        throw runtime_error("The chunk table of the embedded data is corrupt.");
+    }
+    m_dataLength = dataOffset;
+
+    // the shard lies inside the payload
+    if (sharded())
+    {
+        m_shard.length = m_dataLength;
+        if (m_shard.index >= m_shard.count ||
+            m_shard.dataOffset > m_shard.totalLength ||
+            m_shard.length > m_shard.totalLength - m_shard.dataOffset)
+        {
+            throw runtime_error("The shard record of the embedded data is corrupt.");
+        }
+    }
+}
+
+void SteganographyLib::ContainerHeader::setChunkLength(std::size_t index, std::uint32_t length)
+{
+    if (!compressed() ||
+        index >= m_chunks.size() ||
+        length == 0 ||
+        length > m_chunks[index].dataLength)
+    {
+        throw runtime_error("Invalid chunk length.");
+    }
+
+    // the chunks after it move along in finalize(), once all the lengths are known
+    m_chunks[index].length = length;
+}
+
+void SteganographyLib::ContainerHeader::finalize() noexcept
+{
+    uint64_t offset = 0;
+    for (auto &chunk : m_chunks)
+    {
+        chunk.offset = offset;
+        offset += chunk.length;
+    }
+    m_payloadLength = offset;
+}
+
+void SteganographyLib::ContainerHeader::setShard(const ContainerShard &shard)
+{
+    if (m_format != ContainerFormat::Chunked)
+    {
+        throw runtime_error("The legacy container format does not support shards.");
+    }
+    if (shard.index >= shard.count ||
+        shard.length != m_dataLength ||
+        shard.dataOffset > shard.totalLength ||
+        shard.length > shard.totalLength - shard.dataOffset)
+    {
+        throw runtime_error("Invalid shard.");
+    }
+
+    m_flags |= FLAG_SHARD;
+    m_shard = shard;
+}
+
+std::vector<char> SteganographyLib::ContainerHeader::serialize() const
+{
+    vector<char> bytes(size());
+    if (m_format == ContainerFormat::Legacy)
+    {
+        store(bytes.data(), m_payloadLength, LEGACY_SIZE);
+        return bytes;
+    }
+
+    char *entry = bytes.data() + FIXED_SIZE;
+    if (sharded())
+    {
+        store(entry, m_shard.payloadId, 8);
+        store(entry + 8, m_shard.index, 4);
+        store(entry + 12, m_shard.count, 4);
+        store(entry + 16, m_shard.dataOffset, 8);
+        store(entry + 24, m_shard.totalLength, 8);
+        entry += SHARD_RECORD_SIZE;
+    }
+    for (const auto &chunk : m_chunks)
+    {
+        store(entry, chunk.offset, 8);
+        store(entry + 8, chunk.length, 4);
+        if (compressed())
+        {
+            store(entry + 12, chunk.dataLength, 4);
+        }
+        entry += chunkEntrySize();
+    }
+
+    // the fixed part ends with the checksums of the table, then of itself
+    store(bytes.data(), MAGIC, 4);
+    bytes[4] = static_cast<char>(VERSION);
+    bytes[5] = static_cast<char>(m_flags);
+    store(bytes.data() + 8, m_payloadLength, 8);
+    store(bytes.data() + 16, m_chunkCount, 4);
+    store(bytes.data() + 20, crc32c(bytes.data() + FIXED_SIZE, chunkTableSize()), 4);
+    store(bytes.data() + 24, crc32c(bytes.data(), 24), 4);
+    return bytes;
+}
+
+std::size_t SteganographyLib::ContainerHeader::chunkTableSize() const noexcept
+{
+    if (m_format != ContainerFormat::Chunked)
+    {
+        return 0;
+    }
+    return (sharded() ? SHARD_RECORD_SIZE : 0) + static_cast<size_t>(m_chunkCount) * chunkEntrySize();
+}
+
+std::size_t SteganographyLib::ContainerHeader::chunkEntrySize() const noexcept
+{
+    return compressed() ? COMPRESSED_CHUNK_ENTRY_SIZE : CHUNK_ENTRY_SIZE;
+}
+
+std::size_t SteganographyLib::ContainerHeader::size() const noexcept
+{
+    return m_format == ContainerFormat::Chunked ? FIXED_SIZE + chunkTableSize() : LEGACY_SIZE;
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstdint> // std::*int*_t
+#include <cstddef> // std::size_t
+#include <vector>  // std::vector
+
+namespace SteganographyLib
+{
+    /// @brief Layout of the stream embedded in the pixels of a bitmap.
+    enum class ContainerFormat
+    {
+        Legacy, // 16-bit payload length followed by the payload, limited to 65535 bytes
+        Chunked // versioned header with a 64-bit payload length and a chunk table, followed by the chunks
+    };
+
+    /// @brief A chunk of the payload, stored 'offset' bytes after the end of the header.
+    /// Compressed chunks hold 'length' bytes that decompress to the 'dataLength' bytes at 'dataOffset' in the data,
+    /// other chunks hold the data as is.
+    struct ContainerChunk
+    {
+        std::uint64_t offset;
+        std::uint32_t length;
+        std::uint64_t dataOffset;
+        std::uint32_t dataLength;
+    };
+
+    /// @brief Place of the data of a header in a payload split across several bitmaps.
+    struct ContainerShard
+    {
+        std::uint64_t payloadId = 0;   // identifies the payload, the same in all of its shards
+        std::uint32_t index = 0;       // position of the shard, counted from 0
+        std::uint32_t count = 0;       // number of shards of the payload
+        std::uint64_t dataOffset = 0;  // offset of the data of the shard in the payload
+        std::uint64_t length = 0;      // bytes of data in the shard, the data length of its header
+        std::uint64_t totalLength = 0; // bytes of the whole payload
+    };
+
+    /// @brief Header at the start of the embedded stream.
+    /// The chunked layout is, with every field little endian:
+    ///     u32 magic "STEG", u8 version, u8 flags, u16 reserved, u64 payload length, u32 chunk count,
+    ///     u32 CRC-32C of the chunk table, u32 CRC-32C of the 24 bytes before it,
+    ///     then for every chunk: u64 offset, u32 length.
+    /// With FLAG_COMPRESSED, every chunk is an LZ4 block, or the data as is when it does not shrink, of DEFAULT_CHUNK_SIZE
+    /// bytes of data but the last, and its entry is
+    ///     u64 offset, u32 stored length, u32 data length.
+    /// With FLAG_SHARD, the data is one shard of a larger payload, and the chunk table starts with a shard record:
+    ///     u64 payload ID, u32 shard index, u32 shard count, u64 offset of the shard in the payload, u64 payload length.
+    /// The payload length is the number of bytes stored, so the fixed part alone tells the size of the payload, and the
+    /// chunk table lets readers locate any chunk directly.
+    /// The legacy layout is the u16 payload length written by the first versions of the library.
+    class ContainerHeader
+    {
+        public:
+            static constexpr std::uint32_t MAGIC = 0x47455453; // "STEG"
+            static constexpr std::uint8_t VERSION = 1;
+            static constexpr std::uint8_t FLAG_COMPRESSED = 0x01;
+            static constexpr std::uint8_t FLAG_SHARD = 0x02;
+            static constexpr std::uint8_t SUPPORTED_FLAGS = FLAG_COMPRESSED | FLAG_SHARD;
+            static constexpr std::size_t FIXED_SIZE = 28;
+            static constexpr std::size_t CHUNK_ENTRY_SIZE = 12;
+            static constexpr std::size_t COMPRESSED_CHUNK_ENTRY_SIZE = 16;
+            static constexpr std::size_t SHARD_RECORD_SIZE = 32;
+            static constexpr std::size_t LEGACY_SIZE = 2;
+            static constexpr std::uint32_t DEFAULT_CHUNK_SIZE = 1024 * 1024;
+
+            /// @brief Constructor, legacy header of an empty payload.
+            ContainerHeader() noexcept;
+
+            /// @brief Header of a payload split into chunks of 'chunkSize' bytes, the last one possibly shorter.
+            /// The chunks of a compressed header are stored as is until setChunkLength() tells their compressed length.
+            /// @param chunkSize DEFAULT_CHUNK_SIZE for a compressed header, which readers check the data lengths against.
+            /// @param flags 0, or FLAG_COMPRESSED for a chunked header.
+            /// @throws std::runtime_error if the payload is too large for the format, the format does not support the
+            /// flags, or a compressed header has another chunk size
+            ContainerHeader(ContainerFormat format, std::uint64_t payloadLength, std::uint32_t chunkSize = DEFAULT_CHUNK_SIZE, std::uint8_t flags = 0);
+
+            /// @brief Reads the fixed part of a header from the first bytes of a stream.
+            /// A chunked header is recognized by its magic, anything else is a legacy header.
+            /// A header with the magic but another version or a wrong checksum is read as legacy when that length fits
+            /// in the cover, since legacy data can begin with the same bytes.
+            /// @param bytes First bytes of the stream.
+            /// @param length Number of bytes, at least LEGACY_SIZE.  Chunked headers are only recognized with FIXED_SIZE bytes.
+            /// @param capacity Number of bytes the cover can hold, 0 to never fall back to legacy.
+            /// @throws std::runtime_error if a chunked header that cannot be read as legacy has another version or a
+            /// wrong checksum, or if it uses flags this version does not support
+            static ContainerHeader parse(const char *bytes, std::size_t length, std::uint64_t capacity = 0);
+
+            /// @brief Returns true if the checksum of the fixed part of a chunked header matches, which tells a header
+            /// from bytes that happen to start with the magic.
+            /// @param bytes The FIXED_SIZE bytes of the fixed part.
+            static bool checksumMatches(const char *bytes) noexcept;
+
+            /// @brief Reads the chunk table, which follows the fixed part of a chunked header.
+            /// @param bytes The chunkTableSize() bytes after the fixed part.
+            /// @throws std::runtime_error if the table is corrupt or does not cover the payload
+            void parseChunkTable(const char *bytes);
+
+            /// @brief Sets the number of bytes stored for a chunk of a compressed header.  The chunks after it move
+            /// along in finalize().
+            /// @param length Between 1 and the data length of the chunk, which means the chunk is stored as is.
+            /// @throws std::runtime_error if the header is not compressed or the length is out of range
+            void setChunkLength(std::size_t index, std::uint32_t length);
+
+            /// @brief Places the chunks back to back and updates the payload length, once setChunkLength() has been
+            /// called for the chunks that shrink.  Required before serialize() and the offsets of the chunks are used.
+            void finalize() noexcept;
+
+            /// @brief Marks the data as one shard of a larger payload, which adds the shard record to the chunk table.
+            /// @param shard Its length must be the data length of the header.
+            /// @throws std::runtime_error if the header is not chunked or the shard does not fit in the payload
+            void setShard(const ContainerShard &shard);
+
+            /// @brief Returns the header as written at the start of the stream.
+            std::vector<char> serialize() const;
+
+            ContainerFormat format() const noexcept { return m_format; }
+            std::uint8_t flags() const noexcept { return m_flags; }
+            bool compressed() const noexcept { return (m_flags & FLAG_COMPRESSED) != 0; }
+            bool sharded() const noexcept { return (m_flags & FLAG_SHARD) != 0; }
+
+            /// @brief Returns the place of the data in the whole payload.  Known once the chunk table is read.
+            const ContainerShard &shard() const noexcept { return m_shard; }
+
+            /// @brief Returns the number of bytes stored after the header.
+            std::uint64_t payloadLength() const noexcept { return m_payloadLength; }
+
+            /// @brief Returns the number of bytes of data, once decompressed.  Known once the chunk table is read.
+            std::uint64_t dataLength() const noexcept { return m_dataLength; }
+            const std::vector<ContainerChunk> &chunks() const noexcept { return m_chunks; }
+
+            /// @brief Returns the number of bytes of the chunk table of a chunked header, shard record included.
+            std::size_t chunkTableSize() const noexcept;
+
+            /// @brief Returns the number of bytes of the whole header, i.e. the stream offset of the payload.
+            std::size_t size() const noexcept;
+
+        private:
+            static ContainerHeader parseLegacy(const char *bytes);
+            std::size_t chunkEntrySize() const noexcept;
+
+            ContainerFormat m_format;
+            std::uint8_t m_flags;
+            std::uint64_t m_payloadLength;
+            std::uint64_t m_dataLength;
+            std::uint32_t m_chunkCount;
+            std::uint32_t m_chunkTableCrc; // read from a stream, written by serialize()
+            ContainerShard m_shard;
+            std::vector<ContainerChunk> m_chunks;
+    };
+}
@@ -0,0 +1,83 @@
+#include "covercache.h"
+
+using namespace std;
+
+SteganographyLib::CoverCache::CoverCache(std::size_t capacityBytes)
+    : m_capacityBytes(capacityBytes)
+{
+}
+
+std::shared_ptr<const bmp::Bitmap> SteganographyLib::CoverCache::acquire(const std::string &bitmapFilePath)
+{
+    // the stamp is taken before loading, so a file modified while it loads is reloaded next time
+    auto modified = filesystem::last_write_time(bitmapFilePath);
+    auto fileSize = filesystem::file_size(bitmapFilePath);
+    {
+        lock_guard<mutex> lock(m_mutex);
+        auto found = m_index.find(bitmapFilePath);
+        if (found != m_index.end())
+        {
+            auto entry = found->second;
+            if (entry->modified == modified &&
+                entry->fileSize == fileSize)
+            {
+                m_entries.splice(m_entries.begin(), m_entries, entry);
+                m_stats.hits++;
+                return entry->bitmap;
+            }
+            erase(entry);
+        }
+        m_stats.misses++;
+    }
+
+    // loaded without the lock, so that other covers can be served meanwhile
+    auto bitmap = make_shared<bmp::Bitmap>();
+    bitmap->load(bitmapFilePath);
+    size_t bytes = static_cast<size_t>(bitmap->width()) * static_cast<size_t>(bitmap->height()) * (sizeof(bmp::Pixel) + bitmap->has_alpha());
+    if (bytes > m_capacityBytes)
+    {
+        return bitmap;
+    }
+
+    lock_guard<mutex> lock(m_mutex);
+    auto found = m_index.find(bitmapFilePath);
+    if (found != m_index.end())
+    {
+        // loaded by another thread meanwhile
+        erase(found->second);
+    }
+    m_entries.push_front({bitmapFilePath, modified, fileSize, bitmap, bytes});
+    m_index[bitmapFilePath] = m_entries.begin();
+    m_stats.entries++;
+    m_stats.bytes += bytes;
+
+    while (m_stats.bytes > m_capacityBytes)
+    {
+        erase(prev(m_entries.end()));
+        m_stats.evictions++;
+    }
+    return bitmap;
+}
+
+void SteganographyLib::CoverCache::clear()
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_entries.clear();
+    m_index.clear();
+    m_stats.entries = 0;
+    m_stats.bytes = 0;
+}
+
+SteganographyLib::CoverCacheStats SteganographyLib::CoverCache::stats() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void SteganographyLib::CoverCache::erase(std::list<Entry>::iterator entry)
+{
+    m_stats.entries--;
+    m_stats.bytes -= entry->bytes;
+    m_index.erase(entry->path);
+    m_entries.erase(entry);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>       // std::*int*_t
+#include <cstddef>       // std::size_t
+#include <string>        // std::string
+#include <memory>        // std::shared_ptr
+#include <list>          // std::list
+#include <unordered_map> // std::unordered_map
+#include <mutex>         // std::mutex
+#include <filesystem>    // std::filesystem::file_time_type
+#include "bitmap.h"
+
+namespace SteganographyLib
+{
+    /// @brief Counters of a cover cache, to size it.
+    struct CoverCacheStats
+    {
+        std::uint64_t hits = 0;      // covers served from the cache
+        std::uint64_t misses = 0;    // covers loaded from disk, including stale entries
+        std::uint64_t evictions = 0; // entries dropped to stay within the capacity
+        std::size_t entries = 0;     // covers currently held
+        std::size_t bytes = 0;       // bytes of pixels and alpha values currently held
+    };
+
+    /// @brief Cache of decoded cover bitmaps, for repeated embeds into the same set of covers.
+    /// Entries are keyed on the path of the bitmap, and are reloaded when the modification time or the size of the file
+    /// changes.  The pixels held are bounded in bytes, evicting the least recently used covers first.  Covers are
+    /// shared and never modified: an evicted cover stays valid for as long as an operation still uses it.
+    /// The cache can be shared by several Steganography instances, on any thread.
+    class CoverCache
+    {
+        public:
+            /// @brief Constructor
+            /// @param capacityBytes Bytes of decoded pixels the cache may hold.  A cover larger than this is loaded but not kept.
+            explicit CoverCache(std::size_t capacityBytes);
+
+            /// @brief Returns the decoded pixels of a bitmap, loading it on a miss.
+            /// @throws bmp::Exception if the bitmap cannot be loaded
+            /// @throws std::filesystem::filesystem_error if the file does not exist
+            std::shared_ptr<const bmp::Bitmap> acquire(const std::string &bitmapFilePath);
+
+            /// @brief Drops every entry.  The counters are kept.
+            void clear();
+
+            CoverCacheStats stats() const;
+            std::size_t capacity() const noexcept { return m_capacityBytes; }
+
+        private:
+            struct Entry
+            {
+                std::string path;
+                std::filesystem::file_time_type modified;
+                std::uintmax_t fileSize;
+                std::shared_ptr<const bmp::Bitmap> bitmap;
+                std::size_t bytes;
+            };
+
+            void erase(std::list<Entry>::iterator entry);
+
+            // member variables
+            mutable std::mutex m_mutex;
+            std::size_t m_capacityBytes;
+            std::list<Entry> m_entries; // most recently used first
+            std::unordered_map<std::string, std::list<Entry>::iterator> m_index;
+            CoverCacheStats m_stats;
+    };
+}
@@ -0,0 +1,126 @@
+#include <array>   // std::array
+#include <cstring> // std::memcpy
+#include "crc32c.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <nmmintrin.h> // SSE4.2 CRC32 intrinsics
+#if defined(_M_X64)
+#include <intrin.h>    // __cpuid
+#endif
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>  // ARMv8 CRC32 intrinsics
+#endif
+
+using namespace std;
+
+namespace
+{
+    // Reflected Castagnoli polynomial
+    constexpr uint32_t polynomial = 0x82F63B78;
+
+    constexpr array<uint32_t, 256> crcTable()
+    {
+        array<uint32_t, 256> table{};
+        for (uint32_t i = 0; i < table.size(); i++)
+        {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++)
+            {
+                crc = (crc >> 1) ^ (crc & 1 ? polynomial : 0);
+            }
+            table[i] = crc;
+        }
+        return table;
+    }
+
+    constexpr array<uint32_t, 256> table = crcTable();
+
+    uint32_t tableCrc(const uint8_t *bytes, size_t length, uint32_t crc)
+    {
+        for (size_t i = 0; i < length; i++)
+        {
+            crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return crc;
+    }
+
+#if defined(__x86_64__) || defined(_M_X64)
+    // compiled for SSE4.2 through a function attribute, and only called once the processor has been checked for it
+#if defined(__GNUC__) || defined(__clang__)
+#define SSE42_TARGET __attribute__((target("sse4.2")))
+#else
+#define SSE42_TARGET
+#endif
+
+    SSE42_TARGET uint32_t hardwareCrc(const uint8_t *bytes, size_t length, uint32_t crc)
+    {
+        // the CRC32 instruction uses the Castagnoli polynomial, 8 bytes at a time
+        uint64_t crc64 = crc;
+        for (; length >= 8; length -= 8, bytes += 8)
+        {
+            uint64_t value;
+            memcpy(&value, bytes, sizeof(value));
+            crc64 = _mm_crc32_u64(crc64, value);
+        }
+        crc = static_cast<uint32_t>(crc64);
+        for (; length > 0; length--)
+        {
+            crc = _mm_crc32_u8(crc, *bytes++);
+        }
+        return crc;
+    }
+
+    bool hardwareCrcSupported()
+    {
+#if defined(_M_X64)
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 20)) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse4.2");
+#endif
+    }
+#elif defined(__ARM_FEATURE_CRC32)
+    uint32_t hardwareCrc(const uint8_t *bytes, size_t length, uint32_t crc)
+    {
+        for (; length >= 8; length -= 8, bytes += 8)
+        {
+            uint64_t value;
+            memcpy(&value, bytes, sizeof(value));
+            crc = __crc32cd(crc, value);
+        }
+        for (; length > 0; length--)
+        {
+            crc = __crc32cb(crc, *bytes++);
+        }
+        return crc;
+    }
+
+    bool hardwareCrcSupported()
+    {
+        // the compiler only targets processors with the CRC32 instructions
+        return true;
+    }
+#else
+    uint32_t hardwareCrc(const uint8_t *bytes, size_t length, uint32_t crc)
+    {
+        return tableCrc(bytes, length, crc);
+    }
+
+    bool hardwareCrcSupported()
+    {
+        return false;
+    }
+#endif
+}
+
+std::uint32_t SteganographyLib::crc32c(const void *data, std::size_t length, std::uint32_t crc) noexcept
+{
+    // the processor does not change while we run, so detect its features only once
+    static const bool hardware = hardwareCrcSupported();
+    auto bytes = static_cast<const uint8_t *>(data);
+    crc = ~crc;
+    crc = hardware ? hardwareCrc(bytes, length, crc) : tableCrc(bytes, length, crc);
+    return ~crc;
+}
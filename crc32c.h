@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint> // std::*int*_t
+#include <cstddef> // std::size_t
+
+namespace SteganographyLib
+{
+    /// @brief Computes the CRC-32C (Castagnoli) checksum of a buffer.
+    /// Uses the CRC32 instructions of SSE4.2 or ARMv8 where the processor has them, and a table otherwise.
+    /// @param data Bytes to checksum.
+    /// @param length Number of bytes.
+    /// @param crc Checksum of the preceding bytes, to checksum a buffer in several calls.  0 for the first call.
+    std::uint32_t crc32c(const void *data, std::size_t length, std::uint32_t crc = 0) noexcept;
+}
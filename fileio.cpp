@@ -0,0 +1,240 @@
+#include <stdexcept>  // std::runtime_error
+#include <filesystem> // std::filesystem::copy_file
+#include "fileio.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>    // CreateFile, ReadFile, WriteFile
+#else
+#include <cerrno>       // errno
+#include <fcntl.h>      // open
+#include <sys/stat.h>   // fstat
+#include <unistd.h>     // pread, pwrite, close
+#endif
+
+#if defined(__linux__)
+#include <sys/ioctl.h>  // ioctl
+#include <linux/fs.h>   // FICLONE
+#elif defined(__APPLE__)
+#include <sys/clonefile.h> // clonefile
+#endif
+
+using namespace std;
+
+namespace
+{
+#if defined(__linux__)
+    // Shares the data blocks of the source with the destination (btrfs, XFS, ...) or lets the kernel copy
+    // them with copy_file_range.  Returns false if neither is available, so that the caller can fall back.
+    bool kernelCopy(const string &sourceFilePath, const string &destinationFilePath)
+    {
+        int source = open(sourceFilePath.c_str(), O_RDONLY);
+        if (source < 0)
+        {
+            return false;
+        }
+
+        struct stat sourceStat{};
+        int destination = -1;
+        if (fstat(source, &sourceStat) == 0)
+        {
+            destination = open(destinationFilePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, sourceStat.st_mode & 0777);
+        }
+        if (destination < 0)
+        {
+            close(source);
+            return false;
+        }
+
+        bool copied = false;
+#if defined(FICLONE)
+        copied = ioctl(destination, FICLONE, source) == 0;
+#endif
+        if (!copied)
+        {
+            off_t remaining = sourceStat.st_size;
+            while (remaining > 0)
+            {
+                ssize_t written = copy_file_range(source, nullptr, destination, nullptr, static_cast<size_t>(remaining), 0);
+                if (written <= 0)
+                {
+                    break;
+                }
+                remaining -= written;
+            }
+            copied = remaining == 0;
+        }
+
+        close(source);
+        close(destination);
+        return copied;
+    }
+#endif
+}
+
+void SteganographyLib::cloneFile(const std::string &sourceFilePath, const std::string &destinationFilePath)
+{
+#if defined(__linux__)
+    if (kernelCopy(sourceFilePath, destinationFilePath))
+    {
+        return;
+    }
+#elif defined(__APPLE__)
+    // clonefile refuses to replace an existing file
+    std::error_code removeError;
+    filesystem::remove(destinationFilePath, removeError);
+    if (clonefile(sourceFilePath.c_str(), destinationFilePath.c_str(), 0) == 0)
+    {
+        return;
+    }
+#endif
+
+    std::error_code error;
+    filesystem::copy_file(sourceFilePath, destinationFilePath, filesystem::copy_options::overwrite_existing, error);
+    if (error)
+    {
+        throw runtime_error("Could not copy " + sourceFilePath + " to " + destinationFilePath + ": " + error.message());
+    }
+}
+
+#if defined(_WIN32)
+
+SteganographyLib::RandomAccessFile::RandomAccessFile(const std::string &filePath, Mode mode)
+    : m_filePath(filePath)
+{
+    DWORD access = mode == Mode::Read ? GENERIC_READ : GENERIC_READ | GENERIC_WRITE;
+    DWORD disposition = mode == Mode::Create ? CREATE_ALWAYS : OPEN_EXISTING;
+    HANDLE handle = CreateFileA(filePath.c_str(), access, FILE_SHARE_READ, nullptr, disposition, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        throw runtime_error("Could not open file at " + filePath);
+    }
+    m_handle = handle;
+}
+
+SteganographyLib::RandomAccessFile::~RandomAccessFile() noexcept
+{
+    CloseHandle(static_cast<HANDLE>(m_handle));
+}
+
+void SteganographyLib::RandomAccessFile::readAt(std::uint64_t offset, void *data, std::size_t length)
+{
+    auto bytes = static_cast<char *>(data);
+    while (length > 0)
+    {
+        OVERLAPPED position{};
+        position.Offset = static_cast<DWORD>(offset);
+        position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD chunk = static_cast<DWORD>(length < 0x40000000 ? length : 0x40000000);
+        DWORD read = 0;
+        if (!ReadFile(static_cast<HANDLE>(m_handle), bytes, chunk, &read, &position) || read == 0)
+        {
+            throw runtime_error("Could not read from file at " + m_filePath);
+        }
+        bytes += read;
+        offset += read;
+        length -= read;
+    }
+}
+
+void SteganographyLib::RandomAccessFile::writeAt(std::uint64_t offset, const void *data, std::size_t length)
+{
+    auto bytes = static_cast<const char *>(data);
+    while (length > 0)
+    {
+        OVERLAPPED position{};
+        position.Offset = static_cast<DWORD>(offset);
+        position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD chunk = static_cast<DWORD>(length < 0x40000000 ? length : 0x40000000);
+        DWORD written = 0;
+        if (!WriteFile(static_cast<HANDLE>(m_handle), bytes, chunk, &written, &position) || written == 0)
+        {
+            throw runtime_error("Could not write to file at " + m_filePath);
+        }
+        bytes += written;
+        offset += written;
+        length -= written;
+    }
+}
+
+std::uint64_t SteganographyLib::RandomAccessFile::size() const
+{
+    LARGE_INTEGER fileSize{};
+    GetFileSizeEx(static_cast<HANDLE>(m_handle), &fileSize);
+    return static_cast<std::uint64_t>(fileSize.QuadPart);
+}
+
+#else
+
+SteganographyLib::RandomAccessFile::RandomAccessFile(const std::string &filePath, Mode mode)
+    : m_filePath(filePath)
+{
+    int flags = mode == Mode::Read ? O_RDONLY : mode == Mode::ReadWrite ? O_RDWR : O_RDWR | O_CREAT | O_TRUNC;
+    m_fd = open(filePath.c_str(), flags, 0666);
+    if (m_fd < 0)
+    {
+        throw runtime_error("Could not open file at " + filePath);
+    }
+}
+
+SteganographyLib::RandomAccessFile::~RandomAccessFile() noexcept
+{
+    close(m_fd);
+}
+
+void SteganographyLib::RandomAccessFile::readAt(std::uint64_t offset, void *data, std::size_t length)
+{
+    auto bytes = static_cast<char *>(data);
+    while (length > 0)
+    {
+        ssize_t read = pread(m_fd, bytes, length, static_cast<off_t>(offset));
+        if (read < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (read <= 0)
+        {
+            throw runtime_error("Could not read from file at " + m_filePath);
+        }
+        bytes += read;
+        offset += read;
+        length -= read;
+    }
+}
+
+void SteganographyLib::RandomAccessFile::writeAt(std::uint64_t offset, const void *data, std::size_t length)
+{
+    auto bytes = static_cast<const char *>(data);
+    while (length > 0)
+    {
+        ssize_t written = pwrite(m_fd, bytes, length, static_cast<off_t>(offset));
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            throw runtime_error("Could not write to file at " + m_filePath);
+        }
+        bytes += written;
+        offset += written;
+        length -= written;
+    }
+}
+
+std::uint64_t SteganographyLib::RandomAccessFile::size() const
+{
+    struct stat fileStat{};
+    if (fstat(m_fd, &fileStat) != 0)
+    {
+        throw runtime_error("Could not read the size of file at " + m_filePath);
+    }
+    return static_cast<std::uint64_t>(fileStat.st_size);
+}
+
+#endif
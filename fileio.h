@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint> // std::*int*_t
+#include <cstddef> // std::size_t
+#include <string>  // std::string
+
+namespace SteganographyLib
+{
+    /// @brief Copies a file.  The copy shares the data blocks of the source when the filesystem supports it
+    /// (reflink on Linux, clonefile on macOS), otherwise the data is copied inside the kernel where possible.
+    /// @throws std::runtime_error on error
+    void cloneFile(const std::string &sourceFilePath, const std::string &destinationFilePath);
+
+    /// @brief File that is read and written at explicit offsets (pread/pwrite), without a stream position or buffering.
+    class RandomAccessFile
+    {
+        public:
+            enum class Mode
+            {
+                Read,
+                ReadWrite,
+                Create     // creates the file, or empties an existing one, for reading and writing
+            };
+
+            /// @brief Opens an existing file, or creates one in Mode::Create.
+            /// @throws std::runtime_error on error
+            RandomAccessFile(const std::string &filePath, Mode mode);
+
+            /// @brief Destructor, closes the file.
+            ~RandomAccessFile() noexcept;
+
+            RandomAccessFile(const RandomAccessFile &) = delete;
+            RandomAccessFile &operator=(const RandomAccessFile &) = delete;
+
+            /// @brief Reads exactly 'length' bytes at 'offset'.
+            /// @throws std::runtime_error on error or if the file ends first
+            void readAt(std::uint64_t offset, void *data, std::size_t length);
+
+            /// @brief Writes 'length' bytes at 'offset', leaving the rest of the file untouched.
+            /// @throws std::runtime_error on error
+            void writeAt(std::uint64_t offset, const void *data, std::size_t length);
+
+            /// @brief Returns the size of the file in bytes.
+            std::uint64_t size() const;
+
+        private:
+            std::string m_filePath;
+#if defined(_WIN32)
+            void *m_handle;
+#else
+            int m_fd;
+#endif
+    };
+}
@@ -1,8 +1,13 @@
 #pragma once
 
 #include <cstdint>    // std::int*_t
+#include <cstddef>    // std::size_t
+#include <iosfwd>     // std::istream, std::ostream
 #include <functional> // std::function
 #include <string>     // std::string
+#include <vector>     // std::vector
+#include "operationstats.h"
+#include "bitpacker.h"
 
 namespace SteganographyLib
 {
@@ -30,11 +35,64 @@ namespace SteganographyLib
             /// @param bitsPerPixel Resolution that determines how many bits from each RGB pixel (24 bits) encodes source data.  Must be a multiple of 3 between 3 and 24.
             virtual void extract(const std::string &sourceBitmapFilePath, const std::string &destinationDataFilePath, std::uint8_t bitsPerPixel) = 0;
 
+            /// @brief Embeds information read from a stream into a bitmap read from a stream.
+            /// @param originalBitmap Stream positioned at the start of the original bitmap.
+            /// @param sourceData Stream of the information to embed, up to its end.
+            /// @param destinationBitmap Receives the bitmap with the information embedded.
+            /// @param bitsPerPixel Resolution that determines how many bits from each RGB pixel (24 bits) will encode source data.  Must be a multiple of 3 between 3 and 24.
+            virtual void embed(std::istream &originalBitmap, std::istream &sourceData, std::ostream &destinationBitmap, std::uint8_t bitsPerPixel) = 0;
+
+            /// @brief Embeds information into the pixels of a bitmap held in memory, in place.
+            /// @param bitmapData Bytes of a 24 bits per pixel BGR or 32 bits per pixel BGRA .bmp file, modified in place.
+            /// @param bitmapSize Number of bytes of the bitmap.
+            /// @param sourceData Information to embed.
+            /// @param sourceDataSize Number of bytes of information.
+            /// @param bitsPerPixel Resolution that determines how many bits from each RGB pixel (24 bits) will encode source data.  Must be a multiple of 3 between 3 and 24.
+            virtual void embed(std::uint8_t *bitmapData, std::size_t bitmapSize, const char *sourceData, std::size_t sourceDataSize, std::uint8_t bitsPerPixel) = 0;
+
+            /// @brief Extracts information from a bitmap read from a stream.
+            /// @param sourceBitmap Stream positioned at the start of the bitmap.
+            /// @param destinationData Receives the extracted information.
+            /// @param bitsPerPixel Resolution that determines how many bits from each RGB pixel (24 bits) encodes source data.  Must be a multiple of 3 between 3 and 24.
+            virtual void extract(std::istream &sourceBitmap, std::ostream &destinationData, std::uint8_t bitsPerPixel) = 0;
+
+            /// @brief Extracts information from a bitmap held in memory.
+            /// @param bitmapData Bytes of a 24 bits per pixel BGR or 32 bits per pixel BGRA .bmp file.
+            /// @param bitmapSize Number of bytes of the bitmap.
+            /// @param bitsPerPixel Resolution that determines how many bits from each RGB pixel (24 bits) encodes source data.  Must be a multiple of 3 between 3 and 24.
+            /// @return The extracted information.
+            virtual std::vector<char> extract(const std::uint8_t *bitmapData, std::size_t bitmapSize, std::uint8_t bitsPerPixel) = 0;
+
+            /// @brief Extracts a range of the information embedded in a bitmap, reading only the pixel rows that hold it.
+            /// @param sourceBitmapFilePath Path to the bitmap that contains the information.
+            /// @param offset Offset of the first byte to extract, from the start of the embedded information.
+            /// @param length Number of bytes to extract.
+            /// @param bitsPerPixel Resolution that determines how many bits from each RGB pixel (24 bits) encodes source data.  Must be a multiple of 3 between 3 and 24.
+            /// @return The extracted bytes.
+            virtual std::vector<char> extractRange(const std::string &sourceBitmapFilePath, std::uint64_t offset, std::size_t length, std::uint8_t bitsPerPixel) = 0;
+
             /// @brief Registers a callback function to be invoked during both the embed and extract methods.
             /// Allows the caller to be notified with the progress of these operations, such as for logging or to display a progress bar to the user.
             /// @param callbackFunction The callback function that will be invoked.
             /// @param percentGrain value between 1 to 100, indicating after how many percentage units of completed work (over a total of 100) will the callback be invoked.
             //  Example, if 1 is provided, 100 callbacks will be invoked.  If 50 is provided 2 callbacks will be invoked.
             virtual void registerProgressCallback(ProgressCallback callbackFunction, int percentGrain = 10) = 0;
+
+            /// @brief Returns the timings and counters of the last operation.
+            virtual const OperationStats &lastStats() const noexcept = 0;
+
+            /// @brief Selects whether the stats also count the channel bytes modified by embed, which costs a copy of them.
+            virtual void setDetailedStats(bool enabled) noexcept = 0;
+
+            /// @brief Selects whether embed compresses the data before encoding it.  Extract recognizes compressed data on its own.
+            virtual void setCompression(bool enabled) noexcept = 0;
+
+            /// @brief Selects how many bits each color channel of a pixel stores, instead of a uniform density.
+            /// The following operations must then be given the bits per pixel of the profile.
+            virtual void setDensityProfile(const DensityProfile &profile) = 0;
+
+            /// @brief Selects a keyed order of the pixels instead of the order from the top left pixel onwards.
+            /// Extract must be given the same key.
+            virtual void setScatterKey(const std::string &key) = 0;
     };
 }
@@ -0,0 +1,224 @@
+#include <cstdint> // std::*int*_t
+#include <cstring> // std::memcpy
+#include <vector>  // std::vector
+#include "lz.h"
+
+using namespace std;
+
+namespace
+{
+    // limits of the LZ4 block format: the last match starts at least 12 bytes before the end of the block,
+    // and the last 5 bytes are always literals
+    constexpr size_t MIN_MATCH = 4;
+    constexpr size_t MATCH_FIND_LIMIT = 12;
+    constexpr size_t LAST_LITERALS = 5;
+    constexpr size_t MAX_OFFSET = 65535;
+    constexpr unsigned int HASH_BITS = 14;
+
+    uint32_t read32(const uint8_t *bytes)
+    {
+        uint32_t value;
+        memcpy(&value, bytes, sizeof(value));
+        return value;
+    }
+
+    uint32_t hashSequence(uint32_t sequence)
+    {
+        return (sequence * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    // lengths of 15 and more continue in bytes of 255, up to a byte below 255
+    uint8_t *writeLength(uint8_t *output, size_t length)
+    {
+        for (; length >= 255; length -= 255)
+        {
+            *output++ = 255;
+        }
+        *output++ = static_cast<uint8_t>(length);
+        return output;
+    }
+
+    bool readLength(const uint8_t *&input, const uint8_t *inputEnd, size_t &length)
+    {
+        uint8_t byte;
+        do
+        {
+            if (input == inputEnd)
+            {
+                return false;
+            }
+            byte = *input++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+}
+
+std::size_t SteganographyLib::lzCompressBound(std::size_t length) noexcept
+{
+    return length + length / 255 + 16;
+}
+
+std::size_t SteganographyLib::lzCompress(const char *source, std::size_t length, char *destination, std::size_t capacity) noexcept
+{
+    const uint8_t *input = reinterpret_cast<const uint8_t *>(source);
+    const uint8_t *inputEnd = input + length;
+    uint8_t *output = reinterpret_cast<uint8_t *>(destination);
+    uint8_t *outputEnd = output + capacity;
+    const uint8_t *anchor = input;
+
+    // a sequence is a token, the literals since the previous match, then the offset and the length of a match
+    auto writeSequence = [&](const uint8_t *literals, size_t literalLength, size_t offset, size_t matchLength)
+    {
+        size_t worstCase = 1 + literalLength / 255 + 1 + literalLength + (offset > 0 ? 2 + matchLength / 255 + 1 : 0);
+        if (worstCase > static_cast<size_t>(outputEnd - output))
+        {
+            return false;
+        }
+        uint8_t *token = output++;
+        *token = static_cast<uint8_t>((literalLength < 15 ? literalLength : 15) << 4);
+        if (literalLength >= 15)
+        {
+            output = writeLength(output, literalLength - 15);
+        }
+        memcpy(output, literals, literalLength);
+        output += literalLength;
+        if (offset > 0)
+        {
+            *output++ = static_cast<uint8_t>(offset);
+            *output++ = static_cast<uint8_t>(offset >> 8);
+            size_t extraLength = matchLength - MIN_MATCH;
+            *token |= static_cast<uint8_t>(extraLength < 15 ? extraLength : 15);
+            if (extraLength >= 15)
+            {
+                output = writeLength(output, extraLength - 15);
+            }
+        }
+        return true;
+    };
+
+    if (length > MATCH_FIND_LIMIT)
+    {
+        // positions of the last sequence of 4 bytes with each hash, relative to the start of the input
+        vector<uint32_t> table(static_cast<size_t>(1) << HASH_BITS, 0);
+        const uint8_t *matchFindEnd = inputEnd - MATCH_FIND_LIMIT;
+        const uint8_t *matchEnd = inputEnd - LAST_LITERALS;
+        const uint8_t *position = input + 1;
+        while (position < matchFindEnd)
+        {
+            uint32_t sequence = read32(position);
+            uint32_t &entry = table[hashSequence(sequence)];
+            const uint8_t *match = input + entry;
+            entry = static_cast<uint32_t>(position - input);
+            if (match >= position ||
+                static_cast<size_t>(position - match) > MAX_OFFSET ||
+                read32(match) != sequence)
+            {
+                // the search skips ahead faster through data that does not compress
+                position += 1 + ((position - anchor) >> 6);
+                continue;
+            }
+
+            // extend the match backwards over the pending literals, then forwards
+            while (position > anchor &&
+                   match > input &&
+                   position[-1] == match[-1])
+            {
+                position--;
+                match--;
+            }
+            size_t matchLength = MIN_MATCH;
+            while (position + matchLength < matchEnd &&
+                   position[matchLength] == match[matchLength])
+            {
+                matchLength++;
+            }
+
+            if (!writeSequence(anchor, static_cast<size_t>(position - anchor), static_cast<size_t>(position - match), matchLength))
+            {
+                return 0;
+            }
+            position += matchLength;
+            anchor = position;
+            if (position < matchFindEnd)
+            {
+                table[hashSequence(read32(position - 2))] = static_cast<uint32_t>(position - 2 - input);
+            }
+        }
+    }
+
+    if (!writeSequence(anchor, static_cast<size_t>(inputEnd - anchor), 0, 0))
+    {
+        return 0;
+    }
+    return static_cast<size_t>(output - reinterpret_cast<uint8_t *>(destination));
+}
+
+bool SteganographyLib::lzDecompress(const char *source, std::size_t length, char *destination, std::size_t decompressedLength) noexcept
+{
+    const uint8_t *input = reinterpret_cast<const uint8_t *>(source);
+    const uint8_t *inputEnd = input + length;
+    uint8_t *output = reinterpret_cast<uint8_t *>(destination);
+    uint8_t *outputStart = output;
+    uint8_t *outputEnd = output + decompressedLength;
+
+    while (input < inputEnd)
+    {
+        uint8_t token = *input++;
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 &&
+            !readLength(input, inputEnd, literalLength))
+        {
+            return false;
+        }
+        if (literalLength > static_cast<size_t>(inputEnd - input) ||
+            literalLength > static_cast<size_t>(outputEnd - output))
+        {
+            return false;
+        }
+        memcpy(output, input, literalLength);
+        input += literalLength;
+        output += literalLength;
+
+        // the last sequence has no match
+        if (input == inputEnd)
+        {
+            break;
+        }
+        if (inputEnd - input < 2)
+        {
+            return false;
+        }
+        size_t offset = input[0] | (static_cast<size_t>(input[1]) << 8);
+        input += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 &&
+            !readLength(input, inputEnd, matchLength))
+        {
+            return false;
+        }
+        matchLength += MIN_MATCH;
+        if (offset == 0 ||
+            offset > static_cast<size_t>(output - outputStart) ||
+            matchLength > static_cast<size_t>(outputEnd - output))
+        {
+            return false;
+        }
+
+        // a match closer than its length repeats the bytes it is copying
+        const uint8_t *match = output - offset;
+        if (offset >= matchLength)
+        {
+            memcpy(output, match, matchLength);
+            output += matchLength;
+        }
+        else
+        {
+            for (size_t i = 0; i < matchLength; i++)
+            {
+                *output++ = *match++;
+            }
+        }
+    }
+    return output == outputEnd;
+}
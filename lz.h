@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef> // std::size_t
+
+namespace SteganographyLib
+{
+    /// @brief Returns the largest number of bytes lzCompress() can produce from 'length' bytes.
+    std::size_t lzCompressBound(std::size_t length) noexcept;
+
+    /// @brief Compresses a buffer into an LZ4 block: greedy matches of at least 4 bytes up to 64 KiB back,
+    /// which decompresses at several GB/s and shrinks text and other redundant data about 2 to 3 times.
+    /// @param source Bytes to compress.
+    /// @param length Number of bytes, less than 4 GiB.
+    /// @param destination Receives the compressed block.
+    /// @param capacity Number of bytes available at 'destination'.
+    /// @return Number of bytes of the compressed block, or 0 if it does not fit in 'capacity'.
+    std::size_t lzCompress(const char *source, std::size_t length, char *destination, std::size_t capacity) noexcept;
+
+    /// @brief Decompresses an LZ4 block.  Every length and offset is checked, so corrupt blocks are rejected safely.
+    /// @param source The compressed block.
+    /// @param length Number of bytes of the compressed block.
+    /// @param destination Receives the decompressed bytes.
+    /// @param decompressedLength Exact number of bytes the block decompresses to.
+    /// @return false if the block is corrupt or does not decompress to exactly 'decompressedLength' bytes.
+    bool lzDecompress(const char *source, std::size_t length, char *destination, std::size_t decompressedLength) noexcept;
+}
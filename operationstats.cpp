@@ -0,0 +1,43 @@
+#include <sstream> // std::ostringstream
+#include "operationstats.h"
+
+using namespace std;
+
+SteganographyLib::PhaseTimer::PhaseTimer(PhaseTiming &timing) noexcept
+    : m_timing(timing),
+      m_wallStart(chrono::steady_clock::now()),
+      m_cpuStart(clock())
+{
+}
+
+SteganographyLib::PhaseTimer::~PhaseTimer() noexcept
+{
+    chrono::duration<double, milli> wall = chrono::steady_clock::now() - m_wallStart;
+    m_timing.wallMilliseconds += wall.count();
+    m_timing.cpuMilliseconds += 1000.0 * (clock() - m_cpuStart) / CLOCKS_PER_SEC;
+}
+
+std::string SteganographyLib::formatStatsJson(const std::string &operation, const OperationStats &stats)
+{
+    auto phase = [](const PhaseTiming &timing)
+    {
+        ostringstream text;
+        text << "{\"wallMilliseconds\": " << timing.wallMilliseconds << ", \"cpuMilliseconds\": " << timing.cpuMilliseconds << "}";
+        return text.str();
+    };
+
+    ostringstream json;
+    json << "{\"operation\": \"" << operation << "\""
+         << ", \"load\": " << phase(stats.load)
+         << ", \"payload\": " << phase(stats.payload)
+         << ", \"save\": " << phase(stats.save)
+         << ", \"total\": " << phase(stats.total)
+         << ", \"bytesRead\": " << stats.bytesRead
+         << ", \"bytesWritten\": " << stats.bytesWritten
+         << ", \"payloadBytes\": " << stats.payloadBytes
+         << ", \"pixelsTouched\": " << stats.pixelsTouched
+         << ", \"channelBytesModified\": " << stats.channelBytesModified
+         << ", \"peakBufferBytes\": " << stats.peakBufferBytes
+         << "}";
+    return json.str();
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint> // std::*int*_t
+#include <ctime>   // std::clock_t
+#include <chrono>  // std::chrono::steady_clock
+#include <string>  // std::string
+
+namespace SteganographyLib
+{
+    /// @brief Time spent in one phase of an operation.
+    struct PhaseTiming
+    {
+        double wallMilliseconds = 0;
+        double cpuMilliseconds = 0; // CPU time of the whole process, so above the wall time when several threads work
+    };
+
+    /// @brief What the last embed or extract did, and where its time went.
+    struct OperationStats
+    {
+        PhaseTiming load;                       // reading the bitmap and decoding its pixels
+        PhaseTiming payload;                    // reading and encoding the data for embed, decoding and writing it for extract
+        PhaseTiming save;                       // writing the destination bitmap, embed only
+        PhaseTiming total;                      // the whole operation
+        std::uint64_t bytesRead = 0;            // bytes read from files and streams, bitmap and data, but not pages of a mapped bitmap
+        std::uint64_t bytesWritten = 0;         // bytes written to files and streams
+        std::uint64_t payloadBytes = 0;         // bytes of data embedded or extracted, without the header
+        std::uint64_t pixelsTouched = 0;        // pixels holding at least one channel byte of the embedded stream
+        std::uint64_t channelBytesModified = 0; // channel bytes whose value changed, embed only, counted with detailed stats
+        std::uint64_t peakBufferBytes = 0;      // largest amount of pixel and data buffers held at once, not counting mapped or caller buffers
+    };
+
+    /// @brief Adds the wall and CPU time of a scope to a phase.
+    class PhaseTimer
+    {
+        public:
+            explicit PhaseTimer(PhaseTiming &timing) noexcept;
+            ~PhaseTimer() noexcept;
+
+            PhaseTimer(const PhaseTimer &) = delete;
+            PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+        private:
+            PhaseTiming &m_timing;
+            std::chrono::steady_clock::time_point m_wallStart;
+            std::clock_t m_cpuStart;
+    };
+
+    /// @brief Formats stats as a single line JSON object, such as
+    ///     {"operation": "embed", "load": {"wallMilliseconds": 1.5, "cpuMilliseconds": 1.4}, ..., "peakBufferBytes": 482328}
+    std::string formatStatsJson(const std::string &operation, const OperationStats &stats);
+}
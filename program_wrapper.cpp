@@ -1,6 +1,17 @@
 #include "program_wrapper.h"
 #include <iostream>
+#include <fstream>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <csignal>
 #include "steganography.h"
+#include "batch.h"
+#include "shard.h"
+#include "server.h"
 
 using namespace std;
 
@@ -17,18 +28,140 @@ void percentageProgressCallback(int progressPercentage)
     cout << "Percent complete: " << progressPercentage << "\n";
 }
 
+// parses a whole field of --range, which must be a decimal number of bytes
+static bool parseRangeField(const string &text, uint64_t &value)
+{
+    if (text.empty() ||
+        text.find_first_not_of("0123456789") != string::npos)
+    {
+        return false;
+    }
+    try
+    {
+        value = stoull(text, nullptr, 10);
+    }
+    catch (const exception &)
+    {
+        return false;
+    }
+    return true;
+}
+
+// the server runs until it is interrupted
+static SteganographyLib::CancellationToken serverStop;
+
+extern "C" void stopServer(int)
+{
+    serverStop.cancel();
+}
+
 // By extracting the logic of the main() function into a wrapper, we can make it testable
 // without causing collision with the main() function from the test harness of choice.
 int SteganographyLib::mainWrapper(int argc, char* argv[])
 {
-    const string usage = "steganography embed bitmapPath sourceData destinationBitmap bitsPerPixel |\nsteganography extract bitmapPath destinationFile bitsPerPixel\n";
+    const string usage = "steganography embed bitmapPath sourceData destinationBitmap bitsPerPixel [--compression lz4] [--profile red,green,blue] [--scatter key] [--stats json] |\nsteganography extract bitmapPath destinationFile bitsPerPixel [--range offset:length] [--profile red,green,blue] [--scatter key] [--stats json] |\nsteganography batch manifestPath|- [workerCount] [--cover-cache megabytes] |\nsteganography probe bitmapPath bitsPerPixel [--scatter key] |\nsteganography scan directory [workerCount] |\nsteganography embed-shards sourceData bitsPerPixel cover destinationBitmap [cover destinationBitmap ...] [--workers count] [--compression lz4] |\nsteganography extract-shards destinationFile bitsPerPixel bitmap [bitmap ...] [--workers count] |\nsteganography serve socketPath [workerCount] [--cover-cache megabytes]\n";
 
     auto returnCode = SteganographyLib::SUCCESS;
 
+    // options ("--name value" or "--name=value") may appear anywhere, the other arguments keep their positions
+    map<string, string> options;
+    vector<char*> arguments;
+    for (int i = 0; i < argc; i++)
+    {
+        string argument = argv[i];
+        if (i == 0 || argument.compare(0, 2, "--") != 0)
+        {
+            arguments.push_back(argv[i]);
+            continue;
+        }
+
+        auto separator = argument.find('=');
+        if (separator != string::npos)
+        {
+            options[argument.substr(2, separator - 2)] = argument.substr(separator + 1);
+        }
+        else if (i + 1 < argc)
+        {
+            options[argument.substr(2)] = argv[++i];
+        }
+        else
+        {
+            cerr << "Missing value for option " << argument << "\n" << usage;
+            return ERROR_CODE_INVALID_ARGUMENTS;
+        }
+    }
+    argc = static_cast<int>(arguments.size());
+    argv = arguments.data();
+
+    // the options of every operation, any other option is refused rather than silently ignored
+    const map<string, vector<string>> operationOptions = {
+        {"embed", {"compression", "profile", "scatter", "stats"}},
+        {"extract", {"range", "profile", "scatter", "stats"}},
+        {"batch", {"cover-cache"}},
+        {"probe", {"scatter"}},
+        {"scan", {}},
+        {"embed-shards", {"workers", "compression"}},
+        {"extract-shards", {"workers"}},
+        {"serve", {"cover-cache"}}
+    };
+    auto operation = argc >= 2 ? operationOptions.find(argv[1]) : operationOptions.end();
+    for (const auto &option : options)
+    {
+        // an unknown operation is reported as such below
+        if (operation != operationOptions.end() &&
+            find(operation->second.begin(), operation->second.end(), option.first) == operation->second.end())
+        {
+            cerr << "Invalid option '--" << option.first << "' for " << operation->first << " operation.\n" << usage;
+            return ERROR_CODE_INVALID_ARGUMENTS;
+        }
+    }
+    if (options.count("stats") > 0 &&
+        options["stats"].compare("json") != 0)
+    {
+        cerr << "Invalid value for option --stats, expected json\n" << usage;
+        return ERROR_CODE_INVALID_ARGUMENTS;
+    }
+    bool printStats = options.count("stats") > 0;
+    if (options.count("compression") > 0 &&
+        options["compression"].compare("lz4") != 0)
+    {
+        cerr << "Invalid value for option --compression, expected lz4\n" << usage;
+        return ERROR_CODE_INVALID_ARGUMENTS;
+    }
+
+    // a density profile gives the bits of the R, G and B channels, such as 2,1,3
+    DensityProfile profile;
+    if (options.count("profile") > 0)
+    {
+        unsigned int red = 0;
+        unsigned int green = 0;
+        unsigned int blue = 0;
+        char end = 0;
+        if (sscanf(options["profile"].c_str(), "%u,%u,%u%c", &red, &green, &blue, &end) != 3 ||
+            red > 8 || green > 8 || blue > 8 ||
+            red + green + blue == 0)
+        {
+            cerr << "Invalid value for option --profile, expected red,green,blue with 0 to 8 bits each\n" << usage;
+            return ERROR_CODE_INVALID_ARGUMENTS;
+        }
+        profile = {static_cast<uint8_t>(red), static_cast<uint8_t>(green), static_cast<uint8_t>(blue)};
+    }
+
     // Apply dependency inversion principle by taking dependency on abstractions, not concretions.
     SteganographyLib::ISteganography *steg = new SteganographyLib::Steganography();
 
-    steg->registerProgressCallback(percentageProgressCallback, /* percentGrain */ 10);
+    // the stats are the only output on stdout when requested, so that they can be piped
+    if (printStats)
+    {
+        steg->setDetailedStats(true);
+    }
+    else
+    {
+        steg->registerProgressCallback(percentageProgressCallback, /* percentGrain */ 10);
+    }
+    steg->setCompression(options.count("compression") > 0);
+    steg->setDensityProfile(profile);
+    steg->setScatterKey(options.count("scatter") > 0 ? options["scatter"] : string());
 
     // Command line parsing
     if (argc < 2)
@@ -47,6 +180,10 @@ int SteganographyLib::mainWrapper(int argc, char* argv[])
         {
             int bitsPerPixel = strtol(argv[5], NULL, 10);
             steg->embed(argv[2],argv[3], argv[4], bitsPerPixel);
+            if (printStats)
+            {
+                cout << formatStatsJson("embed", steg->lastStats()) << "\n";
+            }
         }
     }
     else if (string(argv[1]).compare("extract") == 0)
@@ -59,7 +196,192 @@ int SteganographyLib::mainWrapper(int argc, char* argv[])
         else
         {
             int bitsPerPixel = strtol(argv[4], NULL, 10);
-            steg->extract(argv[2],argv[3], bitsPerPixel);
+            if (options.count("range") > 0)
+            {
+                // only the rows holding bytes [offset, offset + length) are read
+                const string &range = options["range"];
+                auto separator = range.find(':');
+                uint64_t offset = 0;
+                uint64_t length = 0;
+                if (separator == string::npos ||
+                    !parseRangeField(range.substr(0, separator), offset) ||
+                    !parseRangeField(range.substr(separator + 1), length))
+                {
+                    cerr << "Invalid value for option --range, expected offset:length\n" << usage;
+                    returnCode = ERROR_CODE_INVALID_ARGUMENTS;
+                }
+                else
+                {
+                    auto data = steg->extractRange(argv[2], offset, length, bitsPerPixel);
+                    ofstream destination(argv[3], ios::binary);
+                    destination.write(data.data(), data.size());
+                    destination.close();
+                    if (!destination)
+                    {
+                        cerr << "Could not write the extracted range to " << argv[3] << "\n";
+                        returnCode = ERROR_CODE_WRITE_FAILED;
+                    }
+                }
+            }
+            else
+            {
+                steg->extract(argv[2],argv[3], bitsPerPixel);
+            }
+            if (printStats)
+            {
+                cout << formatStatsJson("extract", steg->lastStats()) << "\n";
+            }
+        }
+    }
+    else if (string(argv[1]).compare("batch") == 0)
+    {
+        if (argc != 3 && argc != 4)
+        {
+            cerr << "Invalid argument count for batch operation\n" << usage;
+            returnCode = ERROR_CODE_INVALID_ARGUMENTS;
+        }
+        else
+        {
+            // the manifest is read from standard input when its path is '-'
+            size_t workerCount = argc == 4 ? strtoul(argv[3], NULL, 10) : 0;
+            ifstream manifestFile;
+            if (string(argv[2]).compare("-") != 0)
+            {
+                manifestFile.open(argv[2]);
+                if (!manifestFile.is_open())
+                {
+                    cerr << "Could not open batch manifest at " << argv[2] << "\n";
+                    delete steg;
+                    return ERROR_CODE_INVALID_ARGUMENTS;
+                }
+            }
+
+            // covers used by several jobs are decoded once when a cache is requested
+            shared_ptr<CoverCache> coverCache;
+            if (options.count("cover-cache") > 0)
+            {
+                coverCache = make_shared<CoverCache>(strtoull(options["cover-cache"].c_str(), NULL, 10) * 1024 * 1024);
+            }
+
+            auto summary = runBatch(manifestFile.is_open() ? manifestFile : cin, cout, workerCount, coverCache);
+            cerr << summary.succeeded << " jobs succeeded, " << summary.failed << " jobs failed\n";
+            if (coverCache)
+            {
+                auto stats = coverCache->stats();
+                cerr << "Cover cache: " << stats.hits << " hits, " << stats.misses << " misses, " << stats.evictions << " evictions\n";
+            }
+            if (summary.failed > 0)
+            {
+                returnCode = ERROR_CODE_BATCH_JOBS_FAILED;
+            }
+        }
+    }
+    else if (string(argv[1]).compare("probe") == 0)
+    {
+        if (argc != 4)
+        {
+            cerr << "Invalid argument count for probe operation\n" << usage;
+            returnCode = ERROR_CODE_INVALID_ARGUMENTS;
+        }
+        else
+        {
+            // a scattered payload starts wherever its key puts it
+            int bitsPerPixel = strtol(argv[3], NULL, 10);
+            Steganography prober;
+            prober.setScatterKey(options.count("scatter") > 0 ? options["scatter"] : string());
+            auto result = prober.probe(argv[2], bitsPerPixel);
+            cout << "Format: " << (result.format == ContainerFormat::Chunked ? "chunked" : "legacy") << "\n"
+                 << "Payload bytes: " << result.payloadLength << "\n"
+                 << "Capacity bytes: " << result.capacity << "\n"
+                 << "Remaining capacity bytes: " << result.remainingCapacity << "\n"
+                 << "Plausible: " << (result.plausible ? "yes" : "no") << "\n";
+            if (!result.plausible)
+            {
+                returnCode = ERROR_CODE_NO_PAYLOAD;
+            }
+        }
+    }
+    else if (string(argv[1]).compare("scan") == 0)
+    {
+        if (argc != 3 && argc != 4)
+        {
+            cerr << "Invalid argument count for scan operation\n" << usage;
+            returnCode = ERROR_CODE_INVALID_ARGUMENTS;
+        }
+        else
+        {
+            // one JSON line per bitmap on stdout, the totals on stderr
+            size_t workerCount = argc == 4 ? strtoul(argv[3], NULL, 10) : 0;
+            auto summary = runScan(argv[2], cout, workerCount);
+            cerr << summary.files << " bitmaps scanned, " << summary.flagged << " carry a payload, " << summary.failed << " could not be read\n";
+        }
+    }
+    else if (string(argv[1]).compare("embed-shards") == 0)
+    {
+        if (argc < 6 ||
+            argc % 2 != 0)
+        {
+            cerr << "Invalid argument count for embed-shards operation\n" << usage;
+            returnCode = ERROR_CODE_INVALID_ARGUMENTS;
+        }
+        else
+        {
+            // the covers and their destinations come in pairs
+            int bitsPerPixel = strtol(argv[3], NULL, 10);
+            size_t workerCount = options.count("workers") > 0 ? strtoul(options["workers"].c_str(), NULL, 10) : 0;
+            vector<string> covers;
+            vector<string> destinations;
+            for (int i = 4; i < argc; i += 2)
+            {
+                covers.push_back(argv[i]);
+                destinations.push_back(argv[i + 1]);
+            }
+            auto shards = embedSharded(covers, argv[2], destinations, bitsPerPixel, workerCount, options.count("compression") > 0);
+            for (const auto &shard : shards)
+            {
+                cout << "Shard " << shard.index + 1 << "/" << shard.count << ": " << shard.length << " bytes at offset " << shard.dataOffset
+                     << " in " << destinations[shard.index] << "\n";
+            }
+        }
+    }
+    else if (string(argv[1]).compare("extract-shards") == 0)
+    {
+        if (argc < 5)
+        {
+            cerr << "Invalid argument count for extract-shards operation\n" << usage;
+            returnCode = ERROR_CODE_INVALID_ARGUMENTS;
+        }
+        else
+        {
+            // the bitmaps can be given in any order
+            int bitsPerPixel = strtol(argv[3], NULL, 10);
+            size_t workerCount = options.count("workers") > 0 ? strtoul(options["workers"].c_str(), NULL, 10) : 0;
+            vector<string> bitmaps(argv + 4, argv + argc);
+            auto payloadLength = extractSharded(bitmaps, argv[2], bitsPerPixel, workerCount);
+            cout << "Reassembled " << payloadLength << " bytes from " << bitmaps.size() << " shards\n";
+        }
+    }
+    else if (string(argv[1]).compare("serve") == 0)
+    {
+        if (argc != 3 && argc != 4)
+        {
+            cerr << "Invalid argument count for serve operation\n" << usage;
+            returnCode = ERROR_CODE_INVALID_ARGUMENTS;
+        }
+        else
+        {
+            // one status line per job on stdout, the totals on stderr once interrupted
+            size_t workerCount = argc == 4 ? strtoul(argv[3], NULL, 10) : 0;
+            shared_ptr<CoverCache> coverCache;
+            if (options.count("cover-cache") > 0)
+            {
+                coverCache = make_shared<CoverCache>(strtoull(options["cover-cache"].c_str(), NULL, 10) * 1024 * 1024);
+            }
+            signal(SIGINT, stopServer);
+            signal(SIGTERM, stopServer);
+            cerr << "Serving on " << argv[2] << "\n";
+            auto summary = runServer(argv[2], workerCount, coverCache, serverStop, &cout);
+            cerr << summary.connections << " connections, " << summary.succeeded << " jobs succeeded, " << summary.failed << " jobs failed\n";
         }
     }
     else
@@ -5,6 +5,9 @@ namespace SteganographyLib
     const int SUCCESS = 0;
     const int ERROR_CODE_INVALID_ARGUMENTS = 1;
     const int ERROR_CODE_INVALID_OPERATION = 2;
+    const int ERROR_CODE_BATCH_JOBS_FAILED = 3;
+    const int ERROR_CODE_NO_PAYLOAD = 4;
+    const int ERROR_CODE_WRITE_FAILED = 5;
 
     int mainWrapper(int argc, char* argv[]);
 }
@@ -0,0 +1,159 @@
+#include <cstdint>   // std::*int*_t
+#include <algorithm> // std::min, std::max
+#include <vector>    // std::vector
+#include "scatter.h"
+
+#define SCATTER_BAND_PIXELS (64 * 1024)
+#define SCATTER_TILE_PIXELS 256
+#define FEISTEL_ROUNDS 4
+
+using namespace std;
+
+namespace
+{
+    // the splitmix64 finalizer, which spreads every bit of its input over all the bits of its output
+    uint64_t mix(uint64_t value)
+    {
+        value ^= value >> 30;
+        value *= 0xBF58476D1CE4E5B9ull;
+        value ^= value >> 27;
+        value *= 0x94D049BB133111EBull;
+        value ^= value >> 31;
+        return value;
+    }
+
+    // keyed permutation of [0, domain): a balanced Feistel network over the smallest even number of bits that holds
+    // the domain, applied again to its own output until that lands inside the domain, fewer than 4 times on average
+    uint64_t permute(uint64_t value, uint64_t domain, uint64_t key)
+    {
+        if (domain <= 1)
+        {
+            return value;
+        }
+        unsigned int bits = 1;
+        while (((domain - 1) >> bits) != 0)
+        {
+            bits++;
+        }
+        unsigned int half = (bits + 1) / 2;
+        uint64_t mask = (1ull << half) - 1;
+        do
+        {
+            uint64_t left = value >> half;
+            uint64_t right = value & mask;
+            for (uint64_t round = 0; round < FEISTEL_ROUNDS; round++)
+            {
+                uint64_t next = left ^ (mix(right ^ key ^ (round * 0x9E3779B97F4A7C15ull)) & mask);
+                left = right;
+                right = next;
+            }
+            value = left << half | right;
+        } while (value >= domain);
+        return value;
+    }
+}
+
+SteganographyLib::ScatterOrder::ScatterOrder(std::size_t width, std::size_t height, std::uint64_t key) noexcept
+    : m_width(width),
+      m_height(height),
+      m_key(key)
+{
+    // the bands depend on the width only, so the same key gives the same order to every image of the same size
+    m_bandRows = min<std::size_t>(max<std::size_t>(SCATTER_BAND_PIXELS / max<std::size_t>(width, 1), 1), max<std::size_t>(height, 1));
+    m_bandPixels = static_cast<std::uint64_t>(m_bandRows) * width;
+    m_fullBands = height / m_bandRows;
+    m_tilesPerBand = static_cast<std::size_t>((m_bandPixels + SCATTER_TILE_PIXELS - 1) / SCATTER_TILE_PIXELS);
+}
+
+std::uint64_t SteganographyLib::ScatterOrder::key(const std::string &passphrase) noexcept
+{
+    // FNV-1a, then mixed so that similar passphrases give unrelated keys
+    std::uint64_t hash = 0xCBF29CE484222325ull;
+    for (char c : passphrase)
+    {
+        hash ^= static_cast<std::uint8_t>(c);
+        hash *= 0x100000001B3ull;
+    }
+    return mix(hash);
+}
+
+std::size_t SteganographyLib::ScatterOrder::tileCount() const noexcept
+{
+    std::uint64_t lastBandPixels = pixelCount() - m_fullBands * m_bandPixels;
+    return static_cast<std::size_t>(m_fullBands * m_tilesPerBand + (lastBandPixels + SCATTER_TILE_PIXELS - 1) / SCATTER_TILE_PIXELS);
+}
+
+SteganographyLib::ScatterTile SteganographyLib::ScatterOrder::tile(std::size_t index) const noexcept
+{
+    ScatterTile tile;
+    std::uint64_t band;
+    std::uint64_t bandPixels;
+    std::uint64_t order; // position of the tile in the walk of its band
+    std::uint64_t fullBandTiles = m_fullBands * m_tilesPerBand;
+    if (index < fullBandTiles)
+    {
+        std::uint64_t bandOrder = index / m_tilesPerBand;
+        order = index % m_tilesPerBand;
+        band = permute(bandOrder, m_fullBands, m_key);
+        bandPixels = m_bandPixels;
+        tile.position = bandOrder * m_bandPixels + order * SCATTER_TILE_PIXELS;
+    }
+    else
+    {
+        // the short band at the bottom of the image comes last
+        order = index - fullBandTiles;
+        band = m_fullBands;
+        bandPixels = pixelCount() - m_fullBands * m_bandPixels;
+        tile.position = m_fullBands * m_bandPixels + order * SCATTER_TILE_PIXELS;
+    }
+
+    // and so does the short tile at the end of a band
+    std::uint64_t wholeTiles = bandPixels / SCATTER_TILE_PIXELS;
+    std::uint64_t slot = order < wholeTiles ? permute(order, wholeTiles, bandKey(band)) : order;
+    tile.firstPixel = band * m_bandPixels + slot * SCATTER_TILE_PIXELS;
+    tile.pixelCount = static_cast<std::size_t>(min<std::uint64_t>(SCATTER_TILE_PIXELS, bandPixels - slot * SCATTER_TILE_PIXELS));
+    return tile;
+}
+
+std::size_t SteganographyLib::ScatterOrder::tileAt(std::uint64_t position) const noexcept
+{
+    std::uint64_t fullBandPixels = m_fullBands * m_bandPixels;
+    if (position < fullBandPixels)
+    {
+        return static_cast<std::size_t>(position / m_bandPixels * m_tilesPerBand + position % m_bandPixels / SCATTER_TILE_PIXELS);
+    }
+    return static_cast<std::size_t>(m_fullBands * m_tilesPerBand + (position - fullBandPixels) / SCATTER_TILE_PIXELS);
+}
+
+std::vector<SteganographyLib::ChannelSpan> SteganographyLib::ScatterOrder::spans(std::uint8_t *first, std::ptrdiff_t rowStep, std::ptrdiff_t pixelStride) const
+{
+    return spans(first, rowStep, pixelStride, 0, tileCount());
+}
+
+std::vector<SteganographyLib::ChannelSpan> SteganographyLib::ScatterOrder::spans(std::uint8_t *first, std::ptrdiff_t rowStep, std::ptrdiff_t pixelStride,
+                                                                                  std::size_t firstTile, std::size_t tileCount) const
+{
+    vector<ChannelSpan> result;
+    result.reserve(tileCount + tileCount / 4);
+    for (std::size_t i = firstTile; i < firstTile + tileCount; i++)
+    {
+        ScatterTile tile = this->tile(i);
+        std::uint64_t pixel = tile.firstPixel;
+        std::size_t remaining = tile.pixelCount;
+        while (remaining > 0)
+        {
+            std::size_t y = static_cast<std::size_t>(pixel / m_width);
+            std::size_t x = static_cast<std::size_t>(pixel % m_width);
+            std::size_t run = min(remaining, m_width - x);
+            result.push_back({first + static_cast<std::ptrdiff_t>(y) * rowStep + static_cast<std::ptrdiff_t>(x) * pixelStride, run, pixelStride});
+            pixel += run;
+            remaining -= run;
+        }
+    }
+    return result;
+}
+
+std::uint64_t SteganographyLib::ScatterOrder::bandKey(std::uint64_t band) const noexcept
+{
+    return mix(m_key ^ mix(band + 1));
+}
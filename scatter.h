@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint> // std::*int*_t
+#include <cstddef> // std::size_t, std::ptrdiff_t
+#include <string>  // std::string
+#include <vector>  // std::vector
+#include "bitpacker.h"
+
+namespace SteganographyLib
+{
+    /// @brief A run of consecutive pixels of an image, in row-major order, which a scattered walk goes through in one go.
+    struct ScatterTile
+    {
+        std::uint64_t position;   // position in the walk of the first pixel of the tile
+        std::uint64_t firstPixel; // index of the first pixel in the image, row after row from the top left pixel
+        std::size_t pixelCount;
+    };
+
+    /// @brief Keyed order in which a scattered walk visits the pixels of an image.
+    /// The image is cut into bands of whole rows of about 64K pixels, small enough to stay in the cache of a core, and
+    /// every band into tiles of 256 consecutive pixels.  The walk goes through the bands in a keyed order, through the
+    /// tiles of each band in a keyed order, and through the pixels of each tile from left to right.  Both orders are
+    /// Feistel permutations, so the tile that holds any position of the walk is found in constant time, without
+    /// building the order, and a run of the walk only ever works on one band at a time.  The short band at the bottom
+    /// of the image and the short tile at the end of each band keep their place at the end.
+    /// The order hides where the data lies from anyone without the key.  It is not encryption: the data bits are
+    /// stored as they are.
+    class ScatterOrder
+    {
+        public:
+            /// @brief Constructor
+            /// @param key Key of the order, see key().
+            ScatterOrder(std::size_t width, std::size_t height, std::uint64_t key) noexcept;
+
+            /// @brief Derives the key of an order from a passphrase.
+            static std::uint64_t key(const std::string &passphrase) noexcept;
+
+            /// @brief Returns the number of pixels of the image, which is also the length of the walk.
+            std::uint64_t pixelCount() const noexcept { return static_cast<std::uint64_t>(m_width) * m_height; }
+
+            /// @brief Returns the number of tiles of the walk.
+            std::size_t tileCount() const noexcept;
+
+            /// @brief Returns the tile at an index of the walk.
+            /// @param index Less than tileCount().
+            ScatterTile tile(std::size_t index) const noexcept;
+
+            /// @brief Returns the index in the walk of the tile that holds a position of the walk.
+            /// @param position Less than pixelCount().
+            std::size_t tileAt(std::uint64_t position) const noexcept;
+
+            /// @brief Returns the channel spans of one byte of every pixel, in the order of the walk.  A tile that
+            /// wraps around the end of a row takes a span in each row.
+            /// @param first The byte of the top left pixel.
+            /// @param rowStep Distance in bytes from a row to the row below it, negative for bottom-up images.
+            /// @param pixelStride Distance in bytes from a pixel to the next pixel of its row.
+            std::vector<ChannelSpan> spans(std::uint8_t *first, std::ptrdiff_t rowStep, std::ptrdiff_t pixelStride) const;
+
+            /// @brief Returns the channel spans of a range of tiles, see spans().
+            std::vector<ChannelSpan> spans(std::uint8_t *first, std::ptrdiff_t rowStep, std::ptrdiff_t pixelStride,
+                                           std::size_t firstTile, std::size_t tileCount) const;
+
+        private:
+            std::uint64_t bandKey(std::uint64_t band) const noexcept;
+
+            std::size_t m_width;
+            std::size_t m_height;
+            std::uint64_t m_key;
+            std::size_t m_bandRows;
+            std::uint64_t m_bandPixels;
+            std::uint64_t m_fullBands;
+            std::size_t m_tilesPerBand;
+    };
+}
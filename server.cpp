@@ -0,0 +1,314 @@
+#include <ostream>    // std::ostream
+#include <vector>     // std::vector
+#include <thread>     // std::thread
+#include <mutex>      // std::mutex
+#include <condition_variable> // std::condition_variable
+#include <filesystem> // std::filesystem::is_socket
+#include <chrono>     // std::chrono::steady_clock
+#include <stdexcept>  // std::runtime_error
+#include <algorithm>  // std::max
+#include "server.h"
+#include "batch.h"
+#include "steganography.h"
+#include "threadpool.h"
+
+#if !defined(_WIN32)
+#include <cerrno>       // errno
+#include <cstring>      // std::memcpy
+#include <poll.h>       // poll
+#include <sys/socket.h> // socket, bind, listen, accept, recv, send
+#include <sys/un.h>     // sockaddr_un
+#include <unistd.h>     // close
+#endif
+
+#define SERVER_POLL_MILLISECONDS 100
+#define SERVER_READ_SIZE 4096
+#define SERVER_MAX_LINE_SIZE (64 * 1024)
+#define SERVER_MAX_CONNECTIONS 64
+
+using namespace std;
+
+#if defined(_WIN32)
+
+SteganographyLib::ServerSummary SteganographyLib::runServer(const std::string &socketPath, std::size_t workerCount, std::shared_ptr<CoverCache> coverCache, const CancellationToken &stop, std::ostream *log)
+{
+    throw runtime_error("The server is not supported on this platform.");
+}
+
+#else
+
+namespace
+{
+    // a client connection, closed once its reader and the jobs it sent are all done with it
+    class Connection
+    {
+        public:
+            explicit Connection(int fd) : m_fd(fd)
+            {
+#if defined(SO_NOSIGPIPE)
+                // a client that goes away must not kill the server with SIGPIPE
+                int enabled = 1;
+                setsockopt(m_fd, SOL_SOCKET, SO_NOSIGPIPE, &enabled, sizeof(enabled));
+#endif
+            }
+
+            ~Connection() noexcept
+            {
+                close(m_fd);
+            }
+
+            Connection(const Connection &) = delete;
+            Connection &operator=(const Connection &) = delete;
+
+            int fd() const noexcept { return m_fd; }
+
+            // writes a whole status line, or nothing more once the client has gone away
+            void send(const string &text)
+            {
+                lock_guard<mutex> lock(m_sendMutex);
+#if defined(MSG_NOSIGNAL)
+                const int flags = MSG_NOSIGNAL;
+#else
+                const int flags = 0;
+#endif
+                size_t sent = 0;
+                while (sent < text.size())
+                {
+                    ssize_t count = ::send(m_fd, text.data() + sent, text.size() - sent, flags);
+                    if (count < 0 && errno == EINTR)
+                    {
+                        continue;
+                    }
+                    if (count <= 0)
+                    {
+                        return;
+                    }
+                    sent += static_cast<size_t>(count);
+                }
+            }
+
+        private:
+            int m_fd;
+            mutex m_sendMutex;
+    };
+
+    // Steganography instances kept warm between jobs, one per worker at most
+    class InstancePool
+    {
+        public:
+            explicit InstancePool(shared_ptr<SteganographyLib::CoverCache> coverCache) : m_coverCache(move(coverCache)) {}
+
+            unique_ptr<SteganographyLib::Steganography> acquire()
+            {
+                {
+                    lock_guard<mutex> lock(m_mutex);
+                    if (!m_idle.empty())
+                    {
+                        auto steg = move(m_idle.back());
+                        m_idle.pop_back();
+                        return steg;
+                    }
+                }
+                auto steg = make_unique<SteganographyLib::Steganography>();
+                steg->setCoverCache(m_coverCache);
+                return steg;
+            }
+
+            void release(unique_ptr<SteganographyLib::Steganography> steg)
+            {
+                lock_guard<mutex> lock(m_mutex);
+                m_idle.push_back(move(steg));
+            }
+
+        private:
+            shared_ptr<SteganographyLib::CoverCache> m_coverCache;
+            mutex m_mutex;
+            vector<unique_ptr<SteganographyLib::Steganography>> m_idle;
+    };
+
+    // waits until the socket can be read or 'stop' is cancelled, whichever comes first
+    bool waitReadable(int fd, const SteganographyLib::CancellationToken &stop)
+    {
+        while (!stop.cancelled())
+        {
+            pollfd descriptor = {fd, POLLIN, 0};
+            int ready = poll(&descriptor, 1, SERVER_POLL_MILLISECONDS);
+            if (ready > 0)
+            {
+                return true;
+            }
+            if (ready < 0 && errno != EINTR)
+            {
+                return false;
+            }
+        }
+        return false;
+    }
+}
+
+SteganographyLib::ServerSummary SteganographyLib::runServer(const std::string &socketPath, std::size_t workerCount, std::shared_ptr<CoverCache> coverCache, const CancellationToken &stop, std::ostream *log)
+{
+    if (workerCount == 0)
+    {
+        workerCount = max(1u, thread::hardware_concurrency());
+    }
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socketPath.empty() ||
+        socketPath.size() >= sizeof(address.sun_path))
+    {
+        throw runtime_error("Invalid socket path " + socketPath + ", it must have between 1 and " + to_string(sizeof(address.sun_path) - 1) + " bytes.");
+    }
+    memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+    // the socket of a previous server is replaced, any other file is left alone
+    std::error_code error;
+    if (filesystem::is_socket(socketPath, error))
+    {
+        filesystem::remove(socketPath, error);
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+    {
+        throw runtime_error("Could not create a socket for " + socketPath);
+    }
+    if (::bind(listener, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 ||
+        listen(listener, SOMAXCONN) != 0)
+    {
+        close(listener);
+        throw runtime_error("Could not listen on socket at " + socketPath);
+    }
+
+    // the instances outlive the workers, which outlive the connections
+    InstancePool instances(coverCache);
+    mutex summaryMutex;
+    ServerSummary summary;
+    condition_variable readersDone;
+    size_t readerCount = 0;
+    {
+        ThreadPool workers(workerCount);
+
+        auto runJob = [&](const shared_ptr<Connection> &connection, const string &text, size_t line, chrono::steady_clock::time_point received)
+        {
+            auto steg = instances.acquire();
+            BatchJobStatus status = runBatchJob(*steg, text, line, received);
+            instances.release(move(steg));
+            connection->send(status.text);
+
+            lock_guard<mutex> lock(summaryMutex);
+            (status.succeeded ? summary.succeeded : summary.failed)++;
+            if (log != nullptr)
+            {
+                *log << status.text << flush;
+            }
+        };
+
+        // reads the jobs of a connection line by line and hands them to the workers as they arrive
+        auto readConnection = [&](shared_ptr<Connection> connection)
+        {
+            string pending;
+            size_t line = 0;
+            bool lineTooLong = false;
+            char buffer[SERVER_READ_SIZE];
+            while (!lineTooLong && waitReadable(connection->fd(), stop))
+            {
+                ssize_t count = recv(connection->fd(), buffer, sizeof(buffer), 0);
+                if (count < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (count <= 0)
+                {
+                    break;
+                }
+                auto received = chrono::steady_clock::now();
+                pending.append(buffer, static_cast<size_t>(count));
+
+                size_t start = 0;
+                for (size_t end = pending.find('\n'); end != string::npos; end = pending.find('\n', start))
+                {
+                    if (end - start > SERVER_MAX_LINE_SIZE)
+                    {
+                        break;
+                    }
+                    string text = pending.substr(start, end - start);
+                    start = end + 1;
+                    line++;
+                    if (!text.empty() && text.back() == '\r')
+                    {
+                        text.pop_back();
+                    }
+                    size_t first = text.find_first_not_of(" \t");
+                    if (first == string::npos || text[first] == '#')
+                    {
+                        continue;
+                    }
+                    workers.submit([=, &runJob]() { runJob(connection, text, line, received); });
+                }
+                pending.erase(0, start);
+
+                // a client that never ends its line must not grow the buffer without bound, and the rest of its
+                // stream cannot be split into jobs reliably, so the connection is closed after the status
+                if (pending.size() > SERVER_MAX_LINE_SIZE &&
+                    pending.find('\n') > SERVER_MAX_LINE_SIZE)
+                {
+                    lineTooLong = true;
+                    string status = "{\"line\": " + to_string(line + 1) + ", \"status\": \"error\", \"error\": \"The line is longer than "
+                        + to_string(SERVER_MAX_LINE_SIZE) + " bytes.\"}\n";
+                    connection->send(status);
+
+                    lock_guard<mutex> lock(summaryMutex);
+                    summary.failed++;
+                    if (log != nullptr)
+                    {
+                        *log << status << flush;
+                    }
+                }
+            }
+
+            lock_guard<mutex> lock(summaryMutex);
+            readerCount--;
+            readersDone.notify_all();
+        };
+
+        // past the connection limit, new clients wait in the backlog of the socket until a reader is done
+        auto readerAvailable = [&]()
+        {
+            unique_lock<mutex> lock(summaryMutex);
+            while (readerCount >= SERVER_MAX_CONNECTIONS &&
+                   !stop.cancelled())
+            {
+                readersDone.wait_for(lock, chrono::milliseconds(SERVER_POLL_MILLISECONDS));
+            }
+            return !stop.cancelled();
+        };
+
+        while (readerAvailable() &&
+               waitReadable(listener, stop))
+        {
+            int fd = accept(listener, nullptr, nullptr);
+            if (fd < 0)
+            {
+                continue;
+            }
+            auto connection = make_shared<Connection>(fd);
+            {
+                lock_guard<mutex> lock(summaryMutex);
+                summary.connections++;
+                readerCount++;
+            }
+            thread(readConnection, move(connection)).detach();
+        }
+        close(listener);
+        filesystem::remove(socketPath, error);
+
+        // the readers stop within a poll interval, then the workers finish the jobs already read
+        unique_lock<mutex> lock(summaryMutex);
+        readersDone.wait(lock, [&]() { return readerCount == 0; });
+    }
+
+    return summary;
+}
+
+#endif
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef> // std::size_t
+#include <iosfwd>  // std::ostream
+#include <string>  // std::string
+#include <memory>  // std::shared_ptr
+#include "covercache.h"
+#include "cancellation.h"
+
+namespace SteganographyLib
+{
+    /// @brief Counters of a server, see runServer().
+    struct ServerSummary
+    {
+        std::size_t connections = 0;
+        std::size_t succeeded = 0;
+        std::size_t failed = 0;
+    };
+
+    /// @brief Serves embed, extract and probe jobs to local clients on a Unix domain socket, until 'stop' is cancelled.
+    /// A client connects and writes jobs as the lines of a batch manifest, see parseBatchJob(), and reads one status
+    /// line per job, the same as runBatch() writes, in completion order: the "line" of a status is the line of the job
+    /// on its connection, and JSON jobs can carry an "id" that the status echoes.  The milliseconds of a status count
+    /// from the moment the job was read, queueing included, which is the latency the client sees.
+    /// Every connection is read on a thread of its own, and its jobs run on a pool of workers, so a client can send
+    /// several jobs without waiting and a slow job never holds up the other connections beyond the workers it takes.
+    /// The workers, a warm Steganography instance per worker with its buffers, and the cover cache live as long as the
+    /// server, which is what makes small jobs cheap.  Jobs already read when the server stops still run and get their
+    /// status.  The socket file is replaced if it exists, and removed when the server stops.
+    /// A line longer than 64 KiB gets an error status and closes its connection.  At most 64 connections are read at
+    /// once, further clients wait in the backlog of the socket until one of them closes.
+    /// @param socketPath Path of the socket, which must be short enough for a socket address (about 100 bytes).
+    /// @param workerCount Number of workers, 0 selects the number of hardware threads.
+    /// @param coverCache Cache of decoded covers shared by the workers, or nullptr for none.
+    /// @param stop Token that stops the server, checked every 100 ms.
+    /// @param log Receives every status line as well, or nullptr.
+    /// @throws std::runtime_error if the socket cannot be created, and on Windows, where the server is not supported
+    ServerSummary runServer(const std::string &socketPath, std::size_t workerCount, std::shared_ptr<CoverCache> coverCache, const CancellationToken &stop, std::ostream *log = nullptr);
+}
@@ -0,0 +1,157 @@
+#include <stdexcept>  // std::runtime_error
+#include <algorithm>  // std::min, std::sort
+#include <filesystem> // std::filesystem::file_size
+#include <random>     // std::random_device
+#include "shard.h"
+#include "steganography.h"
+#include "threadpool.h"
+#include "fileio.h"
+
+using namespace std;
+
+std::vector<SteganographyLib::ContainerShard> SteganographyLib::planShards(const std::vector<std::uint64_t> &capacities, std::uint64_t payloadLength, std::uint64_t payloadId)
+{
+    if (capacities.empty() ||
+        capacities.size() > UINT32_MAX)
+    {
+        throw runtime_error("Invalid number of covers.");
+    }
+    uint64_t totalCapacity = 0;
+    for (uint64_t capacity : capacities)
+    {
+        totalCapacity += capacity;
+    }
+    if (payloadLength > totalCapacity)
+    {
+        throw runtime_error("Data file is too large to fit in the covers.  Use more or larger covers or a higher packing density.");
+    }
+
+    // the proportional lengths are rounded down, then the bytes left go to the first covers with room for them
+    vector<uint64_t> lengths(capacities.size());
+    uint64_t assigned = 0;
+    for (size_t i = 0; i < capacities.size(); i++)
+    {
+        long double share = static_cast<long double>(payloadLength) * capacities[i] / totalCapacity;
+        lengths[i] = min(capacities[i], min(static_cast<uint64_t>(share), payloadLength - assigned));
+        assigned += lengths[i];
+    }
+    for (size_t i = 0; i < capacities.size() && assigned < payloadLength; i++)
+    {
+        uint64_t extra = min(capacities[i] - lengths[i], payloadLength - assigned);
+        lengths[i] += extra;
+        assigned += extra;
+    }
+
+    vector<ContainerShard> shards(capacities.size());
+    uint64_t offset = 0;
+    for (size_t i = 0; i < shards.size(); i++)
+    {
+        shards[i] = {payloadId, static_cast<uint32_t>(i), static_cast<uint32_t>(shards.size()), offset, lengths[i], payloadLength};
+        offset += lengths[i];
+    }
+    return shards;
+}
+
+std::vector<SteganographyLib::ContainerShard> SteganographyLib::embedSharded(const std::vector<std::string> &covers, const std::string &sourceDataFilePath, const std::vector<std::string> &destinations,
+                                                                             std::uint8_t bitsPerPixel, std::size_t workerCount, bool compression)
+{
+    if (covers.size() != destinations.size())
+    {
+        throw runtime_error("Every cover needs a destination bitmap.");
+    }
+
+    // the capacities only need the bitmap headers
+    ThreadPool pool(workerCount);
+    vector<uint64_t> capacities(covers.size());
+    pool.parallelFor(covers.size(), [&](size_t i)
+    {
+        Steganography steg;
+        steg.setCompression(compression);
+        capacities[i] = steg.shardCapacity(covers[i], bitsPerPixel);
+    });
+
+    // the payload ID tells apart the shards of different payloads embedded in the same covers
+    random_device random;
+    uint64_t payloadId = (static_cast<uint64_t>(random()) << 32) | random();
+    vector<ContainerShard> shards = planShards(capacities, filesystem::file_size(sourceDataFilePath), payloadId);
+
+    try
+    {
+        pool.parallelFor(shards.size(), [&](size_t i)
+        {
+            Steganography steg;
+            steg.setCompression(compression);
+            steg.embedShard(covers[i], sourceDataFilePath, shards[i], destinations[i], bitsPerPixel);
+        });
+    }
+    catch(...)
+    {
+        for (const auto &destination : destinations)
+        {
+            std::error_code error;
+            filesystem::remove(destination, error);
+        }
+        throw;
+    }
+    return shards;
+}
+
+std::uint64_t SteganographyLib::extractSharded(const std::vector<std::string> &bitmaps, const std::string &destinationDataFilePath, std::uint8_t bitsPerPixel, std::size_t workerCount)
+{
+    if (bitmaps.empty())
+    {
+        throw runtime_error("No shard to extract.");
+    }
+
+    // the shard records are checked before any data is decoded
+    ThreadPool pool(workerCount);
+    vector<ContainerShard> shards(bitmaps.size());
+    pool.parallelFor(bitmaps.size(), [&](size_t i)
+    {
+        shards[i] = Steganography().readShard(bitmaps[i], bitsPerPixel);
+    });
+
+    vector<ContainerShard> ordered = shards;
+    sort(ordered.begin(), ordered.end(), [](const ContainerShard &a, const ContainerShard &b) { return a.index < b.index; });
+    uint64_t offset = 0;
+    for (size_t i = 0; i < ordered.size(); i++)
+    {
+        if (ordered[i].payloadId != ordered[0].payloadId ||
+            ordered[i].totalLength != ordered[0].totalLength ||
+            ordered[i].count != ordered[0].count)
+        {
+            throw runtime_error("The shards do not belong to the same payload.");
+        }
+        if (ordered[i].index != i ||
+            ordered[i].dataOffset != offset)
+        {
+            throw runtime_error("Shard " + to_string(i) + " of the payload is missing or duplicated.");
+        }
+        offset += ordered[i].length;
+    }
+    if (ordered.size() != ordered[0].count ||
+        offset != ordered[0].totalLength)
+    {
+        throw runtime_error("Some shards of the payload are missing.");
+    }
+
+    // every worker writes its shard at its place in a file of the final size
+    try
+    {
+        {
+            RandomAccessFile destination(destinationDataFilePath, RandomAccessFile::Mode::Create);
+        }
+        filesystem::resize_file(destinationDataFilePath, offset);
+        pool.parallelFor(bitmaps.size(), [&](size_t i)
+        {
+            Steganography().extractShard(bitmaps[i], destinationDataFilePath, bitsPerPixel);
+        });
+    }
+    catch(...)
+    {
+        std::error_code error;
+        filesystem::remove(destinationDataFilePath, error);
+        throw;
+    }
+    return offset;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint> // std::*int*_t
+#include <cstddef> // std::size_t
+#include <string>  // std::string
+#include <vector>  // std::vector
+#include "container.h"
+
+namespace SteganographyLib
+{
+    /// @brief Splits a payload across covers in proportion to their capacities, so that every cover is filled to
+    /// about the same fraction and the shards take about as long to embed per pixel.
+    /// @param capacities Bytes of data each cover can hold, see Steganography::shardCapacity().
+    /// @param payloadLength Bytes of the whole payload.
+    /// @param payloadId Identifier written in every shard.
+    /// @return One shard per cover, in the order of the covers.  Shards can be empty when the payload is small.
+    /// @throws std::runtime_error if the payload does not fit in the covers together
+    std::vector<ContainerShard> planShards(const std::vector<std::uint64_t> &capacities, std::uint64_t payloadLength, std::uint64_t payloadId);
+
+    /// @brief Embeds a payload too large for any single cover across several covers.  The capacities of the covers are
+    /// read from their headers, the payload is split with planShards() under a random payload ID, then every shard is
+    /// embedded concurrently, each worker reading its own range of the source file.  If any shard fails, no
+    /// destination bitmap is left behind.
+    /// @param covers Paths to the original bitmaps.
+    /// @param sourceDataFilePath Path to the payload.
+    /// @param destinations Paths to the bitmaps that receive the shards, one per cover.
+    /// @param bitsPerPixel Density of every shard.  Must be a multiple of 3 between 3 and 24.
+    /// @param workerCount Number of workers, 0 selects the number of hardware threads.
+    /// @param compression Compresses the data of every shard, see Steganography::setCompression().
+    /// @return The shards, in the order of the covers.
+    /// @throws std::runtime_error on error
+    std::vector<ContainerShard> embedSharded(const std::vector<std::string> &covers, const std::string &sourceDataFilePath, const std::vector<std::string> &destinations,
+                                             std::uint8_t bitsPerPixel, std::size_t workerCount, bool compression = false);
+
+    /// @brief Reassembles a payload from the bitmaps of embedSharded(), given in any order.  The shard records are read
+    /// and checked first: every shard of one payload must be present exactly once.  The shards are then extracted
+    /// concurrently, each straight into its place in the destination file.  If any shard fails, the destination file
+    /// is removed.
+    /// @param bitmaps Paths to the bitmaps holding the shards.
+    /// @param destinationDataFilePath Path to the reassembled payload.
+    /// @param bitsPerPixel Density of the shards.
+    /// @param workerCount Number of workers, 0 selects the number of hardware threads.
+    /// @return Bytes of the payload.
+    /// @throws std::runtime_error on error
+    std::uint64_t extractSharded(const std::vector<std::string> &bitmaps, const std::string &destinationDataFilePath, std::uint8_t bitsPerPixel, std::size_t workerCount);
+}
@@ -3,10 +3,28 @@
 #include <filesystem> // std::filesystem::file_size
 #include <cassert>    // assert
 #include <cmath>      // ceil
+#include <algorithm>  // std::min
+#include <numeric>    // std::gcd
+#include <cstring>    // std::memcpy
+#include <iterator>   // std::istreambuf_iterator
+#include <chrono>     // std::chrono::steady_clock
+#include <thread>     // std::thread
+#include <mutex>      // std::mutex
+#include <exception>  // std::exception_ptr
+#include <unordered_map> // std::unordered_map
 #include "steganography.h"
+#include "fileio.h"
+#include "container.h"
+#include "operationstats.h"
+#include "lz.h"
 
-#define FILE_CHUNK_SIZE 1024
-#define LSB_BYTE_MASK 0x01
+#define BLOCK_SIZE (64 * 1024)
+#define PARALLEL_SEGMENT_SIZE (1024 * 1024)
+#define PARALLEL_MIN_SEGMENT_SIZE (16 * 1024)
+#define DIRECT_WRITE_MIN_SIZE (64 * 1024 * 1024)
+#define PIPELINE_BLOCK_SIZE (1024 * 1024)
+#define PIPELINE_BLOCK_COUNT 4
+#define COMPRESSION_BUFFER_COUNT 3
 
 using namespace std;
 using namespace bmp;
@@ -14,6 +32,22 @@ using namespace bmp;
 SteganographyLib::Steganography::Steganography() noexcept
 {
     m_progressCallback = nullptr;
+    m_memoryMapping = false;
+    m_alphaEmbedding = false;
+    m_directWrites = false;
+    m_pipelining = false;
+    m_outputMode = OutputMode::Rewrite;
+    m_threadCount = 1;
+    m_containerFormat = ContainerFormat::Chunked;
+    m_compression = false;
+    m_densityProfile = DensityProfile();
+    m_scatter = false;
+    m_scatterKey = 0;
+    m_progressInterval = chrono::milliseconds(0);
+    m_deadline = chrono::steady_clock::time_point::max();
+    m_bytesDone = 0;
+    m_bytesTotal = 0;
+    m_detailedStats = false;
 }
 
 SteganographyLib::Steganography::~Steganography() noexcept
@@ -22,8 +56,25 @@ SteganographyLib::Steganography::~Steganography() noexcept
 
 void SteganographyLib::Steganography::embed(const std::string &originalBitmapFilePath, const std::string &sourceDataFilePath, const std::string &destinationBitmapDataFilePath, std::uint8_t bitsPerPixel)
 {
+    embedFile(originalBitmapFilePath, sourceDataFilePath, destinationBitmapDataFilePath, bitsPerPixel, nullptr);
+}
+
+void SteganographyLib::Steganography::embedFile(const std::string &originalBitmapFilePath, const std::string &sourceDataFilePath, const std::string &destinationBitmapDataFilePath, std::uint8_t bitsPerPixel, const ContainerShard *shard)
+{
+    m_stats = OperationStats();
+    PhaseTimer totalTimer(m_stats.total);
     setBitsPerPixel(bitsPerPixel);
 
+    // the clone would truncate the original before reading it, and a failed patch removes the destination
+    std::error_code sameFileError;
+    if (m_outputMode == OutputMode::Patch &&
+        filesystem::equivalent(originalBitmapFilePath, destinationBitmapDataFilePath, sameFileError))
+    {
+        throw runtime_error("Could not patch the original bitmap at "
+            + originalBitmapFilePath
+            + " in place, select another destination, aborting embed operation.");
+    }
+
     // Open and verify sourceDataFilePath
     auto sourceDataFileStream = ifstream(sourceDataFilePath, ios::binary);
     if (!sourceDataFileStream ||
@@ -35,106 +86,181 @@ void SteganographyLib::Steganography::embed(const std::string &originalBitmapFil
             + " aborting embed operation.");
     }
 
-    auto rawSourceFileSize = filesystem::file_size(sourceDataFilePath);
-    if (rawSourceFileSize > UINT16_MAX)
+    // the header tells the extract operation the size of the data and where its chunks are
+    std::uint64_t sourceFileSize = filesystem::file_size(sourceDataFilePath);
+    ContainerHeader header = payloadHeader(shard ? shard->length : sourceFileSize);
+    if (shard)
     {
-        throw runtime_error("Source file size is too large");
+        // a shard is a range of the source file
+        if (shard->totalLength != sourceFileSize)
+        {
+            throw runtime_error("The shard does not belong to the source data file at "
+                + sourceDataFilePath
+                + " aborting embed operation.");
+        }
+        header.setShard(*shard);
+        sourceDataFileStream.seekg(static_cast<streamoff>(shard->dataOffset));
     }
-
-    std::uint16_t sourceFileSize = static_cast<std::uint16_t>(rawSourceFileSize);
-
-    try
+    if (m_outputMode == OutputMode::Rewrite &&
+        !header.compressed() &&
+        pipelinable(originalBitmapFilePath, destinationBitmapDataFilePath))
     {
-        m_sourceBitmap.load(originalBitmapFilePath);
+        sourceDataFileStream.close();
+        embedPipelined(originalBitmapFilePath, sourceDataFilePath, destinationBitmapDataFilePath, header);
+        return;
     }
-    catch(const bmp::Exception& e)
+
     {
-        // Repackage exception from underlying library for uniformity.
-        throw runtime_error("Could not open original bitmap file at "
-            + originalBitmapFilePath
-            + " aborting embed operation."
-            + e.what());
+        PhaseTimer loadTimer(m_stats.load);
+        loadSourceBitmap(originalBitmapFilePath, MapMode::CopyOnWrite, "embed");
     }
 
-    // verify that the bitmap can fit in the encoded file with the provided
-    // bits per pixel density
-    auto maxFileSizeBytes = (m_sourceBitmap.height() * m_sourceBitmap.width() * m_bitsPerPixel) / 8 ;
-    auto encodedFileSizeBytes = rawSourceFileSize + sizeof(sourceFileSize);
-    if (encodedFileSizeBytes > maxFileSizeBytes)
     {
-        throw runtime_error("Data file is too large to fit in the bitmap.  Use a larger bitmap or a higher packing density.");
-    }
+        // for performance reasons, we read the input in chunks instead of one byte at a time
+        PhaseTimer payloadTimer(m_stats.payload);
+        vector<char> buffer;
+        encodePayload(header, [&](std::size_t length)
+        {
+            buffer.resize(max(buffer.size(), length));
+            trackBufferBytes(buffer.capacity());
+            sourceDataFileStream.read(buffer.data(), length);
+            if (sourceDataFileStream.gcount() != static_cast<streamsize>(length))
+            {
+                throw runtime_error("Could not read source data file at "
+                    + sourceDataFilePath
+                    + " aborting embed operation.");
+            }
+            m_stats.bytesRead += length;
+            return static_cast<const char *>(buffer.data());
+        });
 
-    // perform embed operation
-    // for performance reasons, we read the input in chunks instead of one byte at a time
-    vector<char> buffer(FILE_CHUNK_SIZE);
-    auto inputStreamExhausted = false;
-    m_currentPixelIterator = m_sourceBitmap.begin();
+        sourceDataFileStream.close();
+    }
 
-    m_pixelBitEncodingPos = 0; // index to the bit (0 to 7) where data will be stored in the current pixel.
-    m_currentPixelColor = PixelColor::R;
-    m_pPixel = &m_currentPixelIterator->r;
+    // the destination is only written once the whole payload is encoded
+    PhaseTimer saveTimer(m_stats.save);
+    if (m_outputMode == OutputMode::Patch)
+    {
+        patchDestinationBitmap(originalBitmapFilePath, destinationBitmapDataFilePath);
+    }
+    else
+    {
+        try
+        {
+            saveSourceBitmap(destinationBitmapDataFilePath);
+            m_stats.bytesWritten += filesystem::file_size(destinationBitmapDataFilePath);
+        }
+        catch(const runtime_error &)
+        {
+            std::error_code error;
+            filesystem::remove(destinationBitmapDataFilePath, error);
+            throw;
+        }
+    }
+}
 
-    // embed the source file size in the first 16 bits of encoded data, so that
-    // the extract operation knows when to stop decoding bytes
-    vector<char> sourceFileSizeBytes(sizeof(sourceFileSize));
-    std::memcpy(sourceFileSizeBytes.data(), &sourceFileSize, sizeof(sourceFileSize));
-    encodeByte(sourceFileSizeBytes[0]); // 8 least significant bytes of the file size
-    encodeByte(sourceFileSizeBytes[1]); // 8 most significant bytes of the file size
+void SteganographyLib::Steganography::embed(std::istream &originalBitmap, std::istream &sourceData, std::ostream &destinationBitmap, std::uint8_t bitsPerPixel)
+{
+    m_stats = OperationStats();
+    PhaseTimer totalTimer(m_stats.total);
+    setBitsPerPixel(bitsPerPixel);
 
-    // determine the correspondence between bytes of encoded data and grain for the callback function
-    int bytesPerProgress, encodedByteCount = 0;
-    if (m_progressCallback != nullptr)
+    // the header needs the size of the data, so streams that cannot seek are read up front
+    vector<char> bufferedData;
+    std::uint64_t sourceDataSize = 0;
+    streampos start = sourceData.tellg();
+    if (start != streampos(-1) &&
+        sourceData.seekg(0, ios::end))
     {
-        assert(m_progressCallbackPercentGrain > 0); // m_progressCallbackPercentGrain is validated when setting the callback, so should never be 0.
-        int clicks = 100 / m_progressCallbackPercentGrain;
-        bytesPerProgress = sourceFileSize / clicks;
+        sourceDataSize = static_cast<std::uint64_t>(sourceData.tellg() - start);
+        sourceData.seekg(start);
+    }
+    else
+    {
+        sourceData.clear();
+        bufferedData.assign(istreambuf_iterator<char>(sourceData), istreambuf_iterator<char>());
+        sourceDataSize = bufferedData.size();
+        m_stats.bytesRead += sourceDataSize;
     }
+    ContainerHeader header = payloadHeader(sourceDataSize);
 
-    while(!inputStreamExhausted  &&
-          m_currentPixelIterator != m_sourceBitmap.end())
     {
-        sourceDataFileStream.read(buffer.data(), buffer.size());
-        auto bytesRead = sourceDataFileStream.gcount();
+        PhaseTimer loadTimer(m_stats.load);
+        loadSourceBitmap(originalBitmap, "embed");
+    }
 
-        if (bytesRead > 0)
+    {
+        PhaseTimer payloadTimer(m_stats.payload);
+        vector<char> buffer;
+        std::size_t bufferedPosition = 0;
+        encodePayload(header, [&](std::size_t length)
         {
-            for (streamsize i = 0; i < bytesRead; i++)
+            if (!bufferedData.empty())
             {
-                encodeByte(buffer[i]);
-                encodedByteCount++;
-                if (m_progressCallback != nullptr &&
-                    encodedByteCount % bytesPerProgress == 0)
-                {
-                    m_progressCallback(ceil((100*encodedByteCount)/(double)sourceFileSize));
-                }
+                trackBufferBytes(bufferedData.capacity());
+                const char *data = bufferedData.data() + bufferedPosition;
+                bufferedPosition += length;
+                return data;
             }
-        }
 
-        if (bytesRead < buffer.size())
-        {
-            inputStreamExhausted = true;
-        }
+            buffer.resize(max(buffer.size(), length));
+            trackBufferBytes(buffer.capacity());
+            sourceData.read(buffer.data(), length);
+            if (sourceData.gcount() != static_cast<streamsize>(length))
+            {
+                throw runtime_error("Could not read the source data stream, aborting embed operation.");
+            }
+            m_stats.bytesRead += length;
+            return static_cast<const char *>(buffer.data());
+        });
+    }
+
+    PhaseTimer saveTimer(m_stats.save);
+    streampos destinationStart = destinationBitmap.tellp();
+    m_sourceBitmap.save(destinationBitmap, vector<bmp::Pixel>(), [this]() { checkCancellation(); });
+    if (destinationStart != streampos(-1))
+    {
+        m_stats.bytesWritten += static_cast<std::uint64_t>(destinationBitmap.tellp() - destinationStart);
     }
-    sourceDataFileStream.close();
-    m_sourceBitmap.save(destinationBitmapDataFilePath);
 }
 
-void SteganographyLib::Steganography::extract(const std::string &sourceBitmapFilePath, const std::string &destinationDataFilePath, std::uint8_t bitsPerPixel)
+void SteganographyLib::Steganography::embed(std::uint8_t *bitmapData, std::size_t bitmapSize, const char *sourceData, std::size_t sourceDataSize, std::uint8_t bitsPerPixel)
 {
+    m_stats = OperationStats();
+    PhaseTimer totalTimer(m_stats.total);
     setBitsPerPixel(bitsPerPixel);
 
-    try
+    ContainerHeader header = payloadHeader(sourceDataSize);
     {
-        m_sourceBitmap.load(sourceBitmapFilePath);
+        PhaseTimer loadTimer(m_stats.load);
+        useBitmapBuffer(bitmapData, bitmapSize);
     }
-    catch(const bmp::Exception& e)
+
+    // the payload is encoded straight from the caller's memory into the caller's pixels
+    PhaseTimer payloadTimer(m_stats.payload);
+    std::size_t position = 0;
+    encodePayload(header, [&](std::size_t length)
     {
-        // Repackage exception from underlying library for uniformity.
-        throw runtime_error("Could not open original bitmap file at "
-            + sourceBitmapFilePath
-            + " aborting extract operation."
-            + e.what());
+        const char *data = sourceData + position;
+        position += length;
+        return data;
+    });
+}
+
+void SteganographyLib::Steganography::extract(const std::string &sourceBitmapFilePath, const std::string &destinationDataFilePath, std::uint8_t bitsPerPixel)
+{
+    m_stats = OperationStats();
+    PhaseTimer totalTimer(m_stats.total);
+    setBitsPerPixel(bitsPerPixel);
+    if (pipelinable(sourceBitmapFilePath, destinationDataFilePath) &&
+        extractPipelined(sourceBitmapFilePath, destinationDataFilePath))
+    {
+        return;
+    }
+
+    {
+        PhaseTimer loadTimer(m_stats.load);
+        loadSourceBitmap(sourceBitmapFilePath, MapMode::ReadOnly, "extract");
     }
 
     // Open and verify destinationDataFilePath
@@ -148,70 +274,326 @@ void SteganographyLib::Steganography::extract(const std::string &sourceBitmapFil
             + " aborting extract operation.");
     }
 
-    // perform extract operation
-    // for performance reasons, we write the output in chunks instead of one byte at a time
-    vector<char> buffer(FILE_CHUNK_SIZE);
-    m_currentPixelIterator = m_sourceBitmap.begin();
-    m_pixelBitEncodingPos = 0; // index to the bit (0 to 7) where data is encoded in the current pixel.
-    m_currentPixelColor = PixelColor::R;
-    m_pPixel = &m_currentPixelIterator->r;
-    int vectorPos = 0;
-
-    // the first 16 bits of encoded data indicate the number of data bytes encoded in the file
+    // the header at the start of the encoded data indicates the number of data bytes encoded in the file
     // so that the extract operation knows when to stop decoding bytes
-    std::uint16_t dataFileSize;
-    vector<char> sourceFileSizeBytes(sizeof(dataFileSize));
-    sourceFileSizeBytes[0] = decodeByte(); // 8 least significant bytes of the file size
-    sourceFileSizeBytes[1] = decodeByte(); // 8 most significant bytes of the file size
-    std::memcpy(&dataFileSize, sourceFileSizeBytes.data(), sizeof(dataFileSize));
+    try
+    {
+        PhaseTimer payloadTimer(m_stats.payload);
+        resetBitPacker();
+        ContainerHeader header = decodeContainerHeader(sourceBitmapFilePath);
+        decodePayload(destinationDataFileStream, header);
+        destinationDataFileStream.close();
+    }
+    catch(const runtime_error &)
+    {
+        // never leave a partial file behind, such as after a cancellation
+        destinationDataFileStream.close();
+        std::error_code error;
+        filesystem::remove(destinationDataFilePath, error);
+        throw;
+    }
+}
+
+void SteganographyLib::Steganography::extract(std::istream &sourceBitmap, std::ostream &destinationData, std::uint8_t bitsPerPixel)
+{
+    m_stats = OperationStats();
+    PhaseTimer totalTimer(m_stats.total);
+    setBitsPerPixel(bitsPerPixel);
 
-    // verify that the bitmap can hold at least 'dataFileSize' bytes, based on the number of pixels
-    // in the image and the value provided for 'bitsPerPixel'
-    // this protects against cases where the bitmap that has been provided is not a valid encoded file
-    auto maxEncodedBytes = (m_sourceBitmap.width() * m_sourceBitmap.height() * bitsPerPixel)/8 - sizeof(dataFileSize);
-    if (dataFileSize > maxEncodedBytes)
     {
-        throw runtime_error("Could not decode bitmap at "
-            + sourceBitmapFilePath
-            + " the bitmap may not be a valid encoded file or try selecting a higher value for 'bitsPerPixel'.");
+        PhaseTimer loadTimer(m_stats.load);
+        loadSourceBitmap(sourceBitmap, "extract");
+    }
+
+    PhaseTimer payloadTimer(m_stats.payload);
+    resetBitPacker();
+    ContainerHeader header = decodeContainerHeader("the source bitmap stream");
+    decodePayload(destinationData, header);
+}
+
+std::vector<char> SteganographyLib::Steganography::extract(const std::uint8_t *bitmapData, std::size_t bitmapSize, std::uint8_t bitsPerPixel)
+{
+    m_stats = OperationStats();
+    PhaseTimer totalTimer(m_stats.total);
+    setBitsPerPixel(bitsPerPixel);
+
+    {
+        // decoding only reads the pixels of the buffer
+        PhaseTimer loadTimer(m_stats.load);
+        useBitmapBuffer(const_cast<std::uint8_t *>(bitmapData), bitmapSize);
     }
 
-    // determine the correspondence between bytes of extracted data and grain for the callback function
-    int bytesPerProgress, extractedByteCount = 0;
-    if (m_progressCallback != nullptr)
+    PhaseTimer payloadTimer(m_stats.payload);
+    resetBitPacker();
+    ContainerHeader header = decodeContainerHeader("the source bitmap buffer");
+
+    // the payload is decoded straight into the returned vector
+    vector<char> data(static_cast<std::size_t>(header.dataLength()));
+    trackBufferBytes(data.capacity());
+    std::size_t position = 0;
+    decodePayload(header, [&](std::size_t length)
     {
-        assert(m_progressCallbackPercentGrain > 0); // m_progressCallbackPercentGrain is validated when setting the callback, so should never be 0.
-        int clicks = 100 / m_progressCallbackPercentGrain;
-        bytesPerProgress = dataFileSize / clicks;
+        char *destination = data.data() + position;
+        position += length;
+        return destination;
+    });
+    return data;
+}
+
+std::vector<char> SteganographyLib::Steganography::extractRange(const std::string &sourceBitmapFilePath, std::uint64_t offset, std::size_t length, std::uint8_t bitsPerPixel)
+{
+    m_stats = OperationStats();
+    PhaseTimer totalTimer(m_stats.total);
+    PhaseTimer payloadTimer(m_stats.payload);
+    setBitsPerPixel(bitsPerPixel);
+
+    RandomAccessFile file(sourceBitmapFilePath, RandomAccessFile::Mode::Read);
+    BitmapHeader bitmapHeader = readBitmapHeader(file, sourceBitmapFilePath);
+    ContainerHeader header = readContainerHeader(file, bitmapHeader, sourceBitmapFilePath);
+    if (offset > header.dataLength() ||
+        length > header.dataLength() - offset)
+    {
+        throw runtime_error("Invalid range for bitmap at "
+            + sourceBitmapFilePath
+            + " the embedded data holds " + to_string(header.dataLength()) + " bytes.");
     }
 
-    while (extractedByteCount < dataFileSize &&
-        m_currentPixelIterator != m_sourceBitmap.end())
+    // the chunks are stored back to back after the header
+    vector<char> data(length);
+    if (!header.compressed())
     {
-        auto dataByte = decodeByte();
-        extractedByteCount++;
-        buffer[vectorPos++] = dataByte;
+        readStreamRange(file, bitmapHeader, header.size() + offset, data.data(), data.size());
+        m_stats.payloadBytes = length;
+        return data;
+    }
 
-        if (vectorPos == FILE_CHUNK_SIZE)
+    // only the chunks that hold part of the range are decoded and decompressed
+    vector<char> stored;
+    vector<char> decompressed;
+    for (const auto &chunk : header.chunks())
+    {
+        if (chunk.dataOffset + chunk.dataLength <= offset ||
+            chunk.dataOffset >= offset + length)
         {
-            destinationDataFileStream.write(buffer.data(), buffer.size());
-            vectorPos = 0;
+            continue;
         }
-
-        if (m_progressCallback != nullptr &&
-            extractedByteCount % bytesPerProgress == 0)
+        stored.resize(chunk.length);
+        readStreamRange(file, bitmapHeader, header.size() + chunk.offset, stored.data(), stored.size());
+        const char *chunkData = stored.data();
+        if (chunk.length < chunk.dataLength)
         {
-            m_progressCallback(ceil((100*extractedByteCount)/(double)dataFileSize));
+            decompressed.resize(chunk.dataLength);
+            if (!lzDecompress(stored.data(), stored.size(), decompressed.data(), decompressed.size()))
+            {
+                throw runtime_error("The compressed data embedded in the bitmap at " + sourceBitmapFilePath + " is corrupt.");
+            }
+            chunkData = decompressed.data();
         }
+        trackBufferBytes(stored.capacity() + decompressed.capacity());
+
+        std::uint64_t first = max(offset, chunk.dataOffset);
+        std::uint64_t last = min(offset + length, chunk.dataOffset + chunk.dataLength);
+        memcpy(data.data() + (first - offset), chunkData + (first - chunk.dataOffset), static_cast<std::size_t>(last - first));
+    }
+    m_stats.payloadBytes = length;
+    return data;
+}
+
+void SteganographyLib::Steganography::embedShard(const std::string &originalBitmapFilePath, const std::string &sourceDataFilePath, const ContainerShard &shard, const std::string &destinationBitmapFilePath, std::uint8_t bitsPerPixel)
+{
+    embedFile(originalBitmapFilePath, sourceDataFilePath, destinationBitmapFilePath, bitsPerPixel, &shard);
+}
+
+SteganographyLib::ContainerShard SteganographyLib::Steganography::readShard(const std::string &bitmapFilePath, std::uint8_t bitsPerPixel)
+{
+    m_stats = OperationStats();
+    setBitsPerPixel(bitsPerPixel);
+
+    // the shard record is part of the chunk table, read from the rows that hold it
+    RandomAccessFile file(bitmapFilePath, RandomAccessFile::Mode::Read);
+    BitmapHeader bitmapHeader = readBitmapHeader(file, bitmapFilePath);
+    ContainerHeader header = readContainerHeader(file, bitmapHeader, bitmapFilePath);
+    if (!header.sharded())
+    {
+        throw runtime_error("The bitmap at "
+            + bitmapFilePath
+            + " does not hold a shard.");
+    }
+    return header.shard();
+}
+
+SteganographyLib::ContainerShard SteganographyLib::Steganography::extractShard(const std::string &sourceBitmapFilePath, const std::string &destinationDataFilePath, std::uint8_t bitsPerPixel)
+{
+    m_stats = OperationStats();
+    PhaseTimer totalTimer(m_stats.total);
+    setBitsPerPixel(bitsPerPixel);
+
+    {
+        PhaseTimer loadTimer(m_stats.load);
+        loadSourceBitmap(sourceBitmapFilePath, MapMode::ReadOnly, "extract");
+    }
+
+    PhaseTimer payloadTimer(m_stats.payload);
+    resetBitPacker();
+    ContainerHeader header = decodeContainerHeader(sourceBitmapFilePath);
+    if (!header.sharded())
+    {
+        throw runtime_error("The bitmap at "
+            + sourceBitmapFilePath
+            + " does not hold a shard.");
+    }
+
+    // a block is complete once the next one is requested, and is written at its place in the payload
+    RandomAccessFile destination(destinationDataFilePath, RandomAccessFile::Mode::ReadWrite);
+    vector<char> buffer;
+    std::size_t pendingLength = 0;
+    std::uint64_t offset = header.shard().dataOffset;
+    auto writePending = [&]()
+    {
+        destination.writeAt(offset, buffer.data(), pendingLength);
+        offset += pendingLength;
+        m_stats.bytesWritten += pendingLength;
+    };
+    decodePayload(header, [&](std::size_t length)
+    {
+        writePending();
+        buffer.resize(max(buffer.size(), length));
+        trackBufferBytes(buffer.capacity());
+        pendingLength = length;
+        return buffer.data();
+    });
+    writePending();
+    return header.shard();
+}
+
+std::uint64_t SteganographyLib::Steganography::shardCapacity(const std::string &coverFilePath, std::uint8_t bitsPerPixel)
+{
+    setBitsPerPixel(bitsPerPixel);
+    RandomAccessFile file(coverFilePath, RandomAccessFile::Mode::Read);
+    BitmapHeader bitmapHeader = readBitmapHeader(file, coverFilePath);
+    std::uint64_t height = bitmapHeader.height < 0 ? -static_cast<std::int64_t>(bitmapHeader.height) : bitmapHeader.height;
+
+    // the same capacity as encodePayload checks.  The header of a shard filling the whole capacity is at least
+    // as large as the header of the largest shard that fits
+    bool alphaChannels = m_alphaEmbedding && bitmapHeader.bits_per_pixel == 32 && m_densityProfile.empty();
+    std::uint64_t channelCount = static_cast<std::uint64_t>(bitmapHeader.width) * height * (alphaChannels ? 2 : 1);
+    std::uint64_t capacity = channelCount * m_bitsPerPixel / 8;
+    ContainerHeader header = payloadHeader(capacity);
+    header.setShard({0, 0, 1, 0, capacity, capacity});
+    return capacity > header.size() ? capacity - header.size() : 0;
+}
+
+SteganographyLib::ProbeResult SteganographyLib::Steganography::probe(const std::string &bitmapFilePath, std::uint8_t bitsPerPixel)
+{
+    m_stats = OperationStats();
+    setBitsPerPixel(bitsPerPixel);
+
+    RandomAccessFile file(bitmapFilePath, RandomAccessFile::Mode::Read);
+    BitmapHeader bitmapHeader = readBitmapHeader(file, bitmapFilePath);
+    std::uint64_t height = bitmapHeader.height < 0 ? -static_cast<std::int64_t>(bitmapHeader.height) : bitmapHeader.height;
+
+    // like extract, the walk continues into the alpha channel of 32 bpp bitmaps
+    ProbeResult result;
+    std::uint64_t channelCount = static_cast<std::uint64_t>(bitmapHeader.width) * height * (bitmapHeader.bits_per_pixel == 32 ? 2 : 1);
+    result.capacity = channelCount * m_bitsPerPixel / 8;
+    if (result.capacity < ContainerHeader::LEGACY_SIZE)
+    {
+        return result;
     }
 
-    // need to flush the data vector once more, as it may be partially filled.
-    if (vectorPos > 0)
+    // the fixed part of the header tells the size of the chunk table, which does not need to be read
+    vector<char> fixedBytes(static_cast<std::size_t>(min<std::uint64_t>(result.capacity, ContainerHeader::FIXED_SIZE)));
+    readStreamRange(file, bitmapHeader, 0, fixedBytes.data(), fixedBytes.size());
+    try
     {
-        destinationDataFileStream.write(buffer.data(), vectorPos);
+        ContainerHeader header = ContainerHeader::parse(fixedBytes.data(), fixedBytes.size(), result.capacity);
+        result.format = header.format();
+        result.payloadLength = header.payloadLength();
+        result.plausible = header.payloadLength() <= result.capacity &&
+                           header.size() <= result.capacity - header.payloadLength();
+        if (result.plausible)
+        {
+            result.remainingCapacity = result.capacity - header.size() - header.payloadLength();
+        }
+    }
+    catch(const runtime_error &)
+    {
+        // a chunked header this version cannot read, newer or damaged
+        result.format = ContainerFormat::Chunked;
     }
+    return result;
+}
+
+SteganographyLib::ScanResult SteganographyLib::Steganography::scan(const std::string &bitmapFilePath)
+{
+    m_stats = OperationStats();
+
+    RandomAccessFile file(bitmapFilePath, RandomAccessFile::Mode::Read);
+    BitmapHeader bitmapHeader = readBitmapHeader(file, bitmapFilePath);
+    std::size_t width = static_cast<std::size_t>(bitmapHeader.width);
+    std::size_t height = static_cast<std::size_t>(bitmapHeader.height < 0 ? -static_cast<std::int64_t>(bitmapHeader.height) : bitmapHeader.height);
+    std::size_t pixelSize = bitmapHeader.bits_per_pixel / 8;
+    std::size_t rowStride = (width * pixelSize + 3) & ~static_cast<std::size_t>(3);
+    bool bottomUp = bitmapHeader.height > 0;
+
+    // at 3 bits per channel, the fixed part of a header ends in the R byte of pixel 72: the rows down to it are read
+    // once, with a single positioned read, and shared by every density
+    const std::uint64_t headerChannels = (ContainerHeader::FIXED_SIZE * 8 + 2) / 3;
+    std::size_t rowCount = static_cast<std::size_t>(min<std::uint64_t>((headerChannels - 3) / width + 1, height));
+    std::size_t firstFileRow = bottomUp ? height - rowCount : 0;
+    vector<std::uint8_t> rows(rowCount * rowStride);
+    file.readAt(bitmapHeader.offset_bits + static_cast<std::uint64_t>(firstFileRow) * rowStride, rows.data(), rows.size());
+    m_stats.bytesRead += rows.size();
+    std::uint8_t *topRow = bottomUp ? rows.data() + (rowCount - 1) * rowStride : rows.data();
+    std::ptrdiff_t rowStep = bottomUp ? -static_cast<std::ptrdiff_t>(rowStride) : static_cast<std::ptrdiff_t>(rowStride);
+    std::uint64_t colorChannels = static_cast<std::uint64_t>(rowCount) * width + 2;
+
+    ScanResult result;
+    BitPacker packer;
+    for (std::uint8_t bitsPerPixel = 3; bitsPerPixel <= 24; bitsPerPixel += 3)
+    {
+        if (colorChannels * bitsPerPixel < ContainerHeader::FIXED_SIZE * 8)
+        {
+            continue;
+        }
+
+        // most bitmaps are rejected on the magic, only a matching magic is worth decoding the rest of the fixed part
+        char fixedBytes[ContainerHeader::FIXED_SIZE];
+        packer.reset(bitsPerPixel);
+        packer.setBgrRows(topRow, width, rowCount, rowStep, pixelSize);
+        packer.decode(reinterpret_cast<std::uint8_t *>(fixedBytes), 4);
+        if (memcmp(fixedBytes, "STEG", 4) != 0)
+        {
+            continue;
+        }
+        packer.decode(reinterpret_cast<std::uint8_t *>(fixedBytes) + 4, sizeof(fixedBytes) - 4);
 
-    destinationDataFileStream.close();
+        if (!ContainerHeader::checksumMatches(fixedBytes))
+        {
+            // the checksum does not match, the magic was a coincidence
+            continue;
+        }
+
+        try
+        {
+            // the checksum matched, so the header is chunked and never read as a legacy length
+            ContainerHeader header = ContainerHeader::parse(fixedBytes, sizeof(fixedBytes));
+            std::uint64_t capacity = static_cast<std::uint64_t>(width) * height * (pixelSize == 4 ? 2 : 1) * bitsPerPixel / 8;
+            result.payloadLength = header.payloadLength();
+            result.compressed = header.compressed();
+            result.supported = true;
+            result.plausible = header.payloadLength() <= capacity &&
+                               header.size() <= capacity - header.payloadLength();
+        }
+        catch(const runtime_error &)
+        {
+            // a valid header with features this version does not know about
+        }
+        result.found = true;
+        result.bitsPerPixel = bitsPerPixel;
+        return result;
+    }
+    return result;
 }
 
 void SteganographyLib::Steganography::registerProgressCallback(ProgressCallback callbackFunction, int percentGrain)
@@ -221,105 +603,1921 @@ void SteganographyLib::Steganography::registerProgressCallback(ProgressCallback
         throw runtime_error("Invalid value for parameter callbackFunction. Must be a non-null function. Aborting operation.");
     }
 
-    if (percentGrain < 0 ||
+    if (percentGrain < 1 ||
         percentGrain > 100)
     {
-        throw runtime_error("Invalid value for parameter percentGrain. Must be a value between 0 and 100. Aborting operation.");
+        throw runtime_error("Invalid value for parameter percentGrain. Must be a value between 1 and 100. Aborting operation.");
     }
 
     m_progressCallback = callbackFunction;
     m_progressCallbackPercentGrain = percentGrain;
+    m_progressInterval = chrono::milliseconds(0);
 }
 
-void SteganographyLib::Steganography::encodeByte(const char inputByte)
+void SteganographyLib::Steganography::registerProgressCallback(ProgressCallback callbackFunction, std::chrono::milliseconds interval)
 {
-    // loop with an index to the bit (0 to 7) that is being encoded from the data file byte
-    // encoding from least significant bit to most significant bit
-    for (int inputByteBitEncodingPos = 0; inputByteBitEncodingPos < 8; inputByteBitEncodingPos++)
+    if (callbackFunction == nullptr)
+    {
+        throw runtime_error("Invalid value for parameter callbackFunction. Must be a non-null function. Aborting operation.");
+    }
+
+    if (interval.count() <= 0)
     {
-        // isolate the bit we are trying to encode on the LSB position of a byte
-        std::uint8_t inputByteBit = LSB_BYTE_MASK & (inputByte >> inputByteBitEncodingPos);
+        throw runtime_error("Invalid value for parameter interval. Must be a positive duration. Aborting operation.");
+    }
+
+    m_progressCallback = callbackFunction;
+    m_progressInterval = interval;
+}
+
+void SteganographyLib::Steganography::setCancellationToken(std::shared_ptr<CancellationToken> cancellationToken) noexcept
+{
+    m_cancellationToken = move(cancellationToken);
+}
+
+void SteganographyLib::Steganography::setDeadline(std::chrono::steady_clock::time_point deadline) noexcept
+{
+    m_deadline = deadline;
+}
+
+void SteganographyLib::Steganography::setMemoryMapping(bool enabled) noexcept
+{
+    m_memoryMapping = enabled;
+}
+
+void SteganographyLib::Steganography::setAlphaEmbedding(bool enabled) noexcept
+{
+    m_alphaEmbedding = enabled;
+}
+
+void SteganographyLib::Steganography::setDirectWrites(bool enabled) noexcept
+{
+    m_directWrites = enabled;
+}
 
-        // encode the bit at the encoding position
-        // we encode bits starting at the least significant bit positions to ensure we shift
-        // the color of the bit as little as possible.
-        int8_t mask;
-        if (inputByteBit)
+void SteganographyLib::Steganography::setPipelining(bool enabled) noexcept
+{
+    m_pipelining = enabled;
+}
+
+void SteganographyLib::Steganography::releaseSourceBitmap() noexcept
+{
+    // release whichever representation the previous operation used
+    m_sourceBitmap = Bitmap();
+    m_mappedBitmap.close();
+    m_bufferRows = PixelRows();
+    m_cachedCover.reset();
+    m_coverRows.clear();
+}
+
+void SteganographyLib::Steganography::loadSourceBitmap(const std::string &bitmapFilePath, MapMode mapMode, const std::string &operation)
+{
+    releaseSourceBitmap();
+
+    try
+    {
+        if (m_memoryMapping)
         {
-            // we encode a '1' bit by performing OR bitwise operation on the pixel byte
-            mask = inputByteBit << m_pixelBitEncodingPos;
-            *m_pPixel |= mask;
+            m_mappedBitmap.open(bitmapFilePath, mapMode);
         }
-        else
+        else if (m_coverCache)
         {
-            // we encode a '0' bit by performing AND bitwise operation on the complement of the mask
-            mask = LSB_BYTE_MASK << m_pixelBitEncodingPos;
-            *m_pPixel &= ~mask;
+            CoverCacheStats cacheStats = m_coverCache->stats();
+            m_cachedCover = m_coverCache->acquire(bitmapFilePath);
+            if (m_coverCache->stats().misses != cacheStats.misses)
+            {
+                m_stats.bytesRead += filesystem::file_size(bitmapFilePath);
+            }
         }
-
-        m_pixelBitEncodingPos++;
-
-        // check to see if we need to encode data in the next byte of the bitmap
-        if (m_pixelBitEncodingPos == m_bitsPerPixel)
+        else
         {
-            nextBitmapByte();
+            m_sourceBitmap.load(bitmapFilePath);
+            m_stats.bytesRead += filesystem::file_size(bitmapFilePath);
         }
     }
+    catch(const bmp::Exception& e)
+    {
+        // Repackage exception from underlying library for uniformity.
+        throw runtime_error("Could not open original bitmap file at "
+            + bitmapFilePath
+            + " aborting " + operation + " operation."
+            + e.what());
+    }
+    catch(const filesystem::filesystem_error& e)
+    {
+        throw runtime_error("Could not open original bitmap file at "
+            + bitmapFilePath
+            + " aborting " + operation + " operation."
+            + e.what());
+    }
 }
 
-std::uint8_t SteganographyLib::Steganography::decodeByte()
+void SteganographyLib::Steganography::loadSourceBitmap(std::istream &bitmap, const std::string &operation)
 {
-    std::uint8_t dataByte = 0x00;
+    releaseSourceBitmap();
 
-    for (int dataByteBitPos = 0; dataByteBitPos < 8; dataByteBitPos++)
+    try
     {
-        std::uint8_t mask = LSB_BYTE_MASK << m_pixelBitEncodingPos;
-        if (*m_pPixel & mask)
+        streampos start = bitmap.tellg();
+        m_sourceBitmap.load(bitmap);
+        if (start != streampos(-1) &&
+            bitmap.tellg() != streampos(-1))
         {
-            dataByte |= LSB_BYTE_MASK << dataByteBitPos;
+            m_stats.bytesRead += static_cast<std::uint64_t>(bitmap.tellg() - start);
         }
-        m_pixelBitEncodingPos++;
+    }
+    catch(const bmp::Exception& e)
+    {
+        // Repackage exception from underlying library for uniformity.
+        throw runtime_error("Could not read original bitmap stream, aborting " + operation + " operation."
+            + e.what());
+    }
+}
 
-        if (m_pixelBitEncodingPos == m_bitsPerPixel)
-        {
-            nextBitmapByte();
-        }
+void SteganographyLib::Steganography::useBitmapBuffer(std::uint8_t *bitmapData, std::size_t bitmapSize)
+{
+    releaseSourceBitmap();
+
+    BitmapHeader header;
+    if (bitmapSize < sizeof(header))
+    {
+        throw runtime_error("Could not open bitmap buffer, unrecognized file format.");
     }
+    memcpy(&header, bitmapData, sizeof(header));
+    validateBitmapHeader(header, bitmapSize >= sizeof(header) + BITMAP_MASKS_SIZE ? bitmapData + sizeof(header) : nullptr, bitmapSize, "bitmap buffer,");
 
-    return dataByte;
+    // the pixels are used in place, upside down for bottom-up bitmaps
+    std::size_t width = static_cast<std::size_t>(header.width);
+    std::size_t height = static_cast<std::size_t>(header.height < 0 ? -static_cast<std::int64_t>(header.height) : header.height);
+    std::size_t pixelSize = header.bits_per_pixel / 8;
+    std::size_t rowStride = (width * pixelSize + 3) & ~static_cast<std::size_t>(3);
+    bool bottomUp = header.height > 0;
+    m_bufferRows.topRow = bitmapData + header.offset_bits + (bottomUp ? (height - 1) * rowStride : 0);
+    m_bufferRows.width = width;
+    m_bufferRows.height = height;
+    m_bufferRows.rowStep = bottomUp ? -static_cast<std::ptrdiff_t>(rowStride) : static_cast<std::ptrdiff_t>(rowStride);
+    m_bufferRows.pixelSize = pixelSize;
 }
 
-void SteganographyLib::Steganography::nextBitmapByte()
+void SteganographyLib::Steganography::saveSourceBitmap(const std::string &bitmapFilePath)
 {
-    switch(m_currentPixelColor)
+    // saving a large bitmap takes long after the payload is placed, so it is cancelled between blocks as well
+    auto beforeBlock = [this]() { checkCancellation(); };
+    if (m_mappedBitmap)
+    {
+        m_mappedBitmap.save(bitmapFilePath, beforeBlock);
+    }
+    else if (m_cachedCover)
+    {
+        // the rows that received data come from the private copy, the others from the shared cover
+        m_cachedCover->save(bitmapFilePath, m_coverRows, writeMode(*m_cachedCover), beforeBlock);
+    }
+    else
     {
-        case PixelColor::R:
-            m_currentPixelColor = PixelColor::G;
-            m_pPixel = &m_currentPixelIterator->g;
-            break;
-        case PixelColor::G:
-            m_currentPixelColor = PixelColor::B;
-            m_pPixel = &m_currentPixelIterator->b;
-            break;
-        case PixelColor::B:
-            m_currentPixelIterator++;
+        m_sourceBitmap.save(bitmapFilePath, vector<bmp::Pixel>(), writeMode(m_sourceBitmap), beforeBlock);
+    }
+}
 
-            if (m_currentPixelIterator == m_sourceBitmap.end())
-            {
-                throw runtime_error("end of source bitmap reached");
-            }
+bmp::WriteMode SteganographyLib::Steganography::writeMode(const bmp::Bitmap &bitmap) const noexcept
+{
+    return m_directWrites && bitmap.file_size() >= DIRECT_WRITE_MIN_SIZE ? WriteMode::Direct : WriteMode::Buffered;
+}
+
+void SteganographyLib::Steganography::setOutputMode(OutputMode mode) noexcept
+{
+    m_outputMode = mode;
+}
+
+void SteganographyLib::Steganography::setContainerFormat(ContainerFormat format) noexcept
+{
+    m_containerFormat = format;
+}
 
-            m_pPixel = &m_currentPixelIterator->r;
-            break;
-        default:
-            throw runtime_error("Unexpected pixel color during encode/decode operation");
+void SteganographyLib::Steganography::setCompression(bool enabled) noexcept
+{
+    m_compression = enabled;
+}
+
+void SteganographyLib::Steganography::setDensityProfile(const DensityProfile &profile)
+{
+    if (profile.red > 8 ||
+        profile.green > 8 ||
+        profile.blue > 8)
+    {
+        throw runtime_error("Invalid density profile. Each channel stores between 0 and 8 bits.");
     }
+    m_densityProfile = profile;
+}
 
-    m_pixelBitEncodingPos = 0;
+void SteganographyLib::Steganography::setScatterKey(const std::string &key)
+{
+    m_scatter = !key.empty();
+    m_scatterKey = ScatterOrder::key(key);
 }
 
-void SteganographyLib::Steganography::setBitsPerPixel(int bitsPerPixel)
+SteganographyLib::ContainerHeader SteganographyLib::Steganography::payloadHeader(std::uint64_t payloadLength) const
 {
+    return ContainerHeader(m_containerFormat, payloadLength, ContainerHeader::DEFAULT_CHUNK_SIZE, m_compression ? ContainerHeader::FLAG_COMPRESSED : 0);
+}
+
+void SteganographyLib::Steganography::setCoverCache(std::shared_ptr<CoverCache> coverCache) noexcept
+{
+    m_coverCache = move(coverCache);
+}
+
+void SteganographyLib::Steganography::setThreadCount(std::size_t threadCount)
+{
+    if (threadCount != m_threadCount)
+    {
+        m_threadPool.reset();
+        m_threadCount = threadCount;
+    }
+}
+
+SteganographyLib::ThreadPool &SteganographyLib::Steganography::threadPool()
+{
+    // started on first use, and kept for the following operations
+    if (!m_threadPool)
+    {
+        m_threadPool = make_unique<ThreadPool>(m_threadCount);
+    }
+    return *m_threadPool;
+}
+
+std::size_t SteganographyLib::Steganography::parallelSegmentSize(std::size_t windowSize) const
+{
+    // every 'alignment' bytes of the stream fill a whole number of channel bytes, so segments
+    // that start on a multiple of it never share a channel byte with the previous segment
+    std::size_t alignment = m_bitsPerPixel / gcd(8, static_cast<int>(m_bitsPerPixel));
+    std::size_t segmentSize = (windowSize + m_threadPool->size() - 1) / m_threadPool->size();
+    segmentSize = max<std::size_t>(segmentSize, PARALLEL_MIN_SEGMENT_SIZE);
+    return (segmentSize + alignment - 1) / alignment * alignment;
+}
+
+void SteganographyLib::Steganography::copyCoverRows(std::uint64_t streamSize)
+{
+    // the encoder fills the channel walk from the top left pixel onwards, so it only writes to the rows
+    // from the top down to the row of the last channel byte of the stream: those are the only rows copied
+    std::size_t width = sourceBitmapWidth();
+    std::uint64_t channelCount = (streamSize * 8 + m_bitsPerPixel - 1) / m_bitsPerPixel;
+    std::uint64_t lastPixel = max<std::uint64_t>(pixelsOfChannels(channelCount, static_cast<std::uint64_t>(width) * sourceBitmapHeight()), 1) - 1;
+    std::size_t rowCount = static_cast<std::size_t>(min<std::uint64_t>(lastPixel / width + 1, sourceBitmapHeight()));
+    m_coverRows.assign(m_cachedCover->cbegin(), m_cachedCover->cbegin() + rowCount * width);
+}
+
+void SteganographyLib::Steganography::encodePayload(const ContainerHeader &header, const PayloadReader &readPayload)
+{
+    // verify that the bitmap can fit in the encoded file with the provided
+    // bits per pixel density.  Compressed data is checked as it is encoded, until then
+    // its size as is bounds the channels that may be written
+    auto maxFileSizeBytes = streamCapacity(m_alphaEmbedding);
+    auto encodedFileSizeBytes = header.payloadLength() + header.size();
+    if (header.compressed())
+    {
+        encodedFileSizeBytes = min(encodedFileSizeBytes, maxFileSizeBytes);
+    }
+    else if (encodedFileSizeBytes > maxFileSizeBytes)
+    {
+        throw runtime_error("Data file is too large to fit in the bitmap.  Use a larger bitmap or a higher packing density.");
+    }
+
+    beginProgress(header.dataLength());
+
+    std::size_t channelCount = static_cast<std::size_t>((encodedFileSizeBytes * 8 + m_bitsPerPixel - 1) / m_bitsPerPixel);
+    if (m_cachedCover)
+    {
+        if (m_scatter ||
+            channelCount > sourceBitmapWidth() * sourceBitmapHeight() + 2)
+        {
+            // the stream is scattered or reaches the alpha channel, and is written to a private copy of the whole cover
+            m_sourceBitmap = *m_cachedCover;
+            m_cachedCover.reset();
+        }
+        else
+        {
+            copyCoverRows(encodedFileSizeBytes);
+        }
+    }
+    trackBufferBytes(0);
+
+    // embed the header at the start of the encoded data
+    resetBitPacker();
+    if (m_detailedStats)
+    {
+        // the channel bytes are compared with a copy of their original values once encoded
+        m_channelSnapshot.resize(channelCount * m_bitPacker.channelWidth());
+        m_bitPacker.copyChannels(m_channelSnapshot.data(), channelCount);
+    }
+    if (!header.compressed())
+    {
+        // the header of compressed data is only known, and written, once the chunks are
+        vector<char> headerBytes = header.serialize();
+        encodeBytes(headerBytes.data(), headerBytes.size());
+    }
+
+    std::uint64_t streamSize = encodedFileSizeBytes;
+    if (header.compressed())
+    {
+        streamSize = encodeCompressed(header, readPayload, maxFileSizeBytes);
+    }
+    else if (m_threadCount != 1)
+    {
+        encodeParallel(header, readPayload);
+    }
+    else
+    {
+        // the payload is encoded in blocks, progress and cancellation are checked between them
+        std::uint64_t sourceFileSize = header.payloadLength();
+        std::uint64_t encodedByteCount = 0;
+        while (encodedByteCount < sourceFileSize)
+        {
+            std::size_t runLength = static_cast<std::size_t>(min<std::uint64_t>(sourceFileSize - encodedByteCount, BLOCK_SIZE));
+            encodeBytes(readPayload(runLength), runLength);
+            advanceProgress(encodedByteCount, encodedByteCount + runLength);
+            encodedByteCount += runLength;
+        }
+
+        if (!m_bitPacker.flush())
+        {
+            throw runtime_error("end of source bitmap reached");
+        }
+    }
+
+    m_stats.payloadBytes = header.dataLength();
+    m_stats.pixelsTouched = pixelsOfChannels((streamSize * 8 + m_bitsPerPixel - 1) / m_bitsPerPixel, static_cast<std::uint64_t>(sourceBitmapWidth()) * sourceBitmapHeight());
+    if (m_detailedStats)
+    {
+        m_stats.channelBytesModified = m_bitPacker.countChangedChannels(m_channelSnapshot.data(), channelCount);
+    }
+}
+
+void SteganographyLib::Steganography::decodePayload(const ContainerHeader &header, const PayloadWriter &writePayload)
+{
+    beginProgress(header.dataLength());
+    trackBufferBytes(0);
+    m_stats.payloadBytes = header.dataLength();
+    m_stats.pixelsTouched = pixelsOfChannels(static_cast<std::size_t>(((header.size() + header.payloadLength()) * 8 + m_bitsPerPixel - 1) / m_bitsPerPixel),
+                                             static_cast<std::uint64_t>(sourceBitmapWidth()) * sourceBitmapHeight());
+
+    if (header.compressed())
+    {
+        decodeCompressed(header, writePayload);
+        return;
+    }
+    if (m_threadCount != 1)
+    {
+        decodeParallel(header, writePayload);
+        return;
+    }
+
+    // the payload is decoded in blocks, progress and cancellation are checked between them
+    std::uint64_t dataFileSize = header.payloadLength();
+    std::uint64_t extractedByteCount = 0;
+    while (extractedByteCount < dataFileSize)
+    {
+        std::size_t runLength = static_cast<std::size_t>(min<std::uint64_t>(dataFileSize - extractedByteCount, BLOCK_SIZE));
+        decodeBytes(writePayload(runLength), runLength);
+        advanceProgress(extractedByteCount, extractedByteCount + runLength);
+        extractedByteCount += runLength;
+    }
+}
+
+void SteganographyLib::Steganography::decodePayload(std::ostream &destination, const ContainerHeader &header)
+{
+    // a block is complete once the next one is requested, or once decoding returns
+    vector<char> buffer;
+    std::size_t pendingLength = 0;
+    decodePayload(header, [&](std::size_t length)
+    {
+        destination.write(buffer.data(), pendingLength);
+        m_stats.bytesWritten += pendingLength;
+        buffer.resize(max(buffer.size(), length));
+        trackBufferBytes(buffer.capacity());
+        pendingLength = length;
+        return buffer.data();
+    });
+    destination.write(buffer.data(), pendingLength);
+    m_stats.bytesWritten += pendingLength;
+}
+
+void SteganographyLib::Steganography::encodeParallel(const ContainerHeader &header, const PayloadReader &readPayload)
+{
+    ThreadPool &pool = threadPool();
+    std::size_t alignment = m_bitsPerPixel / gcd(8, static_cast<int>(m_bitsPerPixel));
+    std::uint64_t payloadSize = header.payloadLength();
+
+    // the header is written first, so the segment starting in its last channel byte keeps its bits
+    if (!m_bitPacker.flush())
+    {
+        throw runtime_error("end of source bitmap reached");
+    }
+
+    // the stream is encoded in windows of a few segments per thread, so that the payload never has to fit in memory
+    std::uint64_t streamOffset = header.size();
+    std::uint64_t streamEnd = header.size() + payloadSize;
+    std::uint64_t encodedByteCount = 0;
+    while (streamOffset < streamEnd)
+    {
+        std::uint64_t windowEnd = streamOffset + min<std::uint64_t>(streamEnd - streamOffset, pool.size() * PARALLEL_SEGMENT_SIZE);
+        if (windowEnd < streamEnd)
+        {
+            // the next window must start on a channel byte as well
+            windowEnd -= windowEnd % alignment;
+        }
+        std::size_t windowSize = static_cast<std::size_t>(windowEnd - streamOffset);
+        const char *window = readPayload(windowSize);
+
+        // segments end on multiples of the segment size in the stream, which start on a channel byte
+        std::size_t segmentSize = parallelSegmentSize(windowSize);
+        std::uint64_t firstSegment = streamOffset / segmentSize;
+        std::size_t segmentCount = static_cast<std::size_t>((windowEnd - 1) / segmentSize - firstSegment + 1);
+        pool.parallelFor(segmentCount, [&](std::size_t segment)
+        {
+            checkCancellation();
+            std::uint64_t first = max<std::uint64_t>(streamOffset, (firstSegment + segment) * segmentSize);
+            std::uint64_t last = min<std::uint64_t>(windowEnd, (firstSegment + segment + 1) * segmentSize);
+            std::size_t length = static_cast<std::size_t>(last - first);
+
+            // each segment has its own packer, sharing the channel walk of the configured one
+            BitPacker packer = m_bitPacker;
+            packer.seek(first * 8);
+            if (packer.encode(reinterpret_cast<const std::uint8_t *>(window + (first - streamOffset)), length) < length ||
+                !packer.flush())
+            {
+                throw runtime_error("end of source bitmap reached");
+            }
+            m_bytesDone.fetch_add(length, memory_order_relaxed);
+        });
+
+        advanceProgress(encodedByteCount, encodedByteCount + windowSize);
+        encodedByteCount += windowSize;
+        streamOffset = windowEnd;
+    }
+
+    // leave the packer after the last channel byte written, as the sequential path would
+    m_bitPacker.seek((streamOffset * 8 + m_bitsPerPixel - 1) / m_bitsPerPixel * m_bitsPerPixel);
+}
+
+void SteganographyLib::Steganography::decodeParallel(const ContainerHeader &header, const PayloadWriter &writePayload)
+{
+    ThreadPool &pool = threadPool();
+
+    // a segment of a chunk, decoded by one task into the window
+    struct Segment
+    {
+        std::uint64_t streamOffset;
+        std::size_t windowOffset;
+        std::size_t length;
+    };
+
+    // the chunks are decoded in windows of a few segments per thread, and handed over in order.
+    // decoding only reads the channel bytes, so segments may start in the middle of one
+    const auto &chunks = header.chunks();
+    vector<Segment> segments;
+    std::size_t chunkIndex = 0;
+    std::uint64_t extractedByteCount = 0;
+    while (chunkIndex < chunks.size())
+    {
+        std::size_t windowSize = 0;
+        std::size_t windowEnd = chunkIndex;
+        while (windowEnd < chunks.size() &&
+               (windowEnd == chunkIndex || windowSize + chunks[windowEnd].length <= pool.size() * PARALLEL_SEGMENT_SIZE))
+        {
+            windowSize += chunks[windowEnd++].length;
+        }
+        char *window = writePayload(windowSize);
+
+        std::size_t segmentSize = parallelSegmentSize(windowSize);
+        std::size_t windowOffset = 0;
+        segments.clear();
+        for (; chunkIndex < windowEnd; chunkIndex++)
+        {
+            std::uint64_t chunkOffset = header.size() + chunks[chunkIndex].offset;
+            for (std::size_t first = 0; first < chunks[chunkIndex].length; first += segmentSize)
+            {
+                std::size_t length = min<std::size_t>(segmentSize, chunks[chunkIndex].length - first);
+                segments.push_back({chunkOffset + first, windowOffset, length});
+                windowOffset += length;
+            }
+        }
+
+        pool.parallelFor(segments.size(), [&](std::size_t i)
+        {
+            checkCancellation();
+            const Segment &segment = segments[i];
+            BitPacker packer = m_bitPacker;
+            packer.seek(segment.streamOffset * 8);
+            if (packer.decode(reinterpret_cast<std::uint8_t *>(window + segment.windowOffset), segment.length) < segment.length)
+            {
+                throw runtime_error("end of source bitmap reached");
+            }
+            m_bytesDone.fetch_add(segment.length, memory_order_relaxed);
+        });
+
+        advanceProgress(extractedByteCount, extractedByteCount + windowSize);
+        extractedByteCount += windowSize;
+    }
+}
+
+std::uint64_t SteganographyLib::Steganography::encodeCompressed(ContainerHeader header, const PayloadReader &readPayload, std::uint64_t capacity)
+{
+    // a chunk on its way from the compressor to the encoder
+    struct CompressedChunk
+    {
+        std::vector<char> bytes;
+        std::size_t length = 0;
+    };
+
+    // the chunks are read and compressed on their own thread, a few chunks ahead of the encoder.
+    // The buffers go round a ring, so that memory does not depend on the size of the payload
+    const auto &chunks = header.chunks();
+    BoundedQueue<unique_ptr<CompressedChunk>> freeChunks(COMPRESSION_BUFFER_COUNT);
+    BoundedQueue<unique_ptr<CompressedChunk>> compressedChunks(COMPRESSION_BUFFER_COUNT);
+    for (std::size_t i = 0; i < COMPRESSION_BUFFER_COUNT; i++)
+    {
+        freeChunks.push(make_unique<CompressedChunk>());
+    }
+    exception_ptr failure;
+    thread compressor([&]()
+    {
+        try
+        {
+            unique_ptr<CompressedChunk> chunk;
+            for (std::size_t i = 0; i < chunks.size() && freeChunks.pop(chunk); i++)
+            {
+                std::size_t dataLength = chunks[i].dataLength;
+                chunk->bytes.resize(max(chunk->bytes.size(), lzCompressBound(dataLength)));
+                const char *data = readPayload(dataLength);
+                chunk->length = lzCompress(data, dataLength, chunk->bytes.data(), dataLength - 1);
+                if (chunk->length == 0)
+                {
+                    // stored as is when it does not shrink
+                    memcpy(chunk->bytes.data(), data, dataLength);
+                    chunk->length = dataLength;
+                }
+                compressedChunks.push(move(chunk));
+            }
+            compressedChunks.close();
+        }
+        catch(...)
+        {
+            failure = current_exception();
+            compressedChunks.cancel();
+        }
+    });
+
+    // the chunks follow the header, which is only known once they are all compressed
+    std::uint64_t streamOffset = header.size();
+    std::size_t peakChunkBytes = 0;
+    try
+    {
+        if (streamOffset > capacity)
+        {
+            throw runtime_error("Data file is too large to fit in the bitmap.  Use a larger bitmap or a higher packing density.");
+        }
+        m_bitPacker.seek(streamOffset * 8);
+        unique_ptr<CompressedChunk> chunk;
+        std::uint64_t encodedByteCount = 0;
+        for (std::size_t i = 0; compressedChunks.pop(chunk); i++)
+        {
+            if (chunk->length > capacity - streamOffset)
+            {
+                throw runtime_error("Data file is too large to fit in the bitmap, even compressed.  Use a larger bitmap or a higher packing density.");
+            }
+            encodeBytes(chunk->bytes.data(), chunk->length);
+            header.setChunkLength(i, static_cast<std::uint32_t>(chunk->length));
+            streamOffset += chunk->length;
+            peakChunkBytes = max(peakChunkBytes, chunk->bytes.capacity());
+
+            advanceProgress(encodedByteCount, encodedByteCount + chunks[i].dataLength);
+            encodedByteCount += chunks[i].dataLength;
+            freeChunks.push(move(chunk));
+        }
+    }
+    catch(...)
+    {
+        freeChunks.cancel();
+        compressedChunks.cancel();
+        compressor.join();
+        throw;
+    }
+    compressor.join();
+    if (failure)
+    {
+        rethrow_exception(failure);
+    }
+    trackBufferBytes(peakChunkBytes * COMPRESSION_BUFFER_COUNT);
+
+    // flush keeps the bits of the first chunk in the channel byte the header ends in
+    header.finalize();
+    vector<char> headerBytes = header.serialize();
+    if (!m_bitPacker.flush())
+    {
+        throw runtime_error("end of source bitmap reached");
+    }
+    m_bitPacker.seek(0);
+    encodeBytes(headerBytes.data(), headerBytes.size());
+    if (!m_bitPacker.flush())
+    {
+        throw runtime_error("end of source bitmap reached");
+    }
+
+    // leave the packer after the last channel byte written, as the sequential path would
+    m_bitPacker.seek((streamOffset * 8 + m_bitsPerPixel - 1) / m_bitsPerPixel * m_bitsPerPixel);
+    return streamOffset;
+}
+
+void SteganographyLib::Steganography::decodeCompressed(const ContainerHeader &header, const PayloadWriter &writePayload)
+{
+    // a chunk on its way from the decoder to the decompressor
+    struct CompressedChunk
+    {
+        std::vector<char> bytes;
+        std::size_t index = 0;
+    };
+
+    // the chunks are stored back to back after the chunk table, where the packer stands.  They are decompressed
+    // on their own thread, straight to where the writer wants them, while the next chunks are decoded
+    const auto &chunks = header.chunks();
+    BoundedQueue<unique_ptr<CompressedChunk>> freeChunks(COMPRESSION_BUFFER_COUNT);
+    BoundedQueue<unique_ptr<CompressedChunk>> decodedChunks(COMPRESSION_BUFFER_COUNT);
+    for (std::size_t i = 0; i < COMPRESSION_BUFFER_COUNT; i++)
+    {
+        freeChunks.push(make_unique<CompressedChunk>());
+    }
+    exception_ptr failure;
+    thread decompressor([&]()
+    {
+        try
+        {
+            unique_ptr<CompressedChunk> chunk;
+            while (decodedChunks.pop(chunk))
+            {
+                const ContainerChunk &entry = chunks[chunk->index];
+                char *destination = writePayload(entry.dataLength);
+                if (entry.length == entry.dataLength)
+                {
+                    memcpy(destination, chunk->bytes.data(), entry.length);
+                }
+                else if (!lzDecompress(chunk->bytes.data(), entry.length, destination, entry.dataLength))
+                {
+                    throw runtime_error("The compressed data embedded in the bitmap is corrupt.");
+                }
+                freeChunks.push(move(chunk));
+            }
+        }
+        catch(...)
+        {
+            failure = current_exception();
+            freeChunks.cancel();
+        }
+    });
+
+    std::size_t peakChunkBytes = 0;
+    try
+    {
+        unique_ptr<CompressedChunk> chunk;
+        std::uint64_t extractedByteCount = 0;
+        for (std::size_t i = 0; i < chunks.size() && freeChunks.pop(chunk); i++)
+        {
+            chunk->bytes.resize(max<std::size_t>(chunk->bytes.size(), chunks[i].length));
+            chunk->index = i;
+            decodeBytes(chunk->bytes.data(), chunks[i].length);
+            peakChunkBytes = max(peakChunkBytes, chunk->bytes.capacity());
+            decodedChunks.push(move(chunk));
+
+            advanceProgress(extractedByteCount, extractedByteCount + chunks[i].dataLength);
+            extractedByteCount += chunks[i].dataLength;
+        }
+        decodedChunks.close();
+    }
+    catch(...)
+    {
+        freeChunks.cancel();
+        decodedChunks.cancel();
+        decompressor.join();
+        throw;
+    }
+    decompressor.join();
+    if (failure)
+    {
+        rethrow_exception(failure);
+    }
+    trackBufferBytes(peakChunkBytes * COMPRESSION_BUFFER_COUNT);
+}
+
+bool SteganographyLib::Steganography::pipelinable(const std::string &sourceFilePath, const std::string &destinationFilePath) const
+{
+    if (!m_pipelining ||
+        m_memoryMapping ||
+        m_coverCache ||
+        m_scatter ||
+        !m_densityProfile.empty())
+    {
+        return false;
+    }
+
+    // the destination is written while the source is still being read, so they must be different files
+    std::error_code error;
+    return !filesystem::equivalent(sourceFilePath, destinationFilePath, error);
+}
+
+void SteganographyLib::Steganography::embedPipelined(const std::string &originalBitmapFilePath, const std::string &sourceDataFilePath, const std::string &destinationBitmapFilePath, const ContainerHeader &header)
+{
+    releaseSourceBitmap();
+
+    // only the bytes up to the first row of the original bitmap are read up front
+    BitmapRowReader original;
+    try
+    {
+        PhaseTimer loadTimer(m_stats.load);
+        original.open(originalBitmapFilePath);
+        m_stats.bytesRead += original.header_bytes().size();
+    }
+    catch(const runtime_error &e)
+    {
+        throw runtime_error("Could not open original bitmap file at "
+            + originalBitmapFilePath
+            + " aborting embed operation."
+            + e.what());
+    }
+    std::size_t width = static_cast<std::size_t>(original.width());
+    std::size_t height = static_cast<std::size_t>(original.height());
+    std::size_t pixelSize = original.pixel_size();
+    std::size_t rowStride = original.row_stride();
+    bool bottomUp = original.header().height > 0;
+
+    // the same capacity check as encodePayload, the walk only reaching the alpha channel when enabled
+    bool alphaChannels = m_alphaEmbedding && pixelSize == 4;
+    std::uint64_t pixelCount = static_cast<std::uint64_t>(width) * height;
+    std::uint64_t streamSize = header.size() + header.payloadLength();
+    if (streamSize > pixelCount * (alphaChannels ? 2 : 1) * m_bitsPerPixel / 8)
+    {
+        throw runtime_error("Data file is too large to fit in the bitmap.  Use a larger bitmap or a higher packing density.");
+    }
+    beginProgress(header.payloadLength());
+
+    auto payloadBytesStartingIn = [&](std::uint64_t firstChannel, std::uint64_t endChannel)
+    {
+        std::uint64_t first = max<std::uint64_t>((firstChannel * m_bitsPerPixel + 7) / 8, header.size());
+        std::uint64_t end = min<std::uint64_t>((endChannel * m_bitsPerPixel + 7) / 8, streamSize);
+        return end > first ? end - first : 0;
+    };
+    vector<char> headerBytes = header.serialize();
+    RandomAccessFile source(sourceDataFilePath, RandomAccessFile::Mode::Read);
+    std::uint64_t sourceOffset = header.sharded() ? header.shard().dataOffset : 0;
+    auto readStream = [&](std::uint64_t offset, char *data, std::size_t length)
+    {
+        // the container header, then the payload
+        if (offset < headerBytes.size())
+        {
+            std::size_t headerLength = min<std::size_t>(length, headerBytes.size() - static_cast<std::size_t>(offset));
+            memcpy(data, headerBytes.data() + offset, headerLength);
+            data += headerLength;
+            offset += headerLength;
+            length -= headerLength;
+        }
+        if (length > 0)
+        {
+            source.readAt(sourceOffset + offset - headerBytes.size(), data, length);
+            m_stats.bytesRead += length;
+        }
+    };
+
+    unique_ptr<BitmapRowWriter> destination;
+    std::size_t blockRows = max<std::size_t>(PIPELINE_BLOCK_SIZE / rowStride, 1);
+    vector<std::uint8_t> originalBytes;
+    std::uint64_t encodedByteCount = 0;
+    std::size_t peakHeldBytes = 0;
+    try
+    {
+        {
+            PhaseTimer saveTimer(m_stats.save);
+            destination = make_unique<BitmapRowWriter>(destinationBitmapFilePath, original);
+            m_stats.bytesWritten += original.header_bytes().size();
+        }
+
+        peakHeldBytes = runPipeline([&](PipelineBlock &block)
+        {
+            // the rows are read in the order of the file, along with the stream bytes their channels receive.
+            // The rows after the payload are copied as well, and can be cancelled as long as the payload
+            checkCancellation();
+            PhaseTimer loadTimer(m_stats.load);
+            std::size_t fileRow = original.rows_read();
+            block.rowCount = min(blockRows, height - fileRow);
+            if (block.rowCount == 0)
+            {
+                return false;
+            }
+            block.firstRow = bottomUp ? height - fileRow - block.rowCount : fileRow;
+            assignStreamRanges(block, width, pixelCount, alphaChannels, 0, streamSize);
+            block.payloadBytes = payloadBytesStartingIn(block.colorChannel, block.endColorChannel) +
+                                 (alphaChannels ? payloadBytesStartingIn(block.alphaChannel, block.endAlphaChannel) : 0);
+
+            block.bytes.resize(block.rowCount * rowStride);
+            block.stream.resize(block.colorStreamLength + block.alphaStreamLength);
+            original.read_rows(block.bytes.data(), block.rowCount);
+            m_stats.bytesRead += block.bytes.size();
+            readStream(block.colorStreamOffset, block.stream.data(), block.colorStreamLength);
+            readStream(block.alphaStreamOffset, block.stream.data() + block.colorStreamLength, block.alphaStreamLength);
+            return true;
+        },
+        [&](PipelineBlock &block)
+        {
+            {
+                PhaseTimer payloadTimer(m_stats.payload);
+                if (m_detailedStats)
+                {
+                    originalBytes.assign(block.bytes.begin(), block.bytes.end());
+                }
+                vector<ChannelSpan> colorSpans;
+                vector<ChannelSpan> alphaSpans;
+                blockSpans(block, width, pixelSize, bottomUp, colorSpans, alphaSpans);
+                if (block.colorStreamLength > 0)
+                {
+                    encodeChannelRange(move(colorSpans), block.colorChannel, block.colorStreamOffset, block.stream.data(), block.colorStreamLength);
+                }
+                if (block.alphaStreamLength > 0)
+                {
+                    encodeChannelRange(move(alphaSpans), block.alphaChannel, block.alphaStreamOffset,
+                                       block.stream.data() + block.colorStreamLength, block.alphaStreamLength);
+                }
+                if (m_detailedStats)
+                {
+                    for (std::size_t i = 0; i < originalBytes.size(); i++)
+                    {
+                        m_stats.channelBytesModified += originalBytes[i] != block.bytes[i];
+                    }
+                }
+            }
+
+            if (block.payloadBytes > 0)
+            {
+                advanceProgress(encodedByteCount, encodedByteCount + block.payloadBytes);
+                encodedByteCount += block.payloadBytes;
+            }
+        },
+        [&](PipelineBlock &block)
+        {
+            checkCancellation();
+            PhaseTimer saveTimer(m_stats.save);
+            destination->write_rows(block.bytes.data(), block.rowCount);
+            m_stats.bytesWritten += block.bytes.size();
+        });
+
+        checkCancellation();
+        PhaseTimer saveTimer(m_stats.save);
+        destination->close();
+    }
+    catch(...)
+    {
+        // never leave a partial file behind
+        destination.reset();
+        std::error_code error;
+        filesystem::remove(destinationBitmapFilePath, error);
+        throw;
+    }
+    trackBufferBytes(peakHeldBytes + originalBytes.capacity());
+    m_stats.payloadBytes = header.payloadLength();
+    m_stats.pixelsTouched = pixelsOfChannels((streamSize * 8 + m_bitsPerPixel - 1) / m_bitsPerPixel, pixelCount);
+}
+
+bool SteganographyLib::Steganography::extractPipelined(const std::string &sourceBitmapFilePath, const std::string &destinationDataFilePath)
+{
+    releaseSourceBitmap();
+
+    // the container header is decoded from the rows that hold it, read in place.
+    // Compressed chunks do not map to offsets of the data, so they are left to the sequential path
+    ContainerHeader header;
+    {
+        PhaseTimer payloadTimer(m_stats.payload);
+        RandomAccessFile file(sourceBitmapFilePath, RandomAccessFile::Mode::Read);
+        BitmapHeader bitmapHeader = readBitmapHeader(file, sourceBitmapFilePath);
+        header = readContainerHeader(file, bitmapHeader, sourceBitmapFilePath);
+    }
+    if (header.compressed())
+    {
+        return false;
+    }
+    BitmapRowReader source;
+    {
+        PhaseTimer loadTimer(m_stats.load);
+        source.open(sourceBitmapFilePath);
+        m_stats.bytesRead += source.header_bytes().size();
+    }
+    std::size_t width = static_cast<std::size_t>(source.width());
+    std::size_t height = static_cast<std::size_t>(source.height());
+    std::size_t pixelSize = source.pixel_size();
+    std::size_t rowStride = source.row_stride();
+    bool bottomUp = source.header().height > 0;
+
+    // extract always follows the walk into the alpha channel
+    bool alphaChannels = pixelSize == 4;
+    std::uint64_t pixelCount = static_cast<std::uint64_t>(width) * height;
+    std::uint64_t payloadBegin = header.size();
+    std::uint64_t payloadEnd = payloadBegin + header.payloadLength();
+    beginProgress(header.payloadLength());
+    m_stats.payloadBytes = header.payloadLength();
+    m_stats.pixelsTouched = pixelsOfChannels((payloadEnd * 8 + m_bitsPerPixel - 1) / m_bitsPerPixel, pixelCount);
+
+    // a byte whose bits are spread over several blocks is decoded a part at a time, the bits of the other blocks
+    // reading as 0 from scratch channels.  Its parts are combined here, and the block that completes it writes it last
+    struct PartialByte
+    {
+        std::uint8_t bits = 0;
+        std::uint64_t bitCount = 0;
+    };
+    unordered_map<std::uint64_t, PartialByte> partialBytes;
+    auto combineEnds = [&](std::uint64_t firstChannel, std::uint64_t endChannel, std::uint64_t offset, char *stream, std::size_t length)
+    {
+        std::uint64_t firstBit = firstChannel * m_bitsPerPixel;
+        std::uint64_t endBit = endChannel * m_bitsPerPixel;
+        std::uint64_t completeBytes = length;
+        auto combine = [&](std::size_t i)
+        {
+            // only the first and the last byte can have bits outside the block
+            std::uint64_t bit = (offset + i) * 8;
+            if (bit >= firstBit &&
+                bit + 8 <= endBit)
+            {
+                return;
+            }
+            completeBytes--;
+            PartialByte &partial = partialBytes[offset + i];
+            partial.bits |= static_cast<std::uint8_t>(stream[i]);
+            partial.bitCount += min(bit + 8, endBit) - max(bit, firstBit);
+            stream[i] = static_cast<char>(partial.bits);
+            if (partial.bitCount == 8)
+            {
+                partialBytes.erase(offset + i);
+                completeBytes++;
+            }
+        };
+        combine(0);
+        if (length > 1)
+        {
+            combine(length - 1);
+        }
+        return completeBytes;
+    };
+
+    unique_ptr<RandomAccessFile> destination;
+    std::size_t blockRows = max<std::size_t>(PIPELINE_BLOCK_SIZE / rowStride, 1);
+    std::uint64_t extractedByteCount = 0;
+    PhaseTiming writeTiming;
+    std::size_t peakHeldBytes = 0;
+    try
+    {
+        destination = make_unique<RandomAccessFile>(destinationDataFilePath, RandomAccessFile::Mode::Create);
+        peakHeldBytes = runPipeline([&](PipelineBlock &block)
+        {
+            // the rows are read in the order of the file, and the rows that hold no data are skipped
+            PhaseTimer loadTimer(m_stats.load);
+            while (source.rows_read() < height)
+            {
+                std::size_t fileRow = source.rows_read();
+                block.rowCount = min(blockRows, height - fileRow);
+                block.firstRow = bottomUp ? height - fileRow - block.rowCount : fileRow;
+                assignStreamRanges(block, width, pixelCount, alphaChannels, payloadBegin, payloadEnd);
+                if (block.colorStreamLength == 0 &&
+                    block.alphaStreamLength == 0)
+                {
+                    source.skip_rows(block.rowCount);
+                    continue;
+                }
+
+                block.bytes.resize(block.rowCount * rowStride);
+                block.stream.resize(block.colorStreamLength + block.alphaStreamLength);
+                source.read_rows(block.bytes.data(), block.rowCount);
+                m_stats.bytesRead += block.bytes.size();
+                return true;
+            }
+            return false;
+        },
+        [&](PipelineBlock &block)
+        {
+            std::uint64_t completeBytes = 0;
+            {
+                PhaseTimer payloadTimer(m_stats.payload);
+                vector<ChannelSpan> colorSpans;
+                vector<ChannelSpan> alphaSpans;
+                blockSpans(block, width, pixelSize, bottomUp, colorSpans, alphaSpans);
+                if (block.colorStreamLength > 0)
+                {
+                    decodeChannelRange(move(colorSpans), block.colorChannel, block.colorStreamOffset, block.stream.data(), block.colorStreamLength);
+                    completeBytes += combineEnds(block.colorChannel, block.endColorChannel, block.colorStreamOffset,
+                                                 block.stream.data(), block.colorStreamLength);
+                }
+                if (block.alphaStreamLength > 0)
+                {
+                    char *stream = block.stream.data() + block.colorStreamLength;
+                    decodeChannelRange(move(alphaSpans), block.alphaChannel, block.alphaStreamOffset, stream, block.alphaStreamLength);
+                    completeBytes += combineEnds(block.alphaChannel, block.endAlphaChannel, block.alphaStreamOffset,
+                                                 stream, block.alphaStreamLength);
+                }
+            }
+
+            if (completeBytes > 0)
+            {
+                advanceProgress(extractedByteCount, extractedByteCount + completeBytes);
+                extractedByteCount += completeBytes;
+            }
+        },
+        [&](PipelineBlock &block)
+        {
+            // the payload is written in place, in the order the rows are stored
+            PhaseTimer writeTimer(writeTiming);
+            if (block.colorStreamLength > 0)
+            {
+                destination->writeAt(block.colorStreamOffset - payloadBegin, block.stream.data(), block.colorStreamLength);
+            }
+            if (block.alphaStreamLength > 0)
+            {
+                destination->writeAt(block.alphaStreamOffset - payloadBegin, block.stream.data() + block.colorStreamLength, block.alphaStreamLength);
+            }
+            m_stats.bytesWritten += block.stream.size();
+        });
+        destination.reset();
+    }
+    catch(...)
+    {
+        // never leave a partial file behind
+        destination.reset();
+        std::error_code error;
+        filesystem::remove(destinationDataFilePath, error);
+        throw;
+    }
+    m_stats.payload.wallMilliseconds += writeTiming.wallMilliseconds;
+    m_stats.payload.cpuMilliseconds += writeTiming.cpuMilliseconds;
+    trackBufferBytes(peakHeldBytes);
+    return true;
+}
+
+std::size_t SteganographyLib::Steganography::runPipeline(const PipelineReader &read, const PipelineStage &process, const PipelineStage &write)
+{
+    // the blocks go round a ring: free, read, processed, written and free again
+    BoundedQueue<unique_ptr<PipelineBlock>> freeBlocks(PIPELINE_BLOCK_COUNT);
+    BoundedQueue<unique_ptr<PipelineBlock>> readBlocks(PIPELINE_BLOCK_COUNT);
+    BoundedQueue<unique_ptr<PipelineBlock>> processedBlocks(PIPELINE_BLOCK_COUNT);
+    for (std::size_t i = 0; i < PIPELINE_BLOCK_COUNT; i++)
+    {
+        freeBlocks.push(make_unique<PipelineBlock>());
+    }
+    mutex failureMutex;
+    exception_ptr failure;
+    auto fail = [&](exception_ptr error)
+    {
+        {
+            lock_guard<mutex> lock(failureMutex);
+            if (!failure)
+            {
+                failure = error;
+            }
+        }
+        freeBlocks.cancel();
+        readBlocks.cancel();
+        processedBlocks.cancel();
+    };
+
+    std::size_t heldBytes = 0;
+    std::size_t peakHeldBytes = 0;
+    thread reader([&]()
+    {
+        try
+        {
+            unique_ptr<PipelineBlock> block;
+            while (freeBlocks.pop(block))
+            {
+                heldBytes -= block->bytes.capacity() + block->stream.capacity();
+                bool filled = read(*block);
+                heldBytes += block->bytes.capacity() + block->stream.capacity();
+                peakHeldBytes = max(peakHeldBytes, heldBytes);
+                if (!filled)
+                {
+                    break;
+                }
+                readBlocks.push(move(block));
+            }
+            readBlocks.close();
+        }
+        catch(...)
+        {
+            fail(current_exception());
+        }
+    });
+    thread writer([&]()
+    {
+        try
+        {
+            unique_ptr<PipelineBlock> block;
+            while (processedBlocks.pop(block))
+            {
+                write(*block);
+                freeBlocks.push(move(block));
+            }
+        }
+        catch(...)
+        {
+            fail(current_exception());
+        }
+    });
+
+    // the calling thread processes the blocks, in the order they are read
+    try
+    {
+        unique_ptr<PipelineBlock> block;
+        while (readBlocks.pop(block))
+        {
+            process(*block);
+            processedBlocks.push(move(block));
+        }
+        processedBlocks.close();
+    }
+    catch(...)
+    {
+        fail(current_exception());
+    }
+    reader.join();
+    writer.join();
+
+    if (failure)
+    {
+        rethrow_exception(failure);
+    }
+    return peakHeldBytes;
+}
+
+void SteganographyLib::Steganography::assignStreamRanges(PipelineBlock &block, std::size_t width, std::uint64_t pixelCount, bool alphaChannels, std::uint64_t streamBegin, std::uint64_t streamEnd) const
+{
+    // channel c of the walk holds the stream bits from c * bitsPerPixel, so the channels of a block of rows hold bits
+    // of every stream byte in these ranges.  The bytes at both ends may be shared with the neighbouring blocks
+    auto streamRange = [&](std::uint64_t firstChannel, std::uint64_t endChannel, std::uint64_t &offset, std::size_t &length)
+    {
+        offset = max<std::uint64_t>(firstChannel * m_bitsPerPixel / 8, streamBegin);
+        std::uint64_t end = min<std::uint64_t>((endChannel * m_bitsPerPixel + 7) / 8, streamEnd);
+        length = end > offset ? static_cast<std::size_t>(end - offset) : 0;
+    };
+
+    // the rows hold a run of color channels, and a run of alpha channels
+    std::uint64_t colorChannelCount = pixelCount + 2;
+    std::uint64_t firstPixel = static_cast<std::uint64_t>(block.firstRow) * width;
+    std::uint64_t endPixel = firstPixel + static_cast<std::uint64_t>(block.rowCount) * width;
+    block.colorChannel = firstPixel == 0 ? 0 : firstPixel + 2;
+    block.endColorChannel = endPixel + 2;
+    streamRange(block.colorChannel, block.endColorChannel, block.colorStreamOffset, block.colorStreamLength);
+    block.alphaChannel = colorChannelCount + firstPixel;
+    block.endAlphaChannel = colorChannelCount + endPixel;
+    block.alphaStreamLength = 0;
+    if (alphaChannels)
+    {
+        streamRange(block.alphaChannel, block.endAlphaChannel, block.alphaStreamOffset, block.alphaStreamLength);
+    }
+}
+
+void SteganographyLib::Steganography::blockSpans(PipelineBlock &block, std::size_t width, std::size_t pixelSize, bool bottomUp, std::vector<ChannelSpan> &color, std::vector<ChannelSpan> &alpha)
+{
+    std::size_t rowStride = (width * pixelSize + 3) & ~static_cast<std::size_t>(3);
+    std::uint8_t *topRow = block.bytes.data() + (bottomUp ? (block.rowCount - 1) * rowStride : 0);
+    std::ptrdiff_t rowStep = bottomUp ? -static_cast<std::ptrdiff_t>(rowStride) : static_cast<std::ptrdiff_t>(rowStride);
+
+    // R, G, B of the first pixel of the image, then the R byte of each pixel
+    color.clear();
+    color.reserve(block.rowCount + 1);
+    for (std::size_t y = 0; y < block.rowCount; y++)
+    {
+        std::uint8_t *row = topRow + static_cast<std::ptrdiff_t>(y) * rowStep;
+        if (block.firstRow + y == 0)
+        {
+            color.push_back({row + 2, 3, -1});
+            color.push_back({row + pixelSize + 2, width - 1, static_cast<std::ptrdiff_t>(pixelSize)});
+        }
+        else
+        {
+            color.push_back({row + 2, width, static_cast<std::ptrdiff_t>(pixelSize)});
+        }
+    }
+    if (pixelSize == 4)
+    {
+        alpha = alphaSpans(topRow, width, block.rowCount, rowStep);
+    }
+}
+
+void SteganographyLib::Steganography::setChannelRange(BitPacker &packer, std::vector<ChannelSpan> spans, std::uint64_t firstChannel, std::uint64_t streamOffset, std::uint8_t *scratch) const
+{
+    // the first stream byte may start in the channels before the range, and the last one end in the channels after it.
+    // Those bits belong to the neighbouring blocks, here they go to 16 bytes of scratch channels around the range
+    std::uint64_t firstBit = firstChannel * m_bitsPerPixel;
+    std::uint64_t leadingBits = firstBit > streamOffset * 8 ? firstBit - streamOffset * 8 : 0;
+    std::size_t leadingChannels = static_cast<std::size_t>((leadingBits + m_bitsPerPixel - 1) / m_bitsPerPixel);
+    if (leadingChannels > 0)
+    {
+        spans.insert(spans.begin(), {scratch, leadingChannels, 1});
+    }
+    spans.push_back({scratch + 8, 8, 1});
+
+    packer.reset(m_bitsPerPixel);
+    packer.setChannels(spans);
+    packer.seek(leadingChannels * m_bitsPerPixel + streamOffset * 8 - firstBit);
+}
+
+void SteganographyLib::Steganography::encodeChannelRange(std::vector<ChannelSpan> spans, std::uint64_t firstChannel, std::uint64_t streamOffset, const char *stream, std::size_t length) const
+{
+    std::uint8_t scratch[16] = {};
+    BitPacker packer;
+    setChannelRange(packer, move(spans), firstChannel, streamOffset, scratch);
+    if (packer.encode(reinterpret_cast<const std::uint8_t *>(stream), length) < length ||
+        !packer.flush())
+    {
+        throw runtime_error("end of source bitmap reached");
+    }
+}
+
+void SteganographyLib::Steganography::decodeChannelRange(std::vector<ChannelSpan> spans, std::uint64_t firstChannel, std::uint64_t streamOffset, char *stream, std::size_t length) const
+{
+    // the bits held by the scratch channels read as 0
+    std::uint8_t scratch[16] = {};
+    BitPacker packer;
+    setChannelRange(packer, move(spans), firstChannel, streamOffset, scratch);
+    if (packer.decode(reinterpret_cast<std::uint8_t *>(stream), length) < length)
+    {
+        throw runtime_error("end of source bitmap reached");
+    }
+}
+
+SteganographyLib::ContainerHeader SteganographyLib::Steganography::decodeContainerHeader(const std::string &bitmapFilePath)
+{
+    // verify that the bitmap can hold the header and the data it announces, based on the number of pixels
+    // in the image and the value provided for 'bitsPerPixel'
+    // this protects against cases where the bitmap that has been provided is not a valid encoded file
+    auto maxEncodedBytes = streamCapacity(true);
+    auto invalidBitmap = [&]()
+    {
+        return runtime_error("Could not decode bitmap at "
+            + bitmapFilePath
+            + " the bitmap may not be a valid encoded file or try selecting a higher value for 'bitsPerPixel'.");
+    };
+    if (maxEncodedBytes < ContainerHeader::LEGACY_SIZE)
+    {
+        throw invalidBitmap();
+    }
+
+    // a chunked header is recognized from its fixed part, anything else is the legacy 16-bit length
+    vector<char> fixedBytes(min<std::size_t>(maxEncodedBytes, ContainerHeader::FIXED_SIZE));
+    decodeBytes(fixedBytes.data(), fixedBytes.size());
+    ContainerHeader header = ContainerHeader::parse(fixedBytes.data(), fixedBytes.size(), maxEncodedBytes);
+    if (header.payloadLength() > maxEncodedBytes ||
+        header.size() > maxEncodedBytes - header.payloadLength())
+    {
+        throw invalidBitmap();
+    }
+
+    if (header.format() == ContainerFormat::Legacy)
+    {
+        m_bitPacker.seek(ContainerHeader::LEGACY_SIZE * 8);
+    }
+    else
+    {
+        vector<char> chunkTable(header.chunkTableSize());
+        decodeBytes(chunkTable.data(), chunkTable.size());
+        header.parseChunkTable(chunkTable.data());
+    }
+    return header;
+}
+
+void SteganographyLib::Steganography::setDetailedStats(bool enabled) noexcept
+{
+    m_detailedStats = enabled;
+    if (!enabled)
+    {
+        m_channelSnapshot = vector<std::uint8_t>();
+    }
+}
+
+void SteganographyLib::Steganography::trackBufferBytes(std::size_t payloadBufferBytes) noexcept
+{
+    // pixels decoded in memory, the copy of the channel bytes for detailed stats, and the payload buffers
+    std::size_t pixelBytes = (m_sourceBitmap.cbegin() == m_sourceBitmap.cend() ? 0 : sourceBitmapWidth() * sourceBitmapHeight() * (sizeof(Pixel) + m_sourceBitmap.has_alpha())) +
+                             m_coverRows.size() * sizeof(Pixel);
+    std::uint64_t bytes = pixelBytes + m_channelSnapshot.capacity() + payloadBufferBytes;
+    m_stats.peakBufferBytes = max(m_stats.peakBufferBytes, bytes);
+}
+
+std::uint64_t SteganographyLib::Steganography::pixelsOfChannels(std::uint64_t channelCount, std::uint64_t pixelCount) const noexcept
+{
+    // the first three channels are the R, G and B bytes of the first pixel, then one channel per pixel,
+    // and the alpha channels go over the same pixels again.  With a density profile or a scattered walk, each
+    // channel is a pixel
+    std::uint64_t pixels = m_scatter || !m_densityProfile.empty() ? channelCount : channelCount == 0 ? 0 : channelCount <= 3 ? 1 : channelCount - 2;
+    return min<std::uint64_t>(pixels, pixelCount);
+}
+
+void SteganographyLib::Steganography::beginProgress(std::uint64_t total)
+{
+    m_bytesTotal.store(total, memory_order_relaxed);
+    m_bytesDone.store(0, memory_order_relaxed);
+    m_lastProgressTime = chrono::steady_clock::now();
+    checkCancellation();
+}
+
+void SteganographyLib::Steganography::advanceProgress(std::uint64_t previousCount, std::uint64_t count)
+{
+    m_bytesDone.store(count, memory_order_relaxed);
+
+    std::uint64_t total = m_bytesTotal.load(memory_order_relaxed);
+    if (m_progressCallback != nullptr &&
+        m_progressInterval.count() > 0)
+    {
+        // sampled on time, and once more when the operation completes
+        auto now = chrono::steady_clock::now();
+        if (count == total ||
+            now - m_lastProgressTime >= m_progressInterval)
+        {
+            m_lastProgressTime = now;
+            m_progressCallback(static_cast<int>(ceil((100 * count) / (double)total)));
+        }
+    }
+    else if (m_progressCallback != nullptr)
+    {
+        // one callback per progress boundary crossed, with the percentage of the boundary.
+        // payloads smaller than the number of clicks report every byte
+        assert(m_progressCallbackPercentGrain > 0); // m_progressCallbackPercentGrain is validated when setting the callback, so should never be 0.
+        std::uint64_t clicks = 100 / m_progressCallbackPercentGrain;
+        std::uint64_t bytesPerProgress = max<std::uint64_t>(total / clicks, 1);
+        for (std::uint64_t boundary = (previousCount / bytesPerProgress + 1) * bytesPerProgress; boundary <= count; boundary += bytesPerProgress)
+        {
+            m_progressCallback(static_cast<int>(ceil((100 * boundary) / (double)total)));
+        }
+    }
+
+    checkCancellation();
+}
+
+void SteganographyLib::Steganography::checkCancellation() const
+{
+    if (m_cancellationToken != nullptr &&
+        m_cancellationToken->cancelled())
+    {
+        throw OperationCancelled("The operation was cancelled.");
+    }
+    if (m_deadline != chrono::steady_clock::time_point::max() &&
+        chrono::steady_clock::now() >= m_deadline)
+    {
+        throw OperationCancelled("The operation ran past its deadline.");
+    }
+}
+
+void SteganographyLib::Steganography::patchDestinationBitmap(const std::string &originalBitmapFilePath, const std::string &destinationBitmapFilePath)
+{
+    try
+    {
+        cloneFile(originalBitmapFilePath, destinationBitmapFilePath);
+
+        // the encoder fills the channel walk from the top left pixel onwards, so the rows it touched
+        // are the rows from the top down to the row of the last channel byte it wrote
+        std::size_t channelCount = m_bitPacker.channelPosition();
+        if (channelCount == 0)
+        {
+            return;
+        }
+        std::size_t width = sourceBitmapWidth();
+        std::size_t height = sourceBitmapHeight();
+        std::size_t pixelSize = sourceBitmapPixelSize();
+        std::size_t lastPixel = static_cast<std::size_t>(pixelsOfChannels(channelCount, static_cast<std::uint64_t>(width) * height) - 1);
+        std::size_t dirtyRows = m_scatter ? height : min(lastPixel / width + 1, height);
+
+        RandomAccessFile destination(destinationBitmapFilePath, RandomAccessFile::Mode::ReadWrite);
+
+        if (m_mappedBitmap)
+        {
+            // the mapping has the layout of the file, so the dirty rows are a single range of it
+            const std::uint8_t *topRow = m_mappedBitmap.row(0);
+            const std::uint8_t *lastRow = m_mappedBitmap.row(static_cast<std::int32_t>(dirtyRows - 1));
+            const std::uint8_t *first = min(topRow, lastRow);
+            const std::uint8_t *last = max(topRow, lastRow) + width * pixelSize;
+            destination.writeAt(first - m_mappedBitmap.data(), first, last - first);
+            m_stats.bytesWritten += last - first;
+        }
+        else
+        {
+            BitmapHeader header;
+            destination.readAt(0, &header, sizeof(header));
+            std::size_t rowStride = (width * pixelSize + 3) & ~static_cast<std::size_t>(3);
+            const Pixel *pixels = m_cachedCover ? m_coverRows.data() : &m_sourceBitmap[0];
+            const std::uint8_t *alpha = m_cachedCover ? m_cachedCover->alpha() : m_sourceBitmap.alpha();
+
+            vector<std::uint8_t> line(width * pixelSize);
+            for (std::size_t y = 0; y < dirtyRows; y++)
+            {
+                std::size_t i = 0;
+                for (std::size_t x = 0; x < width; x++)
+                {
+                    const Pixel &color = pixels[x + y * width];
+                    line[i++] = color.b;
+                    line[i++] = color.g;
+                    line[i++] = color.r;
+                    if (alpha != nullptr)
+                    {
+                        line[i++] = alpha[x + y * width];
+                    }
+                }
+
+                std::size_t fileRow = header.height < 0 ? y : height - 1 - y;
+                destination.writeAt(header.offset_bits + fileRow * rowStride, line.data(), line.size());
+                m_stats.bytesWritten += line.size();
+            }
+        }
+    }
+    catch(const runtime_error &)
+    {
+        // never leave a half patched bitmap behind
+        std::error_code error;
+        filesystem::remove(destinationBitmapFilePath, error);
+        throw;
+    }
+}
+
+bmp::BitmapHeader SteganographyLib::Steganography::readBitmapHeader(RandomAccessFile &file, const std::string &bitmapFilePath)
+{
+    BitmapHeader header;
+    std::uint64_t fileSize = file.size();
+    if (fileSize < sizeof(header))
+    {
+        throw runtime_error("Could not open bitmap file at " + bitmapFilePath + " unrecognized file format.");
+    }
+    file.readAt(0, &header, sizeof(header));
+    std::uint8_t masks[BITMAP_MASKS_SIZE];
+    bool hasMasks = fileSize >= sizeof(header) + sizeof(masks);
+    if (hasMasks)
+    {
+        file.readAt(sizeof(header), masks, sizeof(masks));
+    }
+    validateBitmapHeader(header, hasMasks ? masks : nullptr, fileSize, "bitmap file at " + bitmapFilePath);
+    return header;
+}
+
+void SteganographyLib::Steganography::validateBitmapHeader(const bmp::BitmapHeader &header, const std::uint8_t *masks, std::uint64_t size, const std::string &description)
+{
+    // pixels are read in place, so only 24 bits per pixel BGR and 32 bits per pixel BGRA bitmaps are supported
+    std::size_t pixelSize = pixel_size(header, masks);
+    std::uint64_t rowStride = (static_cast<std::uint64_t>(header.width) * pixelSize + 3) & ~static_cast<std::uint64_t>(3);
+    std::uint64_t height = header.height < 0 ? -static_cast<std::int64_t>(header.height) : header.height;
+    if (header.magic != BITMAP_BUFFER_MAGIC ||
+        pixelSize == 0 ||
+        header.width <= 0 ||
+        height == 0 ||
+        header.offset_bits > size ||
+        rowStride * height > size - header.offset_bits)
+    {
+        throw runtime_error("Could not open " + description + " only 24 bits per pixel BGR and 32 bits per pixel BGRA bitmaps are supported.");
+    }
+}
+
+void SteganographyLib::Steganography::readStreamRange(RandomAccessFile &file, const bmp::BitmapHeader &header, std::uint64_t streamOffset, char *data, std::size_t length)
+{
+    if (m_scatter)
+    {
+        readScatteredRange(file, header, streamOffset, data, length);
+        return;
+    }
+    if (!m_densityProfile.empty())
+    {
+        throw runtime_error("Reading part of a bitmap in place is not supported with a density profile.");
+    }
+    if (length == 0)
+    {
+        return;
+    }
+
+    // channel c of the walk is the R, G or B byte of pixel 0 for c < 3, then the R byte of pixel c - 2,
+    // followed by the alpha byte of every pixel for 32 bpp bitmaps
+    std::size_t width = static_cast<std::size_t>(header.width);
+    std::size_t height = static_cast<std::size_t>(header.height < 0 ? -static_cast<std::int64_t>(header.height) : header.height);
+    std::size_t pixelSize = header.bits_per_pixel / 8;
+    std::uint64_t firstChannel = streamOffset * 8 / m_bitsPerPixel;
+    std::uint64_t lastChannel = ((streamOffset + length) * 8 - 1) / m_bitsPerPixel;
+    std::uint64_t colorChannelCount = static_cast<std::uint64_t>(width) * height + 2;
+    std::uint64_t channelCount = colorChannelCount + (pixelSize == 4 ? colorChannelCount - 2 : 0);
+    if (lastChannel >= channelCount)
+    {
+        throw runtime_error("end of source bitmap reached");
+    }
+    auto rowOf = [&](std::uint64_t channel)
+    {
+        std::uint64_t pixel = channel < colorChannelCount ? (channel < 3 ? 0 : channel - 2) : channel - colorChannelCount;
+        return static_cast<std::size_t>(pixel / width);
+    };
+    bool colorChannels = firstChannel < colorChannelCount;
+    bool alphaChannels = lastChannel >= colorChannelCount;
+
+    // a range that goes from the R bytes to the alpha bytes needs both ends of the image, so all of it
+    std::size_t firstRow = colorChannels && alphaChannels ? 0 : rowOf(firstChannel);
+    std::size_t lastRow = colorChannels && alphaChannels ? height - 1 : rowOf(lastChannel);
+    std::size_t rowCount = lastRow - firstRow + 1;
+
+    // the rows are contiguous in the file, upside down for bottom-up bitmaps
+    std::size_t rowStride = (width * pixelSize + 3) & ~static_cast<std::size_t>(3);
+    bool bottomUp = header.height > 0;
+    std::size_t firstFileRow = bottomUp ? height - 1 - lastRow : firstRow;
+    vector<std::uint8_t> rows(rowCount * rowStride);
+    file.readAt(header.offset_bits + static_cast<std::uint64_t>(firstFileRow) * rowStride, rows.data(), rows.size());
+    m_stats.bytesRead += rows.size();
+    trackBufferBytes(rows.capacity());
+
+    std::uint8_t *topRow = bottomUp ? rows.data() + (rowCount - 1) * rowStride : rows.data();
+    std::ptrdiff_t rowStep = bottomUp ? -static_cast<std::ptrdiff_t>(rowStride) : static_cast<std::ptrdiff_t>(rowStride);
+    BitPacker packer;
+    packer.reset(m_bitsPerPixel);
+    std::uint64_t baseChannel = 0;
+    if (!colorChannels)
+    {
+        packer.setChannels(alphaSpans(topRow, width, rowCount, rowStep));
+        baseChannel = colorChannelCount + static_cast<std::uint64_t>(firstRow) * width;
+    }
+    else if (firstRow == 0)
+    {
+        packer.setBgrRows(topRow, width, rowCount, rowStep, pixelSize);
+        if (alphaChannels)
+        {
+            packer.appendChannels(alphaSpans(topRow, width, rowCount, rowStep));
+        }
+    }
+    else
+    {
+        // only R bytes after the first row
+        vector<ChannelSpan> spans;
+        spans.reserve(rowCount);
+        for (std::size_t y = 0; y < rowCount; y++)
+        {
+            spans.push_back({topRow + static_cast<std::ptrdiff_t>(y) * rowStep + 2, width, static_cast<std::ptrdiff_t>(pixelSize)});
+        }
+        packer.setChannels(spans);
+        baseChannel = static_cast<std::uint64_t>(firstRow) * width + 2;
+    }
+
+    packer.seek(streamOffset * 8 - baseChannel * m_bitsPerPixel);
+    if (packer.decode(reinterpret_cast<std::uint8_t *>(data), length) < length)
+    {
+        throw runtime_error("end of source bitmap reached");
+    }
+}
+
+void SteganographyLib::Steganography::readScatteredRange(RandomAccessFile &file, const bmp::BitmapHeader &header, std::uint64_t streamOffset, char *data, std::size_t length)
+{
+    if (length == 0)
+    {
+        return;
+    }
+
+    // the walk goes through the R byte of every pixel in the keyed order, then through the alpha bytes in the same order
+    // for 32 bpp bitmaps.  With a density profile, channel c is the whole pixel the R byte belongs to
+    std::size_t width = static_cast<std::size_t>(header.width);
+    std::size_t height = static_cast<std::size_t>(header.height < 0 ? -static_cast<std::int64_t>(header.height) : header.height);
+    std::size_t pixelSize = header.bits_per_pixel / 8;
+    ScatterOrder order(width, height, m_scatterKey);
+    std::uint64_t pixelCount = order.pixelCount();
+    std::uint64_t passCount = pixelSize == 4 && m_densityProfile.empty() ? 2 : 1;
+    std::uint64_t firstChannel = streamOffset * 8 / m_bitsPerPixel;
+    std::uint64_t lastChannel = ((streamOffset + length) * 8 - 1) / m_bitsPerPixel;
+    if (lastChannel >= pixelCount * passCount)
+    {
+        throw runtime_error("end of source bitmap reached");
+    }
+
+    // the tiles that hold the range, in the color pass, the alpha pass or both
+    vector<pair<ScatterTile, std::size_t>> tiles;
+    std::uint64_t baseChannel = 0;
+    for (std::uint64_t pass = 0; pass < passCount; pass++)
+    {
+        std::uint64_t passChannel = pass * pixelCount;
+        if (lastChannel < passChannel ||
+            firstChannel >= passChannel + pixelCount)
+        {
+            continue;
+        }
+        std::size_t firstTile = order.tileAt(max(firstChannel, passChannel) - passChannel);
+        std::size_t lastTile = order.tileAt(min(lastChannel, passChannel + pixelCount - 1) - passChannel);
+        if (tiles.empty())
+        {
+            baseChannel = passChannel + order.tile(firstTile).position;
+        }
+        for (std::size_t i = firstTile; i <= lastTile; i++)
+        {
+            tiles.emplace_back(order.tile(i), pass == 0 ? 2 : 3);
+        }
+    }
+
+    // each tile is read from the file one row at a time, into a buffer the spans point into
+    std::size_t byteCount = 0;
+    for (const auto &tile : tiles)
+    {
+        byteCount += tile.first.pixelCount * pixelSize;
+    }
+    vector<std::uint8_t> pixels(byteCount);
+    vector<ChannelSpan> spans;
+    spans.reserve(tiles.size());
+    std::size_t rowStride = (width * pixelSize + 3) & ~static_cast<std::size_t>(3);
+    bool bottomUp = header.height > 0;
+    std::uint8_t *cursor = pixels.data();
+    for (const auto &tile : tiles)
+    {
+        std::uint64_t pixel = tile.first.firstPixel;
+        std::size_t remaining = tile.first.pixelCount;
+        while (remaining > 0)
+        {
+            std::size_t y = static_cast<std::size_t>(pixel / width);
+            std::size_t x = static_cast<std::size_t>(pixel % width);
+            std::size_t run = min(remaining, width - x);
+            std::size_t fileRow = bottomUp ? height - 1 - y : y;
+            file.readAt(header.offset_bits + static_cast<std::uint64_t>(fileRow) * rowStride + x * pixelSize, cursor, run * pixelSize);
+            spans.push_back({cursor + tile.second, run, static_cast<std::ptrdiff_t>(pixelSize)});
+            cursor += run * pixelSize;
+            pixel += run;
+            remaining -= run;
+        }
+    }
+    m_stats.bytesRead += pixels.size();
+    trackBufferBytes(pixels.capacity());
+
+    BitPacker packer;
+    if (m_densityProfile.empty())
+    {
+        packer.reset(m_bitsPerPixel);
+    }
+    else
+    {
+        packer.reset(m_densityProfile);
+    }
+    packer.setChannels(spans, -1);
+    packer.seek(streamOffset * 8 - baseChannel * m_bitsPerPixel);
+    if (packer.decode(reinterpret_cast<std::uint8_t *>(data), length) < length)
+    {
+        throw runtime_error("end of source bitmap reached");
+    }
+}
+
+SteganographyLib::ContainerHeader SteganographyLib::Steganography::readContainerHeader(RandomAccessFile &file, const bmp::BitmapHeader &header, const std::string &bitmapFilePath)
+{
+    std::uint64_t height = header.height < 0 ? -static_cast<std::int64_t>(header.height) : header.height;
+    std::uint64_t channelCount = static_cast<std::uint64_t>(header.width) * height * (header.bits_per_pixel == 32 ? 2 : 1);
+    std::uint64_t maxEncodedBytes = channelCount * m_bitsPerPixel / 8;
+    auto invalidBitmap = [&]()
+    {
+        return runtime_error("Could not decode bitmap at "
+            + bitmapFilePath
+            + " the bitmap may not be a valid encoded file or try selecting a higher value for 'bitsPerPixel'.");
+    };
+    if (maxEncodedBytes < ContainerHeader::LEGACY_SIZE)
+    {
+        throw invalidBitmap();
+    }
+
+    vector<char> fixedBytes(static_cast<std::size_t>(min<std::uint64_t>(maxEncodedBytes, ContainerHeader::FIXED_SIZE)));
+    readStreamRange(file, header, 0, fixedBytes.data(), fixedBytes.size());
+    ContainerHeader containerHeader = ContainerHeader::parse(fixedBytes.data(), fixedBytes.size(), maxEncodedBytes);
+    if (containerHeader.payloadLength() > maxEncodedBytes ||
+        containerHeader.size() > maxEncodedBytes - containerHeader.payloadLength())
+    {
+        throw invalidBitmap();
+    }
+
+    if (containerHeader.format() == ContainerFormat::Chunked)
+    {
+        vector<char> chunkTable(containerHeader.chunkTableSize());
+        readStreamRange(file, header, ContainerHeader::FIXED_SIZE, chunkTable.data(), chunkTable.size());
+        containerHeader.parseChunkTable(chunkTable.data());
+    }
+    return containerHeader;
+}
+
+std::size_t SteganographyLib::Steganography::sourceBitmapWidth() const noexcept
+{
+    if (m_bufferRows.topRow != nullptr)
+    {
+        return m_bufferRows.width;
+    }
+    if (m_cachedCover)
+    {
+        return m_cachedCover->width();
+    }
+    return m_mappedBitmap ? m_mappedBitmap.width() : m_sourceBitmap.width();
+}
+
+std::size_t SteganographyLib::Steganography::sourceBitmapHeight() const noexcept
+{
+    if (m_bufferRows.topRow != nullptr)
+    {
+        return m_bufferRows.height;
+    }
+    if (m_cachedCover)
+    {
+        return m_cachedCover->height();
+    }
+    return m_mappedBitmap ? m_mappedBitmap.height() : m_sourceBitmap.height();
+}
+
+std::size_t SteganographyLib::Steganography::sourceBitmapPixelSize() const noexcept
+{
+    if (m_bufferRows.topRow != nullptr)
+    {
+        return m_bufferRows.pixelSize;
+    }
+    if (m_cachedCover)
+    {
+        return m_cachedCover->has_alpha() ? 4 : 3;
+    }
+    return m_mappedBitmap ? m_mappedBitmap.pixel_size() : (m_sourceBitmap.has_alpha() ? 4 : 3);
+}
+
+std::uint64_t SteganographyLib::Steganography::streamCapacity(bool alphaChannels) const noexcept
+{
+    // one channel byte per pixel, and a second one in the alpha channel of 32 bpp bitmaps.
+    // A density profile stores its bits in the color channels only
+    std::uint64_t channelCount = static_cast<std::uint64_t>(sourceBitmapWidth()) * sourceBitmapHeight();
+    if (alphaChannels && sourceBitmapPixelSize() == 4 && m_densityProfile.empty())
+    {
+        channelCount *= 2;
+    }
+    return channelCount * m_bitsPerPixel / 8;
+}
+
+std::vector<SteganographyLib::ChannelSpan> SteganographyLib::Steganography::alphaSpans(std::uint8_t *topRow, std::size_t width, std::size_t height, std::ptrdiff_t rowStep)
+{
+    // the alpha byte is the last byte of each BGRA pixel
+    vector<ChannelSpan> spans;
+    spans.reserve(height);
+    for (std::size_t y = 0; y < height; y++)
+    {
+        spans.push_back({topRow + static_cast<std::ptrdiff_t>(y) * rowStep + 3, width, 4});
+    }
+    return spans;
+}
+
+void SteganographyLib::Steganography::resetBitPacker()
+{
+    // the packing kernel for the selected density is chosen once here, then walks the
+    // R, G and B bytes of the first pixel followed by the R byte of every other pixel,
+    // and then the alpha byte of every pixel of 32 bpp bitmaps
+    std::size_t width = sourceBitmapWidth();
+    std::size_t height = sourceBitmapHeight();
+    if (m_scatter)
+    {
+        resetScatteredBitPacker();
+        return;
+    }
+    if (!m_densityProfile.empty())
+    {
+        // or, with a density profile, the kernel of the profile walks every pixel in turn
+        m_bitPacker.reset(m_densityProfile);
+        if (m_bufferRows.topRow != nullptr)
+        {
+            m_bitPacker.setBgrRows(m_bufferRows.topRow, width, height, m_bufferRows.rowStep, m_bufferRows.pixelSize);
+        }
+        else if (m_cachedCover)
+        {
+            const Pixel *pixels = m_coverRows.empty() ? &*m_cachedCover->cbegin() : m_coverRows.data();
+            m_bitPacker.setPixels(const_cast<std::uint8_t *>(&pixels->r), m_coverRows.empty() ? width * height : m_coverRows.size());
+        }
+        else if (m_mappedBitmap)
+        {
+            m_bitPacker.setBgrRows(m_mappedBitmap.row(0), width, height, m_mappedBitmap.row_step(), m_mappedBitmap.pixel_size());
+        }
+        else
+        {
+            m_bitPacker.setPixels(&m_sourceBitmap.begin()->r, width * height);
+        }
+        return;
+    }
+
+    m_bitPacker.reset(m_bitsPerPixel);
+    if (m_bufferRows.topRow != nullptr)
+    {
+        // work directly on the BGR or BGRA rows of the caller's buffer
+        m_bitPacker.setBgrRows(m_bufferRows.topRow, width, height, m_bufferRows.rowStep, m_bufferRows.pixelSize);
+        if (m_bufferRows.pixelSize == 4)
+        {
+            m_bitPacker.appendChannels(alphaSpans(m_bufferRows.topRow, width, height, m_bufferRows.rowStep));
+        }
+    }
+    else if (m_cachedCover)
+    {
+        // embed writes to its copy of the top rows, which never reaches the alpha channel, extract reads the shared cover
+        const Pixel *pixels = m_coverRows.empty() ? &*m_cachedCover->cbegin() : m_coverRows.data();
+        std::size_t pixelCount = m_coverRows.empty() ? width * height : m_coverRows.size();
+        m_bitPacker.setPixels(const_cast<std::uint8_t *>(&pixels->r), pixelCount);
+        if (m_coverRows.empty() && m_cachedCover->has_alpha())
+        {
+            m_bitPacker.appendChannels({{const_cast<std::uint8_t *>(m_cachedCover->alpha()), width * height, 1}});
+        }
+    }
+    else if (m_mappedBitmap)
+    {
+        // work directly on the BGR or BGRA rows of the mapped file
+        m_bitPacker.setBgrRows(m_mappedBitmap.row(0), width, height, m_mappedBitmap.row_step(), m_mappedBitmap.pixel_size());
+        if (m_mappedBitmap.pixel_size() == 4)
+        {
+            m_bitPacker.appendChannels(alphaSpans(m_mappedBitmap.row(0), width, height, m_mappedBitmap.row_step()));
+        }
+    }
+    else
+    {
+        // the alpha channel of a loaded bitmap is contiguous
+        m_bitPacker.setPixels(&m_sourceBitmap.begin()->r, width * height);
+        if (m_sourceBitmap.has_alpha())
+        {
+            m_bitPacker.appendChannels({{m_sourceBitmap.alpha(), width * height, 1}});
+        }
+    }
+}
+
+void SteganographyLib::Steganography::resetScatteredBitPacker()
+{
+    // the walk goes through the R byte of every pixel in the keyed order, then through the alpha bytes of 32 bpp
+    // bitmaps in the same order.  With a density profile, through every pixel from its R byte, without the alpha bytes
+    std::size_t width = sourceBitmapWidth();
+    std::size_t height = sourceBitmapHeight();
+    ScatterOrder order(width, height, m_scatterKey);
+    bool alphaChannels = m_densityProfile.empty();
+    if (m_densityProfile.empty())
+    {
+        m_bitPacker.reset(m_bitsPerPixel);
+    }
+    else
+    {
+        m_bitPacker.reset(m_densityProfile);
+    }
+
+    if (m_bufferRows.topRow != nullptr)
+    {
+        std::ptrdiff_t pixelSize = static_cast<std::ptrdiff_t>(m_bufferRows.pixelSize);
+        m_bitPacker.setChannels(order.spans(m_bufferRows.topRow + 2, m_bufferRows.rowStep, pixelSize), -1);
+        if (alphaChannels && pixelSize == 4)
+        {
+            m_bitPacker.appendChannels(order.spans(m_bufferRows.topRow + 3, m_bufferRows.rowStep, pixelSize));
+        }
+    }
+    else if (m_cachedCover)
+    {
+        // only extract reads the shared cover, embed works on a private copy of all of it
+        std::uint8_t *pixels = const_cast<std::uint8_t *>(&m_cachedCover->cbegin()->r);
+        m_bitPacker.setChannels(order.spans(pixels, static_cast<std::ptrdiff_t>(width * 3), 3), 1);
+        if (alphaChannels && m_cachedCover->has_alpha())
+        {
+            m_bitPacker.appendChannels(order.spans(const_cast<std::uint8_t *>(m_cachedCover->alpha()), static_cast<std::ptrdiff_t>(width), 1));
+        }
+    }
+    else if (m_mappedBitmap)
+    {
+        std::ptrdiff_t pixelSize = static_cast<std::ptrdiff_t>(m_mappedBitmap.pixel_size());
+        m_bitPacker.setChannels(order.spans(m_mappedBitmap.row(0) + 2, m_mappedBitmap.row_step(), pixelSize), -1);
+        if (alphaChannels && pixelSize == 4)
+        {
+            m_bitPacker.appendChannels(order.spans(m_mappedBitmap.row(0) + 3, m_mappedBitmap.row_step(), pixelSize));
+        }
+    }
+    else
+    {
+        m_bitPacker.setChannels(order.spans(&m_sourceBitmap.begin()->r, static_cast<std::ptrdiff_t>(width * 3), 3), 1);
+        if (alphaChannels && m_sourceBitmap.has_alpha())
+        {
+            m_bitPacker.appendChannels(order.spans(m_sourceBitmap.alpha(), static_cast<std::ptrdiff_t>(width), 1));
+        }
+    }
+}
+
+void SteganographyLib::Steganography::encodeBytes(const char *inputBytes, std::size_t length)
+{
+    // data bits are encoded from least significant to most significant bit, into the least significant
+    // bits of each channel byte, to ensure we shift the color of the pixel as little as possible.
+    if (m_bitPacker.encode(reinterpret_cast<const std::uint8_t *>(inputBytes), length) < length)
+    {
+        throw runtime_error("end of source bitmap reached");
+    }
+}
+
+void SteganographyLib::Steganography::decodeBytes(char *dataBytes, std::size_t length)
+{
+    if (m_bitPacker.decode(reinterpret_cast<std::uint8_t *>(dataBytes), length) < length)
+    {
+        throw runtime_error("end of source bitmap reached");
+    }
+}
+
+void SteganographyLib::Steganography::setBitsPerPixel(int bitsPerPixel)
+{
+    // a density profile sets the density on its own
+    if (!m_densityProfile.empty())
+    {
+        if (bitsPerPixel != m_densityProfile.bitsPerPixel())
+        {
+            throw runtime_error("Invalid value for parameter bitsPerPixel. Must be "
+                + to_string(m_densityProfile.bitsPerPixel())
+                + ", the bits per pixel of the density profile. Aborting operation.");
+        }
+        m_bitsPerPixel = bitsPerPixel;
+        return;
+    }
+
+
     // Before manipulating files, verify that bitsPerPixel is a number between 3 and 24 and a multiple of 3.
     // this number represents how many bits of information from the input file we will pack into each 24-bit RGB pixel.
     if (bitsPerPixel < 3 ||
@@ -3,16 +3,50 @@
 #include <vector>     // std::vector
 #include <cstdint>    // std::int*_t
 #include <functional> // std::function
+#include <memory>     // std::unique_ptr
+#include <istream>    // std::istream
+#include <ostream>    // std::ostream
+#include <atomic>     // std::atomic
+#include <chrono>     // std::chrono
 #include "isteganography.h"
 #include "bitmap.h"
+#include "bitpacker.h"
+#include "scatter.h"
+#include "threadpool.h"
+#include "container.h"
+#include "fileio.h"
+#include "covercache.h"
+#include "cancellation.h"
+#include "boundedqueue.h"
 
 namespace SteganographyLib
 {
-    enum PixelColor
+    /// @brief How embed produces the destination bitmap.
+    enum class OutputMode
     {
-        R,
-        G,
-        B
+        Rewrite, // the whole bitmap is written to the destination
+        Patch    // the original bitmap is cloned to the destination, then only the rows that carry data are written
+    };
+
+    /// @brief What probe found at the start of a bitmap.
+    struct ProbeResult
+    {
+        ContainerFormat format = ContainerFormat::Legacy; // Chunked only when the header checksum matched
+        std::uint64_t payloadLength = 0;                  // bytes of embedded data announced by the header
+        std::uint64_t capacity = 0;                       // bytes the bitmap can hold at the density, header and alpha channel included
+        std::uint64_t remainingCapacity = 0;              // capacity left after the header and the data, when plausible
+        bool plausible = false;                           // true when the header and the data it announces fit the bitmap
+    };
+
+    /// @brief What scan found at the start of a bitmap.
+    struct ScanResult
+    {
+        bool found = false;              // a chunked header was recognized by its magic and checksum
+        std::uint8_t bitsPerPixel = 0;   // density the header was found at
+        std::uint64_t payloadLength = 0; // bytes stored after the header
+        bool compressed = false;         // the payload is compressed
+        bool supported = false;          // the header only uses features this version supports
+        bool plausible = false;          // the header and the data it announces fit the bitmap
     };
 
     /// @brief Concrete class for Steganography operations on a bitmap
@@ -38,26 +72,340 @@ namespace SteganographyLib
             /// @param bitsPerPixel Resolution that determines how many bits from each RGB pixel (24 bits) encodes source data.  Must be a multiple of 3 between 3 and 24.
             void extract(const std::string &sourceBitmapFilePath, const std::string &destinationDataFilePath, std::uint8_t bitsPerPixel) override;
 
+            /// @brief Embeds information read from a stream into a bitmap read from a stream.
+            /// @param originalBitmap Stream positioned at the start of the original bitmap.
+            /// @param sourceData Stream of the information to embed, up to its end.  Streams that cannot seek are read up front.
+            /// @param destinationBitmap Receives the bitmap with the information embedded.
+            /// @param bitsPerPixel Resolution that determines how many bits from each RGB pixel (24 bits) will encode source data.  Must be a multiple of 3 between 3 and 24.
+            void embed(std::istream &originalBitmap, std::istream &sourceData, std::ostream &destinationBitmap, std::uint8_t bitsPerPixel) override;
+
+            /// @brief Embeds information into the pixels of a bitmap held in memory, in place.
+            /// Neither the bitmap nor the information is copied: the information is encoded straight into the pixel rows of the buffer.
+            /// @param bitmapData Bytes of a 24 bits per pixel BGR or 32 bits per pixel BGRA .bmp file, modified in place.
+            /// @param bitmapSize Number of bytes of the bitmap.
+            /// @param sourceData Information to embed.
+            /// @param sourceDataSize Number of bytes of information.
+            /// @param bitsPerPixel Resolution that determines how many bits from each RGB pixel (24 bits) will encode source data.  Must be a multiple of 3 between 3 and 24.
+            void embed(std::uint8_t *bitmapData, std::size_t bitmapSize, const char *sourceData, std::size_t sourceDataSize, std::uint8_t bitsPerPixel) override;
+
+            /// @brief Extracts information from a bitmap read from a stream.
+            /// @param sourceBitmap Stream positioned at the start of the bitmap.
+            /// @param destinationData Receives the extracted information.
+            /// @param bitsPerPixel Resolution that determines how many bits from each RGB pixel (24 bits) encodes source data.  Must be a multiple of 3 between 3 and 24.
+            void extract(std::istream &sourceBitmap, std::ostream &destinationData, std::uint8_t bitsPerPixel) override;
+
+            /// @brief Extracts information from a bitmap held in memory, decoding its pixel rows in place.
+            /// @param bitmapData Bytes of a 24 bits per pixel BGR or 32 bits per pixel BGRA .bmp file.
+            /// @param bitmapSize Number of bytes of the bitmap.
+            /// @param bitsPerPixel Resolution that determines how many bits from each RGB pixel (24 bits) encodes source data.  Must be a multiple of 3 between 3 and 24.
+            /// @return The extracted information.
+            std::vector<char> extract(const std::uint8_t *bitmapData, std::size_t bitmapSize, std::uint8_t bitsPerPixel) override;
+
+            /// @brief Extracts a range of the information embedded in a bitmap, reading only the pixel rows that hold it.
+            /// The position of every byte in the pixels follows from the density, so the header, the chunk table and the
+            /// requested bytes are each decoded from a single positioned read of their rows.  The bitmap is never loaded.
+            /// @param sourceBitmapFilePath Path to the bitmap that contains the information.
+            /// @param offset Offset of the first byte to extract, from the start of the embedded information.
+            /// @param length Number of bytes to extract.
+            /// @param bitsPerPixel Resolution that determines how many bits from each RGB pixel (24 bits) encodes source data.  Must be a multiple of 3 between 3 and 24.
+            /// @return The extracted bytes.
+            std::vector<char> extractRange(const std::string &sourceBitmapFilePath, std::uint64_t offset, std::size_t length, std::uint8_t bitsPerPixel) override;
+
+            /// @brief Embeds one shard of a payload split across several bitmaps: the 'shard.length' bytes at 'shard.dataOffset'
+            /// in the source file, with a shard record that lets extractShard() put them back in place.
+            /// @param originalBitmapFilePath Path to the original bitmap.
+            /// @param sourceDataFilePath Path to the whole payload.
+            /// @param shard Place of the shard in the payload, see planShards().
+            /// @param destinationBitmapFilePath Path to the bitmap that receives the shard.
+            /// @param bitsPerPixel Resolution that determines how many bits from each RGB pixel (24 bits) encodes source data.  Must be a multiple of 3 between 3 and 24.
+            void embedShard(const std::string &originalBitmapFilePath, const std::string &sourceDataFilePath, const ContainerShard &shard, const std::string &destinationBitmapFilePath, std::uint8_t bitsPerPixel);
+
+            /// @brief Reads the shard record of a bitmap embedded by embedShard(), without decoding its data.
+            /// @throws std::runtime_error if the bitmap does not hold a shard
+            ContainerShard readShard(const std::string &bitmapFilePath, std::uint8_t bitsPerPixel);
+
+            /// @brief Extracts one shard into its place in the destination file, which is neither created nor truncated,
+            /// so that several shards, or several threads, can fill the same file.
+            /// @return The shard record.
+            /// @throws std::runtime_error if the bitmap does not hold a shard
+            ContainerShard extractShard(const std::string &sourceBitmapFilePath, const std::string &destinationDataFilePath, std::uint8_t bitsPerPixel);
+
+            /// @brief Returns the number of bytes of data a shard embedded in a cover can hold, with the current settings,
+            /// from the bitmap header alone.  Compressed shards never take more room than their data as is.
+            std::uint64_t shardCapacity(const std::string &coverFilePath, std::uint8_t bitsPerPixel);
+
+            /// @brief Reports whether a bitmap carries embedded data, and how much, without extracting it.
+            /// Only the bitmap header and the first pixel row(s), which hold the fixed part of the container header, are read,
+            /// so the cost does not depend on the size of the image.  A bitmap without embedded data usually reads as a
+            /// legacy header announcing a random length, which is only reported as plausible if it fits the bitmap.
+            /// @param bitmapFilePath Path to the bitmap.
+            /// @param bitsPerPixel Resolution that the data would have been embedded with.  Must be a multiple of 3 between 3 and 24.
+            /// @throws std::runtime_error if the file is not a supported bitmap
+            ProbeResult probe(const std::string &bitmapFilePath, std::uint8_t bitsPerPixel);
+
+            /// @brief Looks for a chunked header at every density, without knowing the density data was embedded with.
+            /// The bitmap header and the top pixel rows that hold the fixed part of a container header at the lowest
+            /// density are read once, then each density only decodes the 4 bytes of the magic, and the fixed part when
+            /// they match, checked with its CRC-32C.  Legacy headers carry no magic and are not recognized, nor are headers
+            /// that continue into the alpha channel of bitmaps of less than 75 pixels.
+            /// @param bitmapFilePath Path to the bitmap.
+            /// @throws std::runtime_error if the file is not a supported bitmap
+            ScanResult scan(const std::string &bitmapFilePath);
+
             /// @brief Registers a callback function to be invoked during both the embed and extract methods.
             /// Allows the caller to be notified with the progress of these operations, such as for logging or to display a progress bar to the user.
             /// @param callbackFunction The callback function that will be invoked.
             /// @param percentGrain value between 1 to 100, indicating after how many percentage units of completed work (over a total of 100) will the callback be invoked.
             //  Example, if 1 is provided, 100 callbacks will be invoked.  If 50 is provided 2 callbacks will be invoked.
             void registerProgressCallback(ProgressCallback callbackFunction, int percentGrain = 10) override;
+
+            /// @brief Registers a callback function sampled on time rather than on the amount of work done.
+            /// The callback is invoked from the thread running the operation, at most once per interval, and once more
+            /// when the operation completes.  For cheap polling from other threads, see bytesDone().
+            /// @param callbackFunction The callback function that will be invoked with the percentage completed.
+            /// @param interval Minimum time between two callbacks.
+            void registerProgressCallback(ProgressCallback callbackFunction, std::chrono::milliseconds interval);
+
+            /// @brief Selects a token that stops the following operations when cancelled.
+            /// Embed and extract check the token, and the deadline, once per block of data and throw OperationCancelled.
+            /// A cancelled file operation leaves no destination file behind.  A cancelled stream extract may have written
+            /// part of the data to its stream, and a cancelled in-place embed leaves the buffer partially encoded.
+            /// @param cancellationToken The token, or nullptr (the default) for none.
+            void setCancellationToken(std::shared_ptr<CancellationToken> cancellationToken) noexcept;
+
+            /// @brief Selects the time after which the following operations stop, as if cancelled.
+            /// @param deadline The deadline, or std::chrono::steady_clock::time_point::max() (the default) for none.
+            void setDeadline(std::chrono::steady_clock::time_point deadline) noexcept;
+
+            /// @brief Returns the number of payload bytes encoded or decoded by the running or last operation.
+            /// Can be polled from any thread.
+            std::uint64_t bytesDone() const noexcept { return m_bytesDone.load(std::memory_order_relaxed); }
+
+            /// @brief Returns the number of payload bytes of the running or last operation.
+            std::uint64_t bytesTotal() const noexcept { return m_bytesTotal.load(std::memory_order_relaxed); }
+
+            /// @brief Returns the timings and counters of the last embed, extract or extractRange, filled in as it ran.
+            /// After a failure, they cover the work done until then.
+            const OperationStats &lastStats() const noexcept override { return m_stats; }
+
+            /// @brief Selects whether the stats also count the channel bytes modified by embed.
+            /// Counting them needs a copy of every channel byte the stream will use, taken before encoding.
+            /// @param enabled true to count them, false (the default) to leave the counter at 0.
+            void setDetailedStats(bool enabled) noexcept override;
+
+            /// @brief Selects whether bitmaps are memory mapped instead of loaded.
+            /// When enabled, extract reads the pixels straight from a read-only mapping of the bitmap file, and embed works
+            /// on a private copy-on-write mapping that is written to the destination in a single write.  Pixels are never
+            /// decoded into memory, and the header of the original file is kept as is.
+            /// @param enabled true to memory map bitmaps, false (the default) to load them.
+            void setMemoryMapping(bool enabled) noexcept;
+
+            /// @brief Selects whether embed may store data in the alpha channel of 32 bits per pixel covers.
+            /// The alpha byte of every pixel continues the channel walk once the R bytes are used up, which doubles the
+            /// capacity of the cover.  Extract always follows the walk into the alpha channel, so it needs no option.
+            /// @param enabled true to embed into the alpha channel, false (the default) to keep it unchanged.
+            void setAlphaEmbedding(bool enabled) noexcept;
+
+            /// @brief Selects whether embed writes destination bitmaps of 64 MiB or more without the page cache.
+            /// Large destinations then neither evict other files from the cache nor wait for its write back, where the
+            /// platform and filesystem support it.  Memory mapped covers and pipelined embeds are always written through the
+            /// page cache.
+            /// @param enabled true to bypass the page cache, false (the default) to write through it.
+            void setDirectWrites(bool enabled) noexcept;
+
+            /// @brief Selects whether embed and extract between files stream the bitmap through a pipeline instead of loading it whole.
+            /// One thread reads blocks of pixel rows with a BitmapRowReader, the calling thread encodes or decodes them, and
+            /// another thread writes the destination bitmap with a BitmapRowWriter, or the extracted bytes in place in the
+            /// destination file.  With a bounded number of blocks in flight, memory use is a few MiB whatever the size of
+            /// the bitmap or of the payload, and the stages overlap, so on large images an operation takes about as long as
+            /// its slowest stage rather than their sum.  Embed keeps the header of the original file and the padding of its
+            /// rows as is.  Extract skips the rows that hold no data.  The load, payload and save stats then time each stage,
+            /// and overlap.
+            /// Not used with memory mapping, a cover cache, an embed in OutputMode::Patch or with compression, an extract of
+            /// compressed data, or when the destination is the source file.
+            /// @param enabled true to pipeline embed and extract, false (the default) to load, encode or decode, and save in turn.
+            void setPipelining(bool enabled) noexcept;
+
+            /// @brief Selects how embed produces the destination bitmap.
+            /// In Patch mode the original file is cloned (sharing its blocks where the filesystem supports it) and only the
+            /// pixel rows touched by the encoder are written over the clone, keeping the original header and padding.
+            /// Combined with memory mapping, neither the untouched pixels nor the rest of the file are ever read or written.
+            /// An embed in Patch mode refuses a destination that is the original file itself.
+            /// @param mode OutputMode::Rewrite (the default) or OutputMode::Patch.
+            void setOutputMode(OutputMode mode) noexcept;
+
+            /// @brief Selects how many threads embed and extract use.
+            /// With more than one thread the payload is split into contiguous segments that start on a channel byte,
+            /// which are encoded or decoded concurrently.  The result is identical to the single-threaded one.
+            /// @param threadCount Number of threads, 0 selects the number of hardware threads.  Defaults to 1.
+            void setThreadCount(std::size_t threadCount);
+
+            /// @brief Selects the layout of the data embedded by embed.
+            /// Extract recognizes both layouts on its own.
+            /// @param format ContainerFormat::Chunked (the default), or ContainerFormat::Legacy for readers that predate it.
+            void setContainerFormat(ContainerFormat format) noexcept;
+
+            /// @brief Selects whether embed compresses the data before encoding it.
+            /// Every chunk of the data is compressed into an LZ4 block on a thread of its own while the previous chunks are
+            /// being encoded, and chunks that do not shrink are stored as is, so compression never costs capacity.  Data
+            /// that compresses touches fewer pixels and fits in smaller covers.  Extract recognizes compressed data from
+            /// its header and decompresses it on a thread of its own as the chunks are decoded.  Compressed chunks are
+            /// encoded and decoded on the calling thread, whatever the thread count.
+            /// Requires ContainerFormat::Chunked.
+            /// @param enabled true to compress, false (the default) to embed the data as is.
+            void setCompression(bool enabled) noexcept override;
+
+            /// @brief Selects a density profile, such as 2 bits in red, 1 in green and 3 in blue, where the eye is least
+            /// sensitive.  The stream then walks every pixel of the bitmap in turn and stores the bits of the profile in
+            /// its R, G and B bytes, leaving channels of 0 bits untouched.  The packing routine of each profile is
+            /// specialized at compile time, and is selected once per operation.  The bitsPerPixel given to the following
+            /// operations must be the total of the profile, and can be any value from 1 to 24.
+            /// The profile applies to the pixels loaded by embed and extract: the alpha channel is not used, the pipelined
+            /// mode is not used, and operations that read parts of a bitmap in place, such as extractRange and probe,
+            /// are not supported.  Scan only recognizes the uniform densities.
+            /// @param profile The profile, or an empty profile (the default) for the uniform densities.
+            /// @throws std::runtime_error if a channel stores more than 8 bits
+            void setDensityProfile(const DensityProfile &profile) override;
+
+            /// @brief Scatters the stream over the whole bitmap in an order derived from a key, see ScatterOrder, instead
+            /// of filling it from the top left pixel onwards.  The walk goes through the R byte of every pixel, then through
+            /// the alpha byte of every pixel of 32 bpp bitmaps, or through whole pixels with a density profile.  The order
+            /// is cut into cache-sized bands, so the parallel engine and random access work as in the sequential order:
+            /// extractRange and probe read only the tiles that hold the bytes they need, with or without a density profile.
+            /// Extract must be given the same key.  Embed copies or writes the whole bitmap, the pipelined mode is not
+            /// used, and scan does not recognize scattered data.
+            /// @param key The key, or an empty string (the default) for the sequential order.
+            void setScatterKey(const std::string &key) override;
+
+            /// @brief Selects a cache of decoded covers, for repeated operations on the same bitmaps.
+            /// Bitmaps loaded from files are taken from the cache instead of being decoded again.  Embed works on a private
+            /// copy of only the top rows that receive data, and writes the rest of the image from the shared cover.
+            /// The cache is not used when memory mapping is enabled.
+            /// @param coverCache The cache, which may be shared with other instances, or nullptr (the default) for none.
+            void setCoverCache(std::shared_ptr<CoverCache> coverCache) noexcept;
         private:
-            void encodeByte(const char inputByte);
-            std::uint8_t decodeByte();
-            void nextBitmapByte();
+            /// @brief Returns the next 'length' bytes of the payload, valid until the next call.
+            typedef std::function<const char *(std::size_t length)> PayloadReader;
+
+            /// @brief Returns where the next 'length' bytes of the payload are decoded to.
+            /// The bytes are complete when the writer is called again, or when decoding returns.
+            typedef std::function<char *(std::size_t length)> PayloadWriter;
+
+            /// @brief Pixel rows of a bitmap held in the caller's memory.
+            struct PixelRows
+            {
+                std::uint8_t *topRow = nullptr;
+                std::size_t width = 0;
+                std::size_t height = 0;
+                std::ptrdiff_t rowStep = 0;
+                std::size_t pixelSize = 3;
+            };
+
+            /// @brief Pixel rows on their way through the embed or extract pipeline.
+            struct PipelineBlock
+            {
+                std::vector<std::uint8_t> bytes;  // pixel rows as stored in the file
+                std::size_t firstRow = 0;         // top row of the image held, counted from the top
+                std::size_t rowCount = 0;
+                std::uint64_t colorChannel = 0;   // first channel of the rows in the walk
+                std::uint64_t endColorChannel = 0;
+                std::uint64_t alphaChannel = 0;   // first alpha channel of the rows in the walk
+                std::uint64_t endAlphaChannel = 0;
+                std::uint64_t colorStreamOffset = 0;
+                std::size_t colorStreamLength = 0; // stream bytes with bits in the color channels of the rows
+                std::uint64_t alphaStreamOffset = 0;
+                std::size_t alphaStreamLength = 0; // stream bytes with bits in the alpha channels of the rows
+                std::vector<char> stream;         // the color stream bytes, followed by the alpha stream bytes
+                std::uint64_t payloadBytes = 0;   // payload bytes starting in the rows, for progress
+            };
+
+            /// @brief Fills the next block of a pipeline, returns false once there is none left.
+            typedef std::function<bool(PipelineBlock &block)> PipelineReader;
+
+            /// @brief Encodes, decodes or writes a block of a pipeline.
+            typedef std::function<void(PipelineBlock &block)> PipelineStage;
+
+            void encodeBytes(const char *inputBytes, std::size_t length);
+            void decodeBytes(char *dataBytes, std::size_t length);
+            void releaseSourceBitmap() noexcept;
+            void loadSourceBitmap(const std::string &bitmapFilePath, bmp::MapMode mapMode, const std::string &operation);
+            void loadSourceBitmap(std::istream &bitmap, const std::string &operation);
+            void useBitmapBuffer(std::uint8_t *bitmapData, std::size_t bitmapSize);
+            void saveSourceBitmap(const std::string &bitmapFilePath);
+            bmp::WriteMode writeMode(const bmp::Bitmap &bitmap) const noexcept;
+            void patchDestinationBitmap(const std::string &originalBitmapFilePath, const std::string &destinationBitmapFilePath);
+            std::size_t sourceBitmapWidth() const noexcept;
+            std::size_t sourceBitmapHeight() const noexcept;
+            std::size_t sourceBitmapPixelSize() const noexcept;
+            std::uint64_t streamCapacity(bool alphaChannels) const noexcept;
+            static std::vector<ChannelSpan> alphaSpans(std::uint8_t *topRow, std::size_t width, std::size_t height, std::ptrdiff_t rowStep);
+            void resetBitPacker();
+            void resetScatteredBitPacker();
             void setBitsPerPixel(int bitsPerPixel);
+            void copyCoverRows(std::uint64_t streamSize);
+            void encodePayload(const ContainerHeader &header, const PayloadReader &readPayload);
+            void decodePayload(const ContainerHeader &header, const PayloadWriter &writePayload);
+            void decodePayload(std::ostream &destination, const ContainerHeader &header);
+            void encodeParallel(const ContainerHeader &header, const PayloadReader &readPayload);
+            std::uint64_t encodeCompressed(ContainerHeader header, const PayloadReader &readPayload, std::uint64_t capacity);
+            void decodeCompressed(const ContainerHeader &header, const PayloadWriter &writePayload);
+            ContainerHeader payloadHeader(std::uint64_t payloadLength) const;
+            void embedFile(const std::string &originalBitmapFilePath, const std::string &sourceDataFilePath, const std::string &destinationBitmapFilePath, std::uint8_t bitsPerPixel, const ContainerShard *shard);
+            bool pipelinable(const std::string &sourceFilePath, const std::string &destinationFilePath) const;
+            void embedPipelined(const std::string &originalBitmapFilePath, const std::string &sourceDataFilePath, const std::string &destinationBitmapFilePath, const ContainerHeader &header);
+            bool extractPipelined(const std::string &sourceBitmapFilePath, const std::string &destinationDataFilePath);
+            std::size_t runPipeline(const PipelineReader &read, const PipelineStage &process, const PipelineStage &write);
+            void assignStreamRanges(PipelineBlock &block, std::size_t width, std::uint64_t pixelCount, bool alphaChannels, std::uint64_t streamBegin, std::uint64_t streamEnd) const;
+            void setChannelRange(BitPacker &packer, std::vector<ChannelSpan> spans, std::uint64_t firstChannel, std::uint64_t streamOffset, std::uint8_t *scratch) const;
+            static void blockSpans(PipelineBlock &block, std::size_t width, std::size_t pixelSize, bool bottomUp, std::vector<ChannelSpan> &color, std::vector<ChannelSpan> &alpha);
+            void encodeChannelRange(std::vector<ChannelSpan> spans, std::uint64_t firstChannel, std::uint64_t streamOffset, const char *stream, std::size_t length) const;
+            void decodeChannelRange(std::vector<ChannelSpan> spans, std::uint64_t firstChannel, std::uint64_t streamOffset, char *stream, std::size_t length) const;
+            void decodeParallel(const ContainerHeader &header, const PayloadWriter &writePayload);
+            ContainerHeader decodeContainerHeader(const std::string &bitmapFilePath);
+            static bmp::BitmapHeader readBitmapHeader(RandomAccessFile &file, const std::string &bitmapFilePath);
+            static void validateBitmapHeader(const bmp::BitmapHeader &header, const std::uint8_t *masks, std::uint64_t size, const std::string &description);
+            void readStreamRange(RandomAccessFile &file, const bmp::BitmapHeader &header, std::uint64_t streamOffset, char *data, std::size_t length);
+            void readScatteredRange(RandomAccessFile &file, const bmp::BitmapHeader &header, std::uint64_t streamOffset, char *data, std::size_t length);
+            ContainerHeader readContainerHeader(RandomAccessFile &file, const bmp::BitmapHeader &header, const std::string &bitmapFilePath);
+            std::size_t parallelSegmentSize(std::size_t windowSize) const;
+            void beginProgress(std::uint64_t total);
+            void advanceProgress(std::uint64_t previousCount, std::uint64_t count);
+            void checkCancellation() const;
+            void trackBufferBytes(std::size_t payloadBufferBytes) noexcept;
+            std::uint64_t pixelsOfChannels(std::uint64_t channelCount, std::uint64_t pixelCount) const noexcept;
+            ThreadPool &threadPool();
 
             // member variables
             std::uint8_t m_bitsPerPixel;
-            std::vector<bmp::Pixel>::iterator m_currentPixelIterator;
-            int m_pixelBitEncodingPos;
             bmp::Bitmap m_sourceBitmap;
-            PixelColor m_currentPixelColor;
-            std::uint8_t* m_pPixel;
+            bmp::MappedBitmap m_mappedBitmap;
+            PixelRows m_bufferRows;
+            std::shared_ptr<CoverCache> m_coverCache;
+            std::shared_ptr<const bmp::Bitmap> m_cachedCover;
+            std::vector<bmp::Pixel> m_coverRows;
+            bool m_memoryMapping;
+            bool m_alphaEmbedding;
+            bool m_directWrites;
+            bool m_pipelining;
+            OutputMode m_outputMode;
+            BitPacker m_bitPacker;
             ProgressCallback m_progressCallback;
             int m_progressCallbackPercentGrain;
+            std::chrono::milliseconds m_progressInterval;
+            std::chrono::steady_clock::time_point m_lastProgressTime;
+            std::shared_ptr<CancellationToken> m_cancellationToken;
+            std::chrono::steady_clock::time_point m_deadline;
+            std::atomic<std::uint64_t> m_bytesDone;
+            std::atomic<std::uint64_t> m_bytesTotal;
+            OperationStats m_stats;
+            bool m_detailedStats;
+            std::vector<std::uint8_t> m_channelSnapshot;
+            std::size_t m_threadCount;
+            std::unique_ptr<ThreadPool> m_threadPool;
+            ContainerFormat m_containerFormat;
+            bool m_compression;
+            DensityProfile m_densityProfile;
+            bool m_scatter;
+            std::uint64_t m_scatterKey;
     };
 }
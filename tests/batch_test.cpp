@@ -0,0 +1,171 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include "../batch.h"
+#include "../steganography.h"
+#include "../program_wrapper.h"
+#include "test_util.h"
+
+using namespace SteganographyLib;
+
+TEST(BatchTests, ParseJsonJob) {
+    BatchJob job = parseBatchJob(R"({"operation": "embed", "bitmap": "in.bmp", "data": "dir\\sec\"reté.txt", "output": "out.bmp", "bitsPerPixel": 6})", 7);
+    EXPECT_EQ(7u, job.line);
+    EXPECT_EQ("embed", job.operation);
+    EXPECT_EQ("in.bmp", job.bitmap);
+    EXPECT_EQ("dir\\sec\"ret\xC3\xA9.txt", job.data);
+    EXPECT_EQ("out.bmp", job.output);
+    EXPECT_EQ(6, job.bitsPerPixel);
+
+    job = parseBatchJob(R"({"operation":"extract","bitmap":"out.bmp","output":"secret.txt","bitsPerPixel":"9"})", 1);
+    EXPECT_EQ("extract", job.operation);
+    EXPECT_EQ(9, job.bitsPerPixel);
+}
+
+TEST(BatchTests, ParseTabSeparatedJob) {
+    BatchJob job = parseBatchJob("embed\tin file.bmp\tsecret.txt\tout.bmp\t12", 1);
+    EXPECT_EQ("embed", job.operation);
+    EXPECT_EQ("in file.bmp", job.bitmap);
+    EXPECT_EQ("secret.txt", job.data);
+    EXPECT_EQ("out.bmp", job.output);
+    EXPECT_EQ(12, job.bitsPerPixel);
+
+    job = parseBatchJob("extract\tout.bmp\tsecret.txt\t3", 2);
+    EXPECT_EQ("extract", job.operation);
+    EXPECT_EQ("out.bmp", job.bitmap);
+    EXPECT_EQ("secret.txt", job.output);
+    EXPECT_EQ(3, job.bitsPerPixel);
+}
+
+TEST(BatchTests, ParseProbeJob) {
+    BatchJob job = parseBatchJob("probe\tin.bmp\t6", 3);
+    EXPECT_EQ("probe", job.operation);
+    EXPECT_EQ("in.bmp", job.bitmap);
+    EXPECT_EQ(6, job.bitsPerPixel);
+
+    job = parseBatchJob(R"({"id": "a-17", "operation": "probe", "bitmap": "in.bmp", "bitsPerPixel": 2})", 1);
+    EXPECT_EQ("a-17", job.id);
+    EXPECT_EQ("probe", job.operation);
+    EXPECT_EQ(2, job.bitsPerPixel);
+}
+
+TEST(BatchTests, ParseInvalidJob) {
+    EXPECT_THROW(parseBatchJob("embed\tin.bmp\tout.bmp\t6", 1), std::runtime_error);
+    EXPECT_THROW(parseBatchJob("foo\tin.bmp\tout.bmp\t6", 1), std::runtime_error);
+    EXPECT_THROW(parseBatchJob("extract\tin.bmp\tout.txt\tsix", 1), std::runtime_error);
+    EXPECT_THROW(parseBatchJob(R"({"operation": "extract", "bitmap": "in.bmp", "bitsPerPixel": 6})", 1), std::runtime_error);
+    EXPECT_THROW(parseBatchJob(R"({"operation": "extract", "bitmap": "in.bmp")", 1), std::runtime_error);
+}
+
+TEST(BatchTests, RunReportsEveryJob) {
+    std::istringstream manifest(
+        "# embed then extract in both manifest syntaxes\n"
+        "embed\t../../../data/sample.bmp\t../../../data/sampleInput.txt\tBatchTests_embedded.bmp\t6\n"
+        "\n"
+        "{\"operation\": \"extract\", \"bitmap\": \"../../../data/embedded_6bits.bmp\", \"output\": \"BatchTests_output.txt\", \"bitsPerPixel\": 6}\r\n"
+        "extract\tnonexistent_bitmap.bmp\tBatchTests_missing.txt\t6\n"
+        "not a job\n");
+    std::ostringstream status;
+
+    BatchSummary summary = runBatch(manifest, status, 3);
+    EXPECT_EQ(2u, summary.succeeded);
+    EXPECT_EQ(2u, summary.failed);
+
+    // one status line per job, failures do not stop the batch
+    std::string text = status.str();
+    EXPECT_EQ(4, std::count(text.begin(), text.end(), '\n'));
+    EXPECT_NE(std::string::npos, text.find("{\"line\": 2, \"operation\": \"embed\", \"status\": \"ok\""));
+    EXPECT_NE(std::string::npos, text.find("{\"line\": 4, \"operation\": \"extract\", \"status\": \"ok\""));
+    EXPECT_NE(std::string::npos, text.find("{\"line\": 5, \"operation\": \"extract\", \"status\": \"error\""));
+    EXPECT_NE(std::string::npos, text.find("{\"line\": 6, \"operation\": \"\", \"status\": \"error\""));
+    EXPECT_EQ(readFileBytes("../../../data/sampleInput.txt"), readFileBytes("BatchTests_output.txt"));
+    EXPECT_TRUE(std::filesystem::exists("BatchTests_embedded.bmp"));
+
+    // Clean up
+    std::filesystem::remove("BatchTests_embedded.bmp");
+    std::filesystem::remove("BatchTests_output.txt");
+}
+
+TEST(BatchTests, ProgramBatch) {
+    std::ofstream("BatchTests_manifest.tsv") << "extract\t../../../data/embedded_6bits.bmp\tBatchTests_program.txt\t6\n";
+    char* argv[] = {(char*)"steganography", (char*)"batch", (char*)"BatchTests_manifest.tsv", (char*)"2"};
+    EXPECT_EQ(SteganographyLib::SUCCESS, SteganographyLib::mainWrapper(4, argv));
+    EXPECT_EQ(readFileBytes("../../../data/sampleInput.txt"), readFileBytes("BatchTests_program.txt"));
+
+    std::ofstream("BatchTests_manifest.tsv") << "extract\tnonexistent_bitmap.bmp\tBatchTests_program.txt\t6\n";
+    EXPECT_EQ(SteganographyLib::ERROR_CODE_BATCH_JOBS_FAILED, SteganographyLib::mainWrapper(3, argv));
+
+    char* missingArgv[] = {(char*)"steganography", (char*)"batch", (char*)"nonexistent_manifest.tsv"};
+    EXPECT_EQ(SteganographyLib::ERROR_CODE_INVALID_ARGUMENTS, SteganographyLib::mainWrapper(3, missingArgv));
+    EXPECT_EQ(SteganographyLib::ERROR_CODE_INVALID_ARGUMENTS, SteganographyLib::mainWrapper(2, missingArgv));
+
+    // Clean up
+    std::filesystem::remove("BatchTests_manifest.tsv");
+    std::filesystem::remove("BatchTests_program.txt");
+}
+
+TEST(BatchTests, ScanFlagsBitmapsCarryingAPayload) {
+    namespace fs = std::filesystem;
+    fs::remove_all("ScanTests_tree");
+    fs::create_directories("ScanTests_tree/a/b");
+    fs::create_directories("ScanTests_tree/flat");
+
+    // payloads at several densities, compressed or not, next to clean, legacy, unreadable and ignored files
+    Steganography steg;
+    ASSERT_NO_THROW(steg.embed("../../../data/sample.bmp", "../../../data/sampleInput.txt", "ScanTests_tree/a/three.bmp", 3));
+    ASSERT_NO_THROW(steg.embed("../../../data/sample.bmp", "../../../data/sampleInput.txt", "ScanTests_tree/a/b/six.BMP", 6));
+    steg.setCompression(true);
+    ASSERT_NO_THROW(steg.embed("../../../data/sample.bmp", "../../../data/sampleInput.txt", "ScanTests_tree/a/b/compressed.bmp", 6));
+    fs::copy_file("../../../data/sample.bmp", "ScanTests_tree/clean.bmp");
+    fs::copy_file("../../../data/embedded_6bits.bmp", "ScanTests_tree/legacy.bmp");
+    fs::copy_file("../../../data/sampleInput.txt", "ScanTests_tree/a/notes.txt");
+    std::ofstream("ScanTests_tree/a/broken.bmp") << "not a bitmap";
+    bmp::Bitmap small(20, 3);
+    for (int i = 0; i < 40; i++)
+    {
+        small.save("ScanTests_tree/flat/" + std::to_string(i) + ".bmp");
+    }
+
+    ScanResult result = steg.scan("ScanTests_tree/a/b/compressed.bmp");
+    EXPECT_TRUE(result.found);
+    EXPECT_EQ(6, result.bitsPerPixel);
+    EXPECT_TRUE(result.compressed);
+    EXPECT_TRUE(result.supported);
+    EXPECT_TRUE(result.plausible);
+    EXPECT_LT(steg.lastStats().bytesRead, 2000u);
+    EXPECT_FALSE(steg.scan("ScanTests_tree/legacy.bmp").found);
+
+    std::ostringstream results;
+    ScanSummary summary = runScan("ScanTests_tree", results, 3);
+    EXPECT_EQ(46u, summary.files);
+    EXPECT_EQ(3u, summary.flagged);
+    EXPECT_EQ(1u, summary.failed);
+
+    std::string text = results.str();
+    auto payloadSize = fs::file_size("../../../data/sampleInput.txt");
+    EXPECT_EQ(46, std::count(text.begin(), text.end(), '\n'));
+    EXPECT_NE(std::string::npos, text.find("three.bmp\", \"status\": \"payload\", \"bitsPerPixel\": 3, \"payloadLength\": " + std::to_string(payloadSize) + ", \"compressed\": false, \"supported\": true, \"plausible\": true}"));
+    EXPECT_NE(std::string::npos, text.find("six.BMP\", \"status\": \"payload\", \"bitsPerPixel\": 6, "));
+    EXPECT_NE(std::string::npos, text.find("compressed.bmp\", \"status\": \"payload\", \"bitsPerPixel\": 6, "));
+    EXPECT_NE(std::string::npos, text.find("clean.bmp\", \"status\": \"clean\"}"));
+    EXPECT_NE(std::string::npos, text.find("legacy.bmp\", \"status\": \"clean\"}"));
+    EXPECT_NE(std::string::npos, text.find("broken.bmp\", \"status\": \"error\", \"error\": "));
+    EXPECT_EQ(std::string::npos, text.find("notes.txt"));
+
+    // a single bitmap, and a missing directory
+    results.str("");
+    summary = runScan("ScanTests_tree/a/three.bmp", results, 0);
+    EXPECT_EQ(1u, summary.flagged);
+    results.str("");
+    summary = runScan("ScanTests_missing", results, 2);
+    EXPECT_EQ(0u, summary.files);
+    EXPECT_EQ(1u, summary.failed);
+
+    char* argv[] = {(char*)"steganography", (char*)"scan", (char*)"ScanTests_tree/a", (char*)"2"};
+    EXPECT_EQ(SteganographyLib::SUCCESS, SteganographyLib::mainWrapper(4, argv));
+    EXPECT_EQ(SteganographyLib::ERROR_CODE_INVALID_ARGUMENTS, SteganographyLib::mainWrapper(2, argv));
+
+    // Clean up
+    fs::remove_all("ScanTests_tree");
+}
@@ -0,0 +1,450 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include "../bitpacker.h"
+
+using namespace SteganographyLib;
+
+// Reference implementation of the original per-bit encoder, used to verify that the packing
+// kernels produce exactly the same pixel bytes for every density.  Like the original it walks
+// the R, G and B bytes of the first pixel and then the R byte of every following pixel.
+static void referenceEncode(const std::vector<std::uint8_t> &data, std::vector<std::uint8_t> &pixels, int bitsPerPixel)
+{
+    std::size_t channel = 0;
+    int pos = 0;
+    for (auto dataByte : data)
+    {
+        for (int bit = 0; bit < 8; bit++)
+        {
+            if (pos < 8)
+            {
+                std::uint8_t mask = static_cast<std::uint8_t>(1 << pos);
+                std::uint8_t &pixelByte = pixels[channel < 3 ? channel : 3 * (channel - 2)];
+                if ((dataByte >> bit) & 1)
+                {
+                    pixelByte |= mask;
+                }
+                else
+                {
+                    pixelByte &= ~mask;
+                }
+            }
+
+            if (++pos == bitsPerPixel)
+            {
+                pos = 0;
+                channel++;
+            }
+        }
+    }
+}
+
+static std::vector<std::uint8_t> randomBytes(std::size_t length, unsigned int seed)
+{
+    std::mt19937 generator(seed);
+    std::vector<std::uint8_t> bytes(length);
+    for (auto &value : bytes)
+    {
+        value = static_cast<std::uint8_t>(generator());
+    }
+    return bytes;
+}
+
+TEST(BitPackerTests, EncodeMatchesReferenceForEveryDensity) {
+    auto data = randomBytes(1031, 1);
+    auto cover = randomBytes(3 * 8 * 8 * data.size(), 2);
+
+    for (int bitsPerPixel = 3; bitsPerPixel <= 24; bitsPerPixel += 3)
+    {
+        auto expected = cover;
+        referenceEncode(data, expected, bitsPerPixel);
+
+        // encode in uneven pieces to exercise the pending bits carried between calls
+        auto actual = cover;
+        BitPacker packer;
+        packer.reset(bitsPerPixel);
+        packer.setPixels(actual.data(), actual.size() / 3);
+        std::size_t offset = 0, piece = 1;
+        while (offset < data.size())
+        {
+            auto length = std::min(piece, data.size() - offset);
+            ASSERT_EQ(length, packer.encode(data.data() + offset, length));
+            offset += length;
+            piece = piece * 3 + 1;
+        }
+        ASSERT_TRUE(packer.flush());
+
+        EXPECT_EQ(expected, actual) << "bitsPerPixel " << bitsPerPixel;
+    }
+}
+
+TEST(BitPackerTests, DecodeRoundTripForEveryDensity) {
+    auto data = randomBytes(777, 3);
+
+    for (int bitsPerPixel = 3; bitsPerPixel <= 24; bitsPerPixel += 3)
+    {
+        auto pixels = randomBytes(3 * 8 * 8 * data.size(), 4);
+        BitPacker encoder;
+        encoder.reset(bitsPerPixel);
+        encoder.setPixels(pixels.data(), pixels.size() / 3);
+        ASSERT_EQ(data.size(), encoder.encode(data.data(), data.size()));
+        ASSERT_TRUE(encoder.flush());
+
+        std::vector<std::uint8_t> decoded(data.size());
+        BitPacker decoder;
+        decoder.reset(bitsPerPixel);
+        decoder.setPixels(pixels.data(), pixels.size() / 3);
+        ASSERT_EQ(2u, decoder.decode(decoded.data(), 2));
+        ASSERT_EQ(decoded.size() - 2, decoder.decode(decoded.data() + 2, decoded.size() - 2));
+
+        if (bitsPerPixel <= 8)
+        {
+            EXPECT_EQ(data, decoded) << "bitsPerPixel " << bitsPerPixel;
+        }
+        // above 8 bits per channel byte only the stored bits survive, as with the original encoder
+        else
+        {
+            EXPECT_EQ(data[0], decoded[0]) << "bitsPerPixel " << bitsPerPixel;
+        }
+    }
+}
+
+TEST(BitPackerTests, SeekMatchesSequentialForEveryDensity) {
+    auto data = randomBytes(1031, 5);
+    auto cover = randomBytes(3 * 8 * 8 * data.size(), 6);
+
+    for (int bitsPerPixel = 3; bitsPerPixel <= 24; bitsPerPixel += 3)
+    {
+        auto expected = cover;
+        referenceEncode(data, expected, bitsPerPixel);
+
+        // encode the pieces out of order, each one from its own seeked copy,
+        // so that pieces begin and end in the middle of channel bytes
+        auto actual = cover;
+        BitPacker packer;
+        packer.reset(bitsPerPixel);
+        packer.setPixels(actual.data(), actual.size() / 3);
+        std::vector<std::size_t> boundaries{0, 1, 2, 5, 100, 101, 517, 1030, data.size()};
+        for (std::size_t i = boundaries.size() - 1; i > 0; i--)
+        {
+            BitPacker segment = packer;
+            segment.seek(boundaries[i - 1] * 8);
+            auto length = boundaries[i] - boundaries[i - 1];
+            ASSERT_EQ(length, segment.encode(data.data() + boundaries[i - 1], length));
+            ASSERT_TRUE(segment.flush());
+        }
+        EXPECT_EQ(expected, actual) << "bitsPerPixel " << bitsPerPixel;
+
+        // decode the same pieces from seeked copies
+        std::vector<std::uint8_t> decoded(data.size());
+        for (std::size_t i = 1; i < boundaries.size(); i++)
+        {
+            BitPacker segment = packer;
+            segment.seek(boundaries[i - 1] * 8);
+            auto length = boundaries[i] - boundaries[i - 1];
+            ASSERT_EQ(length, segment.decode(decoded.data() + boundaries[i - 1], length));
+        }
+        if (bitsPerPixel <= 8)
+        {
+            EXPECT_EQ(data, decoded) << "bitsPerPixel " << bitsPerPixel;
+        }
+    }
+}
+
+TEST(BitPackerTests, EncodeStopsAtEndOfChannels) {
+    std::vector<std::uint8_t> data(16, 0xFF);
+    std::vector<std::uint8_t> channels(16, 0x00);
+    BitPacker packer;
+    packer.reset(3);
+    packer.setChannels({{channels.data(), 4, 1}, {channels.data() + 8, 4, 2}});
+
+    // 8 channel bytes hold 24 bits, the remaining bits stay pending and cannot be flushed
+    packer.encode(data.data(), data.size());
+    EXPECT_EQ(nullptr, packer.channel());
+    EXPECT_FALSE(packer.flush());
+    std::vector<std::uint8_t> expected{7, 7, 7, 7, 0, 0, 0, 0, 7, 0, 7, 0, 7, 0, 7, 0};
+    EXPECT_EQ(expected, channels);
+}
+
+TEST(BitPackerTests, InvalidBitsPerPixel) {
+    BitPacker packer;
+    EXPECT_THROW(packer.reset(5), std::runtime_error);
+    EXPECT_THROW(packer.reset(0), std::runtime_error);
+    EXPECT_THROW(packer.reset(27), std::runtime_error);
+}
+
+// Encodes 'data' into a copy of 'cover' with the given kernels, in uneven pieces so that the vector
+// kernels start at every alignment of the pending bits.
+static std::vector<std::uint8_t> encodeWith(PackingKernels kernels, int bitsPerPixel, const std::vector<std::uint8_t> &data, const std::vector<std::uint8_t> &cover)
+{
+    auto pixels = cover;
+    BitPacker packer;
+    packer.reset(bitsPerPixel, kernels);
+    packer.setPixels(pixels.data(), pixels.size() / 3);
+    std::size_t offset = 0, piece = 1;
+    while (offset < data.size())
+    {
+        auto length = std::min(piece, data.size() - offset);
+        EXPECT_EQ(length, packer.encode(data.data() + offset, length));
+        offset += length;
+        piece = piece * 2 + 3;
+    }
+    EXPECT_TRUE(packer.flush());
+    return pixels;
+}
+
+static std::vector<std::uint8_t> decodeWith(PackingKernels kernels, int bitsPerPixel, std::size_t length, std::vector<std::uint8_t> &pixels)
+{
+    std::vector<std::uint8_t> decoded(length);
+    BitPacker packer;
+    packer.reset(bitsPerPixel, kernels);
+    packer.setPixels(pixels.data(), pixels.size() / 3);
+    std::size_t offset = 0, piece = 1;
+    while (offset < length)
+    {
+        auto pieceLength = std::min(piece, length - offset);
+        EXPECT_EQ(pieceLength, packer.decode(decoded.data() + offset, pieceLength));
+        offset += pieceLength;
+        piece = piece * 2 + 5;
+    }
+    return decoded;
+}
+
+TEST(BitPackerTests, VectorKernelsMatchScalarForEveryDensity) {
+    if (BitPacker::detectKernels() == PackingKernels::Scalar)
+    {
+        GTEST_SKIP() << "Processor has no vector packing kernels";
+    }
+
+    auto data = randomBytes(20011, 5);
+    auto cover = randomBytes(3 * 8 * 8 * data.size(), 6);
+
+    for (int bitsPerPixel = 3; bitsPerPixel <= 24; bitsPerPixel += 3)
+    {
+        auto scalar = encodeWith(PackingKernels::Scalar, bitsPerPixel, data, cover);
+        auto vector = encodeWith(BitPacker::detectKernels(), bitsPerPixel, data, cover);
+        EXPECT_EQ(scalar, vector) << "bitsPerPixel " << bitsPerPixel;
+
+        EXPECT_EQ(decodeWith(PackingKernels::Scalar, bitsPerPixel, data.size(), scalar),
+                  decodeWith(BitPacker::detectKernels(), bitsPerPixel, data.size(), vector)) << "bitsPerPixel " << bitsPerPixel;
+    }
+}
+
+TEST(BitPackerTests, VectorKernelsMatchScalarOnContiguousChannels) {
+    if (BitPacker::detectKernels() == PackingKernels::Scalar)
+    {
+        GTEST_SKIP() << "Processor has no vector packing kernels";
+    }
+
+    auto data = randomBytes(4099, 7);
+    auto cover = randomBytes(8 * data.size(), 8);
+
+    for (int bitsPerPixel = 3; bitsPerPixel <= 24; bitsPerPixel += 3)
+    {
+        std::vector<std::uint8_t> results[2];
+        std::vector<std::uint8_t> decoded[2];
+        PackingKernels kernels[2] = {PackingKernels::Scalar, BitPacker::detectKernels()};
+        for (int i = 0; i < 2; i++)
+        {
+            results[i] = cover;
+            BitPacker encoder;
+            encoder.reset(bitsPerPixel, kernels[i]);
+            encoder.setChannels({{results[i].data(), results[i].size(), 1}});
+            EXPECT_EQ(data.size(), encoder.encode(data.data(), data.size()));
+            EXPECT_TRUE(encoder.flush());
+
+            decoded[i].resize(data.size());
+            BitPacker decoder;
+            decoder.reset(bitsPerPixel, kernels[i]);
+            decoder.setChannels({{results[i].data(), results[i].size(), 1}});
+            EXPECT_EQ(data.size(), decoder.decode(decoded[i].data(), data.size()));
+        }
+        EXPECT_EQ(results[0], results[1]) << "bitsPerPixel " << bitsPerPixel;
+        EXPECT_EQ(decoded[0], decoded[1]) << "bitsPerPixel " << bitsPerPixel;
+    }
+}
+
+TEST(BitPackerTests, BgraRowsWalkTheSameChannelsAsBgrRows) {
+    const std::size_t width = 37, height = 29;
+    auto data = randomBytes(width * height * 2 * 6 / 8 - 8, 9);
+    auto bgr = randomBytes(width * height * 3, 10);
+
+    // the same pixels, with an alpha byte and no row padding
+    std::vector<std::uint8_t> bgra(width * height * 4);
+    for (std::size_t i = 0; i < width * height; i++)
+    {
+        std::copy(bgr.begin() + 3 * i, bgr.begin() + 3 * i + 3, bgra.begin() + 4 * i);
+        bgra[4 * i + 3] = static_cast<std::uint8_t>(i);
+    }
+    auto original = bgra;
+
+    PackingKernels kernels[2] = {PackingKernels::Scalar, BitPacker::detectKernels()};
+    for (auto kernel : kernels)
+    {
+        // the R bytes, then the alpha bytes of every row
+        bgra = original;
+        std::vector<ChannelSpan> alpha;
+        for (std::size_t y = 0; y < height; y++)
+        {
+            alpha.push_back({bgra.data() + y * width * 4 + 3, width, 4});
+        }
+        BitPacker encoder;
+        encoder.reset(6, kernel);
+        encoder.setBgrRows(bgra.data(), width, height, static_cast<std::ptrdiff_t>(width * 4), 4);
+        encoder.appendChannels(alpha);
+        EXPECT_EQ(data.size(), encoder.encode(data.data(), data.size()));
+        EXPECT_TRUE(encoder.flush());
+
+        std::vector<std::uint8_t> decoded(data.size());
+        BitPacker decoder;
+        decoder.reset(6, kernel);
+        decoder.setBgrRows(bgra.data(), width, height, static_cast<std::ptrdiff_t>(width * 4), 4);
+        decoder.appendChannels(alpha);
+        EXPECT_EQ(data.size(), decoder.decode(decoded.data(), decoded.size()));
+        EXPECT_EQ(data, decoded);
+
+        // the color bytes hold the same stream as 3 byte pixels
+        auto expected = bgr;
+        BitPacker reference;
+        reference.reset(6, kernel);
+        reference.setBgrRows(expected.data(), width, height, static_cast<std::ptrdiff_t>(width * 3), 3);
+        reference.encode(data.data(), data.size());
+        for (std::size_t i = 0; i < width * height; i++)
+        {
+            EXPECT_TRUE(std::equal(expected.begin() + 3 * i, expected.begin() + 3 * i + 3, bgra.begin() + 4 * i)) << "pixel " << i;
+        }
+    }
+}
+
+// Reference per-bit encoder for density profiles: every pixel in turn, its R, G and B bytes in that order.
+static void referenceProfileEncode(const std::vector<std::uint8_t> &data, std::vector<std::uint8_t> &pixels, const DensityProfile &profile)
+{
+    const int channelBits[] = {profile.red, profile.green, profile.blue};
+    std::size_t pixel = 0;
+    int channel = 0;
+    int pos = 0;
+    for (auto dataByte : data)
+    {
+        for (int bit = 0; bit < 8; bit++)
+        {
+            while (pos == channelBits[channel])
+            {
+                pos = 0;
+                if (++channel == 3)
+                {
+                    channel = 0;
+                    pixel++;
+                }
+            }
+            std::uint8_t mask = static_cast<std::uint8_t>(1 << pos);
+            std::uint8_t &pixelByte = pixels[3 * pixel + channel];
+            pixelByte = ((dataByte >> bit) & 1) ? (pixelByte | mask) : (pixelByte & ~mask);
+            pos++;
+        }
+    }
+}
+
+TEST(BitPackerTests, ProfilesMatchReferenceForEveryProfile) {
+    auto data = randomBytes(97, 5);
+    auto cover = randomBytes(3 * 8 * data.size(), 6);
+
+    for (std::uint8_t red = 0; red <= 8; red++)
+    {
+        for (std::uint8_t green = 0; green <= 8; green++)
+        {
+            for (std::uint8_t blue = 0; blue <= 8; blue++)
+            {
+                DensityProfile profile{red, green, blue};
+                if (profile.empty())
+                {
+                    continue;
+                }
+                auto expected = cover;
+                referenceProfileEncode(data, expected, profile);
+
+                // RGB pixels walked forwards
+                auto pixels = cover;
+                BitPacker packer;
+                packer.reset(profile);
+                packer.setPixels(pixels.data(), pixels.size() / 3);
+                ASSERT_EQ(data.size(), packer.encode(data.data(), data.size()));
+                ASSERT_TRUE(packer.flush());
+                ASSERT_EQ(expected, pixels) << int(red) << "/" << int(green) << "/" << int(blue);
+
+                std::vector<std::uint8_t> decoded(data.size());
+                packer.setPixels(pixels.data(), pixels.size() / 3);
+                ASSERT_EQ(data.size(), packer.decode(decoded.data(), decoded.size()));
+                ASSERT_EQ(data, decoded);
+
+                // BGR rows of 4 pixels walked from their R byte backwards store the same bits
+                std::vector<std::uint8_t> rows(cover.size());
+                for (std::size_t i = 0; i < cover.size(); i += 3)
+                {
+                    rows[i] = cover[i + 2];
+                    rows[i + 1] = cover[i + 1];
+                    rows[i + 2] = cover[i];
+                }
+                packer.reset(profile);
+                packer.setBgrRows(rows.data(), 4, rows.size() / 12, 12);
+                ASSERT_EQ(data.size(), packer.encode(data.data(), data.size()));
+                ASSERT_TRUE(packer.flush());
+                for (std::size_t i = 0; i < cover.size(); i += 3)
+                {
+                    ASSERT_EQ(expected[i], rows[i + 2]);
+                    ASSERT_EQ(expected[i + 2], rows[i]);
+                }
+            }
+        }
+    }
+}
+
+TEST(BitPackerTests, ProfilesSeekAndFlushInsidePixels) {
+    auto data = randomBytes(300, 7);
+    auto cover = randomBytes(3 * 800, 8);
+    DensityProfile profile{2, 1, 3};
+
+    auto expected = cover;
+    referenceProfileEncode(data, expected, profile);
+
+    // a stream written in two parts that meet inside a pixel, as the parallel encoder does
+    for (std::size_t split : {1, 3, 4, 150, 299})
+    {
+        auto pixels = cover;
+        BitPacker packer;
+        packer.reset(profile);
+        packer.setPixels(pixels.data(), pixels.size() / 3);
+        ASSERT_EQ(split, packer.encode(data.data(), split));
+        ASSERT_TRUE(packer.flush());
+        packer.seek(split * 8);
+        ASSERT_EQ(data.size() - split, packer.encode(data.data() + split, data.size() - split));
+        ASSERT_TRUE(packer.flush());
+        ASSERT_EQ(expected, pixels) << split;
+
+        std::vector<std::uint8_t> decoded(data.size() - split);
+        packer.seek(split * 8);
+        ASSERT_EQ(decoded.size(), packer.decode(decoded.data(), decoded.size()));
+        ASSERT_TRUE(std::equal(decoded.begin(), decoded.end(), data.begin() + split));
+    }
+
+    // the snapshots cover the three bytes of every pixel
+    BitPacker packer;
+    packer.reset(profile);
+    packer.setPixels(cover.data(), cover.size() / 3);
+    EXPECT_EQ(3u, packer.channelWidth());
+    std::vector<std::uint8_t> snapshot(10 * packer.channelWidth());
+    EXPECT_EQ(10u, packer.copyChannels(snapshot.data(), 10));
+    EXPECT_TRUE(std::equal(snapshot.begin(), snapshot.end(), cover.begin()));
+    auto pixels = cover;
+    packer.setPixels(pixels.data(), pixels.size() / 3);
+    packer.encode(data.data(), data.size());
+    std::size_t changed = 0;
+    for (std::size_t i = 0; i < snapshot.size(); i++)
+    {
+        changed += expected[i] != cover[i];
+    }
+    EXPECT_EQ(changed, packer.countChangedChannels(snapshot.data(), 10));
+
+    EXPECT_THROW(packer.reset(DensityProfile{0, 0, 0}), std::runtime_error);
+    EXPECT_THROW(packer.reset(DensityProfile{9, 0, 0}), std::runtime_error);
+}
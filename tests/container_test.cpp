@@ -0,0 +1,171 @@
+#include <gtest/gtest.h>
+#include <string>
+#include "../container.h"
+#include "../crc32c.h"
+
+using namespace SteganographyLib;
+
+TEST(ContainerTests, ChunkedHeaderRoundTrip) {
+    ContainerHeader header(ContainerFormat::Chunked, 2500, 1000);
+    ASSERT_EQ(3u, header.chunks().size());
+    EXPECT_EQ(ContainerHeader::FIXED_SIZE + 3 * ContainerHeader::CHUNK_ENTRY_SIZE, header.size());
+
+    auto bytes = header.serialize();
+    ASSERT_EQ(header.size(), bytes.size());
+
+    // the fixed part gives the payload length, the table gives the chunks
+    ContainerHeader parsed = ContainerHeader::parse(bytes.data(), ContainerHeader::FIXED_SIZE);
+    EXPECT_EQ(ContainerFormat::Chunked, parsed.format());
+    EXPECT_EQ(2500u, parsed.payloadLength());
+    ASSERT_EQ(header.chunkTableSize(), parsed.chunkTableSize());
+    parsed.parseChunkTable(bytes.data() + ContainerHeader::FIXED_SIZE);
+    ASSERT_EQ(3u, parsed.chunks().size());
+    EXPECT_EQ(2000u, parsed.chunks()[2].offset);
+    EXPECT_EQ(500u, parsed.chunks()[2].length);
+}
+
+TEST(ContainerTests, LegacyHeaderIsDetected) {
+    ContainerHeader header(ContainerFormat::Legacy, 2388);
+    auto bytes = header.serialize();
+    ASSERT_EQ(ContainerHeader::LEGACY_SIZE, bytes.size());
+
+    // whatever follows the 16-bit length is payload, not a chunked header
+    bytes.resize(ContainerHeader::FIXED_SIZE, 'x');
+    ContainerHeader parsed = ContainerHeader::parse(bytes.data(), bytes.size());
+    EXPECT_EQ(ContainerFormat::Legacy, parsed.format());
+    EXPECT_EQ(2388u, parsed.payloadLength());
+    EXPECT_EQ(ContainerHeader::LEGACY_SIZE, parsed.size());
+
+    EXPECT_THROW(ContainerHeader(ContainerFormat::Legacy, UINT16_MAX + 1), std::runtime_error);
+}
+
+TEST(ContainerTests, CorruptHeaderIsRejected) {
+    auto bytes = ContainerHeader(ContainerFormat::Chunked, 2500, 1000).serialize();
+
+    // a damaged fixed part is not mistaken for a legacy header
+    auto damagedFixed = bytes;
+    damagedFixed[9] ^= 1;
+    EXPECT_THROW(ContainerHeader::parse(damagedFixed.data(), damagedFixed.size()), std::runtime_error);
+    EXPECT_THROW(ContainerHeader::parse(damagedFixed.data(), damagedFixed.size(), 0x5453), std::runtime_error);
+
+    // a damaged chunk table fails its checksum
+    auto damagedTable = bytes;
+    damagedTable[ContainerHeader::FIXED_SIZE + 8] ^= 1;
+    ContainerHeader parsed = ContainerHeader::parse(damagedTable.data(), damagedTable.size());
+    EXPECT_THROW(parsed.parseChunkTable(damagedTable.data() + ContainerHeader::FIXED_SIZE), std::runtime_error);
+}
+
+TEST(ContainerTests, NewerVersionIsRejected) {
+    auto bytes = ContainerHeader(ContainerFormat::Chunked, 2500, 1000).serialize();
+
+    // a header of a later version, with a valid checksum, is not read as a legacy length either
+    bytes[4] = static_cast<char>(ContainerHeader::VERSION + 1);
+    std::uint32_t crc = crc32c(bytes.data(), 24);
+    for (int i = 0; i < 4; i++)
+    {
+        bytes[24 + i] = static_cast<char>(crc >> (8 * i));
+    }
+    EXPECT_THROW(ContainerHeader::parse(bytes.data(), bytes.size()), std::runtime_error);
+    EXPECT_THROW(ContainerHeader::parse(bytes.data(), bytes.size(), 0x5453), std::runtime_error);
+
+    // without the magic, the same bytes are a legacy header
+    bytes[0] = 'X';
+    EXPECT_EQ(ContainerFormat::Legacy, ContainerHeader::parse(bytes.data(), bytes.size()).format());
+}
+
+TEST(ContainerTests, LegacyDataStartingWithMagicIsDetected) {
+    // a legacy length of 0x5453 ("ST") followed by a payload starting with "EG"
+    std::string bytes = "STEG";
+    bytes.resize(ContainerHeader::FIXED_SIZE, 'x');
+
+    // the cover holds the legacy length, so the bytes are legacy data rather than a damaged chunked header
+    ContainerHeader parsed = ContainerHeader::parse(bytes.data(), bytes.size(), ContainerHeader::LEGACY_SIZE + 0x5453);
+    EXPECT_EQ(ContainerFormat::Legacy, parsed.format());
+    EXPECT_EQ(0x5453u, parsed.payloadLength());
+
+    // one byte less and neither reading is possible
+    EXPECT_THROW(ContainerHeader::parse(bytes.data(), bytes.size(), ContainerHeader::LEGACY_SIZE + 0x5452), std::runtime_error);
+}
+
+TEST(ContainerTests, CompressedHeaderRoundTrip) {
+    const std::uint64_t chunkSize = ContainerHeader::DEFAULT_CHUNK_SIZE;
+    ContainerHeader header(ContainerFormat::Chunked, 2 * chunkSize + 500, ContainerHeader::DEFAULT_CHUNK_SIZE, ContainerHeader::FLAG_COMPRESSED);
+    ASSERT_TRUE(header.compressed());
+    EXPECT_EQ(ContainerHeader::FIXED_SIZE + 3 * ContainerHeader::COMPRESSED_CHUNK_ENTRY_SIZE, header.size());
+
+    // the chunks move along as their compressed lengths are known
+    header.setChunkLength(0, 400);
+    header.setChunkLength(1, 1000);
+    header.setChunkLength(2, 100);
+    header.finalize();
+    EXPECT_EQ(1500u, header.payloadLength());
+    EXPECT_EQ(2 * chunkSize + 500, header.dataLength());
+    EXPECT_THROW(header.setChunkLength(2, 501), std::runtime_error);
+    EXPECT_THROW(header.setChunkLength(2, 0), std::runtime_error);
+    EXPECT_THROW(ContainerHeader(ContainerFormat::Chunked, 2500, 1000).setChunkLength(0, 400), std::runtime_error);
+
+    // the fixed part gives the stored length, the table gives the data length of every chunk
+    auto bytes = header.serialize();
+    ContainerHeader parsed = ContainerHeader::parse(bytes.data(), ContainerHeader::FIXED_SIZE);
+    EXPECT_TRUE(parsed.compressed());
+    EXPECT_EQ(1500u, parsed.payloadLength());
+    ASSERT_EQ(header.chunkTableSize(), parsed.chunkTableSize());
+    parsed.parseChunkTable(bytes.data() + ContainerHeader::FIXED_SIZE);
+    EXPECT_EQ(2 * chunkSize + 500, parsed.dataLength());
+    ASSERT_EQ(3u, parsed.chunks().size());
+    EXPECT_EQ(1400u, parsed.chunks()[2].offset);
+    EXPECT_EQ(100u, parsed.chunks()[2].length);
+    EXPECT_EQ(2 * chunkSize, parsed.chunks()[2].dataOffset);
+    EXPECT_EQ(500u, parsed.chunks()[2].dataLength);
+
+    EXPECT_THROW(ContainerHeader(ContainerFormat::Legacy, 2500, 1000, ContainerHeader::FLAG_COMPRESSED), std::runtime_error);
+    EXPECT_THROW(ContainerHeader(ContainerFormat::Chunked, 2500, 1000, ContainerHeader::FLAG_COMPRESSED), std::runtime_error);
+}
+
+TEST(ContainerTests, OversizedChunksAreRejected) {
+    // a chunk table claiming more data than a chunk holds, with valid checksums, must not drive allocations
+    auto rewrite = [](std::vector<char> bytes, std::size_t chunk, std::uint32_t dataLength)
+    {
+        char *entry = bytes.data() + ContainerHeader::FIXED_SIZE + chunk * ContainerHeader::COMPRESSED_CHUNK_ENTRY_SIZE;
+        for (int i = 0; i < 4; i++)
+        {
+            entry[12 + i] = static_cast<char>(dataLength >> (8 * i));
+        }
+        std::uint32_t tableCrc = crc32c(bytes.data() + ContainerHeader::FIXED_SIZE, bytes.size() - ContainerHeader::FIXED_SIZE);
+        for (int i = 0; i < 4; i++)
+        {
+            bytes[20 + i] = static_cast<char>(tableCrc >> (8 * i));
+        }
+        std::uint32_t fixedCrc = crc32c(bytes.data(), 24);
+        for (int i = 0; i < 4; i++)
+        {
+            bytes[24 + i] = static_cast<char>(fixedCrc >> (8 * i));
+        }
+        ContainerHeader parsed = ContainerHeader::parse(bytes.data(), bytes.size());
+        parsed.parseChunkTable(bytes.data() + ContainerHeader::FIXED_SIZE);
+        return parsed.dataLength();
+    };
+
+    ContainerHeader header(ContainerFormat::Chunked, ContainerHeader::DEFAULT_CHUNK_SIZE + 500, ContainerHeader::DEFAULT_CHUNK_SIZE, ContainerHeader::FLAG_COMPRESSED);
+    header.setChunkLength(0, 300);
+    header.setChunkLength(1, 200);
+    header.finalize();
+    auto bytes = header.serialize();
+    EXPECT_EQ(ContainerHeader::DEFAULT_CHUNK_SIZE + 400u, rewrite(bytes, 1, 400));
+    EXPECT_THROW(rewrite(bytes, 1, UINT32_MAX), std::runtime_error);
+    EXPECT_THROW(rewrite(bytes, 1, ContainerHeader::DEFAULT_CHUNK_SIZE + 1), std::runtime_error);
+    EXPECT_THROW(rewrite(bytes, 0, ContainerHeader::DEFAULT_CHUNK_SIZE - 1), std::runtime_error);
+}
+
+TEST(ContainerTests, Crc32cMatchesKnownValues) {
+    EXPECT_EQ(0xE3069283u, crc32c("123456789", 9));
+    EXPECT_EQ(0x8A9136AAu, crc32c(std::string(32, '\0').data(), 32));
+    EXPECT_EQ(0u, crc32c("", 0));
+
+    // any split of a buffer gives the checksum of the whole, whatever its alignment and length
+    std::string text = "The quick brown fox jumps over the lazy dog, 0123456789 times over.";
+    for (std::size_t split = 0; split <= text.size(); split++)
+    {
+        EXPECT_EQ(crc32c(text.data(), text.size()), crc32c(text.data() + split, text.size() - split, crc32c(text.data(), split)));
+    }
+}
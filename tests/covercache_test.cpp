@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include "../covercache.h"
+#include "../steganography.h"
+#include "test_util.h"
+
+using namespace SteganographyLib;
+
+TEST(CoverCacheTests, EvictsLeastRecentlyUsed) {
+    // 100x100 covers hold 30000 bytes of pixels, the cache holds two of them
+    for (auto file : {"CoverCache_a.bmp", "CoverCache_b.bmp", "CoverCache_c.bmp"})
+    {
+        bmp::Bitmap(100, 100).save(file);
+    }
+    CoverCache cache(70000);
+
+    auto a = cache.acquire("CoverCache_a.bmp");
+    cache.acquire("CoverCache_b.bmp");
+    EXPECT_EQ(a, cache.acquire("CoverCache_a.bmp"));
+    cache.acquire("CoverCache_c.bmp");
+
+    CoverCacheStats stats = cache.stats();
+    EXPECT_EQ(1u, stats.hits);
+    EXPECT_EQ(3u, stats.misses);
+    EXPECT_EQ(1u, stats.evictions);
+    EXPECT_EQ(2u, stats.entries);
+    EXPECT_EQ(60000u, stats.bytes);
+
+    // b was the least recently used
+    cache.acquire("CoverCache_a.bmp");
+    cache.acquire("CoverCache_b.bmp");
+    stats = cache.stats();
+    EXPECT_EQ(2u, stats.hits);
+    EXPECT_EQ(4u, stats.misses);
+
+    // a modified file is reloaded
+    bmp::Bitmap(50, 100).save("CoverCache_b.bmp");
+    EXPECT_EQ(50, cache.acquire("CoverCache_b.bmp")->width());
+    EXPECT_EQ(5u, cache.stats().misses);
+
+    // a cover larger than the cache is served but not kept
+    CoverCache smallCache(1000);
+    EXPECT_EQ(100, smallCache.acquire("CoverCache_a.bmp")->width());
+    EXPECT_EQ(0u, smallCache.stats().entries);
+    EXPECT_THROW(cache.acquire("nonexistent_bitmap.bmp"), std::runtime_error);
+
+    // Clean up
+    for (auto file : {"CoverCache_a.bmp", "CoverCache_b.bmp", "CoverCache_c.bmp"})
+    {
+        std::filesystem::remove(file);
+    }
+}
+
+TEST(CoverCacheTests, CachedCoverMatchesLoadedCover) {
+    auto referenceBytes = readFileBytes("../../../data/embedded_6bits.bmp");
+    auto cache = std::make_shared<CoverCache>(64 * 1024 * 1024);
+
+    for (OutputMode outputMode : {OutputMode::Rewrite, OutputMode::Patch})
+    {
+        Steganography steg;
+        steg.setCoverCache(cache);
+        steg.setOutputMode(outputMode);
+        steg.setContainerFormat(ContainerFormat::Legacy);
+
+        // a different payload first, which must not leak into the shared cover
+        std::ofstream("CoverCache_payload.txt", std::ios::binary) << std::string(40000, 'x');
+        EXPECT_NO_THROW(steg.embed("../../../data/sample.bmp", "CoverCache_payload.txt", "CoverCache_embedded.bmp", 6));
+        EXPECT_NO_THROW(steg.embed("../../../data/sample.bmp", "../../../data/sampleInput.txt", "CoverCache_embedded.bmp", 6));
+
+        // the pixels match the reference bitmap, the rewrite also matches its header
+        auto embeddedBytes = readFileBytes("CoverCache_embedded.bmp");
+        ASSERT_EQ(referenceBytes.size(), embeddedBytes.size());
+        EXPECT_TRUE(std::equal(referenceBytes.begin() + sizeof(bmp::BitmapHeader), referenceBytes.end(), embeddedBytes.begin() + sizeof(bmp::BitmapHeader)));
+        if (outputMode == OutputMode::Rewrite)
+        {
+            EXPECT_EQ(referenceBytes, embeddedBytes);
+        }
+
+        EXPECT_NO_THROW(steg.extract("CoverCache_embedded.bmp", "CoverCache_output.txt", 6));
+        EXPECT_EQ(readFileBytes("../../../data/sampleInput.txt"), readFileBytes("CoverCache_output.txt"));
+    }
+
+    // sample.bmp was decoded once, the embedded bitmap whenever its timestamp changed
+    CoverCacheStats stats = cache->stats();
+    EXPECT_EQ(6u, stats.hits + stats.misses);
+    EXPECT_GE(stats.hits, 3u);
+
+    // Clean up
+    for (auto file : {"CoverCache_payload.txt", "CoverCache_embedded.bmp", "CoverCache_output.txt"})
+    {
+        std::filesystem::remove(file);
+    }
+}
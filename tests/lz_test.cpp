@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include <string>
+#include "../lz.h"
+
+using namespace SteganographyLib;
+
+static std::vector<char> roundTrip(const std::vector<char> &data)
+{
+    std::vector<char> compressed(lzCompressBound(data.size()));
+    std::size_t length = lzCompress(data.data(), data.size(), compressed.data(), compressed.size());
+    EXPECT_GT(length, 0u);
+    compressed.resize(length);
+
+    std::vector<char> decompressed(data.size());
+    EXPECT_TRUE(lzDecompress(compressed.data(), compressed.size(), decompressed.data(), decompressed.size()));
+    return compressed;
+}
+
+TEST(LzTests, RoundTripsEveryKindOfData) {
+    // short inputs are all literals, the others mix literals, matches and matches that overlap themselves
+    for (std::size_t size : {0, 1, 12, 13, 17, 100, 70000, 300000})
+    {
+        std::vector<char> random(size);
+        std::vector<char> text;
+        std::vector<char> runs(size);
+        std::uint32_t state = 0x9E3779B9;
+        for (std::size_t i = 0; i < size; i++)
+        {
+            state = state * 1664525 + 1013904223;
+            random[i] = static_cast<char>(state >> 24);
+            runs[i] = static_cast<char>(i / 1000);
+        }
+        for (std::size_t line = 0; text.size() < size; line++)
+        {
+            std::string row = "line " + std::to_string(line % 97) + ": the quick brown fox jumps over the lazy dog\n";
+            text.insert(text.end(), row.begin(), row.end());
+        }
+        text.resize(size);
+
+        for (const auto *data : {&random, &text, &runs})
+        {
+            std::vector<char> compressed = roundTrip(*data);
+            std::vector<char> decompressed(data->size());
+            ASSERT_TRUE(lzDecompress(compressed.data(), compressed.size(), decompressed.data(), decompressed.size())) << "size " << size;
+            EXPECT_EQ(*data, decompressed) << "size " << size;
+            EXPECT_LE(compressed.size(), lzCompressBound(size));
+        }
+
+        if (size >= 70000)
+        {
+            EXPECT_LT(roundTrip(text).size(), size / 4);
+            EXPECT_LT(roundTrip(runs).size(), size / 50);
+        }
+    }
+}
+
+TEST(LzTests, RejectsShortBuffersAndCorruptBlocks) {
+    std::vector<char> data(10000);
+    for (std::size_t i = 0; i < data.size(); i++)
+    {
+        data[i] = static_cast<char>("abcdefgh"[i % 8] + i / 2500);
+    }
+    std::vector<char> compressed = roundTrip(data);
+
+    // a destination too small for the block
+    std::vector<char> tooSmall(compressed.size() - 1);
+    EXPECT_EQ(0u, lzCompress(data.data(), data.size(), tooSmall.data(), tooSmall.size()));
+
+    // truncated blocks, and blocks that do not decompress to the expected length
+    std::vector<char> decompressed(data.size() + 1);
+    EXPECT_FALSE(lzDecompress(compressed.data(), compressed.size() - 1, decompressed.data(), data.size()));
+    EXPECT_FALSE(lzDecompress(compressed.data(), compressed.size(), decompressed.data(), data.size() - 1));
+    EXPECT_FALSE(lzDecompress(compressed.data(), compressed.size(), decompressed.data(), data.size() + 1));
+
+    // a match reaching back before the start of the data
+    const char badOffset[] = {0x10, 'a', 0x05, 0x00, 0x00};
+    EXPECT_FALSE(lzDecompress(badOffset, sizeof(badOffset) - 1, decompressed.data(), 5));
+}
@@ -38,6 +38,21 @@ TEST(ProgramTests, InvalidArguments)
     EXPECT_EQ(SteganographyLib::ERROR_CODE_INVALID_ARGUMENTS, SteganographyLib::mainWrapper(1, argv));
 }
 
+TEST(ProgramTests, OptionsOfOtherOperations)
+{
+    // every operation refuses the options it would ignore
+    char* embedArgv[] = {(char*)"steganography", (char*)"embed", (char*)"../../../data/sample.bmp", (char*)"../../../data/sampleInput.txt", (char*)"ProgramTests_Options.bmp", (char*)"6", (char*)"--range", (char*)"0:10"};
+    EXPECT_EQ(SteganographyLib::ERROR_CODE_INVALID_ARGUMENTS, SteganographyLib::mainWrapper(8, embedArgv));
+    char* probeArgv[] = {(char*)"steganography", (char*)"probe", (char*)"../../../data/embedded_6bits.bmp", (char*)"6", (char*)"--profile", (char*)"2,2,2"};
+    EXPECT_EQ(SteganographyLib::ERROR_CODE_INVALID_ARGUMENTS, SteganographyLib::mainWrapper(6, probeArgv));
+    char* scanArgv[] = {(char*)"steganography", (char*)"scan", (char*)"../../../data", (char*)"--scatter", (char*)"key"};
+    EXPECT_EQ(SteganographyLib::ERROR_CODE_INVALID_ARGUMENTS, SteganographyLib::mainWrapper(5, scanArgv));
+    char* shardsArgv[] = {(char*)"steganography", (char*)"extract-shards", (char*)"ProgramTests_Options.bin", (char*)"6", (char*)"../../../data/embedded_6bits.bmp", (char*)"--compression", (char*)"lz4"};
+    EXPECT_EQ(SteganographyLib::ERROR_CODE_INVALID_ARGUMENTS, SteganographyLib::mainWrapper(7, shardsArgv));
+    char* unknownArgv[] = {(char*)"steganography", (char*)"embed", (char*)"../../../data/sample.bmp", (char*)"../../../data/sampleInput.txt", (char*)"ProgramTests_Options.bmp", (char*)"6", (char*)"--color", (char*)"red"};
+    EXPECT_EQ(SteganographyLib::ERROR_CODE_INVALID_ARGUMENTS, SteganographyLib::mainWrapper(8, unknownArgv));
+}
+
 TEST(ProgramTests, InvalidOperation)
 {
     char* argv[] = {(char*)"steganography", (char*)"foo"};
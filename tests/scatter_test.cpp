@@ -0,0 +1,235 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include "../scatter.h"
+#include "../steganography.h"
+#include "../program_wrapper.h"
+#include "test_util.h"
+
+using namespace SteganographyLib;
+
+static std::vector<char> randomPayload(std::size_t length, std::uint32_t seed)
+{
+    std::vector<char> payload(length);
+    for (char &byte : payload)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        byte = static_cast<char>(seed >> 24);
+    }
+    return payload;
+}
+
+TEST(ScatterTests, OrderVisitsEveryPixelOnce) {
+    std::uint64_t key = ScatterOrder::key("secret");
+    EXPECT_EQ(key, ScatterOrder::key("secret"));
+    EXPECT_NE(key, ScatterOrder::key("secreu"));
+
+    // one pixel, narrower than a tile, several bands with a short one, wider than a band
+    for (auto size : std::vector<std::pair<std::size_t, std::size_t>>{{1, 1}, {7, 3}, {300, 2}, {347, 462}, {1000, 300}, {70000, 2}})
+    {
+        std::size_t width = size.first;
+        std::size_t height = size.second;
+        ScatterOrder order(width, height, key);
+        std::vector<int> visits(width * height, 0);
+        std::uint64_t position = 0;
+        std::size_t outOfPlace = 0;
+        for (std::size_t i = 0; i < order.tileCount(); i++)
+        {
+            ScatterTile tile = order.tile(i);
+            ASSERT_EQ(position, tile.position) << width << "x" << height << " tile " << i;
+            ASSERT_GT(tile.pixelCount, 0u);
+            EXPECT_EQ(i, order.tileAt(tile.position));
+            EXPECT_EQ(i, order.tileAt(tile.position + tile.pixelCount - 1));
+            for (std::size_t j = 0; j < tile.pixelCount; j++)
+            {
+                visits[tile.firstPixel + j]++;
+            }
+            outOfPlace += tile.firstPixel != tile.position;
+            position += tile.pixelCount;
+        }
+        EXPECT_EQ(order.pixelCount(), position);
+        EXPECT_TRUE(std::all_of(visits.begin(), visits.end(), [](int count) { return count == 1; })) << width << "x" << height;
+        if (order.tileCount() > 16)
+        {
+            EXPECT_GT(outOfPlace, order.tileCount() / 2) << width << "x" << height;
+        }
+
+        // the spans go over the same pixels, split at the end of the rows, upside down as well
+        std::vector<std::uint8_t> image(width * height);
+        std::uint8_t *bottomRow = image.data() + (height - 1) * width;
+        std::size_t channels = 0;
+        for (const ChannelSpan &span : order.spans(bottomRow, -static_cast<std::ptrdiff_t>(width), 1))
+        {
+            std::size_t offset = static_cast<std::size_t>(span.first - image.data());
+            EXPECT_LE(offset % width + span.count, width);
+            for (std::size_t j = 0; j < span.count; j++)
+            {
+                image[offset + j]++;
+            }
+            channels += span.count;
+        }
+        EXPECT_EQ(width * height, channels);
+        EXPECT_TRUE(std::all_of(image.begin(), image.end(), [](std::uint8_t count) { return count == 1; }));
+    }
+
+    // another key, another order
+    ScatterOrder first(1000, 300, key);
+    ScatterOrder second(1000, 300, ScatterOrder::key("other"));
+    std::size_t same = 0;
+    for (std::size_t i = 0; i < first.tileCount(); i++)
+    {
+        same += first.tile(i).firstPixel == second.tile(i).firstPixel;
+    }
+    EXPECT_LT(same, first.tileCount() / 4);
+}
+
+TEST(ScatterTests, ScatteredEmbedRoundTripsOnEveryPath) {
+    std::vector<char> payload = randomPayload(60000, 5);
+    std::ofstream("Scatter_payload.bin", std::ios::binary).write(payload.data(), payload.size());
+
+    Steganography loaded;
+    loaded.setScatterKey("secret");
+    ASSERT_NO_THROW(loaded.embed("../../../data/sample.bmp", "Scatter_payload.bin", "Scatter_loaded.bmp", 6));
+    auto loadedBytes = readFileBytes("Scatter_loaded.bmp");
+    ASSERT_NO_THROW(loaded.extract("Scatter_loaded.bmp", "Scatter_output.bin", 6));
+    EXPECT_EQ(payload, readFileBytes("Scatter_output.bin"));
+
+    // memory mapped, patched and parallel, with the same order
+    for (std::size_t threadCount : {1, 3})
+    {
+        Steganography mapped;
+        mapped.setScatterKey("secret");
+        mapped.setMemoryMapping(true);
+        mapped.setOutputMode(OutputMode::Patch);
+        mapped.setThreadCount(threadCount);
+        ASSERT_NO_THROW(mapped.embed("../../../data/sample.bmp", "Scatter_payload.bin", "Scatter_mapped.bmp", 6));
+        auto mappedBytes = readFileBytes("Scatter_mapped.bmp");
+        ASSERT_EQ(loadedBytes.size(), mappedBytes.size());
+        EXPECT_TRUE(std::equal(loadedBytes.begin() + sizeof(bmp::BitmapHeader), loadedBytes.end(), mappedBytes.begin() + sizeof(bmp::BitmapHeader)));
+        ASSERT_NO_THROW(mapped.extract("Scatter_loaded.bmp", "Scatter_output.bin", 6));
+        EXPECT_EQ(payload, readFileBytes("Scatter_output.bin"));
+
+        Steganography cached;
+        cached.setScatterKey("secret");
+        cached.setCoverCache(std::make_shared<CoverCache>(64 * 1024 * 1024));
+        cached.setThreadCount(threadCount);
+        ASSERT_NO_THROW(cached.embed("../../../data/sample.bmp", "Scatter_payload.bin", "Scatter_cached.bmp", 6));
+        EXPECT_EQ(loadedBytes, readFileBytes("Scatter_cached.bmp"));
+        ASSERT_NO_THROW(cached.extract("Scatter_cached.bmp", "Scatter_output.bin", 6));
+        EXPECT_EQ(payload, readFileBytes("Scatter_output.bin"));
+    }
+
+    std::vector<char> coverChars = readFileBytes("../../../data/sample.bmp");
+    std::vector<std::uint8_t> buffer(coverChars.begin(), coverChars.end());
+    ASSERT_NO_THROW(loaded.embed(buffer.data(), buffer.size(), payload.data(), payload.size(), 6));
+    std::vector<char> bufferBytes(buffer.begin(), buffer.end());
+    EXPECT_TRUE(std::equal(loadedBytes.begin() + sizeof(bmp::BitmapHeader), loadedBytes.end(), bufferBytes.begin() + sizeof(bmp::BitmapHeader)));
+    EXPECT_EQ(payload, loaded.extract(buffer.data(), buffer.size(), 6));
+
+    // random access reads only the tiles of the range
+    for (std::size_t offset : {0, 1, 33333, 59000})
+    {
+        std::vector<char> range;
+        ASSERT_NO_THROW(range = loaded.extractRange("Scatter_loaded.bmp", offset, 1000, 6));
+        EXPECT_EQ(std::vector<char>(payload.begin() + offset, payload.begin() + offset + 1000), range) << "offset " << offset;
+    }
+    EXPECT_EQ(60000u, loaded.probe("Scatter_loaded.bmp", 6).payloadLength);
+
+    // without the key, or with another one, the data is not found
+    for (const char *key : {"", "secreu"})
+    {
+        Steganography other;
+        other.setScatterKey(key);
+        bool recovered = false;
+        try
+        {
+            other.extract("Scatter_loaded.bmp", "Scatter_output.bin", 6);
+            recovered = readFileBytes("Scatter_output.bin") == payload;
+        }
+        catch (const std::runtime_error &)
+        {
+        }
+        EXPECT_FALSE(recovered) << "key '" << key << "'";
+    }
+
+    // a small payload fills tiles of a band, not the first pixels of the image
+    std::ofstream("Scatter_small.bin", std::ios::binary).write(payload.data(), 2000);
+    ASSERT_NO_THROW(loaded.embed("../../../data/sample.bmp", "Scatter_small.bin", "Scatter_small.bmp", 6));
+    bmp::Bitmap original("../../../data/sample.bmp");
+    bmp::Bitmap scattered("Scatter_small.bmp");
+    std::size_t sequentialPixels = 4000;
+    EXPECT_FALSE(std::equal(original.begin() + sequentialPixels, original.end(), scattered.begin() + sequentialPixels));
+
+    char* argv[] = {(char*)"steganography", (char*)"extract", (char*)"Scatter_loaded.bmp", (char*)"Scatter_cli.bin", (char*)"6", (char*)"--scatter", (char*)"secret"};
+    EXPECT_EQ(SteganographyLib::SUCCESS, SteganographyLib::mainWrapper(7, argv));
+    EXPECT_EQ(payload, readFileBytes("Scatter_cli.bin"));
+    char* probeArgv[] = {(char*)"steganography", (char*)"probe", (char*)"Scatter_loaded.bmp", (char*)"6", (char*)"--scatter", (char*)"secret"};
+    EXPECT_EQ(SteganographyLib::SUCCESS, SteganographyLib::mainWrapper(6, probeArgv));
+
+    // Clean up
+    for (const char *file : {"Scatter_payload.bin", "Scatter_small.bin", "Scatter_loaded.bmp", "Scatter_mapped.bmp", "Scatter_cached.bmp", "Scatter_small.bmp",
+                             "Scatter_output.bin", "Scatter_cli.bin"})
+    {
+        std::filesystem::remove(file);
+    }
+}
+
+TEST(ScatterTests, ScatteredWalkCoversAlphaAndProfiles) {
+    // a 32 bpp cover whose R bytes cannot hold the payload, tall enough for several bands
+    bmp::Bitmap cover(97, 1400);
+    std::uint32_t state = 0x2468ACE;
+    for (bmp::Pixel &pixel : cover)
+    {
+        state = state * 1664525 + 1013904223;
+        pixel = bmp::Pixel(static_cast<std::uint8_t>(state >> 24), static_cast<std::uint8_t>(state >> 16), static_cast<std::uint8_t>(state >> 8));
+    }
+    cover.set_alpha_channel(true, 200);
+    cover.save("ScatterAlpha_cover.bmp");
+    std::vector<char> payload = randomPayload(150000, 9);
+    std::ofstream("ScatterAlpha_payload.bin", std::ios::binary).write(payload.data(), payload.size());
+
+    Steganography steg;
+    steg.setScatterKey("alpha");
+    steg.setAlphaEmbedding(true);
+    ASSERT_NO_THROW(steg.embed("ScatterAlpha_cover.bmp", "ScatterAlpha_payload.bin", "ScatterAlpha_embedded.bmp", 6));
+    auto reference = readFileBytes("ScatterAlpha_embedded.bmp");
+
+    Steganography mapped;
+    mapped.setScatterKey("alpha");
+    mapped.setAlphaEmbedding(true);
+    mapped.setMemoryMapping(true);
+    mapped.setThreadCount(2);
+    ASSERT_NO_THROW(mapped.embed("ScatterAlpha_cover.bmp", "ScatterAlpha_payload.bin", "ScatterAlpha_mapped.bmp", 6));
+    EXPECT_EQ(reference, readFileBytes("ScatterAlpha_mapped.bmp"));
+    ASSERT_NO_THROW(mapped.extract("ScatterAlpha_embedded.bmp", "ScatterAlpha_output.bin", 6));
+    EXPECT_EQ(payload, readFileBytes("ScatterAlpha_output.bin"));
+
+    // ranges in the R bytes, across both passes, and in the alpha bytes only
+    for (std::size_t offset : {0, 100000, 140000})
+    {
+        std::vector<char> range;
+        ASSERT_NO_THROW(range = steg.extractRange("ScatterAlpha_embedded.bmp", offset, 5000, 6));
+        EXPECT_EQ(std::vector<char>(payload.begin() + offset, payload.begin() + offset + 5000), range) << "offset " << offset;
+    }
+
+    // with a density profile, whole pixels in the keyed order, read in place as well
+    payload.resize(90000);
+    std::ofstream("ScatterAlpha_payload.bin", std::ios::binary | std::ios::trunc).write(payload.data(), payload.size());
+    Steganography profiled;
+    profiled.setScatterKey("alpha");
+    profiled.setDensityProfile({2, 1, 3});
+    ASSERT_NO_THROW(profiled.embed("ScatterAlpha_cover.bmp", "ScatterAlpha_payload.bin", "ScatterAlpha_profiled.bmp", 6));
+    ASSERT_NO_THROW(profiled.extract("ScatterAlpha_profiled.bmp", "ScatterAlpha_output.bin", 6));
+    EXPECT_EQ(payload, readFileBytes("ScatterAlpha_output.bin"));
+    std::vector<char> range;
+    ASSERT_NO_THROW(range = profiled.extractRange("ScatterAlpha_profiled.bmp", 77777, 3000, 6));
+    EXPECT_EQ(std::vector<char>(payload.begin() + 77777, payload.begin() + 77777 + 3000), range);
+
+    // Clean up
+    for (const char *file : {"ScatterAlpha_cover.bmp", "ScatterAlpha_payload.bin", "ScatterAlpha_embedded.bmp", "ScatterAlpha_mapped.bmp",
+                             "ScatterAlpha_profiled.bmp", "ScatterAlpha_output.bin"})
+    {
+        std::filesystem::remove(file);
+    }
+}
@@ -0,0 +1,244 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include "../server.h"
+#include "test_util.h"
+
+#if !defined(_WIN32)
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace SteganographyLib;
+
+#if !defined(_WIN32)
+
+// a local client standing in for the services that use the server
+class ServerClient
+{
+    public:
+        explicit ServerClient(const std::string &socketPath)
+        {
+            sockaddr_un address = {};
+            address.sun_family = AF_UNIX;
+            socketPath.copy(address.sun_path, sizeof(address.sun_path) - 1);
+            // the server may still be starting
+            for (int attempt = 0; attempt < 200; attempt++)
+            {
+                m_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+                if (connect(m_fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == 0)
+                {
+                    return;
+                }
+                close(m_fd);
+                m_fd = -1;
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+
+        ~ServerClient()
+        {
+            if (m_fd >= 0)
+            {
+                close(m_fd);
+            }
+        }
+
+        bool connected() const { return m_fd >= 0; }
+
+        void send(const std::string &text)
+        {
+            ASSERT_EQ(static_cast<ssize_t>(text.size()), ::send(m_fd, text.data(), text.size(), 0));
+        }
+
+        // sends as much as the server takes before it closes the connection
+        void sendUntilClosed(const std::string &text)
+        {
+            size_t sent = 0;
+            while (sent < text.size())
+            {
+                ssize_t count = ::send(m_fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+                if (count <= 0)
+                {
+                    return;
+                }
+                sent += static_cast<size_t>(count);
+            }
+        }
+
+        bool readable(int milliseconds)
+        {
+            pollfd descriptor = {m_fd, POLLIN, 0};
+            return !m_pending.empty() || poll(&descriptor, 1, milliseconds) > 0;
+        }
+
+        std::string receiveLine()
+        {
+            size_t end;
+            while ((end = m_pending.find('\n')) == std::string::npos)
+            {
+                char buffer[256];
+                ssize_t count = recv(m_fd, buffer, sizeof(buffer), 0);
+                if (count <= 0)
+                {
+                    return "";
+                }
+                m_pending.append(buffer, static_cast<size_t>(count));
+            }
+            std::string line = m_pending.substr(0, end);
+            m_pending.erase(0, end + 1);
+            return line;
+        }
+
+    private:
+        int m_fd = -1;
+        std::string m_pending;
+};
+
+static bool contains(const std::string &text, const std::string &part)
+{
+    return text.find(part) != std::string::npos;
+}
+
+#endif
+
+TEST(ServerTests, ServesConcurrentClients) {
+#if defined(_WIN32)
+    GTEST_SKIP() << "The server needs Unix domain sockets.";
+#else
+    const std::string socketPath = "ServerTests.sock";
+    CancellationToken stop;
+    std::ostringstream log;
+    ServerSummary summary;
+    std::thread server([&]() { summary = runServer(socketPath, 2, std::make_shared<CoverCache>(64 * 1024 * 1024), stop, &log); });
+
+    {
+        ServerClient embedder(socketPath);
+        ServerClient prober(socketPath);
+        ASSERT_TRUE(embedder.connected());
+        ASSERT_TRUE(prober.connected());
+
+        // a job split across writes, then a probe sent while the embed may still be running on the other connection
+        embedder.send("{\"id\": \"job-1\", \"operation\": \"embed\", \"bitmap\": \"../../../data/sample.bmp\", ");
+        embedder.send("\"data\": \"../../../data/sampleInput.txt\", \"output\": \"ServerTests_embedded.bmp\", \"bitsPerPixel\": 6}\n");
+        prober.send("probe\t../../../data/embedded_6bits.bmp\t6\n");
+
+        std::string probed = prober.receiveLine();
+        EXPECT_TRUE(contains(probed, "\"operation\": \"probe\"")) << probed;
+        EXPECT_TRUE(contains(probed, "\"status\": \"ok\"")) << probed;
+        EXPECT_TRUE(contains(probed, "\"payloadLength\"")) << probed;
+        EXPECT_TRUE(contains(probed, "\"capacity\"")) << probed;
+        EXPECT_TRUE(contains(probed, "\"milliseconds\"")) << probed;
+
+        std::string embedded = embedder.receiveLine();
+        EXPECT_TRUE(contains(embedded, "\"line\": 1")) << embedded;
+        EXPECT_TRUE(contains(embedded, "\"id\": \"job-1\"")) << embedded;
+        EXPECT_TRUE(contains(embedded, "\"status\": \"ok\"")) << embedded;
+        EXPECT_TRUE(contains(embedded, "\"milliseconds\"")) << embedded;
+
+        // comments and blank lines take no line of status, a bad job gets an error and leaves the connection open
+        embedder.send("# extract what was embedded\n\n{\"id\": \"job-2\", \"operation\": \"extract\", \"bitmap\": \"ServerTests_embedded.bmp\", \"output\": \"ServerTests_output.txt\", \"bitsPerPixel\": 6}\n");
+        std::string extracted = embedder.receiveLine();
+        EXPECT_TRUE(contains(extracted, "\"line\": 4")) << extracted;
+        EXPECT_TRUE(contains(extracted, "\"id\": \"job-2\"")) << extracted;
+        EXPECT_TRUE(contains(extracted, "\"status\": \"ok\"")) << extracted;
+        EXPECT_EQ(readFileBytes("../../../data/sampleInput.txt"), readFileBytes("ServerTests_output.txt"));
+
+        prober.send("unpack\tServerTests_embedded.bmp\t6\n");
+        std::string failed = prober.receiveLine();
+        EXPECT_TRUE(contains(failed, "\"status\": \"error\"")) << failed;
+        EXPECT_TRUE(contains(failed, "\"error\"")) << failed;
+    }
+
+    stop.cancel();
+    server.join();
+    EXPECT_EQ(2u, summary.connections);
+    EXPECT_EQ(3u, summary.succeeded);
+    EXPECT_EQ(1u, summary.failed);
+    EXPECT_FALSE(std::filesystem::exists(socketPath));
+    EXPECT_TRUE(contains(log.str(), "\"id\": \"job-2\""));
+#endif
+}
+
+TEST(ServerTests, RejectsInvalidSocketPath) {
+#if defined(_WIN32)
+    GTEST_SKIP() << "The server needs Unix domain sockets.";
+#else
+    CancellationToken stop;
+    EXPECT_THROW(runServer(std::string(200, 'x'), 1, nullptr, stop), std::runtime_error);
+    EXPECT_THROW(runServer("", 1, nullptr, stop), std::runtime_error);
+#endif
+}
+
+TEST(ServerTests, LongLineClosesConnection) {
+#if defined(_WIN32)
+    GTEST_SKIP() << "The server needs Unix domain sockets.";
+#else
+    const std::string socketPath = "ServerTests_long.sock";
+    CancellationToken stop;
+    ServerSummary summary;
+    std::thread server([&]() { summary = runServer(socketPath, 1, nullptr, stop); });
+
+    {
+        ServerClient client(socketPath);
+        ASSERT_TRUE(client.connected());
+
+        // a line that never ends is refused once it passes the limit, rather than buffered
+        client.send("# a comment line\n");
+        client.sendUntilClosed(std::string(65 * 1024, 'x'));
+        std::string refused = client.receiveLine();
+        EXPECT_TRUE(contains(refused, "\"line\": 2")) << refused;
+        EXPECT_TRUE(contains(refused, "\"status\": \"error\"")) << refused;
+        EXPECT_TRUE(contains(refused, "longer than")) << refused;
+        EXPECT_EQ("", client.receiveLine());
+    }
+
+    stop.cancel();
+    server.join();
+    EXPECT_EQ(1u, summary.connections);
+    EXPECT_EQ(1u, summary.failed);
+#endif
+}
+
+TEST(ServerTests, ConnectionsBeyondTheLimitWait) {
+#if defined(_WIN32)
+    GTEST_SKIP() << "The server needs Unix domain sockets.";
+#else
+    const std::string socketPath = "ServerTests_limit.sock";
+    CancellationToken stop;
+    ServerSummary summary;
+    std::thread server([&]() { summary = runServer(socketPath, 1, nullptr, stop); });
+
+    {
+        // every client gets an answer, which shows that its connection is being read
+        std::vector<std::unique_ptr<ServerClient>> clients;
+        for (int i = 0; i < 64; i++)
+        {
+            clients.push_back(std::make_unique<ServerClient>(socketPath));
+            ASSERT_TRUE(clients.back()->connected());
+            clients.back()->send("unpack\tServerTests_missing.bmp\t6\n");
+            EXPECT_TRUE(contains(clients.back()->receiveLine(), "\"status\": \"error\""));
+        }
+
+        // one more client connects, but is only read once another one closes
+        ServerClient waiting(socketPath);
+        ASSERT_TRUE(waiting.connected());
+        waiting.send("unpack\tServerTests_missing.bmp\t6\n");
+        EXPECT_FALSE(waiting.readable(300));
+        clients.pop_back();
+        EXPECT_TRUE(contains(waiting.receiveLine(), "\"status\": \"error\""));
+    }
+
+    stop.cancel();
+    server.join();
+    EXPECT_EQ(65u, summary.connections);
+    EXPECT_EQ(65u, summary.failed);
+#endif
+}
@@ -0,0 +1,196 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include "../shard.h"
+#include "../steganography.h"
+#include "../program_wrapper.h"
+#include "test_util.h"
+
+using namespace SteganographyLib;
+
+// covers of 450, 900 and 1500 bytes at 3 bits per pixel, and a payload that only fits in all of them
+static void createShardFiles(std::vector<std::string> &covers, std::vector<std::string> &destinations, std::vector<char> &payload)
+{
+    std::filesystem::create_directories("ShardTests");
+    const int sizes[][2] = {{60, 40}, {40, 30}, {80, 50}};
+    std::uint32_t state = 7;
+    for (int i = 0; i < 3; i++)
+    {
+        bmp::Bitmap cover(sizes[i][0], sizes[i][1]);
+        for (bmp::Pixel &pixel : cover)
+        {
+            state = state * 1664525u + 1013904223u;
+            pixel = bmp::Pixel(static_cast<std::uint8_t>(state >> 24), static_cast<std::uint8_t>(state >> 16), static_cast<std::uint8_t>(state >> 8));
+        }
+        covers.push_back("ShardTests/cover" + std::to_string(i) + ".bmp");
+        destinations.push_back("ShardTests/shard" + std::to_string(i) + ".bmp");
+        cover.save(covers.back());
+    }
+
+    payload.resize(2500);
+    for (char &byte : payload)
+    {
+        state = state * 1664525u + 1013904223u;
+        byte = static_cast<char>(state >> 24);
+    }
+    std::ofstream("ShardTests/payload.bin", std::ios::binary).write(payload.data(), payload.size());
+}
+
+TEST(ShardTests, PlanFollowsCapacities) {
+    auto shards = planShards({100, 300, 600}, 500, 42);
+    ASSERT_EQ(3u, shards.size());
+    EXPECT_EQ(50u, shards[0].length);
+    EXPECT_EQ(150u, shards[1].length);
+    EXPECT_EQ(300u, shards[2].length);
+    EXPECT_EQ(200u, shards[2].dataOffset);
+    for (std::uint32_t i = 0; i < 3; i++)
+    {
+        EXPECT_EQ(42u, shards[i].payloadId);
+        EXPECT_EQ(i, shards[i].index);
+        EXPECT_EQ(3u, shards[i].count);
+        EXPECT_EQ(500u, shards[i].totalLength);
+    }
+
+    // the rounding never overfills a cover, a full set of covers is filled exactly, and small payloads leave shards empty
+    shards = planShards({7, 7, 7}, 20, 1);
+    EXPECT_EQ(20u, shards[0].length + shards[1].length + shards[2].length);
+    EXPECT_LE(shards[0].length, 7u);
+    shards = planShards({3, 5, 1000}, 1008, 1);
+    EXPECT_EQ(5u, shards[1].length);
+    EXPECT_EQ(1000u, shards[2].length);
+    shards = planShards({100, 100}, 1, 1);
+    EXPECT_EQ(1u, shards[0].length + shards[1].length);
+
+    EXPECT_THROW(planShards({100, 100}, 201, 1), std::runtime_error);
+    EXPECT_THROW(planShards({}, 0, 1), std::runtime_error);
+}
+
+TEST(ShardTests, ShardRecordRoundTrip) {
+    ContainerHeader header(ContainerFormat::Chunked, 2500, 1000);
+    header.setShard({99, 1, 3, 4000, 2500, 9000});
+    EXPECT_TRUE(header.sharded());
+    EXPECT_EQ(ContainerHeader::FIXED_SIZE + ContainerHeader::SHARD_RECORD_SIZE + 3 * ContainerHeader::CHUNK_ENTRY_SIZE, header.size());
+
+    auto bytes = header.serialize();
+    ContainerHeader parsed = ContainerHeader::parse(bytes.data(), ContainerHeader::FIXED_SIZE);
+    ASSERT_EQ(header.chunkTableSize(), parsed.chunkTableSize());
+    parsed.parseChunkTable(bytes.data() + ContainerHeader::FIXED_SIZE);
+    EXPECT_EQ(99u, parsed.shard().payloadId);
+    EXPECT_EQ(1u, parsed.shard().index);
+    EXPECT_EQ(3u, parsed.shard().count);
+    EXPECT_EQ(4000u, parsed.shard().dataOffset);
+    EXPECT_EQ(2500u, parsed.shard().length);
+    EXPECT_EQ(9000u, parsed.shard().totalLength);
+    EXPECT_EQ(2000u, parsed.chunks()[2].offset);
+
+    // the record is covered by the table checksum
+    bytes[ContainerHeader::FIXED_SIZE + 8] ^= 1;
+    EXPECT_THROW(parsed.parseChunkTable(bytes.data() + ContainerHeader::FIXED_SIZE), std::runtime_error);
+
+    EXPECT_THROW(header.setShard({99, 3, 3, 0, 2500, 9000}), std::runtime_error);
+    EXPECT_THROW(header.setShard({99, 0, 1, 7000, 2500, 9000}), std::runtime_error);
+    EXPECT_THROW(header.setShard({99, 0, 1, 0, 2000, 9000}), std::runtime_error);
+    EXPECT_THROW(ContainerHeader(ContainerFormat::Legacy, 100).setShard({99, 0, 1, 0, 100, 100}), std::runtime_error);
+    EXPECT_THROW(ContainerHeader(ContainerFormat::Chunked, 100, 1000, ContainerHeader::FLAG_SHARD), std::runtime_error);
+}
+
+TEST(ShardTests, EmbedAndReassembleInAnyOrder) {
+    std::vector<std::string> covers;
+    std::vector<std::string> destinations;
+    std::vector<char> payload;
+    createShardFiles(covers, destinations, payload);
+
+    // no single cover holds the payload
+    EXPECT_THROW(Steganography().embed(covers[2], "ShardTests/payload.bin", "ShardTests/whole.bmp", 3), std::runtime_error);
+
+    auto shards = embedSharded(covers, "ShardTests/payload.bin", destinations, 3, 2);
+    ASSERT_EQ(3u, shards.size());
+    EXPECT_GT(shards[0].length, shards[1].length);
+    EXPECT_GT(shards[2].length, shards[0].length);
+    for (std::size_t i = 0; i < shards.size(); i++)
+    {
+        ContainerShard shard = Steganography().readShard(destinations[i], 3);
+        EXPECT_EQ(shards[i].payloadId, shard.payloadId);
+        EXPECT_EQ(i, shard.index);
+        EXPECT_EQ(shards[i].dataOffset, shard.dataOffset);
+
+        // each shard also extracts on its own as its range of the payload
+        Steganography().extract(destinations[i], "ShardTests/part.bin", 3);
+        EXPECT_EQ(std::vector<char>(payload.begin() + shard.dataOffset, payload.begin() + shard.dataOffset + shard.length), readFileBytes("ShardTests/part.bin"));
+    }
+
+    std::vector<std::string> shuffled = {destinations[2], destinations[0], destinations[1]};
+    EXPECT_EQ(2500u, extractSharded(shuffled, "ShardTests/output.bin", 3, 3));
+    EXPECT_EQ(payload, readFileBytes("ShardTests/output.bin"));
+
+    // missing, duplicated and foreign shards are rejected before anything is written
+    EXPECT_THROW(extractSharded({destinations[0], destinations[1]}, "ShardTests/output.bin", 3, 2), std::runtime_error);
+    EXPECT_THROW(extractSharded({destinations[0], destinations[1], destinations[1]}, "ShardTests/output.bin", 3, 2), std::runtime_error);
+    std::filesystem::copy_file(destinations[1], "ShardTests/first1.bmp");
+    embedSharded(covers, "ShardTests/payload.bin", destinations, 3, 1);
+    EXPECT_THROW(extractSharded({destinations[0], "ShardTests/first1.bmp", destinations[2]}, "ShardTests/output.bin", 3, 2), std::runtime_error);
+    EXPECT_THROW(Steganography().readShard(covers[0], 3), std::runtime_error);
+
+    // a payload larger than all the covers leaves no destination behind
+    std::ofstream("ShardTests/large.bin", std::ios::binary) << std::string(3000, 'x');
+    std::filesystem::remove_all("ShardTests/shard0.bmp");
+    EXPECT_THROW(embedSharded(covers, "ShardTests/large.bin", destinations, 3, 2), std::runtime_error);
+    EXPECT_FALSE(std::filesystem::exists(destinations[0]));
+
+    // Clean up
+    std::filesystem::remove_all("ShardTests");
+}
+
+TEST(ShardTests, ShardsOfEveryEmbedPath) {
+    std::vector<std::string> covers;
+    std::vector<std::string> destinations;
+    std::vector<char> payload;
+    createShardFiles(covers, destinations, payload);
+
+    // the pipelined and compressed paths read the range of the shard from the source file too
+    Steganography compressed;
+    compressed.setCompression(true);
+    std::vector<std::uint64_t> capacities;
+    for (const auto &cover : covers)
+    {
+        capacities.push_back(compressed.shardCapacity(cover, 3));
+    }
+    EXPECT_EQ(450u - ContainerHeader::FIXED_SIZE - ContainerHeader::SHARD_RECORD_SIZE - ContainerHeader::COMPRESSED_CHUNK_ENTRY_SIZE, capacities[1]);
+    auto shards = planShards(capacities, payload.size(), 5);
+    Steganography pipelined;
+    pipelined.setPipelining(true);
+    pipelined.embedShard(covers[0], "ShardTests/payload.bin", shards[0], destinations[0], 3);
+    compressed.embedShard(covers[1], "ShardTests/payload.bin", shards[1], destinations[1], 3);
+    Steganography parallel;
+    parallel.setThreadCount(3);
+    parallel.embedShard(covers[2], "ShardTests/payload.bin", shards[2], destinations[2], 3);
+    EXPECT_EQ(payload.size(), extractSharded(destinations, "ShardTests/output.bin", 3, 1));
+    EXPECT_EQ(payload, readFileBytes("ShardTests/output.bin"));
+
+    // a shard must come from the file it was planned for
+    auto other = planShards({900}, 10, 5);
+    EXPECT_THROW(Steganography().embedShard(covers[0], "ShardTests/payload.bin", other[0], "ShardTests/other.bmp", 3), std::runtime_error);
+
+    std::vector<std::string> embedArguments = {"steganography", "embed-shards", "ShardTests/payload.bin", "3", covers[0], destinations[0], covers[1], destinations[1],
+                                               covers[2], destinations[2], "--workers", "2", "--compression", "lz4"};
+    std::vector<char*> argv;
+    for (auto &argument : embedArguments)
+    {
+        argv.push_back(argument.data());
+    }
+    EXPECT_EQ(SteganographyLib::SUCCESS, SteganographyLib::mainWrapper(static_cast<int>(argv.size()), argv.data()));
+    EXPECT_EQ(SteganographyLib::ERROR_CODE_INVALID_ARGUMENTS, SteganographyLib::mainWrapper(5, argv.data()));
+
+    std::vector<std::string> extractArguments = {"steganography", "extract-shards", "ShardTests/cli.bin", "3", destinations[1], destinations[2], destinations[0]};
+    argv.clear();
+    for (auto &argument : extractArguments)
+    {
+        argv.push_back(argument.data());
+    }
+    EXPECT_EQ(SteganographyLib::SUCCESS, SteganographyLib::mainWrapper(static_cast<int>(argv.size()), argv.data()));
+    EXPECT_EQ(payload, readFileBytes("ShardTests/cli.bin"));
+
+    // Clean up
+    std::filesystem::remove_all("ShardTests");
+}
@@ -1,7 +1,13 @@
 #include <gtest/gtest.h>
 #include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
 #include "../steganography.h"
 #include "../program_wrapper.h"
+#include "test_util.h"
 
 using namespace SteganographyLib;
 
@@ -135,3 +141,1103 @@ TEST(SteganographyTests, ExtractInvalidBitsPerPixel) {
     // Call the extract method and expect an exception
     EXPECT_THROW(steg.extract(sourceBitmapFilePath, destinationDataFilePath, invalidBitsPerPixel), std::runtime_error);
 }
+
+TEST(SteganographyTests, EmbedMatchesReferenceBitmap) {
+    Steganography steg;
+    steg.setContainerFormat(ContainerFormat::Legacy);
+    std::string destinationDataFilePath = "EmbedMatchesReferenceBitmap_6bits.bmp";
+
+    // The packing engine must keep producing the format of the reference bitmap bit for bit
+    EXPECT_NO_THROW(steg.embed("../../../data/sample.bmp", "../../../data/sampleInput.txt", destinationDataFilePath, 6));
+    EXPECT_EQ(readFileBytes("../../../data/embedded_6bits.bmp"), readFileBytes(destinationDataFilePath));
+
+    // Clean up
+    std::filesystem::remove(destinationDataFilePath);
+}
+
+TEST(SteganographyTests, ExtractMatchesReferenceText) {
+    Steganography steg;
+    std::string destinationDataFilePath = "ExtractMatchesReferenceText_output.txt";
+
+    EXPECT_NO_THROW(steg.extract("../../../data/embedded_6bits.bmp", destinationDataFilePath, 6));
+    EXPECT_EQ(readFileBytes("../../../data/sampleInput.txt"), readFileBytes(destinationDataFilePath));
+
+    // Clean up
+    std::filesystem::remove(destinationDataFilePath);
+}
+
+TEST(SteganographyTests, MemoryMappedMatchesLoadedBitmap) {
+    Steganography loaded;
+    Steganography mapped;
+    mapped.setMemoryMapping(true);
+
+    for (std::uint8_t bitsPerPixel : {3, 6, 12, 24})
+    {
+        EXPECT_NO_THROW(loaded.embed("../../../data/sample.bmp", "../../../data/sampleInput.txt", "MemoryMapped_loaded.bmp", bitsPerPixel));
+        EXPECT_NO_THROW(mapped.embed("../../../data/sample.bmp", "../../../data/sampleInput.txt", "MemoryMapped_mapped.bmp", bitsPerPixel));
+
+        // the mapped embed keeps the original header, the pixels must be identical
+        auto loadedBytes = readFileBytes("MemoryMapped_loaded.bmp");
+        auto mappedBytes = readFileBytes("MemoryMapped_mapped.bmp");
+        ASSERT_EQ(loadedBytes.size(), mappedBytes.size());
+        EXPECT_TRUE(std::equal(loadedBytes.begin() + sizeof(bmp::BitmapHeader), loadedBytes.end(), mappedBytes.begin() + sizeof(bmp::BitmapHeader)));
+
+        EXPECT_NO_THROW(mapped.extract("MemoryMapped_mapped.bmp", "MemoryMapped_output.txt", bitsPerPixel));
+        if (bitsPerPixel <= 8)
+        {
+            EXPECT_EQ(readFileBytes("../../../data/sampleInput.txt"), readFileBytes("MemoryMapped_output.txt"));
+        }
+    }
+
+    // the original bitmap is never modified through the copy-on-write mapping
+    EXPECT_NO_THROW(mapped.extract("../../../data/embedded_6bits.bmp", "MemoryMapped_output.txt", 6));
+    EXPECT_EQ(readFileBytes("../../../data/sampleInput.txt"), readFileBytes("MemoryMapped_output.txt"));
+
+    // Clean up
+    std::filesystem::remove("MemoryMapped_loaded.bmp");
+    std::filesystem::remove("MemoryMapped_mapped.bmp");
+    std::filesystem::remove("MemoryMapped_output.txt");
+}
+
+TEST(SteganographyTests, MemoryMappedInvalidBitmapPath) {
+    Steganography steg;
+    steg.setMemoryMapping(true);
+    EXPECT_THROW(steg.extract("nonexistent_bitmap.bmp", "output_data.txt", 6), std::runtime_error);
+
+    // a height that cannot be negated into a row count, and rows past the end of the file
+    for (std::int32_t height : {INT32_MIN, INT32_MAX, -3})
+    {
+        auto bytes = readFileBytes("../../../data/sample.bmp");
+        bmp::BitmapHeader header;
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        header.height = height;
+        std::memcpy(bytes.data(), &header, sizeof(header));
+        bytes.resize(height == -3 ? sizeof(header) + 2 * 1044 : bytes.size());
+        std::ofstream("MemoryMapped_invalid.bmp", std::ios::binary).write(bytes.data(), bytes.size());
+
+        bmp::MappedBitmap mapped;
+        EXPECT_THROW(mapped.open("MemoryMapped_invalid.bmp"), bmp::Exception) << "height " << height;
+        EXPECT_THROW(steg.extract("MemoryMapped_invalid.bmp", "output_data.txt", 6), std::runtime_error) << "height " << height;
+    }
+    std::filesystem::remove("MemoryMapped_invalid.bmp");
+}
+
+TEST(SteganographyTests, PatchOutputMatchesRewrite) {
+    auto originalBytes = readFileBytes("../../../data/sample.bmp");
+    auto referenceBytes = readFileBytes("../../../data/embedded_6bits.bmp");
+
+    for (bool memoryMapping : {false, true})
+    {
+        Steganography steg;
+        steg.setMemoryMapping(memoryMapping);
+        steg.setOutputMode(OutputMode::Patch);
+        steg.setContainerFormat(ContainerFormat::Legacy);
+        EXPECT_NO_THROW(steg.embed("../../../data/sample.bmp", "../../../data/sampleInput.txt", "PatchOutput_6bits.bmp", 6));
+
+        // the header is the original one and the pixels match a full rewrite
+        auto patchedBytes = readFileBytes("PatchOutput_6bits.bmp");
+        ASSERT_EQ(originalBytes.size(), patchedBytes.size());
+        EXPECT_TRUE(std::equal(originalBytes.begin(), originalBytes.begin() + sizeof(bmp::BitmapHeader), patchedBytes.begin()));
+        EXPECT_TRUE(std::equal(referenceBytes.begin() + sizeof(bmp::BitmapHeader), referenceBytes.end(), patchedBytes.begin() + sizeof(bmp::BitmapHeader)));
+    }
+
+    // Clean up
+    std::filesystem::remove("PatchOutput_6bits.bmp");
+}
+
+TEST(SteganographyTests, PatchOntoOriginalIsRefused) {
+    auto originalBytes = readFileBytes("../../../data/sample.bmp");
+
+    for (bool memoryMapping : {false, true})
+    {
+        std::filesystem::copy_file("../../../data/sample.bmp", "PatchOriginal.bmp", std::filesystem::copy_options::overwrite_existing);
+        Steganography steg;
+        steg.setMemoryMapping(memoryMapping);
+        steg.setOutputMode(OutputMode::Patch);
+        EXPECT_THROW(steg.embed("PatchOriginal.bmp", "../../../data/sampleInput.txt", "PatchOriginal.bmp", 6), std::runtime_error);
+        EXPECT_THROW(steg.embed("PatchOriginal.bmp", "../../../data/sampleInput.txt", "./PatchOriginal.bmp", 6), std::runtime_error);
+
+        // the original is neither truncated nor removed
+        EXPECT_EQ(originalBytes, readFileBytes("PatchOriginal.bmp"));
+    }
+
+    // Clean up
+    std::filesystem::remove("PatchOriginal.bmp");
+}
+
+TEST(SteganographyTests, MultiThreadedMatchesSingleThreaded) {
+    // a payload large enough to be split into several segments, in a cover large enough for it at 3 bits per pixel
+    std::vector<char> payload(60000);
+    for (std::size_t i = 0; i < payload.size(); i++)
+    {
+        payload[i] = static_cast<char>((i * 2654435761u) >> 13);
+    }
+    std::ofstream("MultiThreaded_payload.bin", std::ios::binary).write(payload.data(), payload.size());
+    bmp::Bitmap cover(400, 420);
+    for (std::size_t i = 0; i < static_cast<std::size_t>(cover.width()) * static_cast<std::size_t>(cover.height()); i++)
+    {
+        cover[i] = bmp::Pixel(static_cast<std::uint8_t>(i), static_cast<std::uint8_t>(i >> 8), static_cast<std::uint8_t>(i >> 16));
+    }
+    cover.save("MultiThreaded_cover.bmp");
+
+    Steganography single;
+    for (std::size_t threadCount : {2, 3, 8})
+    {
+        Steganography threaded;
+        threaded.setThreadCount(threadCount);
+        for (std::uint8_t bitsPerPixel : {3, 6, 9, 24})
+        {
+            EXPECT_NO_THROW(single.embed("MultiThreaded_cover.bmp", "MultiThreaded_payload.bin", "MultiThreaded_single.bmp", bitsPerPixel));
+            EXPECT_NO_THROW(threaded.embed("MultiThreaded_cover.bmp", "MultiThreaded_payload.bin", "MultiThreaded_threaded.bmp", bitsPerPixel));
+            EXPECT_EQ(readFileBytes("MultiThreaded_single.bmp"), readFileBytes("MultiThreaded_threaded.bmp")) << "bitsPerPixel " << int(bitsPerPixel);
+
+            EXPECT_NO_THROW(single.extract("MultiThreaded_single.bmp", "MultiThreaded_single.bin", bitsPerPixel));
+            EXPECT_NO_THROW(threaded.extract("MultiThreaded_single.bmp", "MultiThreaded_threaded.bin", bitsPerPixel));
+            EXPECT_EQ(readFileBytes("MultiThreaded_single.bin"), readFileBytes("MultiThreaded_threaded.bin")) << "bitsPerPixel " << int(bitsPerPixel);
+        }
+
+        // the reference bitmap, small enough for a single segment
+        threaded.setContainerFormat(ContainerFormat::Legacy);
+        EXPECT_NO_THROW(threaded.embed("../../../data/sample.bmp", "../../../data/sampleInput.txt", "MultiThreaded_threaded.bmp", 6));
+        EXPECT_EQ(readFileBytes("../../../data/embedded_6bits.bmp"), readFileBytes("MultiThreaded_threaded.bmp"));
+        threaded.setContainerFormat(ContainerFormat::Chunked);
+
+        // patching finds the rows written by the segments
+        threaded.setMemoryMapping(true);
+        threaded.setOutputMode(OutputMode::Patch);
+        EXPECT_NO_THROW(single.embed("MultiThreaded_cover.bmp", "MultiThreaded_payload.bin", "MultiThreaded_single.bmp", 3));
+        EXPECT_NO_THROW(threaded.embed("MultiThreaded_cover.bmp", "MultiThreaded_payload.bin", "MultiThreaded_threaded.bmp", 3));
+        EXPECT_EQ(readFileBytes("MultiThreaded_single.bmp"), readFileBytes("MultiThreaded_threaded.bmp"));
+    }
+
+    // Clean up
+    for (auto file : {"MultiThreaded_payload.bin", "MultiThreaded_cover.bmp", "MultiThreaded_single.bmp", "MultiThreaded_threaded.bmp", "MultiThreaded_single.bin", "MultiThreaded_threaded.bin"})
+    {
+        std::filesystem::remove(file);
+    }
+}
+
+TEST(SteganographyTests, ChunkedFormatCarriesLargePayloads) {
+    // more than the 64 KB of the legacy format, and more than one chunk
+    std::vector<char> payload(ContainerHeader::DEFAULT_CHUNK_SIZE + 1000);
+    for (std::size_t i = 0; i < payload.size(); i++)
+    {
+        payload[i] = static_cast<char>((i * 2246822519u) >> 11);
+    }
+    std::ofstream("ChunkedFormat_payload.bin", std::ios::binary).write(payload.data(), payload.size());
+    bmp::Bitmap cover(1500, 1000);
+    cover.save("ChunkedFormat_cover.bmp");
+
+    Steganography legacy;
+    legacy.setContainerFormat(ContainerFormat::Legacy);
+    EXPECT_THROW(legacy.embed("ChunkedFormat_cover.bmp", "ChunkedFormat_payload.bin", "ChunkedFormat_embedded.bmp", 6), std::runtime_error);
+
+    Steganography single;
+    Steganography threaded;
+    threaded.setThreadCount(3);
+    EXPECT_NO_THROW(single.embed("ChunkedFormat_cover.bmp", "ChunkedFormat_payload.bin", "ChunkedFormat_embedded.bmp", 6));
+    EXPECT_NO_THROW(threaded.embed("ChunkedFormat_cover.bmp", "ChunkedFormat_payload.bin", "ChunkedFormat_threaded.bmp", 6));
+    EXPECT_EQ(readFileBytes("ChunkedFormat_embedded.bmp"), readFileBytes("ChunkedFormat_threaded.bmp"));
+
+    EXPECT_NO_THROW(single.extract("ChunkedFormat_embedded.bmp", "ChunkedFormat_output.bin", 6));
+    EXPECT_EQ(payload, readFileBytes("ChunkedFormat_output.bin"));
+    EXPECT_NO_THROW(threaded.extract("ChunkedFormat_embedded.bmp", "ChunkedFormat_output.bin", 6));
+    EXPECT_EQ(payload, readFileBytes("ChunkedFormat_output.bin"));
+
+    // the legacy reference bitmap is still recognized
+    EXPECT_NO_THROW(threaded.extract("../../../data/embedded_6bits.bmp", "ChunkedFormat_output.bin", 6));
+    EXPECT_EQ(readFileBytes("../../../data/sampleInput.txt"), readFileBytes("ChunkedFormat_output.bin"));
+
+    // Clean up
+    for (auto file : {"ChunkedFormat_payload.bin", "ChunkedFormat_cover.bmp", "ChunkedFormat_embedded.bmp", "ChunkedFormat_threaded.bmp", "ChunkedFormat_output.bin"})
+    {
+        std::filesystem::remove(file);
+    }
+}
+
+TEST(SteganographyTests, ExtractRangeMatchesExtract) {
+    Steganography steg;
+
+    // legacy reference bitmap
+    auto text = readFileBytes("../../../data/sampleInput.txt");
+    EXPECT_EQ(std::vector<char>(text.begin() + 100, text.begin() + 150), steg.extractRange("../../../data/embedded_6bits.bmp", 100, 50, 6));
+    EXPECT_EQ(text, steg.extractRange("../../../data/embedded_6bits.bmp", 0, text.size(), 6));
+    EXPECT_THROW(steg.extractRange("../../../data/embedded_6bits.bmp", text.size() - 10, 11, 6), std::runtime_error);
+
+    // chunked payload, with ranges that start and end in the middle of channel bytes and rows
+    std::vector<char> payload(70000);
+    for (std::size_t i = 0; i < payload.size(); i++)
+    {
+        payload[i] = static_cast<char>((i * 2654435761u) >> 17);
+    }
+    std::ofstream("ExtractRange_payload.bin", std::ios::binary).write(payload.data(), payload.size());
+    bmp::Bitmap cover(501, 420);
+    cover.save("ExtractRange_cover.bmp");
+
+    for (std::uint8_t bitsPerPixel : {3, 6})
+    {
+        EXPECT_NO_THROW(steg.embed("ExtractRange_cover.bmp", "ExtractRange_payload.bin", "ExtractRange_embedded.bmp", bitsPerPixel));
+        for (std::size_t offset : {0, 1, 37, 4097, 69999})
+        {
+            std::size_t length = std::min<std::size_t>(payload.size() - offset, 333);
+            EXPECT_EQ(std::vector<char>(payload.begin() + offset, payload.begin() + offset + length), steg.extractRange("ExtractRange_embedded.bmp", offset, length, bitsPerPixel))
+                << "bitsPerPixel " << int(bitsPerPixel) << " offset " << offset;
+        }
+        EXPECT_TRUE(steg.extractRange("ExtractRange_embedded.bmp", payload.size(), 0, bitsPerPixel).empty());
+    }
+
+    // the command line writes the range to the destination file
+    char* argv[] = {(char*)"steganography", (char*)"extract", (char*)"ExtractRange_embedded.bmp", (char*)"ExtractRange_output.bin", (char*)"6", (char*)"--range", (char*)"4097:10"};
+    EXPECT_EQ(SteganographyLib::SUCCESS, SteganographyLib::mainWrapper(7, argv));
+    EXPECT_EQ(std::vector<char>(payload.begin() + 4097, payload.begin() + 4107), readFileBytes("ExtractRange_output.bin"));
+    for (const char *invalidRange : {"--range=4097", "--range=foo:bar", "--range=10:", "--range=:10", "--range=-1:10", "--range=10:5x", "--range=99999999999999999999:1"})
+    {
+        std::filesystem::remove("ExtractRange_output.bin");
+        char* invalidArgv[] = {(char*)"steganography", (char*)"extract", (char*)"ExtractRange_embedded.bmp", (char*)"ExtractRange_output.bin", (char*)"6", (char*)invalidRange};
+        EXPECT_EQ(SteganographyLib::ERROR_CODE_INVALID_ARGUMENTS, SteganographyLib::mainWrapper(6, invalidArgv)) << invalidRange;
+        EXPECT_FALSE(std::filesystem::exists("ExtractRange_output.bin")) << invalidRange;
+    }
+    char* unwritableArgv[] = {(char*)"steganography", (char*)"extract", (char*)"ExtractRange_embedded.bmp", (char*)"ExtractRange_missing/output.bin", (char*)"6", (char*)"--range", (char*)"4097:10"};
+    EXPECT_EQ(SteganographyLib::ERROR_CODE_WRITE_FAILED, SteganographyLib::mainWrapper(7, unwritableArgv));
+
+    // Clean up
+    for (auto file : {"ExtractRange_payload.bin", "ExtractRange_cover.bmp", "ExtractRange_embedded.bmp", "ExtractRange_output.bin"})
+    {
+        std::filesystem::remove(file);
+    }
+}
+
+TEST(SteganographyTests, ProbeReportsPayload) {
+    Steganography steg;
+
+    // legacy reference bitmap: 2 header bytes and the text
+    ProbeResult result = steg.probe("../../../data/embedded_6bits.bmp", 6);
+    auto textSize = std::filesystem::file_size("../../../data/sampleInput.txt");
+    EXPECT_EQ(ContainerFormat::Legacy, result.format);
+    EXPECT_EQ(textSize, result.payloadLength);
+    EXPECT_TRUE(result.plausible);
+    EXPECT_EQ(result.capacity - 2 - textSize, result.remainingCapacity);
+
+    // chunked header
+    EXPECT_NO_THROW(steg.embed("../../../data/sample.bmp", "../../../data/sampleInput.txt", "Probe_embedded.bmp", 3));
+    result = steg.probe("Probe_embedded.bmp", 3);
+    EXPECT_EQ(ContainerFormat::Chunked, result.format);
+    EXPECT_EQ(textSize, result.payloadLength);
+    EXPECT_TRUE(result.plausible);
+    EXPECT_EQ(result.capacity - ContainerHeader(ContainerFormat::Chunked, textSize).size() - textSize, result.remainingCapacity);
+
+    // the wrong density finds no chunked header
+    EXPECT_NE(ContainerFormat::Chunked, steg.probe("Probe_embedded.bmp", 6).format);
+
+    char* argv[] = {(char*)"steganography", (char*)"probe", (char*)"Probe_embedded.bmp", (char*)"3"};
+    EXPECT_EQ(SteganographyLib::SUCCESS, SteganographyLib::mainWrapper(4, argv));
+    EXPECT_EQ(SteganographyLib::ERROR_CODE_INVALID_ARGUMENTS, SteganographyLib::mainWrapper(3, argv));
+    EXPECT_THROW(steg.probe("nonexistent_bitmap.bmp", 3), std::runtime_error);
+
+    // Clean up
+    std::filesystem::remove("Probe_embedded.bmp");
+}
+
+TEST(SteganographyTests, StreamsAndBuffersMatchFiles) {
+    auto originalBytes = readFileBytes("../../../data/sample.bmp");
+    auto referenceBytes = readFileBytes("../../../data/embedded_6bits.bmp");
+    auto textBytes = readFileBytes("../../../data/sampleInput.txt");
+
+    for (std::size_t threadCount : {1, 2})
+    {
+        Steganography steg;
+        steg.setContainerFormat(ContainerFormat::Legacy);
+        steg.setThreadCount(threadCount);
+
+        // streams produce the file of the reference bitmap
+        std::ifstream originalStream("../../../data/sample.bmp", std::ios::binary);
+        std::ifstream textStream("../../../data/sampleInput.txt", std::ios::binary);
+        std::ostringstream embeddedStream;
+        EXPECT_NO_THROW(steg.embed(originalStream, textStream, embeddedStream, 6));
+        std::string embeddedBytes = embeddedStream.str();
+        EXPECT_TRUE(std::equal(referenceBytes.begin(), referenceBytes.end(), embeddedBytes.begin(), embeddedBytes.end()));
+
+        std::istringstream encodedStream(embeddedBytes);
+        std::ostringstream extractedStream;
+        EXPECT_NO_THROW(steg.extract(encodedStream, extractedStream, 6));
+        EXPECT_EQ(std::string(textBytes.begin(), textBytes.end()), extractedStream.str());
+
+        // buffers are encoded in place, keeping their own header
+        std::vector<std::uint8_t> bitmapBuffer(originalBytes.begin(), originalBytes.end());
+        EXPECT_NO_THROW(steg.embed(bitmapBuffer.data(), bitmapBuffer.size(), textBytes.data(), textBytes.size(), 6));
+        std::vector<char> bufferBytes(bitmapBuffer.begin(), bitmapBuffer.end());
+        ASSERT_EQ(referenceBytes.size(), bufferBytes.size());
+        EXPECT_TRUE(std::equal(originalBytes.begin(), originalBytes.begin() + sizeof(bmp::BitmapHeader), bufferBytes.begin()));
+        EXPECT_TRUE(std::equal(referenceBytes.begin() + sizeof(bmp::BitmapHeader), referenceBytes.end(), bufferBytes.begin() + sizeof(bmp::BitmapHeader)));
+
+        std::vector<char> extracted;
+        EXPECT_NO_THROW(extracted = steg.extract(bitmapBuffer.data(), bitmapBuffer.size(), 6));
+        EXPECT_EQ(textBytes, extracted);
+    }
+
+    // the bitmap saves to and loads from memory exactly as it does with files
+    bmp::Bitmap bitmap;
+    bitmap.load(reinterpret_cast<const std::uint8_t *>(referenceBytes.data()), referenceBytes.size());
+    std::vector<std::uint8_t> savedBytes;
+    bitmap.save(savedBytes);
+    bitmap.save("StreamsAndBuffers_saved.bmp");
+    auto fileBytes = readFileBytes("StreamsAndBuffers_saved.bmp");
+    EXPECT_EQ(fileBytes, std::vector<char>(savedBytes.begin(), savedBytes.end()));
+
+    Steganography steg;
+    std::vector<std::uint8_t> truncated(savedBytes.begin(), savedBytes.begin() + 100);
+    EXPECT_THROW(steg.extract(truncated.data(), truncated.size(), 6), std::runtime_error);
+
+    // Clean up
+    std::filesystem::remove("StreamsAndBuffers_saved.bmp");
+}
+
+TEST(SteganographyTests, ProgressCancellationAndDeadline) {
+    // payloads smaller than the number of progress clicks report every byte
+    std::ofstream("Progress_small.bin", std::ios::binary) << "abc";
+    std::vector<int> percentages;
+    Steganography steg;
+    steg.registerProgressCallback([&](int percent) { percentages.push_back(percent); }, 10);
+    EXPECT_NO_THROW(steg.embed("../../../data/sample.bmp", "Progress_small.bin", "Progress_embedded.bmp", 6));
+    EXPECT_EQ((std::vector<int>{34, 67, 100}), percentages);
+    EXPECT_EQ(3u, steg.bytesDone());
+    EXPECT_EQ(3u, steg.bytesTotal());
+    EXPECT_THROW(steg.registerProgressCallback([](int) {}, 0), std::runtime_error);
+
+    // a payload of several blocks
+    std::vector<char> payload(300000);
+    for (std::size_t i = 0; i < payload.size(); i++)
+    {
+        payload[i] = static_cast<char>((i * 2654435761u) >> 13);
+    }
+    std::ofstream("Progress_payload.bin", std::ios::binary).write(payload.data(), payload.size());
+    bmp::Bitmap(1000, 1000).save("Progress_cover.bmp");
+
+    for (std::size_t threadCount : {1, 3})
+    {
+        Steganography steg;
+        steg.setThreadCount(threadCount);
+
+        // time sampled callbacks always report completion
+        percentages.clear();
+        steg.registerProgressCallback([&](int percent) { percentages.push_back(percent); }, std::chrono::milliseconds(1));
+        EXPECT_NO_THROW(steg.embed("Progress_cover.bmp", "Progress_payload.bin", "Progress_embedded.bmp", 6));
+        ASSERT_FALSE(percentages.empty());
+        EXPECT_EQ(100, percentages.back());
+
+        // cancelling from the callback stops the extract after the current block, without leaving a partial file
+        auto token = std::make_shared<CancellationToken>();
+        steg.setCancellationToken(token);
+        steg.registerProgressCallback([&](int) { token->cancel(); }, 1);
+        EXPECT_THROW(steg.extract("Progress_embedded.bmp", "Progress_output.bin", 6), OperationCancelled);
+        if (threadCount == 1)
+        {
+            // the parallel engine decodes this payload in a single window
+            EXPECT_LT(steg.bytesDone(), payload.size());
+        }
+        EXPECT_FALSE(std::filesystem::exists("Progress_output.bin"));
+
+        // a cancelled token stops embed before it writes anything
+        std::filesystem::remove("Progress_embedded.bmp");
+        EXPECT_THROW(steg.embed("Progress_cover.bmp", "Progress_payload.bin", "Progress_embedded.bmp", 6), OperationCancelled);
+        EXPECT_FALSE(std::filesystem::exists("Progress_embedded.bmp"));
+
+        // so does a deadline in the past
+        steg.setCancellationToken(nullptr);
+        steg.setDeadline(std::chrono::steady_clock::now());
+        EXPECT_THROW(steg.embed("Progress_cover.bmp", "Progress_payload.bin", "Progress_embedded.bmp", 6), OperationCancelled);
+        EXPECT_FALSE(std::filesystem::exists("Progress_embedded.bmp"));
+
+        steg.setDeadline(std::chrono::steady_clock::time_point::max());
+        EXPECT_NO_THROW(steg.embed("Progress_cover.bmp", "Progress_payload.bin", "Progress_embedded.bmp", 6));
+        EXPECT_NO_THROW(steg.extract("Progress_embedded.bmp", "Progress_output.bin", 6));
+        EXPECT_EQ(payload, readFileBytes("Progress_output.bin"));
+    }
+
+    // Clean up
+    for (auto file : {"Progress_small.bin", "Progress_payload.bin", "Progress_cover.bmp", "Progress_embedded.bmp", "Progress_output.bin"})
+    {
+        std::filesystem::remove(file);
+    }
+}
+
+TEST(SteganographyTests, StatsCountTheWorkDone) {
+    auto payloadSize = std::filesystem::file_size("../../../data/sampleInput.txt");
+    auto coverSize = std::filesystem::file_size("../../../data/sample.bmp");
+
+    Steganography steg;
+    steg.setDetailedStats(true);
+    EXPECT_NO_THROW(steg.embed("../../../data/sample.bmp", "../../../data/sampleInput.txt", "Stats_embedded.bmp", 6));
+    OperationStats stats = steg.lastStats();
+    std::uint64_t channels = ((ContainerHeader(ContainerFormat::Chunked, payloadSize).size() + payloadSize) * 8 + 5) / 6;
+    EXPECT_EQ(payloadSize, stats.payloadBytes);
+    EXPECT_EQ(coverSize + payloadSize, stats.bytesRead);
+    EXPECT_EQ(std::filesystem::file_size("Stats_embedded.bmp"), stats.bytesWritten);
+    EXPECT_EQ(channels - 2, stats.pixelsTouched);
+    EXPECT_GT(stats.channelBytesModified, 0u);
+    EXPECT_LE(stats.channelBytesModified, channels);
+    EXPECT_GE(stats.peakBufferBytes, 347u * 462u * sizeof(bmp::Pixel));
+    EXPECT_GE(stats.total.wallMilliseconds, stats.payload.wallMilliseconds);
+    EXPECT_EQ(0u, formatStatsJson("embed", stats).find("{\"operation\": \"embed\", \"load\": {\"wallMilliseconds\": "));
+
+    // extract writes the payload, and only counts modified channels when embedding
+    EXPECT_NO_THROW(steg.extract("Stats_embedded.bmp", "Stats_output.txt", 6));
+    stats = steg.lastStats();
+    EXPECT_EQ(payloadSize, stats.bytesWritten);
+    EXPECT_EQ(channels - 2, stats.pixelsTouched);
+    EXPECT_EQ(0u, stats.channelBytesModified);
+
+    // the command line prints them instead of the progress
+    char* argv[] = {(char*)"steganography", (char*)"extract", (char*)"Stats_embedded.bmp", (char*)"Stats_output.txt", (char*)"6", (char*)"--stats", (char*)"json"};
+    EXPECT_EQ(SUCCESS, mainWrapper(7, argv));
+    argv[6] = (char*)"xml";
+    EXPECT_EQ(ERROR_CODE_INVALID_ARGUMENTS, mainWrapper(7, argv));
+
+    // Clean up
+    std::filesystem::remove("Stats_embedded.bmp");
+    std::filesystem::remove("Stats_output.txt");
+}
+
+TEST(SteganographyTests, AlphaChannelCarriesData) {
+    // a 32 bpp cover, saved and loaded with its alpha channel
+    bmp::Bitmap cover(101, 60);
+    std::uint32_t state = 0x12345678;
+    for (bmp::Pixel &pixel : cover)
+    {
+        state = state * 1664525 + 1013904223;
+        pixel = bmp::Pixel(static_cast<std::uint8_t>(state >> 24), static_cast<std::uint8_t>(state >> 16), static_cast<std::uint8_t>(state >> 8));
+    }
+    cover.set_alpha_channel(true, 200);
+    cover.save("Alpha_cover.bmp");
+    EXPECT_EQ(sizeof(bmp::BitmapHeader) + 101 * 60 * 4, std::filesystem::file_size("Alpha_cover.bmp"));
+    bmp::Bitmap loaded("Alpha_cover.bmp");
+    EXPECT_TRUE(loaded.has_alpha());
+    EXPECT_TRUE(loaded == cover);
+
+    // more data than the R bytes can hold at 6 bits per pixel
+    std::vector<char> payload(6000);
+    for (std::size_t i = 0; i < payload.size(); i++)
+    {
+        payload[i] = static_cast<char>((i * 2654435761u) >> 11);
+    }
+    std::ofstream("Alpha_payload.bin", std::ios::binary).write(payload.data(), payload.size());
+
+    Steganography steg;
+    EXPECT_THROW(steg.embed("Alpha_cover.bmp", "Alpha_payload.bin", "Alpha_embedded.bmp", 6), std::runtime_error);
+    steg.setAlphaEmbedding(true);
+    EXPECT_NO_THROW(steg.embed("Alpha_cover.bmp", "Alpha_payload.bin", "Alpha_embedded.bmp", 6));
+    auto reference = readFileBytes("Alpha_embedded.bmp");
+    EXPECT_TRUE(bmp::Bitmap("Alpha_embedded.bmp").has_alpha());
+    EXPECT_EQ(std::filesystem::file_size("Alpha_cover.bmp"), reference.size());
+
+    // every way of reading the pixels walks the same channels
+    for (std::size_t threadCount : {1, 2})
+    {
+        Steganography mapped;
+        mapped.setAlphaEmbedding(true);
+        mapped.setMemoryMapping(true);
+        mapped.setOutputMode(OutputMode::Patch);
+        mapped.setThreadCount(threadCount);
+        EXPECT_NO_THROW(mapped.embed("Alpha_cover.bmp", "Alpha_payload.bin", "Alpha_mapped.bmp", 6));
+        EXPECT_EQ(reference, readFileBytes("Alpha_mapped.bmp"));
+        EXPECT_NO_THROW(mapped.extract("Alpha_mapped.bmp", "Alpha_output.bin", 6));
+        EXPECT_EQ(payload, readFileBytes("Alpha_output.bin"));
+
+        Steganography cached;
+        cached.setAlphaEmbedding(true);
+        cached.setCoverCache(std::make_shared<CoverCache>(64 * 1024 * 1024));
+        cached.setThreadCount(threadCount);
+        EXPECT_NO_THROW(cached.embed("Alpha_cover.bmp", "Alpha_payload.bin", "Alpha_cached.bmp", 6));
+        EXPECT_EQ(reference, readFileBytes("Alpha_cached.bmp"));
+        EXPECT_NO_THROW(cached.extract("Alpha_cached.bmp", "Alpha_output.bin", 6));
+        EXPECT_EQ(payload, readFileBytes("Alpha_output.bin"));
+    }
+
+    std::vector<char> embeddedChars = readFileBytes("Alpha_cover.bmp");
+    std::vector<std::uint8_t> buffer(embeddedChars.begin(), embeddedChars.end());
+    EXPECT_NO_THROW(steg.embed(buffer.data(), buffer.size(), payload.data(), payload.size(), 6));
+    EXPECT_EQ(reference, std::vector<char>(buffer.begin(), buffer.end()));
+    EXPECT_EQ(payload, steg.extract(buffer.data(), buffer.size(), 6));
+
+    // ranges in the R bytes, across both, and in the alpha bytes only
+    for (std::size_t offset : {0, 4000, 5500})
+    {
+        std::vector<char> range;
+        EXPECT_NO_THROW(range = steg.extractRange("Alpha_embedded.bmp", offset, 500, 6));
+        EXPECT_EQ(std::vector<char>(payload.begin() + offset, payload.begin() + offset + 500), range) << "offset " << offset;
+    }
+    ProbeResult probe = steg.probe("Alpha_embedded.bmp", 6);
+    EXPECT_TRUE(probe.plausible);
+    EXPECT_EQ(101u * 60u * 2u * 6u / 8u, probe.capacity);
+
+    // Clean up
+    for (auto file : {"Alpha_cover.bmp", "Alpha_payload.bin", "Alpha_embedded.bmp", "Alpha_mapped.bmp", "Alpha_cached.bmp", "Alpha_output.bin"})
+    {
+        std::filesystem::remove(file);
+    }
+}
+
+TEST(SteganographyTests, ParallelAlphaEmbedMatchesSingleThreaded) {
+    // segments of the color walk and of the alpha walk run over the same BGRA pixels at the same time
+    bmp::Bitmap cover(512, 512);
+    cover.set_alpha_channel(true);
+    std::uint32_t state = 0x9E3779B9;
+    for (std::size_t i = 0; i < static_cast<std::size_t>(cover.width()) * static_cast<std::size_t>(cover.height()); i++)
+    {
+        state = state * 1664525 + 1013904223;
+        cover[i] = bmp::Pixel(static_cast<std::uint8_t>(state >> 24), static_cast<std::uint8_t>(state >> 16), static_cast<std::uint8_t>(state >> 8));
+        cover.alpha()[i] = static_cast<std::uint8_t>(state);
+    }
+    cover.save("ParallelAlpha_cover.bmp");
+    std::vector<char> coverChars = readFileBytes("ParallelAlpha_cover.bmp");
+
+    std::vector<char> payload(180 * 1024);
+    for (std::size_t i = 0; i < payload.size(); i++)
+    {
+        payload[i] = static_cast<char>((i * 2654435761u) >> 9);
+    }
+    std::ofstream("ParallelAlpha_payload.bin", std::ios::binary).write(payload.data(), payload.size());
+
+    Steganography single;
+    single.setAlphaEmbedding(true);
+    std::vector<std::uint8_t> reference(coverChars.begin(), coverChars.end());
+    ASSERT_NO_THROW(single.embed(reference.data(), reference.size(), payload.data(), payload.size(), 3));
+    ASSERT_EQ(payload, single.extract(reference.data(), reference.size(), 3));
+    std::vector<char> referenceChars(reference.begin(), reference.end());
+
+    // on the buffer and on the memory mapped file, a lost write shows up in some of the runs
+    Steganography threaded;
+    threaded.setAlphaEmbedding(true);
+    threaded.setThreadCount(16);
+    Steganography mapped;
+    mapped.setAlphaEmbedding(true);
+    mapped.setThreadCount(16);
+    mapped.setMemoryMapping(true);
+    mapped.setOutputMode(OutputMode::Patch);
+    for (int run = 0; run < 20; run++)
+    {
+        std::vector<std::uint8_t> buffer(coverChars.begin(), coverChars.end());
+        ASSERT_NO_THROW(threaded.embed(buffer.data(), buffer.size(), payload.data(), payload.size(), 3));
+        ASSERT_TRUE(buffer == reference) << "run " << run;
+
+        ASSERT_NO_THROW(mapped.embed("ParallelAlpha_cover.bmp", "ParallelAlpha_payload.bin", "ParallelAlpha_mapped.bmp", 3));
+        ASSERT_EQ(referenceChars, readFileBytes("ParallelAlpha_mapped.bmp")) << "run " << run;
+    }
+    EXPECT_NO_THROW(mapped.extract("ParallelAlpha_mapped.bmp", "ParallelAlpha_output.bin", 3));
+    EXPECT_EQ(payload, readFileBytes("ParallelAlpha_output.bin"));
+
+    // Clean up
+    for (auto file : {"ParallelAlpha_cover.bmp", "ParallelAlpha_payload.bin", "ParallelAlpha_mapped.bmp", "ParallelAlpha_output.bin"})
+    {
+        std::filesystem::remove(file);
+    }
+}
+
+TEST(SteganographyTests, BitmapLoadsEveryRowLayout) {
+    for (std::int32_t width = 1; width <= 9; width++)
+    {
+        for (bool alpha : {false, true})
+        {
+            bmp::Bitmap bitmap(width, 5);
+            std::uint8_t value = 0;
+            for (bmp::Pixel &pixel : bitmap)
+            {
+                pixel = bmp::Pixel(value, static_cast<std::uint8_t>(value + 1), static_cast<std::uint8_t>(value + 2));
+                value += 3;
+            }
+            bitmap.set_alpha_channel(alpha, 7);
+
+            // rows are padded to 4 bytes
+            std::vector<std::uint8_t> bytes;
+            bitmap.save(bytes);
+            std::size_t rowStride = (static_cast<std::size_t>(width) * (alpha ? 4 : 3) + 3) / 4 * 4;
+            ASSERT_EQ(sizeof(bmp::BitmapHeader) + 5 * rowStride, bytes.size()) << "width " << width;
+
+            bmp::Bitmap loaded;
+            loaded.load(bytes.data(), bytes.size());
+            EXPECT_TRUE(loaded == bitmap) << "width " << width;
+
+            // the same pixels stored top-down
+            std::vector<std::uint8_t> topDown(bytes.begin(), bytes.begin() + sizeof(bmp::BitmapHeader));
+            for (std::size_t row = 5; row-- > 0;)
+            {
+                auto first = bytes.begin() + sizeof(bmp::BitmapHeader) + row * rowStride;
+                topDown.insert(topDown.end(), first, first + rowStride);
+            }
+            std::int32_t height = -5;
+            std::memcpy(topDown.data() + offsetof(bmp::BitmapHeader, height), &height, sizeof(height));
+            loaded.load(topDown.data(), topDown.size());
+            EXPECT_TRUE(loaded == bitmap) << "width " << width;
+
+            bytes.pop_back();
+            EXPECT_THROW(loaded.load(bytes.data(), bytes.size()), bmp::Exception);
+        }
+    }
+}
+
+TEST(SteganographyTests, BitmapSavesFilesInBlocks) {
+    // narrow rows of every padding, and a bitmap spanning several staging blocks
+    for (std::int32_t width : {1, 2, 3, 4, 5, 6, 7, 9, 1001})
+    {
+        for (bool alpha : {false, true})
+        {
+            std::int32_t height = width > 9 ? 700 : 3;
+            bmp::Bitmap bitmap(width, height);
+            std::uint32_t state = 0x9E3779B9;
+            for (bmp::Pixel &pixel : bitmap)
+            {
+                state = state * 1664525 + 1013904223;
+                pixel = bmp::Pixel(static_cast<std::uint8_t>(state >> 24), static_cast<std::uint8_t>(state >> 16), static_cast<std::uint8_t>(state >> 8));
+            }
+            bitmap.set_alpha_channel(alpha, 7);
+
+            std::vector<std::uint8_t> bytes;
+            bitmap.save(bytes);
+            ASSERT_EQ(bitmap.file_size(), bytes.size()) << "width " << width;
+
+            for (bmp::WriteMode mode : {bmp::WriteMode::Buffered, bmp::WriteMode::Direct})
+            {
+                const std::string bitmapFilePath = "saved_in_blocks.bmp";
+                bitmap.save(bitmapFilePath, mode);
+                std::vector<char> saved = readFileBytes(bitmapFilePath);
+                EXPECT_TRUE(std::equal(bytes.begin(), bytes.end(), saved.begin(), saved.end(),
+                    [](std::uint8_t byte, char savedByte) { return byte == static_cast<std::uint8_t>(savedByte); })) << "width " << width;
+
+                bmp::Bitmap loaded(bitmapFilePath);
+                EXPECT_TRUE(loaded == bitmap) << "width " << width;
+                std::filesystem::remove(bitmapFilePath);
+            }
+        }
+    }
+}
+
+TEST(SteganographyTests, BitmapSavesStopBetweenBlocks) {
+    // a bitmap of a few blocks, whose save is stopped before its second block
+    bmp::Bitmap bitmap(1001, 700);
+    bitmap.save("stopped_cover.bmp");
+    int blocks = 0;
+    auto stopAtSecondBlock = [&blocks]()
+    {
+        if (++blocks == 2)
+        {
+            throw OperationCancelled("stopped");
+        }
+    };
+
+    for (bmp::WriteMode mode : {bmp::WriteMode::Buffered, bmp::WriteMode::Direct})
+    {
+        blocks = 0;
+        EXPECT_THROW(bitmap.save("stopped_saved.bmp", std::vector<bmp::Pixel>(), mode, stopAtSecondBlock), OperationCancelled);
+        EXPECT_EQ(2, blocks);
+    }
+    blocks = 0;
+    std::ostringstream stream;
+    EXPECT_THROW(bitmap.save(stream, std::vector<bmp::Pixel>(), stopAtSecondBlock), OperationCancelled);
+    EXPECT_EQ(bmp::BITMAP_IO_BLOCK_SIZE, stream.str().size());
+
+    // the mapped file leaves no temporary file behind
+    blocks = 0;
+    bmp::MappedBitmap mapped;
+    mapped.open("stopped_cover.bmp");
+    EXPECT_THROW(mapped.save("stopped_mapped.bmp", stopAtSecondBlock), OperationCancelled);
+    EXPECT_FALSE(std::filesystem::exists("stopped_mapped.bmp.tmp"));
+    EXPECT_FALSE(std::filesystem::exists("stopped_mapped.bmp"));
+    EXPECT_NO_THROW(mapped.save("stopped_mapped.bmp", [&blocks]() { blocks++; }));
+    EXPECT_EQ(readFileBytes("stopped_cover.bmp"), readFileBytes("stopped_mapped.bmp"));
+    EXPECT_EQ(static_cast<int>(2 + (bitmap.file_size() + bmp::BITMAP_IO_BLOCK_SIZE - 1) / bmp::BITMAP_IO_BLOCK_SIZE), blocks);
+    mapped.close();
+
+    // Clean up
+    for (auto file : {"stopped_cover.bmp", "stopped_saved.bmp", "stopped_mapped.bmp"})
+    {
+        std::filesystem::remove(file);
+    }
+}
+
+TEST(SteganographyTests, PipelinedEmbedMatchesSequentialEmbed) {
+    // covers of a few blocks of rows with padded rows: bottom-up, top-down, and 32 bpp with the alpha channel used
+    const std::int32_t width = 701;
+    const std::int32_t height = 600;
+    bmp::Bitmap cover(width, height);
+    std::uint32_t state = 0x2545F491;
+    for (bmp::Pixel &pixel : cover)
+    {
+        state = state * 1664525 + 1013904223;
+        pixel = bmp::Pixel(static_cast<std::uint8_t>(state >> 24), static_cast<std::uint8_t>(state >> 16), static_cast<std::uint8_t>(state >> 8));
+    }
+    cover.save("Pipeline_bottomup.bmp");
+
+    std::vector<char> bottomUp = readFileBytes("Pipeline_bottomup.bmp");
+    std::vector<char> topDown(bottomUp.begin(), bottomUp.begin() + sizeof(bmp::BitmapHeader));
+    std::size_t rowStride = (width * 3 + 3) / 4 * 4;
+    for (std::size_t row = height; row-- > 0;)
+    {
+        auto first = bottomUp.begin() + sizeof(bmp::BitmapHeader) + row * rowStride;
+        topDown.insert(topDown.end(), first, first + rowStride);
+    }
+    std::int32_t negativeHeight = -height;
+    std::memcpy(topDown.data() + offsetof(bmp::BitmapHeader, height), &negativeHeight, sizeof(negativeHeight));
+    std::ofstream("Pipeline_topdown.bmp", std::ios::binary).write(topDown.data(), topDown.size());
+
+    cover.set_alpha_channel(true, 90);
+    cover.save("Pipeline_alpha.bmp");
+
+    for (const std::string coverPath : {"Pipeline_bottomup.bmp", "Pipeline_topdown.bmp", "Pipeline_alpha.bmp"})
+    {
+        bool alpha = coverPath == "Pipeline_alpha.bmp";
+        for (std::uint8_t bitsPerPixel = 3; bitsPerPixel <= 24; bitsPerPixel += 3)
+        {
+            // a small payload in the top rows, and one that fills the walk up to its last channels
+            std::uint64_t capacity = static_cast<std::uint64_t>(width) * height * (alpha ? 2 : 1) * bitsPerPixel / 8;
+            std::size_t fullLength = static_cast<std::size_t>(capacity - ContainerHeader(ContainerFormat::Chunked, capacity).size() - 1);
+            for (std::size_t length : {std::size_t(100), fullLength})
+            {
+                std::vector<char> payload(length);
+                for (std::size_t i = 0; i < payload.size(); i++)
+                {
+                    payload[i] = static_cast<char>((i * 2654435761u) >> 13);
+                }
+                std::ofstream("Pipeline_payload.bin", std::ios::binary).write(payload.data(), payload.size());
+
+                Steganography sequential;
+                sequential.setAlphaEmbedding(alpha);
+                ASSERT_NO_THROW(sequential.embed(coverPath, "Pipeline_payload.bin", "Pipeline_sequential.bmp", bitsPerPixel));
+
+                Steganography pipelined;
+                pipelined.setAlphaEmbedding(alpha);
+                pipelined.setPipelining(true);
+                pipelined.setDetailedStats(true);
+                ASSERT_NO_THROW(pipelined.embed(coverPath, "Pipeline_payload.bin", "Pipeline_pipelined.bmp", bitsPerPixel));
+                EXPECT_TRUE(bmp::Bitmap("Pipeline_sequential.bmp") == bmp::Bitmap("Pipeline_pipelined.bmp")) << coverPath << " " << int(bitsPerPixel) << " " << length;
+                EXPECT_EQ(length, pipelined.lastStats().payloadBytes);
+                EXPECT_EQ(std::filesystem::file_size(coverPath), pipelined.lastStats().bytesWritten);
+                EXPECT_GT(pipelined.lastStats().channelBytesModified, 0u);
+                if (coverPath == "Pipeline_bottomup.bmp")
+                {
+                    EXPECT_EQ(readFileBytes("Pipeline_sequential.bmp"), readFileBytes("Pipeline_pipelined.bmp"));
+                }
+
+                if (bitsPerPixel <= 8)
+                {
+                    // above 8 bits per pixel only part of the data is stored
+                    EXPECT_NO_THROW(pipelined.extract("Pipeline_pipelined.bmp", "Pipeline_output.bin", bitsPerPixel));
+                    EXPECT_EQ(payload, readFileBytes("Pipeline_output.bin"));
+                }
+            }
+        }
+    }
+
+    // a pipeline cancelled after its first block stops every stage and leaves no destination behind
+    std::vector<char> payload(1200 * 1000, 'p');
+    std::ofstream("Pipeline_payload.bin", std::ios::binary).write(payload.data(), payload.size());
+    std::filesystem::remove("Pipeline_pipelined.bmp");
+    Steganography cancelled;
+    auto token = std::make_shared<CancellationToken>();
+    cancelled.setPipelining(true);
+    cancelled.setCancellationToken(token);
+    cancelled.registerProgressCallback([token](int) { token->cancel(); }, 1);
+    EXPECT_THROW(cancelled.embed("Pipeline_bottomup.bmp", "Pipeline_payload.bin", "Pipeline_pipelined.bmp", 24), OperationCancelled);
+    EXPECT_FALSE(std::filesystem::exists("Pipeline_pipelined.bmp"));
+
+    for (const char *path : {"Pipeline_bottomup.bmp", "Pipeline_topdown.bmp", "Pipeline_alpha.bmp", "Pipeline_payload.bin",
+                             "Pipeline_sequential.bmp", "Pipeline_output.bin"})
+    {
+        std::filesystem::remove(path);
+    }
+}
+
+TEST(SteganographyTests, BitmapRowReaderAndWriterStreamRows) {
+    const std::int32_t width = 37;
+    const std::int32_t height = 23;
+    for (bool alpha : {false, true})
+    {
+        bmp::Bitmap image(width, height);
+        for (std::int32_t y = 0; y < height; y++)
+        {
+            for (std::int32_t x = 0; x < width; x++)
+            {
+                image.set(x, y, bmp::Pixel(static_cast<std::uint8_t>(x * 7), static_cast<std::uint8_t>(y * 11), static_cast<std::uint8_t>(x ^ y)));
+            }
+        }
+        image.set_alpha_channel(alpha, 200);
+        image.save("RowStream_saved.bmp");
+
+        // rows written bottom row first, a few at a time, give the file Bitmap saves
+        {
+            bmp::BitmapRowWriter writer("RowStream_written.bmp", width, height, alpha);
+            for (std::int32_t y = height; y > 0; y -= 5)
+            {
+                for (std::int32_t row = y - 1; row >= std::max(y - 5, 0); row--)
+                {
+                    writer.write_rows(&image[static_cast<std::size_t>(row) * width], alpha ? image.alpha() + static_cast<std::size_t>(row) * width : nullptr, 1);
+                }
+            }
+            EXPECT_EQ(static_cast<std::size_t>(height), writer.rows_written());
+            EXPECT_THROW(writer.write_rows(&image[0], image.alpha(), 1), bmp::Exception);
+            writer.close();
+        }
+        EXPECT_EQ(readFileBytes("RowStream_saved.bmp"), readFileBytes("RowStream_written.bmp"));
+
+        // rows come back in file order, and a writer copying the reader reproduces the file
+        bmp::BitmapRowReader reader("RowStream_written.bmp");
+        EXPECT_EQ(width, reader.width());
+        EXPECT_EQ(height, reader.height());
+        EXPECT_EQ(alpha ? 4u : 3u, reader.pixel_size());
+        bmp::BitmapRowWriter copy("RowStream_copy.bmp", reader);
+        std::vector<bmp::Pixel> pixels(static_cast<std::size_t>(width) * 4);
+        std::vector<std::uint8_t> alphaValues(pixels.size());
+        std::size_t rows = 0;
+        while ((rows = reader.read_rows(pixels.data(), alpha ? alphaValues.data() : nullptr, 4)) > 0)
+        {
+            for (std::size_t i = 0; i < rows; i++)
+            {
+                std::int32_t y = reader.image_row(reader.rows_read() - rows + i);
+                EXPECT_TRUE(std::equal(pixels.begin() + i * width, pixels.begin() + (i + 1) * width, &image[static_cast<std::size_t>(y) * width]));
+                if (alpha)
+                {
+                    EXPECT_TRUE(std::equal(alphaValues.begin() + i * width, alphaValues.begin() + (i + 1) * width, image.alpha() + static_cast<std::size_t>(y) * width));
+                }
+            }
+            copy.write_rows(pixels.data(), alpha ? alphaValues.data() : nullptr, rows);
+        }
+        EXPECT_EQ(static_cast<std::size_t>(height), reader.rows_read());
+        copy.close();
+        EXPECT_EQ(readFileBytes("RowStream_saved.bmp"), readFileBytes("RowStream_copy.bmp"));
+    }
+
+    // a file missing rows cannot be closed, and a truncated file cannot be read past its end
+    {
+        bmp::BitmapRowWriter writer("RowStream_written.bmp", width, height);
+        EXPECT_THROW(writer.close(), bmp::Exception);
+    }
+    std::vector<char> truncated = readFileBytes("RowStream_saved.bmp");
+    truncated.resize(truncated.size() - 10);
+    std::ofstream("RowStream_truncated.bmp", std::ios::binary).write(truncated.data(), truncated.size());
+    bmp::BitmapRowReader reader("RowStream_truncated.bmp");
+    EXPECT_EQ(static_cast<std::size_t>(height - 1), reader.skip_rows(static_cast<std::size_t>(height - 1)));
+    std::vector<std::uint8_t> row(reader.row_stride());
+    EXPECT_THROW(reader.read_rows(row.data(), 1), bmp::Exception);
+    EXPECT_THROW(bmp::BitmapRowReader("RowStream_missing.bmp"), bmp::Exception);
+
+    for (const char *path : {"RowStream_saved.bmp", "RowStream_written.bmp", "RowStream_copy.bmp", "RowStream_truncated.bmp"})
+    {
+        std::filesystem::remove(path);
+    }
+}
+
+TEST(SteganographyTests, PipelinedExtractKeepsAFixedWindowOfRows) {
+    // a cover several times larger than the pipeline window, carrying several MiB of data
+    const std::int32_t width = 2000;
+    const std::int32_t height = 2000;
+    bmp::Bitmap cover(width, height);
+    std::uint32_t state = 0x9E3779B9;
+    for (bmp::Pixel &pixel : cover)
+    {
+        state = state * 1664525 + 1013904223;
+        pixel = bmp::Pixel(static_cast<std::uint8_t>(state >> 24), static_cast<std::uint8_t>(state >> 16), static_cast<std::uint8_t>(state >> 8));
+    }
+    cover.save("WindowedExtract_cover.bmp");
+    std::vector<char> payload(2900 * 1000);
+    for (std::size_t i = 0; i < payload.size(); i++)
+    {
+        payload[i] = static_cast<char>((i * 2654435761u) >> 11);
+    }
+    std::ofstream("WindowedExtract_payload.bin", std::ios::binary).write(payload.data(), payload.size());
+
+    Steganography pipelined;
+    pipelined.setPipelining(true);
+    ASSERT_NO_THROW(pipelined.embed("WindowedExtract_cover.bmp", "WindowedExtract_payload.bin", "WindowedExtract_embedded.bmp", 6));
+    const std::uint64_t window = 8 * 1024 * 1024;
+    std::uint64_t coverBytes = std::filesystem::file_size("WindowedExtract_cover.bmp");
+    EXPECT_LT(pipelined.lastStats().peakBufferBytes, window);
+
+    ASSERT_NO_THROW(pipelined.extract("WindowedExtract_embedded.bmp", "WindowedExtract_output.bin", 6));
+    EXPECT_EQ(payload, readFileBytes("WindowedExtract_output.bin"));
+    EXPECT_LT(pipelined.lastStats().peakBufferBytes, window);
+    EXPECT_EQ(payload.size(), pipelined.lastStats().payloadBytes);
+    // the bytes shared by two blocks are written once per block
+    EXPECT_GE(pipelined.lastStats().bytesWritten, payload.size());
+    EXPECT_LT(pipelined.lastStats().bytesWritten, payload.size() + 100);
+
+    Steganography sequential;
+    ASSERT_NO_THROW(sequential.extract("WindowedExtract_embedded.bmp", "WindowedExtract_sequential.bin", 6));
+    EXPECT_EQ(payload, readFileBytes("WindowedExtract_sequential.bin"));
+    EXPECT_GT(sequential.lastStats().peakBufferBytes, coverBytes);
+
+    // a small payload only needs the rows at the top of the image, which bottom-up files store last
+    std::vector<char> small(payload.begin(), payload.begin() + 1000);
+    std::ofstream("WindowedExtract_payload.bin", std::ios::binary).write(small.data(), small.size());
+    ASSERT_NO_THROW(pipelined.embed("WindowedExtract_cover.bmp", "WindowedExtract_payload.bin", "WindowedExtract_embedded.bmp", 6));
+    ASSERT_NO_THROW(pipelined.extract("WindowedExtract_embedded.bmp", "WindowedExtract_output.bin", 6));
+    EXPECT_EQ(small, readFileBytes("WindowedExtract_output.bin"));
+    EXPECT_LT(pipelined.lastStats().bytesRead, coverBytes / 4);
+
+    // a cancelled extract leaves no destination behind
+    Steganography cancelled;
+    auto token = std::make_shared<CancellationToken>();
+    token->cancel();
+    cancelled.setPipelining(true);
+    cancelled.setCancellationToken(token);
+    EXPECT_THROW(cancelled.extract("WindowedExtract_embedded.bmp", "WindowedExtract_cancelled.bin", 6), OperationCancelled);
+    EXPECT_FALSE(std::filesystem::exists("WindowedExtract_cancelled.bin"));
+
+    for (const char *path : {"WindowedExtract_cover.bmp", "WindowedExtract_payload.bin", "WindowedExtract_embedded.bmp",
+                             "WindowedExtract_output.bin", "WindowedExtract_sequential.bin"})
+    {
+        std::filesystem::remove(path);
+    }
+}
+
+TEST(SteganographyTests, CompressionShrinksTheEmbeddedData) {
+    // text-like data over two chunks, larger than the cover holds as is
+    std::vector<char> payload;
+    for (std::size_t line = 0; payload.size() < ContainerHeader::DEFAULT_CHUNK_SIZE + 500000; line++)
+    {
+        std::string row = "record " + std::to_string(line) + ": the quick brown fox jumps over the lazy dog\n";
+        payload.insert(payload.end(), row.begin(), row.end());
+    }
+    std::ofstream("Compression_payload.bin", std::ios::binary).write(payload.data(), payload.size());
+    bmp::Bitmap cover(1500, 1000);
+    cover.save("Compression_cover.bmp");
+
+    Steganography plain;
+    EXPECT_THROW(plain.embed("Compression_cover.bmp", "Compression_payload.bin", "Compression_embedded.bmp", 6), std::runtime_error);
+
+    Steganography steg;
+    steg.setCompression(true);
+    ASSERT_NO_THROW(steg.embed("Compression_cover.bmp", "Compression_payload.bin", "Compression_embedded.bmp", 6));
+    EXPECT_EQ(payload.size(), steg.lastStats().payloadBytes);
+    EXPECT_LT(steg.lastStats().pixelsTouched, payload.size() * 8 / 6 / 3);
+    ProbeResult result = steg.probe("Compression_embedded.bmp", 6);
+    EXPECT_TRUE(result.plausible);
+    EXPECT_LT(result.payloadLength, payload.size() / 3);
+
+    // every extract path recognizes compressed data on its own
+    Steganography threaded;
+    threaded.setThreadCount(3);
+    Steganography pipelined;
+    pipelined.setPipelining(true);
+    for (Steganography *extractor : {&plain, &threaded, &pipelined})
+    {
+        ASSERT_NO_THROW(extractor->extract("Compression_embedded.bmp", "Compression_output.bin", 6));
+        EXPECT_EQ(payload, readFileBytes("Compression_output.bin"));
+    }
+    EXPECT_EQ(payload.size(), plain.lastStats().payloadBytes);
+
+    auto embeddedBytes = readFileBytes("Compression_embedded.bmp");
+    std::istringstream embeddedStream(std::string(embeddedBytes.begin(), embeddedBytes.end()));
+    std::ostringstream extractedStream;
+    ASSERT_NO_THROW(plain.extract(embeddedStream, extractedStream, 6));
+    EXPECT_EQ(std::string(payload.begin(), payload.end()), extractedStream.str());
+    EXPECT_EQ(payload, plain.extract(reinterpret_cast<const std::uint8_t *>(embeddedBytes.data()), embeddedBytes.size(), 6));
+
+    // ranges are in the data, across the boundary between the chunks
+    std::size_t offset = ContainerHeader::DEFAULT_CHUNK_SIZE - 100;
+    EXPECT_EQ(std::vector<char>(payload.begin() + offset, payload.begin() + offset + 300), plain.extractRange("Compression_embedded.bmp", offset, 300, 6));
+    EXPECT_THROW(plain.extractRange("Compression_embedded.bmp", payload.size() - 10, 11, 6), std::runtime_error);
+
+    // data that does not shrink is stored as is, in memory as well
+    std::vector<char> noise(200000);
+    for (std::size_t i = 0; i < noise.size(); i++)
+    {
+        noise[i] = static_cast<char>((i * 2654435761u) >> 13);
+    }
+    auto coverBytes = readFileBytes("Compression_cover.bmp");
+    std::vector<std::uint8_t> bitmapBuffer(coverBytes.begin(), coverBytes.end());
+    ASSERT_NO_THROW(steg.embed(bitmapBuffer.data(), bitmapBuffer.size(), noise.data(), noise.size(), 6));
+    EXPECT_EQ(noise, plain.extract(bitmapBuffer.data(), bitmapBuffer.size(), 6));
+
+    // the command line selects it, and the legacy format cannot carry it
+    char* argv[] = {(char*)"steganography", (char*)"embed", (char*)"Compression_cover.bmp", (char*)"Compression_payload.bin", (char*)"Compression_embedded.bmp", (char*)"6", (char*)"--compression", (char*)"lz4"};
+    EXPECT_EQ(SUCCESS, mainWrapper(8, argv));
+    argv[7] = (char*)"zip";
+    EXPECT_EQ(ERROR_CODE_INVALID_ARGUMENTS, mainWrapper(8, argv));
+    steg.setContainerFormat(ContainerFormat::Legacy);
+    EXPECT_THROW(steg.embed("Compression_cover.bmp", "Compression_payload.bin", "Compression_other.bmp", 6), std::runtime_error);
+
+    // a cancelled embed stops the compressor as well
+    Steganography cancelled;
+    auto token = std::make_shared<CancellationToken>();
+    cancelled.setCompression(true);
+    cancelled.setCancellationToken(token);
+    cancelled.registerProgressCallback([&](int) { token->cancel(); }, 1);
+    EXPECT_THROW(cancelled.embed("Compression_cover.bmp", "Compression_payload.bin", "Compression_other.bmp", 6), OperationCancelled);
+    EXPECT_FALSE(std::filesystem::exists("Compression_other.bmp"));
+
+    for (const char *path : {"Compression_cover.bmp", "Compression_payload.bin", "Compression_embedded.bmp", "Compression_output.bin"})
+    {
+        std::filesystem::remove(path);
+    }
+}
+
+TEST(SteganographyTests, DensityProfilesRoundTripOnEveryPath) {
+    std::vector<char> payload(90000);
+    std::uint32_t state = 11;
+    for (char &byte : payload)
+    {
+        state = state * 1664525u + 1013904223u;
+        byte = static_cast<char>(state >> 24);
+    }
+    std::ofstream("Profile_payload.bin", std::ios::binary).write(payload.data(), payload.size());
+
+    // 2 bits in red, 1 in green and 3 in blue
+    Steganography loaded;
+    loaded.setDensityProfile({2, 1, 3});
+    ASSERT_NO_THROW(loaded.embed("../../../data/sample.bmp", "Profile_payload.bin", "Profile_loaded.bmp", 6));
+    EXPECT_EQ(90000u, loaded.lastStats().payloadBytes);
+
+    Steganography mapped;
+    mapped.setDensityProfile({2, 1, 3});
+    mapped.setMemoryMapping(true);
+    ASSERT_NO_THROW(mapped.embed("../../../data/sample.bmp", "Profile_payload.bin", "Profile_mapped.bmp", 6));
+    auto loadedBytes = readFileBytes("Profile_loaded.bmp");
+    auto mappedBytes = readFileBytes("Profile_mapped.bmp");
+    ASSERT_EQ(loadedBytes.size(), mappedBytes.size());
+    EXPECT_TRUE(std::equal(loadedBytes.begin() + sizeof(bmp::BitmapHeader), loadedBytes.end(), mappedBytes.begin() + sizeof(bmp::BitmapHeader)));
+    ASSERT_NO_THROW(mapped.extract("Profile_loaded.bmp", "Profile_output.bin", 6));
+    EXPECT_EQ(payload, readFileBytes("Profile_output.bin"));
+
+    // the parallel engine and the patched output agree with them
+    Steganography threaded;
+    threaded.setDensityProfile({2, 1, 3});
+    threaded.setThreadCount(3);
+    threaded.setOutputMode(OutputMode::Patch);
+    threaded.setMemoryMapping(true);
+    ASSERT_NO_THROW(threaded.embed("../../../data/sample.bmp", "Profile_payload.bin", "Profile_threaded.bmp", 6));
+    EXPECT_EQ(mappedBytes, readFileBytes("Profile_threaded.bmp"));
+    ASSERT_NO_THROW(threaded.extract("Profile_threaded.bmp", "Profile_output.bin", 6));
+    EXPECT_EQ(payload, readFileBytes("Profile_output.bin"));
+
+    auto extracted = loaded.extract(reinterpret_cast<const std::uint8_t *>(loadedBytes.data()), loadedBytes.size(), 6);
+    EXPECT_EQ(payload, extracted);
+
+    // the profile rules out any other density, and the operations that read bitmaps in place
+    EXPECT_THROW(loaded.extract("Profile_loaded.bmp", "Profile_output.bin", 3), std::runtime_error);
+    EXPECT_THROW(loaded.extractRange("Profile_loaded.bmp", 0, 10, 6), std::runtime_error);
+    EXPECT_THROW(loaded.setDensityProfile({9, 0, 0}), std::runtime_error);
+
+    // channels of 0 bits are never written, whatever the payload
+    Steganography skipping;
+    skipping.setDensityProfile({3, 0, 4});
+    skipping.setCompression(true);
+    ASSERT_NO_THROW(skipping.embed("../../../data/sample.bmp", "Profile_payload.bin", "Profile_skipping.bmp", 7));
+    bmp::Bitmap original("../../../data/sample.bmp");
+    bmp::Bitmap skipped("Profile_skipping.bmp");
+    ASSERT_EQ(original.width(), skipped.width());
+    EXPECT_TRUE(std::equal(original.begin(), original.end(), skipped.begin(), [](const bmp::Pixel &a, const bmp::Pixel &b) { return a.g == b.g; }));
+    EXPECT_FALSE(std::equal(original.begin(), original.end(), skipped.begin(), [](const bmp::Pixel &a, const bmp::Pixel &b) { return a.b == b.b; }));
+    ASSERT_NO_THROW(skipping.extract("Profile_skipping.bmp", "Profile_output.bin", 7));
+    EXPECT_EQ(payload, readFileBytes("Profile_output.bin"));
+
+    char* argv[] = {(char*)"steganography", (char*)"extract", (char*)"Profile_loaded.bmp", (char*)"Profile_cli.bin", (char*)"6", (char*)"--profile", (char*)"2,1,3"};
+    EXPECT_EQ(SteganographyLib::SUCCESS, SteganographyLib::mainWrapper(7, argv));
+    EXPECT_EQ(payload, readFileBytes("Profile_cli.bin"));
+    argv[6] = (char*)"2,1";
+    EXPECT_EQ(SteganographyLib::ERROR_CODE_INVALID_ARGUMENTS, SteganographyLib::mainWrapper(7, argv));
+
+    // Clean up
+    for (const char *file : {"Profile_payload.bin", "Profile_loaded.bmp", "Profile_mapped.bmp", "Profile_threaded.bmp", "Profile_skipping.bmp", "Profile_output.bin", "Profile_cli.bin"})
+    {
+        std::filesystem::remove(file);
+    }
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <fstream>  // std::ifstream
+#include <iterator> // std::istreambuf_iterator
+#include <string>   // std::string
+#include <vector>   // std::vector
+
+// Returns the bytes of a file, or nothing if it cannot be read.
+inline std::vector<char> readFileBytes(const std::string &filePath)
+{
+    std::ifstream fileStream(filePath, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(fileStream), std::istreambuf_iterator<char>());
+}
@@ -0,0 +1,82 @@
+#include "threadpool.h"
+
+using namespace std;
+
+SteganographyLib::ThreadPool::ThreadPool(std::size_t threadCount)
+    : m_stopping(false)
+{
+    if (threadCount == 0)
+    {
+        threadCount = max(1u, thread::hardware_concurrency());
+    }
+
+    m_workers.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; i++)
+    {
+        m_workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+SteganographyLib::ThreadPool::~ThreadPool() noexcept
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_condition.notify_all();
+
+    for (auto &worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+void SteganographyLib::ThreadPool::parallelFor(std::size_t count, const std::function<void(std::size_t)> &body)
+{
+    vector<future<void>> results;
+    results.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        results.push_back(submit([&body, i]() { body(i); }));
+    }
+
+    // wait for every call before rethrowing, body and its captures must outlive all of them
+    for (auto &result : results)
+    {
+        result.wait();
+    }
+    for (auto &result : results)
+    {
+        result.get();
+    }
+}
+
+void SteganographyLib::ThreadPool::enqueue(std::function<void()> task)
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_tasks.push(move(task));
+    }
+    m_condition.notify_one();
+}
+
+void SteganographyLib::ThreadPool::workerLoop()
+{
+    for (;;)
+    {
+        function<void()> task;
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+            if (m_tasks.empty())
+            {
+                return;
+            }
+            task = move(m_tasks.front());
+            m_tasks.pop();
+        }
+
+        // packaged tasks capture their own exceptions
+        task();
+    }
+}
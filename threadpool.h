@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>            // std::size_t
+#include <functional>         // std::function
+#include <future>             // std::future, std::packaged_task
+#include <memory>             // std::make_shared
+#include <mutex>              // std::mutex
+#include <condition_variable> // std::condition_variable
+#include <queue>              // std::queue
+#include <thread>             // std::thread
+#include <vector>             // std::vector
+
+namespace SteganographyLib
+{
+    /// @brief Fixed-size pool of worker threads that run tasks in submission order.
+    class ThreadPool
+    {
+        public:
+            /// @brief Constructor, starts the worker threads.
+            /// @param threadCount Number of worker threads, 0 selects the number of hardware threads.
+            explicit ThreadPool(std::size_t threadCount);
+
+            /// @brief Destructor, runs the tasks already submitted and joins the worker threads.
+            ~ThreadPool() noexcept;
+
+            ThreadPool(const ThreadPool &) = delete;
+            ThreadPool &operator=(const ThreadPool &) = delete;
+
+            /// @brief Queues a task.
+            /// @return A future holding the result of the task, or the exception it threw.
+            template <typename Task>
+            auto submit(Task task) -> std::future<decltype(task())>
+            {
+                auto packagedTask = std::make_shared<std::packaged_task<decltype(task())()>>(std::move(task));
+                auto result = packagedTask->get_future();
+                enqueue([packagedTask]() { (*packagedTask)(); });
+                return result;
+            }
+
+            /// @brief Runs body(0) to body(count - 1) on the pool and waits for all of them.
+            /// Rethrows the first exception thrown by body, after every call has finished.
+            /// Must not be called from a task running on the same pool.
+            void parallelFor(std::size_t count, const std::function<void(std::size_t)> &body);
+
+            /// @brief Returns the number of worker threads.
+            std::size_t size() const noexcept { return m_workers.size(); }
+
+        private:
+            void enqueue(std::function<void()> task);
+            void workerLoop();
+
+            std::vector<std::thread> m_workers;
+            std::queue<std::function<void()>> m_tasks;
+            std::mutex m_mutex;
+            std::condition_variable m_condition;
+            bool m_stopping;
+    };
+}